@@ -8,9 +8,83 @@
 #define _POSIX_C_SOURCE 200809L
 #include <error_handler.h>
 #include <abs_hashtable.h>
+#include <epoch.h>
 #include <unistd.h>
 #include <stdlib.h>
 
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+/**
+ * @function free_snapshot
+ * @brief Libera la memoria allocata per una snapshot
+ * 
+ * @param snap  snapshot da liberare
+ */
+static void free_snapshot(ht_snapshot_t *snap){
+    if (snap == NULL) return;
+    if (snap->elements != NULL) free(snap->elements);
+    free(snap);
+}
+
+
+/**
+ * @function collect_elements
+ * @brief Copia nella snapshot i puntatori agli elementi della tabella hash,
+ *        prendendo una lock alla volta
+ * 
+ * @param ht    puntatore alla tabella hash
+ * @param snap  snapshot da riempire
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int collect_elements(hashtable_t *ht, ht_snapshot_t *snap){
+    //variabili di appoggio
+    int i = 0, j = 0, ind = 0, check = 0, needed = 0;
+    int size = snap->len;
+    node_t *curr = NULL;
+
+    snap->len = 0;
+
+    for (i = 0; i < ht->n_mtx; i++){
+        //lock sulla mutex 
+        check = pthread_mutex_lock(&(ht->mtx_array)[i]);
+        err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+        //controllo che ci sia spazio per tutti gli elementi delle liste
+        needed = snap->len;
+        for (j = 0; j < ht->factor; j++) needed += ht->lists[(i * ht->factor) + j]->len;
+        if (needed > size) {
+            size = (needed > 2*size) ? needed : 2*size;
+            void **tmp = realloc(snap->elements, size * sizeof(void*));
+            if (tmp == NULL) {
+                pthread_mutex_unlock(&(ht->mtx_array)[i]);
+                fprintf(stderr,"Errore: realloc\n");
+                return -1;
+            }
+            snap->elements = tmp;
+        }
+
+        //copio i puntatori delle liste che hanno la mutex lockata sopra
+        for (j = 0; j < ht->factor; j++){
+            ind = (i * ht->factor) + j;
+            for (curr = ht->lists[ind]->head; curr != NULL; curr = curr->next) {
+                snap->elements[snap->len++] = curr->data;
+            }
+        }
+
+        //unlock della mutex
+        check = pthread_mutex_unlock(&(ht->mtx_array)[i]);
+        err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+    }
+
+    return 0;
+}
+
+
+
+/* ---------------------- implementazione interfaccia tabella hash  --------------------- */
+
 /**
  * @function init_hashtable
  * @brief Inizializza la tabella hash per dati generici
@@ -66,10 +140,21 @@ hashtable_t *init_hashtable(int num_mutex, int factor, void (* clean_data )(void
     ht->compare_data  = compare_data;
     ht->hash_fun      = hash_fun;
     ht->setmutex_data = setmutex_data;
+    ht->version       = 0;
+    ht->snapshot      = NULL;
 
     //variabili di appoggio
     int i = 0, j = 0, checkmutex = 0;
 
+    //mutex per la snapshot in cache
+    checkmutex = pthread_mutex_init(&ht->snap_mtx, NULL);
+    if (checkmutex != 0){
+        errno = checkmutex;
+        free(ht);
+        perror("pthread_mutex_init");
+        return NULL;
+    }
+
     //creo l'array di mutex
     ht->mtx_array = malloc((ht->n_mtx)*sizeof(pthread_mutex_t));
     if (ht->mtx_array == NULL){
@@ -116,6 +201,8 @@ hashtable_t *init_hashtable(int num_mutex, int factor, void (* clean_data )(void
                 clean_hashtable(ht);
                 return NULL;
             }
+            //le ricerche sulle liste della tabella avvengono senza lock
+            set_rcu_list(ht->lists[ind]);
         }
     }
 
@@ -132,6 +219,10 @@ hashtable_t *init_hashtable(int num_mutex, int factor, void (* clean_data )(void
 void clean_hashtable(hashtable_t *ht){
     if(ht == NULL) return;
 
+    //dealloco la snapshot in cache
+    free_snapshot(ht->snapshot);
+    pthread_mutex_destroy(&ht->snap_mtx);
+
     //dealloco l'array di mutex
     if (ht->mtx_array != NULL) free(ht->mtx_array);
 
@@ -180,7 +271,11 @@ int add_data_ht(hashtable_t *ht, void *data, void *param){
     }
     
     //aggiungo data nella lista di competenza
-    return add_data(ht->lists[pos], data, param);
+    int ret = add_data(ht->lists[pos], data, param);
+    //la snapshot in cache non è più valida
+    if (ret == 1) __atomic_add_fetch(&ht->version, 1, __ATOMIC_RELEASE);
+
+    return ret;
 }
 
 
@@ -194,30 +289,62 @@ int add_data_ht(hashtable_t *ht, void *data, void *param){
  *               da rimuovere e hash_fun(dim_hashtable, param)
  * 
  * @return 1 se successo, 0 se non è stato rimosso nessun elemento, -1 in caso di errore
+ * 
+ * @note: l'elemento rimosso viene liberato con clean_data solo quando nessun thread
+ *        si trova più nella sezione epoch in cui poteva averlo letto
  */
 int remove_data_ht(hashtable_t *ht, void *param){
     //controllo gli argomenti
     err_check_return(ht == NULL, EINVAL, "remove_data_ht", -1);
     err_check_return(param == NULL, EINVAL, "remove_data_ht", -1);
 
-    int pos = ht->hash_fun(ht->dim, param);
-    err_return_msg(pos,-1,-1,"Errore: hash_fun\n");
-
     errno = 0;
-    void *data = remove_data(ht->lists[pos], param);
+    void *data = detach_data_ht(ht, param);
 
     //se errore
     if(data == NULL && errno != 0) return -1;
     //se l'oggetto data ricercato non esiste
     else if(data == NULL && errno == 0) return 0;
-    //se esiste
+    //se esiste lo libero quando nessun lettore senza lock può più raggiungerlo
     else {
-        if (ht->clean_data != NULL) ht->clean_data(data);
+        if (ht->clean_data != NULL && epoch_retire(data, ht->clean_data) == -1) return -1;
         return 1;
     }
 }
 
 
+/**
+ * @function detach_data_ht
+ * @brief Rimuove un elemento data dalla tabella hash senza liberarlo
+ * 
+ * @param ht     puntatore alla tabella hash
+ * @param param  puntatore al parametro che verrà utilizzato nelle
+ *               funzioni compare_data(element, param) per trovare l' elemento
+ *               da rimuovere e hash_fun(dim_hashtable, param)
+ * 
+ * @return puntatore all'elemento rimosso, NULL se tale elemento non è presente
+ *         (errno non modificato), NULL in caso di errore (ERRNO MODIFICATO)
+ * 
+ * @note: l'elemento va poi ritirato dal chiamante con epoch_retire, i lettori senza
+ *        lock possono averlo letto prima della rimozione
+ */
+void *detach_data_ht(hashtable_t *ht, void *param){
+    //controllo gli argomenti
+    err_check_return(ht == NULL, EINVAL, "detach_data_ht", NULL);
+    err_check_return(param == NULL, EINVAL, "detach_data_ht", NULL);
+
+    int pos = ht->hash_fun(ht->dim, param);
+    err_return_msg(pos,-1,NULL,"Errore: hash_fun\n");
+
+    void *data = remove_data(ht->lists[pos], param);
+
+    //la snapshot in cache non è più valida
+    if (data != NULL) __atomic_add_fetch(&ht->version, 1, __ATOMIC_RELEASE);
+
+    return data;
+}
+
+
 /**
  * @function search_data_ht
  * @brief Cerca e restituisce l'elemento el nella tabella hash
@@ -232,6 +359,10 @@ int remove_data_ht(hashtable_t *ht, void *param){
  * @return puntatore all'elemento cercato in caso di successo,
  *         NULL se tale elemento non è presente (errno non modificato),
  *         NULL ed errno settato in caso di errore 
+ * 
+ * @note: se il thread è registrato (epoch_register) la ricerca avviene senza lock,
+ *        altrimenti viene presa la lock della lista. L'elemento ritornato resta valido
+ *        finchè il chiamante non esce dalla sezione epoch_enter/epoch_exit più esterna
  */
 void *search_data_ht(hashtable_t *ht, void *param){
     //controllo gli argomenti
@@ -241,7 +372,15 @@ void *search_data_ht(hashtable_t *ht, void *param){
     int pos = ht->hash_fun(ht->dim, param);
     err_return_msg(pos,-1,NULL,"Errore: hash_fun\n");
 
-    return search_data(ht->lists[pos], param);
+    //se il thread non è registrato uso la ricerca con lock
+    if (epoch_enter() == -1) return search_data(ht->lists[pos], param);
+
+    void *ret = search_data_rcu(ht->lists[pos], param);
+    int err = errno;
+    epoch_exit();
+    errno = err;
+
+    return ret;
 }
 
 
@@ -256,36 +395,27 @@ void *search_data_ht(hashtable_t *ht, void *param){
  * @return 0 in caso di successo, -1 in caso di errore
  * 
  * @note: la funzione fun passata deve ritornare -1 in caso di errore
+ * @note: fun viene chiamata su una snapshot della tabella senza tenere le lock delle
+ *        liste, il chiamante deve trovarsi in una sezione epoch_enter/epoch_exit
  */
 int apply_fun_ht(hashtable_t *ht, int (* fun )(void *)) {
     //controllo gli argomenti
     err_check_return(ht == NULL, EINVAL, "apply_fun_ht", -1);
     err_check_return(fun == NULL, EINVAL, "apply_fun_ht", -1);
 
-    //variabili di appoggio
-    int i = 0, j = 0, ind = 0, check = 0;
-
-    //scorro tutte le liste data
-    for (i = 0; i < ht->n_mtx; i++){
-        //lock sulla mutex 
-        check = pthread_mutex_lock(&(ht->mtx_array)[i]);
-        err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+    //prendo la snapshot degli elementi
+    ht_snapshot_t *snap = get_snapshot_ht(ht);
+    if (snap == NULL) return -1;
 
-        //per tutte le liste data che hanno la mutex lockata sopra...
-        for (j = 0; j < ht->factor; j++){
-            ind = (i * (ht->factor)) + j;
-            check = apply_fun(ht->lists[ind], fun);
-            if (check == -1){
-                pthread_mutex_unlock(&(ht->mtx_array)[i]);
-                return -1;
-            }
+    //applico fun a tutti gli elementi senza tenere nessuna lock
+    for (int i = 0; i < snap->len; i++){
+        if (fun(snap->elements[i]) == -1){
+            release_snapshot_ht(ht, snap);
+            return -1;
         }
-
-        //unlock della mutex
-        check = pthread_mutex_unlock(&(ht->mtx_array)[i]);
-        err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
     }
 
+    release_snapshot_ht(ht, snap);
     return 0;
 }
 
@@ -302,6 +432,8 @@ int apply_fun_ht(hashtable_t *ht, int (* fun )(void *)) {
  * @return 0 in caso di successo, -1 in caso di errore
  * 
  * @note: la funzione fun passata deve ritornare -1 in caso di errore
+ * @note: fun viene chiamata su una snapshot della tabella senza tenere le lock delle
+ *        liste, il chiamante deve trovarsi in una sezione epoch_enter/epoch_exit
  */
 int apply_fun_param_ht(hashtable_t *ht, int (* fun )(void *, void *), void *fun_param){
     //controllo gli argomenti
@@ -309,29 +441,190 @@ int apply_fun_param_ht(hashtable_t *ht, int (* fun )(void *, void *), void *fun_
     err_check_return(fun == NULL, EINVAL, "apply_fun_param_ht", -1);
     err_check_return(fun_param == NULL, EINVAL, "apply_fun_param_ht", -1);
 
-    //variabili di appoggio
-    int i = 0, j = 0, ind = 0, check = 0;
+    //prendo la snapshot degli elementi
+    ht_snapshot_t *snap = get_snapshot_ht(ht);
+    if (snap == NULL) return -1;
 
-    //scorro tutte le liste data
-    for (i = 0; i < ht->n_mtx; i++){
-        //lock sulla mutex 
-        check = pthread_mutex_lock(&(ht->mtx_array)[i]);
-        err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+    //applico fun a tutti gli elementi senza tenere nessuna lock
+    for (int i = 0; i < snap->len; i++){
+        if (fun(snap->elements[i], fun_param) == -1){
+            release_snapshot_ht(ht, snap);
+            return -1;
+        }
+    }
 
-        //per tutte le liste data che hanno la mutex lockata sopra...
-        for (j = 0; j < ht->factor; j++){
-            ind = (i * (ht->factor)) + j;
-            check = apply_fun_param(ht->lists[ind], fun, fun_param);
-            if (check == -1){
-                pthread_mutex_unlock(&(ht->mtx_array)[i]);
-                return -1;
-            }
+    release_snapshot_ht(ht, snap);
+    return 0;
+}
+
+
+/**
+ * @function set_intrusive_ht
+ * @brief Rende intrusive tutte le liste della tabella hash (vedi set_intrusive_list)
+ * 
+ * @param ht           puntatore alla tabella hash (deve essere vuota)
+ * @param node_offset  offset del campo node_t negli elementi (usare offsetof)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int set_intrusive_ht(hashtable_t *ht, long node_offset){
+    //controllo gli argomenti
+    err_check_return(ht == NULL, EINVAL, "set_intrusive_ht", -1);
+
+    for (int i = 0; i < ht->dim; i++){
+        if (set_intrusive_list(ht->lists[i], node_offset) == -1) return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function get_snapshot_ht
+ * @brief Restituisce una snapshot degli elementi presenti nella tabella hash. Se la
+ *        tabella non è stata modificata dall'ultima snapshot creata viene riusata quella
+ * 
+ * @param ht  puntatore alla tabella hash
+ * 
+ * @return puntatore alla snapshot, NULL ed errno settato in caso di errore
+ * 
+ * @note: la snapshot va rilasciata con release_snapshot_ht, gli elementi contenuti
+ *        restano validi solo finchè il chiamante è in una sezione epoch_enter/epoch_exit
+ */
+ht_snapshot_t *get_snapshot_ht(hashtable_t *ht){
+    //controllo gli argomenti
+    err_check_return(ht == NULL, EINVAL, "get_snapshot_ht", NULL);
+
+    //controllo se posso riusare la snapshot in cache
+    int check = pthread_mutex_lock(&ht->snap_mtx);
+    err_check_return(check != 0, check, "pthread_mutex_lock", NULL);
+
+    ht_snapshot_t *snap = ht->snapshot;
+    if (snap != NULL && snap->version == __atomic_load_n(&ht->version, __ATOMIC_ACQUIRE)) {
+        snap->refcount++;
+        pthread_mutex_unlock(&ht->snap_mtx);
+        return snap;
+    }
+
+    check = pthread_mutex_unlock(&ht->snap_mtx);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", NULL);
+
+    //creo una nuova snapshot (senza tenere snap_mtx mentre prendo le lock delle liste)
+    snap = malloc(sizeof(ht_snapshot_t));
+    err_return_msg(snap,NULL,NULL,"Errore: malloc\n");
+    snap->elements = NULL;
+    snap->len      = 0;
+    snap->refcount = 2; //uno per il chiamante ed uno per la cache
+
+    //se la tabella viene modificata durante la copia riprovo, dopo SNAPSHOT_RETRY
+    //tentativi mi accontento dell'ultima copia fatta
+    for (int i = 0; i < SNAPSHOT_RETRY; i++) {
+        snap->version = __atomic_load_n(&ht->version, __ATOMIC_ACQUIRE);
+        if (collect_elements(ht, snap) == -1) {
+            free_snapshot(snap);
+            return NULL;
         }
+        if (snap->version == __atomic_load_n(&ht->version, __ATOMIC_ACQUIRE)) break;
+    }
 
-        //unlock della mutex
-        check = pthread_mutex_unlock(&(ht->mtx_array)[i]);
-        err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+    //sostituisco la snapshot in cache
+    check = pthread_mutex_lock(&ht->snap_mtx);
+    if (check != 0) free_snapshot(snap);
+    err_check_return(check != 0, check, "pthread_mutex_lock", NULL);
+
+    ht_snapshot_t *old = ht->snapshot;
+    ht->snapshot = snap;
+    if (old != NULL && --old->refcount == 0) free_snapshot(old);
+
+    check = pthread_mutex_unlock(&ht->snap_mtx);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", NULL);
+
+    return snap;
+}
+
+
+/**
+ * @function release_snapshot_ht
+ * @brief Rilascia un riferimento alla snapshot, che viene liberata quando non
+ *        è più referenziata
+ * 
+ * @param ht    puntatore alla tabella hash
+ * @param snap  snapshot da rilasciare
+ */
+void release_snapshot_ht(hashtable_t *ht, ht_snapshot_t *snap){
+    if (ht == NULL || snap == NULL) return;
+
+    if (pthread_mutex_lock(&ht->snap_mtx) != 0) return;
+    int to_free = (--snap->refcount == 0);
+    pthread_mutex_unlock(&ht->snap_mtx);
+
+    if (to_free) free_snapshot(snap);
+}
+
+
+
+/**
+ * @function trylock_all_ht
+ * @brief Prova a prendere tutte le mutex della tabella hash senza bloccarsi
+ * 
+ * @param ht  puntatore alla tabella hash
+ * 
+ * @return 0 se sono state prese tutte le mutex, EBUSY se una era già occupata
+ *         (in questo caso non ne viene tenuta nessuna), altrimenti errore
+ */
+int trylock_all_ht(hashtable_t *ht) {
+    if (ht == NULL) return EINVAL;
+
+    for (int i = 0; i < ht->n_mtx; i++) {
+        int check = pthread_mutex_trylock(&(ht->mtx_array)[i]);
+        if (check != 0) {
+            //rilascio quelle già prese
+            while (--i >= 0) pthread_mutex_unlock(&(ht->mtx_array)[i]);
+            return check;
+        }
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+/**
+ * @function unlock_all_ht
+ * @brief Rilascia tutte le mutex della tabella hash prese con trylock_all_ht
+ * 
+ * @param ht  puntatore alla tabella hash
+ */
+void unlock_all_ht(hashtable_t *ht) {
+    if (ht == NULL) return;
+
+    for (int i = 0; i < ht->n_mtx; i++) pthread_mutex_unlock(&(ht->mtx_array)[i]);
+}
+
+
+/**
+ * @function reset_locks_ht
+ * @brief Reinizializza le mutex della tabella hash nel processo figlio di una fork
+ *        fatta tenendo le lock (trylock_all_ht)
+ * 
+ * @param ht  puntatore alla tabella hash
+ * 
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reset_locks_ht(hashtable_t *ht) {
+    //controllo gli argomenti
+    err_check_return(ht == NULL, EINVAL, "reset_locks_ht", -1);
+
+    pthread_mutexattr_t   mta;
+    int check = pthread_mutexattr_init(&mta);
+    if (check == 0) check = pthread_mutexattr_settype(&mta, PTHREAD_MUTEX_RECURSIVE);
+    err_check_return(check != 0, check, "pthread_mutexattr", -1);
+
+    for (int i = 0; i < ht->n_mtx && check == 0; i++) {
+        check = pthread_mutex_init(&(ht->mtx_array)[i], &mta);
+    }
+    if (check == 0) check = pthread_mutex_init(&ht->snap_mtx, NULL);
+    pthread_mutexattr_destroy(&mta);
+    err_check_return(check != 0, check, "pthread_mutex_init", -1);
+
+    return 0;
+}
@@ -10,6 +10,27 @@
 
 #include <abs_list.h>
 
+//numero di tentativi per ottenere una snapshot consistente della tabella hash
+#define  SNAPSHOT_RETRY   3
+
+
+/**
+ * @struct ht_snapshot_t
+ * @brief Copia dei puntatori agli elementi della tabella hash in un certo istante
+ * 
+ * @var elements  vettore dei puntatori agli elementi
+ * @var len       numero di elementi nella snapshot
+ * @var refcount  numero di riferimenti alla snapshot (la tabella hash ne mantiene uno
+ *                finchè la snapshot è quella in cache)
+ * @var version   versione della tabella hash a cui si riferisce la snapshot
+ */
+typedef struct {
+    void           **elements;
+    int            len;
+    int            refcount;
+    unsigned long  version;
+} ht_snapshot_t;
+
 
 /**
  * @struct hash_t
@@ -26,6 +47,9 @@
  * @param hash_fun    funzione che calcola l'indice della tabella hash
  * @setmutex_data     funzione per settare la mutex degli elementi data che contiene la tabella hash,
  *                    un elemento data avrà la stessa mutex della lista in cui verrà inserito
+ * @var version       contatore incrementato ad ogni inserimento/rimozione
+ * @var snapshot      ultima snapshot creata (riusata finchè version non cambia)
+ * @var snap_mtx      mutex per l'accesso a snapshot
  * 
  * @note: ogni elemento della tabella hash è costituito da una lista,
  *        la mtx assegnata alla lista dipende dalla sua posizione in tabella.
@@ -40,6 +64,9 @@ typedef struct {
     int  (* compare_data )(void *element, void *param);
     int (* hash_fun)(int dim_hashtable, void *param);
     void (* setmutex_data )(void *, pthread_mutex_t *);
+    unsigned long    version;
+    ht_snapshot_t    *snapshot;
+    pthread_mutex_t  snap_mtx;
 } hashtable_t;
 
 
@@ -117,10 +144,31 @@ int add_data_ht(hashtable_t *ht, void *data, void *param);
  *               da rimuovere e hash_fun(dim_hashtable, param)
  * 
  * @return 1 se successo, 0 se non è stato rimosso nessun elemento, -1 in caso di errore
+ * 
+ * @note: l'elemento rimosso viene liberato con clean_data solo quando nessun thread
+ *        si trova più nella sezione epoch in cui poteva averlo letto
  */
 int remove_data_ht(hashtable_t *ht, void *param);
 
 
+/**
+ * @function detach_data_ht
+ * @brief Rimuove un elemento data dalla tabella hash senza liberarlo
+ * 
+ * @param ht     puntatore alla tabella hash
+ * @param param  puntatore al parametro che verrà utilizzato nelle
+ *               funzioni compare_data(element, param) per trovare l' elemento
+ *               da rimuovere e hash_fun(dim_hashtable, param)
+ * 
+ * @return puntatore all'elemento rimosso, NULL se tale elemento non è presente
+ *         (errno non modificato), NULL in caso di errore (ERRNO MODIFICATO)
+ * 
+ * @note: l'elemento va poi ritirato dal chiamante con epoch_retire, i lettori senza
+ *        lock possono averlo letto prima della rimozione
+ */
+void *detach_data_ht(hashtable_t *ht, void *param);
+
+
 /**
  * @function search_data_ht
  * @brief Cerca e restituisce l'elemento el nella tabella hash
@@ -135,6 +183,10 @@ int remove_data_ht(hashtable_t *ht, void *param);
  * @return puntatore all'elemento cercato in caso di successo,
  *         NULL se tale elemento non è presente (errno non modificato),
  *         NULL in caso di errore (ERRNO MODIFICATO)
+ * 
+ * @note: se il thread è registrato (epoch_register) la ricerca avviene senza lock,
+ *        altrimenti viene presa la lock della lista. L'elemento ritornato resta valido
+ *        finchè il chiamante non esce dalla sezione epoch_enter/epoch_exit più esterna
  */
 void *search_data_ht(hashtable_t *ht, void *param);
 
@@ -150,6 +202,8 @@ void *search_data_ht(hashtable_t *ht, void *param);
  * @return 0 in caso di successo, -1 in caso di errore
  * 
  * @note: la funzione fun passata deve ritornare -1 in caso di errore
+ * @note: fun viene chiamata su una snapshot della tabella senza tenere le lock delle
+ *        liste, il chiamante deve trovarsi in una sezione epoch_enter/epoch_exit
  */
 int apply_fun_ht(hashtable_t *ht, int (* fun )(void *));
 
@@ -166,8 +220,87 @@ int apply_fun_ht(hashtable_t *ht, int (* fun )(void *));
  * @return 0 in caso di successo, -1 in caso di errore
  * 
  * @note: la funzione fun passata deve ritornare -1 in caso di errore
+ * @note: fun viene chiamata su una snapshot della tabella senza tenere le lock delle
+ *        liste, il chiamante deve trovarsi in una sezione epoch_enter/epoch_exit
  */
 int apply_fun_param_ht(hashtable_t *ht, int (* fun )(void *, void *), void *fun_param);
 
 
+/**
+ * @function set_intrusive_ht
+ * @brief Rende intrusive tutte le liste della tabella hash (vedi set_intrusive_list)
+ * 
+ * @param ht           puntatore alla tabella hash (deve essere vuota)
+ * @param node_offset  offset del campo node_t negli elementi (usare offsetof)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int set_intrusive_ht(hashtable_t *ht, long node_offset);
+
+
+/**
+ * @function get_snapshot_ht
+ * @brief Restituisce una snapshot degli elementi presenti nella tabella hash. Se la
+ *        tabella non è stata modificata dall'ultima snapshot creata viene riusata quella
+ * 
+ * @param ht  puntatore alla tabella hash
+ * 
+ * @return puntatore alla snapshot, NULL ed errno settato in caso di errore
+ * 
+ * @note: la snapshot va rilasciata con release_snapshot_ht, gli elementi contenuti
+ *        restano validi solo finchè il chiamante è in una sezione epoch_enter/epoch_exit
+ */
+ht_snapshot_t *get_snapshot_ht(hashtable_t *ht);
+
+
+/**
+ * @function release_snapshot_ht
+ * @brief Rilascia un riferimento alla snapshot, che viene liberata quando non
+ *        è più referenziata
+ * 
+ * @param ht    puntatore alla tabella hash
+ * @param snap  snapshot da rilasciare
+ */
+void release_snapshot_ht(hashtable_t *ht, ht_snapshot_t *snap);
+
+
+/**
+ * @function trylock_all_ht
+ * @brief Prova a prendere tutte le mutex della tabella hash senza bloccarsi
+ * 
+ * @param ht  puntatore alla tabella hash
+ * 
+ * @return 0 se sono state prese tutte le mutex, EBUSY se una era già occupata
+ *         (in questo caso non ne viene tenuta nessuna), altrimenti errore
+ * 
+ * @note: serve a congelare la tabella (ad esempio per una fork), prendendo le mutex
+ *        senza bloccarsi non c'è rischio di deadlock con chi ne tiene già una
+ */
+int trylock_all_ht(hashtable_t *ht);
+
+
+/**
+ * @function unlock_all_ht
+ * @brief Rilascia tutte le mutex della tabella hash prese con trylock_all_ht
+ * 
+ * @param ht  puntatore alla tabella hash
+ */
+void unlock_all_ht(hashtable_t *ht);
+
+
+/**
+ * @function reset_locks_ht
+ * @brief Reinizializza le mutex della tabella hash nel processo figlio di una fork
+ *        fatta tenendo le lock (trylock_all_ht)
+ * 
+ * @param ht  puntatore alla tabella hash
+ * 
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ * 
+ * @note: le mutex sono ricorsive ed appartengono al thread che le ha prese nel padre,
+ *        nel figlio non possono essere rilasciate con unlock_all_ht
+ */
+int reset_locks_ht(hashtable_t *ht);
+
+
 #endif /* ABS_HASHTABLE_H_ */
\ No newline at end of file
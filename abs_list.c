@@ -8,9 +8,23 @@
 #include <unistd.h>
 #include <error_handler.h>
 #include <abs_list.h>
+#include <epoch.h>
 #include <stdlib.h>
 
 
+/* ---------------------- variabili globali nel file abs_list ------------------------- */
+
+//nodi liberi riusabili dal thread
+static __thread node_t *node_pool = NULL;
+
+//numero di nodi nel pool del thread
+static __thread int node_pool_len = 0;
+
+//se diverso da 0 il pool del thread è abilitato
+static __thread int node_pool_on = 0;
+
+
+
 /* ------------------- funzioni di utilita' -------------------- */
 
 /**
@@ -41,6 +55,92 @@ static int unlock_list(list_t *list){
 }
 
 
+/**
+ * @function set_next
+ * @brief Collega un nodo (o la testa della lista) al nodo passato. Nelle liste
+ *        rcu la scrittura è atomica per essere vista in modo consistente dai
+ *        lettori senza lock
+ * 
+ * @param list  puntatore alla lista
+ * @param link  puntatore al campo da aggiornare
+ * @param node  nodo da collegare
+ */
+static inline void set_next(list_t *list, node_t **link, node_t *node){
+    if (list->rcu) __atomic_store_n(link, node, __ATOMIC_RELEASE);
+    else *link = node;
+}
+
+
+/**
+ * @function get_node
+ * @brief Restituisce il nodo per l'elemento data: nelle liste intrusive è
+ *        quello contenuto nell'elemento, altrimenti viene preso dal pool del
+ *        thread o allocato
+ * 
+ * @param list  puntatore alla lista
+ * @param data  elemento da inserire
+ * 
+ * @return puntatore al nodo, NULL in caso di errore
+ */
+static node_t *get_node(list_t *list, void *data){
+    node_t *node = NULL;
+
+    if (list->node_offset >= 0) node = (node_t *)((char *)data + list->node_offset);
+    else if (node_pool != NULL) {
+        node = node_pool;
+        node_pool = node->next;
+        node_pool_len--;
+    }
+    else {
+        node = malloc(sizeof(node_t));
+        err_return_msg(node,NULL,NULL,"Errore: malloc\n");
+    }
+
+    node->data = data;
+    node->next = NULL;
+    return node;
+}
+
+
+/**
+ * @function drop_node
+ * @brief Libera un nodo mai collegato alla lista (o non più raggiungibile)
+ * 
+ * @param list  puntatore alla lista
+ * @param node  nodo da liberare
+ */
+static void drop_node(list_t *list, node_t *node){
+    //il nodo fa parte dell'elemento
+    if (list->node_offset >= 0) return;
+
+    if (node_pool_on && node_pool_len < NODE_POOL_MAX) {
+        node->next = node_pool;
+        node_pool = node;
+        node_pool_len++;
+    }
+    else free(node);
+}
+
+
+/**
+ * @function release_node
+ * @brief Libera un nodo già scollegato dalla lista. Nelle liste rcu la free
+ *        viene rimandata finchè nessun lettore può più raggiungerlo
+ * 
+ * @param list  puntatore alla lista
+ * @param node  nodo da liberare
+ * 
+ * @note: nelle liste intrusive il nodo viene liberato insieme al suo elemento
+ */
+static void release_node(list_t *list, node_t *node){
+    if (list->node_offset >= 0) return;
+    if (!list->rcu) drop_node(list, node);
+    //se non è possibile ritirarlo il nodo non viene liberato, un lettore
+    //potrebbe ancora attraversarlo
+    else if (epoch_retire(node, NULL) == -1) perror("release_node");
+}
+
+
 
 /* ---------------------- implementazione interfaccia della lista  --------------------- */
 
@@ -86,7 +186,10 @@ list_t *init_list(int max_len, pthread_mutex_t  *mutex, void (* clean_data )(voi
     list->max_len = max_len;
     list->len     = 0;
     list->head    = NULL;
+    list->tail    = NULL;
     list->mtx     = mutex;
+    list->rcu     = 0;
+    list->node_offset  = -1;
     list->clean_data   = clean_data;
     list->compare_data = compare_data;
 
@@ -111,7 +214,8 @@ void clean_list(list_t *list){
         list->head = curr->next;
         //se la funzione clean_data è definita la chiamo 
         if (list->clean_data != NULL) list->clean_data(curr->data);
-        free(curr);
+        //nelle liste intrusive il nodo è stato liberato insieme all'elemento
+        if (list->node_offset < 0) free(curr);
         curr = list->head;
     }
 
@@ -159,30 +263,27 @@ int add_data(list_t *list, void *data, void *param_to_cmp){
             node_t *first = list->head;
             //nel caso la lista abbia max_len = 1 
             if (list->tail == list->head) list->tail = NULL;
-            list->head = first->next;
+            set_next(list, &list->head, first->next);
             //se la funzione clean_data è definita la chiamo 
             if (list->clean_data != NULL) list->clean_data(first->data);
-            free(first);
+            release_node(list, first);
             list->len--;
         }
     }
 
-    //creo un nuovo nodo
-    node_t *new = malloc(sizeof(node_t));
-    err_return_msg(new,NULL,-1,"Errore: malloc\n");
-    new->data = data;
-    new->next = NULL;
-
+    //prendo il nodo per il nuovo elemento
+    node_t *new = get_node(list, data);
+    if (new == NULL) return -1;
 
     //lock sulla lista
     int check = lock_list(list);
-    if (check != 0) free(new);
+    if (check != 0) drop_node(list, new);
     err_check_return(check != 0, check, "lock_list", -1);
 
     //se la lista è vuota
     if(list->head == NULL) {
         //lo inserisco nella lista
-        list->head = new;
+        set_next(list, &list->head, new);
         list->tail = new;
         list->len++;
     }
@@ -192,7 +293,7 @@ int add_data(list_t *list, void *data, void *param_to_cmp){
         //in fondo alla lista
         if (list->compare_data == NULL) {
             //aggiungo new in fondo
-            list->tail->next = new;
+            set_next(list, &list->tail->next, new);
             list->tail = new;
             list->len++;
         }
@@ -210,16 +311,17 @@ int add_data(list_t *list, void *data, void *param_to_cmp){
             while (curr != NULL && added == 0) {
                 ris = list->compare_data(curr->data, param_to_cmp);
                 if (ris > 0) {
-                    //lo inserisco nella lista
-                    if (prec == NULL) list->head = new;
-                    else prec->next = new;
+                    //lo inserisco nella lista (new->next va impostato prima
+                    //di renderlo visibile ai lettori senza lock)
                     new->next = curr;
+                    if (prec == NULL) set_next(list, &list->head, new);
+                    else set_next(list, &prec->next, new);
                     list->len++;
                     added = 1;
                 }
                 else if (ris == 0) {
                     //Esiste già un elemento data uguale
-                    free(new);
+                    drop_node(list, new);
                     check = unlock_list(list);
                     err_check_return(check != 0, check, "unlock_list", -1);
                     return 0;
@@ -232,7 +334,7 @@ int add_data(list_t *list, void *data, void *param_to_cmp){
 
             //se deve essere inserito in fondo alla lista
             if(curr == NULL && added == 0){
-                prec->next = new;
+                set_next(list, &prec->next, new);
                 list->tail = new;
                 list->len++;
             }
@@ -287,14 +389,14 @@ void *remove_data(list_t *list, void *param_to_cmp){
             //ho trovato il dato da rimuovere
             if (prec == NULL) {
                 if (curr == list->tail) list->tail = NULL;
-                list->head = curr->next;
+                set_next(list, &list->head, curr->next);
             }
             else {
                 if (curr == list->tail) list->tail = prec;
-                prec->next = curr->next;
+                set_next(list, &prec->next, curr->next);
             }
             ret = curr->data;
-            free(curr);
+            release_node(list, curr);
             list->len--;
             found = 1;
         }
@@ -369,6 +471,114 @@ void *search_data(list_t *list, void *param_to_cmp){
 }
 
 
+/**
+ * @function search_data_rcu
+ * @brief Cerca e restituisce un dato dalla lista senza prendere la lock
+ * 
+ * @param list          puntatore alla lista
+ * @param param_to_cmp  parametro di confronto per la ricerca
+ * 
+ * @return puntatore al dato cercato in caso di successo,
+ *         NULL se il dato non esiste (errno non è modificato),
+ *         NULL ed errno modificato in caso di errore
+ * 
+ * @note: la lista deve avere rcu abilitato (set_rcu_list) e il chiamante deve trovarsi
+ *        in una sezione epoch_enter/epoch_exit per tutto il tempo in cui usa il dato ritornato
+ */
+void *search_data_rcu(list_t *list, void *param_to_cmp){
+    //controllo gli argomenti
+    err_check_return(list == NULL || list->rcu == 0, EINVAL, "search_data_rcu", NULL);
+    err_check_return(param_to_cmp == NULL || list->compare_data == NULL, EINVAL, "search_data_rcu", NULL);
+
+    //variabili di appoggio
+    node_t *curr = __atomic_load_n(&list->head, __ATOMIC_ACQUIRE);
+    int ris;
+
+    while (curr != NULL) {
+        errno = 0;
+        ris = list->compare_data(curr->data, param_to_cmp);
+        //se errore
+        if (errno != 0) return NULL;
+
+        //non esiste il dato cercato nemmeno dopo
+        if (ris > 0) return NULL;
+        //ho trovato il dato cercato
+        else if (ris == 0) return curr->data;
+
+        curr = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @function set_rcu_list
+ * @brief Abilita le letture senza lock sulla lista: da questo momento i nodi
+ *        rimossi non vengono liberati subito ma passati ad epoch_retire
+ * 
+ * @param list  puntatore alla lista
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int set_rcu_list(list_t *list){
+    //controllo gli argomenti
+    err_check_return(list == NULL, EINVAL, "set_rcu_list", -1);
+    list->rcu = 1;
+    return 0;
+}
+
+
+/**
+ * @function set_intrusive_list
+ * @brief Rende la lista intrusiva: il nodo di ogni elemento non viene allocato
+ *        ma è il campo node_t che si trova a node_offset byte dall'inizio dell'elemento
+ * 
+ * @param list         puntatore alla lista (deve essere vuota)
+ * @param node_offset  offset del campo node_t negli elementi (usare offsetof)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ * 
+ * @note: un elemento può trovarsi in una sola lista intrusiva che usa lo stesso campo
+ */
+int set_intrusive_list(list_t *list, long node_offset){
+    //controllo gli argomenti
+    err_check_return(list == NULL || list->head != NULL, EINVAL, "set_intrusive_list", -1);
+    err_check_return(node_offset < 0, EINVAL, "set_intrusive_list", -1);
+    list->node_offset = node_offset;
+    return 0;
+}
+
+
+/**
+ * @function enable_node_pool
+ * @brief Abilita per il thread chiamante il riuso dei nodi liberati dalle liste
+ *        non intrusive (fino a NODE_POOL_MAX nodi)
+ */
+void enable_node_pool(){
+    node_pool_on = 1;
+}
+
+
+/**
+ * @function clean_node_pool
+ * @brief Libera i nodi nel pool del thread chiamante e lo disabilita
+ * 
+ * @note: da chiamare prima della terminazione del thread
+ */
+void clean_node_pool(){
+    node_t *next = NULL;
+
+    while (node_pool != NULL) {
+        next = node_pool->next;
+        free(node_pool);
+        node_pool = next;
+    }
+    node_pool_len = 0;
+    node_pool_on  = 0;
+}
+
+
 /**
  * @function pop_data
  * @brief Rimuove il primo nodo della lista e restituisce l'elemento contenuto in esso
@@ -394,10 +604,10 @@ void *pop_data(list_t *list){
     curr = list->head;
 
     if(curr != NULL) {
-        list->head = curr->next;
+        set_next(list, &list->head, curr->next);
         if (list->head == NULL) list->tail = NULL;
         ret = curr->data;
-        free(curr);
+        release_node(list, curr);
         list->len--;
     }
 
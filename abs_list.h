@@ -10,10 +10,14 @@
 #define ABS_LIST_H_
 
 #include <pthread.h>
+#include <stddef.h>
 
 //numero di elementi in lista di default
 #define  DEFAULT_LEN   1024
 
+//numero massimo di nodi liberi mantenuti nel pool di ogni thread
+#define  NODE_POOL_MAX   256
+
 /**
  * @struct node_t
  * @brief Nodo della lista
@@ -36,6 +40,10 @@ typedef struct node {
  * @var head       puntatore al primo nodo della lista
  * @var tail       puntatore all' ultimo nodo della lista
  * @var mtx        puntatore alla mutex per controllare l'accesso alla lista
+ * @var rcu        se diverso da 0 la lista può essere letta senza lock (vedi search_data_rcu)
+ *                 e i nodi rimossi vengono liberati tramite epoch_retire
+ * @var node_offset  se >= 0 offset del nodo node_t all'interno degli elementi data
+ *                   (lista intrusiva, nessuna allocazione per nodo), -1 altrimenti
  * @clean_data     funzione per eliminare un elemento data
  * @compare_data   funzione per comparare un elemento data della lista con
  *                 un parametro di confronto (può essere qualsiasi cosa)
@@ -46,6 +54,8 @@ typedef struct {
     node_t           *head;
     node_t           *tail;
     pthread_mutex_t  *mtx;
+    int              rcu;
+    long             node_offset;
     void (* clean_data )(void *);
     int  (* compare_data )(void *el, void *param_to_compare);
 } list_t;
@@ -156,6 +166,67 @@ void *remove_data(list_t *list, void *param_to_cmp);
 void *search_data(list_t *list, void *param_to_cmp);
 
 
+/**
+ * @function search_data_rcu
+ * @brief Cerca e restituisce un dato dalla lista senza prendere la lock
+ * 
+ * @param list          puntatore alla lista
+ * @param param_to_cmp  parametro di confronto per la ricerca
+ * 
+ * @return puntatore al dato cercato in caso di successo,
+ *         NULL se il dato non esiste (errno non è modificato),
+ *         NULL ed errno modificato in caso di errore
+ * 
+ * @note: la lista deve avere rcu abilitato (set_rcu_list) e il chiamante deve trovarsi
+ *        in una sezione epoch_enter/epoch_exit per tutto il tempo in cui usa il dato ritornato
+ */
+void *search_data_rcu(list_t *list, void *param_to_cmp);
+
+
+/**
+ * @function set_rcu_list
+ * @brief Abilita le letture senza lock sulla lista: da questo momento i nodi
+ *        rimossi non vengono liberati subito ma passati ad epoch_retire
+ * 
+ * @param list  puntatore alla lista
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int set_rcu_list(list_t *list);
+
+
+/**
+ * @function set_intrusive_list
+ * @brief Rende la lista intrusiva: il nodo di ogni elemento non viene allocato
+ *        ma è il campo node_t che si trova a node_offset byte dall'inizio dell'elemento
+ * 
+ * @param list         puntatore alla lista (deve essere vuota)
+ * @param node_offset  offset del campo node_t negli elementi (usare offsetof)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ * 
+ * @note: un elemento può trovarsi in una sola lista intrusiva che usa lo stesso campo
+ */
+int set_intrusive_list(list_t *list, long node_offset);
+
+
+/**
+ * @function enable_node_pool
+ * @brief Abilita per il thread chiamante il riuso dei nodi liberati dalle liste
+ *        non intrusive (fino a NODE_POOL_MAX nodi)
+ */
+void enable_node_pool();
+
+
+/**
+ * @function clean_node_pool
+ * @brief Libera i nodi nel pool del thread chiamante e lo disabilita
+ * 
+ * @note: da chiamare prima della terminazione del thread
+ */
+void clean_node_pool();
+
+
 /**
  * @function pop_data
  * @brief Rimuove il primo nodo della lista e restituisce l'elemento contenuto in esso
@@ -0,0 +1,178 @@
+/**
+ * @file abs_typed.h
+ * @brief Macro per generare a tempo di compilazione versioni specializzate per tipo
+ *        delle funzioni di ricerca/iterazione su liste (abs_list.h) e tabelle hash
+ *        (abs_hashtable.h). Le funzioni generate lavorano sulle stesse strutture
+ *        list_t ed hashtable_t, ma comparazione ed hash sono chiamate direttamente
+ *        (e quindi possono essere inline) invece che tramite puntatori a funzione.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef ABS_TYPED_H_
+#define ABS_TYPED_H_
+
+#include <errno.h>
+#include <string.h>
+#include <abs_list.h>
+#include <abs_hashtable.h>
+#include <epoch.h>
+#include <config.h>
+
+
+/**
+ * @function typed_strhash
+ * @brief funzione hash su stringhe che restituisce un valore tra 0 e (dim-1)
+ *
+ * @param dim   modulo da applicare alla funzione hash calcolata su str
+ * @param str   stringa a cui applicare la funzione hash
+ *
+ * @return valore compreso tra 0 e (dim-1)
+ *
+ * @note: stesso algoritmo ("djb2") di hashfun_user e hashfun_group, in modo che gli
+ *        elementi inseriti con le funzioni generiche siano trovati da quelle specializzate
+ */
+static inline int typed_strhash(int dim, const char *str) {
+    unsigned long hash = 5381;
+    int c;
+
+    while ((c = *str++) != 0) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+
+    return hash % dim;
+}
+
+
+/**
+ * @function typed_namecmp
+ * @brief Compara due nomi (utenti o gruppi) come cmp_user_by_name e cmp_group
+ *
+ * @return valore < 0, = 0 oppure > 0 come strncmp
+ */
+static inline int typed_namecmp(const char *a, const char *b) {
+    return strncmp(a, b, MAX_NAME_LENGTH);
+}
+
+
+/**
+ * @def DEFINE_TYPED_LIST
+ * @brief Genera le funzioni specializzate di una lista ordinata di elementi 'type'
+ *        con chiave 'key_type':
+ *         - type *name_search(list_t *list, key_type key)      ricerca con lock
+ *         - type *name_search_rcu(list_t *list, key_type key)  ricerca senza lock (lista rcu)
+ *         - int   name_add(list_t *list, type *el, key_type key)
+ *         - type *name_remove(list_t *list, key_type key)
+ *
+ * @param name      prefisso delle funzioni generate
+ * @param type      tipo degli elementi della lista
+ * @param key_type  tipo della chiave di ricerca
+ * @param cmp       funzione/macro int cmp(type *el, key_type key), deve essere
+ *                  coerente con la compare_data della lista
+ *
+ * @note: le funzioni di ricerca ritornano NULL ed errno a 0 se l'elemento
+ *        non c'è, NULL ed errno settato in caso di errore
+ */
+#define DEFINE_TYPED_LIST(name, type, key_type, cmp)                                  \
+static inline type *name##_search(list_t *list, key_type key) {                       \
+    if (list == NULL || key == NULL) { errno = EINVAL; return NULL; }                 \
+    type *ret = NULL;                                                                 \
+    int check = 0, ris = 0;                                                           \
+    errno = 0;                                                                        \
+    if (list->mtx != NULL && (check = pthread_mutex_lock(list->mtx)) != 0) {          \
+        errno = check; return NULL;                                                   \
+    }                                                                                 \
+    for (node_t *curr = list->head; curr != NULL; curr = curr->next) {                \
+        ris = cmp((type *)curr->data, key);                                           \
+        if (ris == 0) ret = (type *)curr->data;                                       \
+        if (ris >= 0) break;                                                          \
+    }                                                                                 \
+    if (list->mtx != NULL && (check = pthread_mutex_unlock(list->mtx)) != 0) {        \
+        errno = check; return NULL;                                                   \
+    }                                                                                 \
+    return ret;                                                                       \
+}                                                                                     \
+                                                                                      \
+static inline type *name##_search_rcu(list_t *list, key_type key) {                   \
+    if (list == NULL || key == NULL) { errno = EINVAL; return NULL; }                 \
+    if (list->rcu == 0) { errno = EINVAL; return NULL; }                              \
+    int ris = 0;                                                                      \
+    errno = 0;                                                                        \
+    node_t *curr = __atomic_load_n(&list->head, __ATOMIC_ACQUIRE);                    \
+    while (curr != NULL) {                                                            \
+        ris = cmp((type *)curr->data, key);                                           \
+        if (ris == 0) return (type *)curr->data;                                      \
+        if (ris > 0) return NULL;                                                     \
+        curr = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE);                        \
+    }                                                                                 \
+    return NULL;                                                                      \
+}                                                                                     \
+                                                                                      \
+static inline int name##_add(list_t *list, type *el, key_type key) {                  \
+    return add_data(list, (void *)el, (void *)key);                                   \
+}                                                                                     \
+                                                                                      \
+static inline type *name##_remove(list_t *list, key_type key) {                       \
+    return (type *)remove_data(list, (void *)key);                                    \
+}
+
+
+/**
+ * @def DEFINE_TYPED_HASHTABLE
+ * @brief Genera le funzioni specializzate di una tabella hash di elementi 'type'
+ *        con chiave 'key_type':
+ *         - type *name_search(hashtable_t *ht, key_type key)
+ *         - int   name_add(hashtable_t *ht, type *el, key_type key)
+ *         - int   name_remove(hashtable_t *ht, key_type key)
+ *        (oltre a quelle di DEFINE_TYPED_LIST con prefisso name_bucket)
+ *
+ * @param name      prefisso delle funzioni generate
+ * @param type      tipo degli elementi della tabella hash
+ * @param key_type  tipo della chiave di ricerca
+ * @param cmp       funzione/macro int cmp(type *el, key_type key)
+ * @param hash      funzione/macro int hash(int dim, key_type key), deve essere
+ *                  coerente con la hash_fun della tabella
+ *
+ * @note: name_search ha la stessa semantica di search_data_ht (senza lock se il
+ *        thread è registrato con epoch_register)
+ */
+#define DEFINE_TYPED_HASHTABLE(name, type, key_type, cmp, hash)                       \
+DEFINE_TYPED_LIST(name##_bucket, type, key_type, cmp)                                 \
+                                                                                      \
+static inline type *name##_search(hashtable_t *ht, key_type key) {                    \
+    if (ht == NULL || key == NULL) { errno = EINVAL; return NULL; }                   \
+    list_t *list = ht->lists[hash(ht->dim, key)];                                     \
+    if (epoch_enter() == -1) return name##_bucket_search(list, key);                  \
+    type *ret = name##_bucket_search_rcu(list, key);                                  \
+    int err = errno;                                                                  \
+    epoch_exit();                                                                     \
+    errno = err;                                                                      \
+    return ret;                                                                       \
+}                                                                                     \
+                                                                                      \
+static inline int name##_add(hashtable_t *ht, type *el, key_type key) {               \
+    return add_data_ht(ht, (void *)el, (void *)key);                                  \
+}                                                                                     \
+                                                                                      \
+static inline int name##_remove(hashtable_t *ht, key_type key) {                      \
+    return remove_data_ht(ht, (void *)key);                                           \
+}
+
+
+/**
+ * @def TYPED_LIST_FOREACH
+ * @brief Scorre gli elementi di una lista come puntatori di tipo 'type'
+ *
+ * @param list  lista da scorrere
+ * @param type  tipo degli elementi
+ * @param var   nome della variabile (type *) assegnata ad ogni elemento
+ *
+ * @note: non prende la lock della lista, è compito del chiamante
+ */
+#define TYPED_LIST_FOREACH(list, type, var)                                           \
+    for (node_t *var##_node = (list)->head;                                           \
+         var##_node != NULL && ((var = (type *)var##_node->data), 1);                 \
+         var##_node = var##_node->next)
+
+
+#endif /* ABS_TYPED_H_ */
@@ -0,0 +1,170 @@
+/**
+ * @file arena.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in arena.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <error_handler.h>
+#include <arena.h>
+
+
+//gli oggetti sono allineati a 16 byte
+#define  ARENA_ALIGN(s)  (((s) + 15) & ~((size_t)15))
+
+
+/**
+ * @struct arena_block_t
+ * @brief Blocco dell'arena
+ *
+ * @var next  blocco successivo
+ * @var data  ARENA_BLOCK byte per gli oggetti
+ */
+typedef struct arena_block {
+    struct arena_block  *next;
+    char                pad[8];
+    char                data[];
+} arena_block_t;
+
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//blocchi del thread (first == NULL se l'arena non è abilitata)
+static __thread arena_block_t *first = NULL;
+
+//blocco in uso e primo byte libero in esso
+static __thread arena_block_t *cur = NULL;
+static __thread size_t        pos  = 0;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function new_block
+ * @brief Alloca un blocco vuoto
+ *
+ * @return puntatore al blocco, NULL ed errno settato in caso di errore
+ */
+static arena_block_t *new_block() {
+    arena_block_t *block = malloc(sizeof(arena_block_t) + ARENA_BLOCK);
+    err_return_msg(block,NULL,NULL,"Errore: malloc\n");
+    block->next = NULL;
+    return block;
+}
+
+
+
+/* -------------------------- interfaccia arena ------------------------------ */
+
+
+/**
+ * @function arena_enable
+ * @brief Abilita l'arena del thread chiamante
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int arena_enable() {
+    if (first != NULL) return 0;
+
+    first = new_block();
+    if (first == NULL) return -1;
+    cur = first;
+    pos = 0;
+
+    return 0;
+}
+
+
+/**
+ * @function arena_clean
+ * @brief Libera i blocchi dell'arena del thread chiamante e la disabilita
+ *
+ * @note: da chiamare prima della terminazione del thread
+ */
+void arena_clean() {
+    arena_block_t *next = NULL;
+
+    while (first != NULL) {
+        next = first->next;
+        free(first);
+        first = next;
+    }
+    cur = NULL;
+    pos = 0;
+}
+
+
+/**
+ * @function arena_alloc
+ * @brief Alloca un oggetto temporaneo nell'arena del thread chiamante (con malloc
+ *        se l'arena non è abilitata o l'oggetto è più grande di ARENA_MAX_OBJ)
+ *
+ * @param len  byte dell'oggetto
+ *
+ * @return puntatore all'oggetto, NULL ed errno settato in caso di errore
+ */
+void *arena_alloc(size_t len) {
+    if (first == NULL || len > ARENA_MAX_OBJ) return malloc(len);
+
+    size_t size = ARENA_ALIGN(len > 0 ? len : 1);
+
+    //blocco pieno: passo al successivo (riusato dalle richieste precedenti o nuovo)
+    if (pos + size > ARENA_BLOCK) {
+        if (cur->next == NULL) {
+            cur->next = new_block();
+            if (cur->next == NULL) return NULL;
+        }
+        cur = cur->next;
+        pos = 0;
+    }
+
+    void *obj = cur->data + pos;
+    pos += size;
+
+    return obj;
+}
+
+
+/**
+ * @function arena_reset
+ * @brief Libera tutti gli oggetti allocati nell'arena del thread chiamante
+ *
+ * @note: da chiamare alla fine di ogni richiesta
+ */
+void arena_reset() {
+    cur = first;
+    pos = 0;
+}
+
+
+/**
+ * @function arena_owns
+ * @brief Controlla se un oggetto è nell'arena del thread chiamante
+ *
+ * @param ptr  oggetto
+ *
+ * @return 1 se l'oggetto è nell'arena, 0 altrimenti
+ */
+int arena_owns(void *ptr) {
+    for (arena_block_t *block = first; block != NULL; block = block->next) {
+        if ((char *)ptr >= block->data && (char *)ptr < block->data + ARENA_BLOCK) return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * @function arena_free
+ * @brief Libera un oggetto allocato con arena_alloc (niente se è nell'arena)
+ *
+ * @param ptr  oggetto da liberare (può essere NULL)
+ */
+void arena_free(void *ptr) {
+    if (ptr != NULL && !arena_owns(ptr)) free(ptr);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file arena.h
+ * @brief File per l'arena delle richieste: ogni worker alloca gli oggetti temporanei
+ *        di una richiesta (request_t, messaggio letto dal client, parametri delle
+ *        funzioni sulle liste, path dei file) spostando un puntatore in blocchi
+ *        propri, e li libera tutti insieme con arena_reset alla fine della richiesta.
+ *        I blocchi restano al thread, per cui dopo le prime richieste non si
+ *        chiama più malloc.
+ *
+ *        Gli oggetti che sopravvivono alla richiesta (messaggi inseriti nelle
+ *        history o da inviare più tardi) non vanno mai allocati nell'arena: vengono
+ *        copiati con duplicate_msg nelle slab (vedi slab.h). Gli oggetti più grandi
+ *        di ARENA_MAX_OBJ (file, liste lunghe) ed i thread senza arena usano malloc:
+ *        per questo gli oggetti dell'arena si liberano comunque con arena_free (o
+ *        slab_free, che li riconosce), che non fa niente se l'oggetto è nell'arena.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+
+//byte di un blocco dell'arena ed oggetto più grande allocato nei blocchi
+#define  ARENA_BLOCK     (64 * 1024)
+#define  ARENA_MAX_OBJ   (16 * 1024)
+
+
+
+/* ---------------------- interfaccia arena  --------------------- */
+
+/**
+ * @function arena_enable
+ * @brief Abilita l'arena del thread chiamante
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int arena_enable();
+
+
+/**
+ * @function arena_clean
+ * @brief Libera i blocchi dell'arena del thread chiamante e la disabilita
+ *
+ * @note: da chiamare prima della terminazione del thread
+ */
+void arena_clean();
+
+
+/**
+ * @function arena_alloc
+ * @brief Alloca un oggetto temporaneo nell'arena del thread chiamante (con malloc
+ *        se l'arena non è abilitata o l'oggetto è più grande di ARENA_MAX_OBJ)
+ *
+ * @param len  byte dell'oggetto
+ *
+ * @return puntatore all'oggetto, NULL ed errno settato in caso di errore
+ */
+void *arena_alloc(size_t len);
+
+
+/**
+ * @function arena_reset
+ * @brief Libera tutti gli oggetti allocati nell'arena del thread chiamante
+ *
+ * @note: da chiamare alla fine di ogni richiesta
+ */
+void arena_reset();
+
+
+/**
+ * @function arena_owns
+ * @brief Controlla se un oggetto è nell'arena del thread chiamante
+ *
+ * @param ptr  oggetto
+ *
+ * @return 1 se l'oggetto è nell'arena, 0 altrimenti
+ */
+int arena_owns(void *ptr);
+
+
+/**
+ * @function arena_free
+ * @brief Libera un oggetto allocato con arena_alloc (niente se è nell'arena)
+ *
+ * @param ptr  oggetto da liberare (può essere NULL)
+ */
+void arena_free(void *ptr);
+
+
+#endif /* ARENA_H_ */
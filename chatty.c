@@ -28,6 +28,8 @@
 #include <signal_handler.h>
 #include <thread_pool.h>
 #include <files_handler.h>
+#include <spill.h>
+#include <history.h>
 
 /* -------------------------- strutture dati globali --------------------------- */
 
@@ -38,7 +40,7 @@ struct statistics chattyStats = { 0,0,0,0,0,0,0 };
 pthread_mutex_t mtx_stats = PTHREAD_MUTEX_INITIALIZER;
 
 //configurazioni del server
-configs_t conf_server = { NULL,0,0,0,0,0,NULL,NULL };
+configs_t conf_server = { NULL,0,0,0,0,0,NULL,NULL,1,NULL,0,0,0,0,0,0,0 };
 
 
 /* ---------------------- altre strutture dati utilizzate ----------------------- */
@@ -74,8 +76,12 @@ static void clean_all() {
     if(hl_listener != NULL) ends_listener(hl_listener);
     if(thread_pool != NULL) ends_thread_pool(thread_pool);
 
-    //cancello tutti i file inviati dagli utenti
-    clean_dirfile(conf_server.dir_name);
+    //elimino i segmenti con le history scaricate su disco
+    clean_spill();
+
+    //cancello tutti i file inviati dagli utenti (se lo stato è persistente
+    //servono ancora ai messaggi nelle history)
+    if (conf_server.persist_dir == NULL) clean_dirfile(conf_server.dir_name);
 
     //cancello le strutture dati
     clean_configs(&conf_server);
@@ -108,6 +114,15 @@ int main(int argc, char *argv[]) {
     check = configura_server(argv[2],&conf_server);
     err_exit(check,-1,clean_all());
 
+    //creo i segmenti su disco per le history degli utenti offline
+    if (conf_server.hist_spill != 0) {
+        check = init_spill(conf_server.dir_name);
+        err_exit(check,-1,clean_all());
+    }
+
+    //messaggi delle history che restano non compressi
+    set_compress_history(conf_server.compress_age);
+
     //creo la coda per gli fd 
     fd_queue = init_fd_queue();
     err_exit(fd_queue,NULL,clean_all());
@@ -128,7 +143,8 @@ int main(int argc, char *argv[]) {
     sigaddset(&set, SIGTERM); // aggiunto SIGTERM --> per terminare chatterbox
     sigaddset(&set, SIGQUIT); // aggiunto SIGQUIT --> per terminare chatterbox
     sigaddset(&set, SIGPIPE); // aggiunto SIGPIPE --> da ignorare 
-    sigaddset(&set, SIGUSR2); // aggiunto SIGUSR2 --> per terminare chatterbox 
+    sigaddset(&set, SIGUSR2); // aggiunto SIGUSR2 --> per terminare chatterbox
+    sigaddset(&set, SIGHUP);  // aggiunto SIGHUP  --> per salvare subito lo stato (BGSAVE) 
     //NOTA su SIGUSR2: inviato dagli altri threads al signal_handler in caso di errore
 
     // blocco i segnali 
@@ -55,6 +55,7 @@ static void use(const char * filename) {
 	    " %s -l unix_socket_path -k nick -c nick -[gad] group -t milli -S msg:to -s file:to -R n -h\n"
 	    "  -l specifica il socket dove il server e' in ascolto\n"
 	    "  -k specifica il nickname del client\n"
+	    "  -K come -k ma riceve subito i messaggi non consegnati\n"
 	    "  -c specifica il nickname che deve essere creato\n"
 	    "  -C chiede che il nickname venga deregistrato\n"
 	    "  -g specifica il groupname che deve essere creato\n"
@@ -62,8 +63,14 @@ static void use(const char * filename) {
 	    "  -d rimuove  'nick' dal gruppo 'group'\n"
 	    "  -L richiede la lista degli utenti online\n"
 	    "  -p richiede di recuperare la history dei messaggi\n"
+	    "  -P since:n come -p ma solo n messaggi successivi al cursore 'since'\n"
 	    "  -t specifica i millisecondi 'milli' che intercorrono tra la gestione di due comandi consecutivi\n"
 	    "  -S spedisce il messaggio 'msg' al destinatario 'to' che puo' essere un nickname o groupname\n"
+	    "  -T ttl:msg:to come -S ma il messaggio scade dopo 'ttl' secondi\n"
+	    "  -A group:n1,n2,.. iscrive gli utenti al gruppo (solo il creatore)\n"
+	    "  -D group:n1,n2,.. rimuove gli utenti dal gruppo (solo il creatore)\n"
+	    "  -W group:n1,n2,.. crea il gruppo con gli utenti come membri\n"
+	    "  -M n1,n2,..:msg spedisce il messaggio 'msg' a tutti gli utenti della lista\n"
 	    "  -s come l'opzione -S ma permette di spedire files\n"
 	    "  -R riceve un messaggio da un nickname o groupname, se viene ricevuto un identificatore di file\n"
 	    "     il file viene scaricato dal server. In base al valore di n il comportamento e' diverso, se:\n"
@@ -73,6 +80,22 @@ static void use(const char * filename) {
 	    filename);
 }
 
+// costruisce la lista di nomi "n1,n2,.." con MAX_NAME_LENGTH+1 byte per nome
+static char *nameList(char *list, long *size) {
+    long n = 1;
+    for(char *c=list; *c; ++c) if (*c == ',') ++n;
+    char *buf = calloc(n, MAX_NAME_LENGTH+1);
+    if (!buf) {
+	perror("calloc");
+	exit(EXIT_FAILURE);
+    }
+    char *save = NULL, *name = strtok_r(list, ",", &save);
+    for(long i=0; name != NULL; ++i, name = strtok_r(NULL, ",", &save))
+	strncpy(buf + i*(MAX_NAME_LENGTH+1), name, MAX_NAME_LENGTH);
+    *size = n*(MAX_NAME_LENGTH+1);
+    return buf;
+}
+
 // legge un messaggio (testuale o file) e lo memorizza in MSGS (array globale)
 static int readMessage(int connfd, message_hdr_t *hdr) {
     
@@ -142,7 +165,9 @@ static int execute_requestreply(int connfd, operation_t *o) {
     //setData(&msg.data, "", NULL, 0);
     setData(&msg.data, rname, NULL, 0);
     setHeader(&msg.hdr, op, sname);
-    if (op == POSTTXT_OP || op == POSTTXTALL_OP || op == POSTFILE_OP) {
+    if (op == GETPREVMSGS_SINCE_OP || op == CONNECT_OP || op == GROUPADD_OP || op == GROUPDEL_OP || op == CREATEGROUPWITH_OP)
+	setData(&msg.data, rname, o->msg, o->size); // invio il cursore o la lista di nomi
+    if (op == POSTTXT_OP || op == POSTTXT_TTL_OP || op == POSTTXTMULTI_OP || op == POSTTXTALL_OP || op == POSTFILE_OP) {
 	if (o->size == 0) {
 	    fprintf(stderr, "ERRORE: size non valida per l'operazione di POST\n");
 	    return -1;
@@ -208,6 +233,8 @@ static int execute_requestreply(int connfd, operation_t *o) {
 	case OP_NICK_ALREADY:
 	case OP_NICK_UNKNOWN:
 	case OP_MSG_TOOLONG:
+	case OP_MSG_NOSPACE:
+	case OP_NO_CREATOR:
 	case OP_FAIL: {
 	    if (msg.data.buf) fprintf(stderr, "Operazione %d FALLITA: %s\n", op, msg.data.buf);
 	    else  	      fprintf(stderr, "Operazione %d FALLITA\n", op);
@@ -236,6 +263,7 @@ static int execute_requestreply(int connfd, operation_t *o) {
 	    printf(" %s\n", &msg.data.buf[p]);
 	}
     } break;
+    case GETPREVMSGS_SINCE_OP:
     case GETPREVMSGS_OP: { // ... ricevere la lista dei vecchi messaggi
 	if (readData(connfd, &msg.data) <= 0) {
 	    perror("reply data");
@@ -243,6 +271,10 @@ static int execute_requestreply(int connfd, operation_t *o) {
 	}	
 	// numero di messaggi che devo ricevere
 	size_t nmsgs = *(size_t*)(msg.data.buf); 
+	if (op == GETPREVMSGS_SINCE_OP) { // cursore per la richiesta successiva
+	    prevmsgs_reply_t *reply = (prevmsgs_reply_t*)msg.data.buf;
+	    printf("[cursore %lu%s]\n", reply->next, reply->more ? " +" : "");
+	}
 	char *FILENAMES[nmsgs]; // NOTA: si suppone che nmsgs non sia molto grande
 	size_t nfiles=0;
 	for(size_t i=0;i<nmsgs;++i) {
@@ -269,7 +301,21 @@ static int execute_requestreply(int connfd, operation_t *o) {
 	    printf("[Il file '%s' e' stato scaricato correttamente]\n",FILENAMES[i]);
 	}
     } break;
+    case GROUPADD_OP:
+    case GROUPDEL_OP:
+    case CREATEGROUPWITH_OP:
+    case POSTTXTMULTI_OP: { // ... ricevere un esito per ogni utente
+	if (readData(connfd, &msg.data) <= 0) {
+	    perror("reply data");
+	    return -1; 
+	}
+	printf("Esiti:");
+	for(unsigned int i=0;i<msg.data.hdr.len;++i) printf(" %d", msg.data.buf[i]);
+	printf("\n");
+	free(msg.data.buf);
+    } break;
     case POSTTXT_OP:
+    case POSTTXT_TTL_OP:
     case POSTTXTALL_OP:
     case POSTFILE_OP:
     case DISCONNECT_OP:
@@ -343,7 +389,7 @@ static int execute_receive(int connfd, operation_t *o) {
 }
 
 int main(int argc, char *argv[]) {
-    const char optstring[] = "l:k:c:C:g:a:d:t:S:s:R:pLh";
+    const char optstring[] = "l:k:K:c:C:g:a:d:A:D:W:M:t:S:T:s:R:P:pLh";
     int optc;
     char *spath = NULL, *nick = NULL;
     operation_t *ops = NULL;
@@ -366,6 +412,7 @@ int main(int argc, char *argv[]) {
  	switch (optc) {
         case 'l': spath=optarg;                   break;
 	case 't': msleep= strtol(optarg,NULL,10); break;
+	case 'K':
 	case 'k': {
 	    nick = strdup(optarg);
 	    if (strlen(nick)>MAX_NAME_LENGTH) {
@@ -375,8 +422,8 @@ int main(int argc, char *argv[]) {
 	    ops[k].sname = nick;
 	    ops[k].rname = NULL;
 	    ops[k].op    = CONNECT_OP;
-	    ops[k].msg   = NULL;
-	    ops[k].size  = 0;
+	    ops[k].msg   = (optc == 'K') ? strdup(CONNECT_PUSH) : NULL; // -K: push dei messaggi non consegnati
+	    ops[k].size  = (optc == 'K') ? sizeof(CONNECT_PUSH) : 0;
 	    ++k;
 	} break;
         case 'c': {
@@ -424,6 +471,53 @@ int main(int argc, char *argv[]) {
 	    ops[k].size  = 0;
 	    ++k;
 	} break;
+	case 'A':
+	case 'D':
+	case 'W': {
+	    nickneeded = 1;
+	    char *arg = strdup(optarg);
+	    char *p = strchr(arg, ':');
+	    if (!p || *(p+1) == '\0') {
+		use(argv[0]);
+		return -1;
+	    }
+	    *p++ = '\0';
+	    ops[k].sname = nick;
+	    ops[k].rname = arg;
+	    ops[k].op    = (optc == 'A') ? GROUPADD_OP : (optc == 'D') ? GROUPDEL_OP : CREATEGROUPWITH_OP;
+	    ops[k].msg   = nameList(p, &ops[k].size);
+	    ++k;
+	} break;
+	case 'M': {
+	    nickneeded = 1;
+	    char *arg = strdup(optarg);
+	    char *p = strchr(arg, ':');
+	    if (!p || *(p+1) == '\0') {
+		use(argv[0]);
+		return -1;
+	    }
+	    *p++ = '\0';
+	    // dati "n:" + n nomi + testo
+	    long len = 0;
+	    char *list = nameList(arg, &len);
+	    char head[32];
+	    int h = snprintf(head, sizeof(head), "%ld:", len/(MAX_NAME_LENGTH+1));
+	    ops[k].sname = nick;
+	    ops[k].rname = NULL;
+	    ops[k].op    = POSTTXTMULTI_OP;
+	    ops[k].size  = h + len + strlen(p)+1;
+	    ops[k].msg   = malloc(ops[k].size);
+	    if (!ops[k].msg) {
+		perror("malloc");
+		return -1;
+	    }
+	    memcpy(ops[k].msg, head, h);
+	    memcpy(ops[k].msg + h, list, len);
+	    strcpy(ops[k].msg + h + len, p);
+	    free(list);
+	    free(arg);
+	    ++k;
+	} break;
 	case 'L': {
 	    nickneeded = 1;
 	    ops[k].sname = nick;
@@ -433,20 +527,22 @@ int main(int argc, char *argv[]) {
 	    ops[k].size  = 0;
 	    ++k;
 	} break;
+	case 'P':
 	case 'p': {
 	    nickneeded = 1;
 	    ops[k].sname = nick;
 	    ops[k].rname = NULL;
-	    ops[k].op    = GETPREVMSGS_OP;
-	    ops[k].msg   = NULL;
-	    ops[k].size  = 0;
+	    ops[k].op    = (optc == 'p') ? GETPREVMSGS_OP : GETPREVMSGS_SINCE_OP;
+	    ops[k].msg   = (optc == 'p') ? NULL : strdup(optarg); // cursore "since:n"
+	    ops[k].size  = (optc == 'p') ? 0 : strlen(optarg)+1;
 	    ++k;
 	} break;
+	case 'T':
 	case 'S': {
 	    nickneeded = 1;
 	    char *arg = strdup(optarg);
 	    char *p;
-	    p = strchr(arg, ':');
+	    p = (optc == 'T') ? strrchr(arg, ':') : strchr(arg, ':'); // -T: "ttl:msg" resta nei dati
 	    if (!p) {
 		use(argv[0]);
 		return -1;
@@ -460,7 +556,7 @@ int main(int argc, char *argv[]) {
 
 	    ops[k].sname = nick;    
 	    ops[k].rname = strlen(p)?p:NULL;
-	    ops[k].op    = strlen(p)?POSTTXT_OP:POSTTXTALL_OP;
+	    ops[k].op    = (optc == 'T') ? POSTTXT_TTL_OP : (strlen(p)?POSTTXT_OP:POSTTXTALL_OP);
 	    ops[k].msg   = arg;
 	    ops[k].size  = strlen(arg)+1;
 
@@ -74,6 +74,59 @@ static int assegna_var(char *nomevar, char *valvar, configs_t *conf_server) {
         free(nomevar);
         return 0;
     }
+    else if (strncmp("HistorySpill",nomevar,strlen("HistorySpill"))==0){
+        conf_server->hist_spill=strtol(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("PersistDir",nomevar,strlen("PersistDir"))==0){
+        conf_server->persist_dir=valvar;
+        free(nomevar);
+        return 0;
+    }
+    else if (strncmp("SnapshotInterval",nomevar,strlen("SnapshotInterval"))==0){
+        conf_server->snap_interval=strtol(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("SnapshotFork",nomevar,strlen("SnapshotFork"))==0){
+        conf_server->snap_fork=strtol(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("MsgTTL",nomevar,strlen("MsgTTL"))==0){
+        conf_server->msg_ttl=strtol(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("MaxUserHistBytes",nomevar,strlen("MaxUserHistBytes"))==0){
+        conf_server->user_hist_bytes=strtoul(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("MaxHistBytes",nomevar,strlen("MaxHistBytes"))==0){
+        conf_server->hist_bytes=strtoul(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("HistEvictPolicy",nomevar,strlen("HistEvictPolicy"))==0){
+        conf_server->evict_policy=strtol(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
+    else if (strncmp("HistCompressAge",nomevar,strlen("HistCompressAge"))==0){
+        conf_server->compress_age=strtol(valvar,NULL,10);
+        free(nomevar);
+        free(valvar);
+        return 0;
+    }
     //se non ho trovato nessuna corrispondenza
     free(nomevar);
     free(valvar);
@@ -275,4 +328,5 @@ void clean_configs(configs_t *conf_server) {
     if(conf_server->socket_path != NULL) free(conf_server->socket_path);
     if(conf_server->dir_name != NULL) free(conf_server->dir_name);
     if(conf_server->stat_file_name != NULL) free(conf_server->stat_file_name);
+    if(conf_server->persist_dir != NULL) free(conf_server->persist_dir);
 }
\ No newline at end of file
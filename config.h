@@ -36,6 +36,25 @@
  * @var max_hist_msg   numero massimo di messaggi che il server 'ricorda' per ogni client
  * @var dir_name       directory per memorizzare i file inviati dagli utenti
  * @var stat_file_name file nel quale verranno scritte le statistiche del server
+ * @var hist_spill     se diverso da 0 le history degli utenti offline vengono scaricate
+ *                     su disco (in DirName), opzionale (default 1)
+ * @var persist_dir    directory per log e snapshot dello stato del server, opzionale
+ *                     (se NULL lo stato non sopravvive al riavvio)
+ * @var snap_interval  secondi tra una snapshot e l'altra (0 = solo in base alla
+ *                     dimensione del log), opzionale
+ * @var snap_fork      se diverso da 0 le snapshot sono scritte da un processo figlio
+ *                     (fork) su una copia copy-on-write dello stato, opzionale
+ * @var msg_ttl        secondi dopo i quali i messaggi vengono eliminati dalle history
+ *                     (0 = mai, POSTTXT_TTL_OP fissa il ttl del singolo messaggio), opzionale
+ * @var user_hist_bytes  byte massimi dei messaggi nella history di un utente, in memoria
+ *                       e scaricati su disco (0 = nessun limite), opzionale
+ * @var hist_bytes       byte massimi dei messaggi in tutte le history, in memoria e
+ *                       scaricati su disco (0 = nessun limite), opzionale
+ * @var evict_policy     0 = per rispettare i limiti si eliminano solo i messaggi già
+ *                       consegnati del destinatario (dal più vecchio), 1 = oltre il limite
+ *                       globale si eliminano anche quelli degli utenti con più byte, opzionale
+ * @var compress_age     numero di messaggi più recenti di ogni history che restano non
+ *                       compressi in memoria (0 = nessuna compressione), opzionale
  */
 typedef struct{
     char         *socket_path;          
@@ -46,6 +65,15 @@ typedef struct{
     unsigned int max_hist_msg;        
     char         *dir_name;           
     char         *stat_file_name; 
+    unsigned int hist_spill;
+    char         *persist_dir;
+    unsigned int snap_interval;
+    unsigned int snap_fork;
+    unsigned int msg_ttl;
+    unsigned long user_hist_bytes;
+    unsigned long hist_bytes;
+    unsigned int evict_policy;
+    unsigned int compress_age;
 }configs_t;
 
 
@@ -0,0 +1,294 @@
+/**
+ * @file epoch.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in epoch.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#include <stdlib.h>
+#include <error_handler.h>
+#include <epoch.h>
+
+
+/* ---------------------- variabili globali nel file epoch ------------------------- */
+
+//epoca globale, viene incrementata ad ogni elemento ritirato
+static unsigned long global_epoch = 1;
+
+//epoca osservata da ogni lettore al momento dell'ingresso (0 = fuori da sezioni critiche)
+static unsigned long reader_epoch[MAX_EPOCH_SLOTS];
+
+//slot occupati dai thread registrati (0 = libero, 1 = occupato)
+static int slot_used[MAX_EPOCH_SLOTS];
+
+//lista degli elementi ritirati in attesa di essere liberati
+static retired_t *retired_list = NULL;
+
+//numero di elementi ritirati in attesa
+static unsigned long n_retired = 0;
+
+//mutex per la lista degli elementi ritirati
+static pthread_mutex_t mtx_retired = PTHREAD_MUTEX_INITIALIZER;
+
+//slot assegnato al thread (-1 se non registrato)
+static __thread int my_slot = -1;
+
+//livello di annidamento delle sezioni critiche del thread
+static __thread int depth = 0;
+
+
+
+/* ------------------- funzioni di utilita' -------------------- */
+
+/**
+ * @function min_active_epoch
+ * @brief Calcola la minima epoca osservata dai lettori attualmente attivi
+ *
+ * @return minima epoca dei lettori attivi, 0 se non c'è nessun lettore attivo
+ */
+static unsigned long min_active_epoch() {
+    unsigned long min = 0, e = 0;
+
+    for (int i = 0; i < MAX_EPOCH_SLOTS; i++) {
+        e = __atomic_load_n(&reader_epoch[i], __ATOMIC_SEQ_CST);
+        if (e != 0 && (min == 0 || e < min)) min = e;
+    }
+
+    return min;
+}
+
+
+/**
+ * @function free_retired
+ * @brief Libera una lista di elementi ritirati
+ *
+ * @param r  testa della lista da liberare
+ *
+ * @return numero di elementi liberati
+ */
+static int free_retired(retired_t *r) {
+    int n = 0;
+    retired_t *next = NULL;
+
+    while (r != NULL) {
+        next = r->next;
+        if (r->clean_data != NULL) r->clean_data(r->data);
+        else free(r->data);
+        free(r);
+        r = next;
+        n++;
+    }
+
+    return n;
+}
+
+
+
+/* ---------------------- implementazione interfaccia epoch  --------------------- */
+
+/**
+ * @function epoch_register
+ * @brief Registra il thread chiamante come possibile lettore senza lock
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *         (EBUSY se non ci sono più slot liberi)
+ */
+int epoch_register() {
+    if (my_slot != -1) return 0;
+
+    for (int i = 0; i < MAX_EPOCH_SLOTS; i++) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&slot_used[i], &expected, 1, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            my_slot = i;
+            depth   = 0;
+            __atomic_store_n(&reader_epoch[i], 0, __ATOMIC_SEQ_CST);
+            return 0;
+        }
+    }
+
+    errno = EBUSY;
+    perror("epoch_register");
+    return -1;
+}
+
+
+/**
+ * @function epoch_unregister
+ * @brief Rilascia lo slot del thread chiamante
+ */
+void epoch_unregister() {
+    if (my_slot == -1) return;
+
+    __atomic_store_n(&reader_epoch[my_slot], 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot_used[my_slot], 0, __ATOMIC_SEQ_CST);
+    my_slot = -1;
+    depth   = 0;
+}
+
+
+/**
+ * @function epoch_enter
+ * @brief Entra in una sezione critica di lettura. Finchè il thread non chiama
+ *        epoch_exit nessun elemento ritirato dopo questa chiamata verrà liberato.
+ *        Le chiamate possono essere annidate.
+ *
+ * @return 0 in caso di successo, -1 se il thread non è registrato
+ *         (in tal caso il chiamante deve usare il percorso con lock)
+ */
+int epoch_enter() {
+    if (my_slot == -1) return -1;
+
+    if (depth++ == 0) {
+        unsigned long e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&reader_epoch[my_slot], e, __ATOMIC_SEQ_CST);
+        //le letture successive devono vedere tutte le rimozioni precedenti
+        //all'ultimo incremento dell'epoca globale
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function epoch_exit
+ * @brief Esce dalla sezione critica di lettura aperta con epoch_enter
+ */
+void epoch_exit() {
+    if (my_slot == -1 || depth == 0) return;
+
+    if (--depth == 0) {
+        __atomic_store_n(&reader_epoch[my_slot], 0, __ATOMIC_RELEASE);
+
+        //libero solo se ci sono abbastanza elementi in attesa: la scansione dei
+        //lettori e della lista costa, gli altri li libera il thread dei ttl
+        if (__atomic_load_n(&n_retired, __ATOMIC_RELAXED) >= EPOCH_RECLAIM_THRESHOLD) epoch_reclaim();
+    }
+}
+
+
+/**
+ * @function epoch_pause
+ * @brief Esce temporaneamente dalla sezione critica più esterna prima di un'operazione
+ *        che può bloccarsi a lungo (scrittura sul socket di un client), così un client
+ *        lento non impedisce di liberare gli elementi ritirati
+ *
+ * @return 1 se il thread è uscito dalla sezione, 0 se non era in una sezione o se
+ *         la sezione è annidata (da passare ad epoch_resume)
+ *
+ * @note: gli elementi letti nella sezione ed usati dopo epoch_resume devono essere
+ *        tenuti con un riferimento (vedi get_user e get_group)
+ */
+int epoch_pause() {
+    if (my_slot == -1 || depth != 1) return 0;
+
+    depth = 0;
+    __atomic_store_n(&reader_epoch[my_slot], 0, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+
+/**
+ * @function epoch_resume
+ * @brief Rientra nella sezione critica lasciata con epoch_pause
+ *
+ * @param paused  valore ritornato da epoch_pause
+ */
+void epoch_resume(int paused) {
+    if (paused) epoch_enter();
+}
+
+
+/**
+ * @function epoch_retire
+ * @brief Ritira un elemento già rimosso dalla struttura condivisa, verrà liberato
+ *        con clean_data quando nessun lettore potrà più accedervi
+ *
+ * @param data        elemento da liberare
+ * @param clean_data  funzione da chiamare per liberarlo (se NULL viene usata free)
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (errno settato)
+ *
+ * @note: se non è possibile allocare il descrittore dell'elemento ritirato,
+ *        il chiamante NON deve liberare data (viene ritornato -1)
+ */
+int epoch_retire(void *data, void (* clean_data )(void *)) {
+    //controllo gli argomenti
+    err_check_return(data == NULL, EINVAL, "epoch_retire", -1);
+
+    retired_t *r = malloc(sizeof(retired_t));
+    err_return_msg(r,NULL,-1,"Errore: malloc\n");
+    r->data       = data;
+    r->clean_data = clean_data;
+
+    int check = pthread_mutex_lock(&mtx_retired);
+    if (check != 0) free(r);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    //l'elemento è già stato scollegato, i lettori che entreranno da ora
+    //in poi osserveranno un'epoca maggiore di quella assegnata
+    r->epoch = __atomic_fetch_add(&global_epoch, 1, __ATOMIC_SEQ_CST);
+    r->next  = retired_list;
+    retired_list = r;
+    __atomic_add_fetch(&n_retired, 1, __ATOMIC_RELAXED);
+
+    check = pthread_mutex_unlock(&mtx_retired);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+
+    //se sono fuori da una sezione critica posso provare a liberare subito
+    if (depth == 0 || n_retired >= EPOCH_RECLAIM_THRESHOLD) epoch_reclaim();
+
+    return 0;
+}
+
+
+/**
+ * @function epoch_reclaim
+ * @brief Libera tutti gli elementi ritirati che non possono più essere letti
+ *
+ * @return numero di elementi liberati
+ */
+int epoch_reclaim() {
+    retired_t *to_free = NULL;
+
+    if (pthread_mutex_lock(&mtx_retired) != 0) return 0;
+
+    unsigned long min = min_active_epoch();
+
+    //separo gli elementi non più raggiungibili da nessun lettore attivo
+    retired_t **curr = &retired_list;
+    while (*curr != NULL) {
+        retired_t *r = *curr;
+        if (min == 0 || r->epoch < min) {
+            *curr = r->next;
+            r->next = to_free;
+            to_free = r;
+            __atomic_sub_fetch(&n_retired, 1, __ATOMIC_RELAXED);
+        }
+        else curr = &r->next;
+    }
+
+    pthread_mutex_unlock(&mtx_retired);
+
+    //libero gli elementi fuori dalla lock
+    return free_retired(to_free);
+}
+
+
+/**
+ * @function epoch_cleanup
+ * @brief Libera tutti gli elementi ritirati senza controllare i lettori
+ *
+ * @note: da chiamare solo quando tutti i thread lettori sono terminati
+ */
+void epoch_cleanup() {
+    pthread_mutex_lock(&mtx_retired);
+    retired_t *to_free = retired_list;
+    retired_list = NULL;
+    n_retired = 0;
+    pthread_mutex_unlock(&mtx_retired);
+
+    free_retired(to_free);
+}
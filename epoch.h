@@ -0,0 +1,140 @@
+/**
+ * @file epoch.h
+ * @brief File per la gestione della memoria condivisa tramite epoch-based reclamation (EBR).
+ *        Permette ai thread di leggere le strutture dati condivise senza prendere lock,
+ *        rimandando la free degli elementi rimossi fino a quando nessun lettore può
+ *        più avere un riferimento ad essi.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include <pthread.h>
+#include <config.h>
+
+//numero massimo di thread lettori registrabili contemporaneamente
+//(workers + eventuali thread di servizio)
+#define  MAX_EPOCH_SLOTS   (MAXTHREADS + 8)
+
+//numero di elementi ritirati oltre il quale si prova a liberarli all'uscita
+//da una sezione critica
+#define  EPOCH_RECLAIM_THRESHOLD   64
+
+
+/**
+ * @struct retired_t
+ * @brief Elemento rimosso da una struttura condivisa ed in attesa di essere liberato
+ *
+ * @var data        puntatore all'elemento da liberare
+ * @var clean_data  funzione da chiamare per liberare l'elemento
+ * @var epoch       epoca globale al momento della rimozione
+ * @var next        puntatore al successivo elemento ritirato
+ */
+typedef struct retired {
+    void            *data;
+    void            (* clean_data )(void *);
+    unsigned long   epoch;
+    struct retired  *next;
+} retired_t;
+
+
+
+/* ---------------------- interfaccia epoch  --------------------- */
+
+/**
+ * @function epoch_register
+ * @brief Registra il thread chiamante come possibile lettore senza lock
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *         (EBUSY se non ci sono più slot liberi)
+ */
+int epoch_register();
+
+
+/**
+ * @function epoch_unregister
+ * @brief Rilascia lo slot del thread chiamante
+ */
+void epoch_unregister();
+
+
+/**
+ * @function epoch_enter
+ * @brief Entra in una sezione critica di lettura. Finchè il thread non chiama
+ *        epoch_exit nessun elemento ritirato dopo questa chiamata verrà liberato.
+ *        Le chiamate possono essere annidate.
+ *
+ * @return 0 in caso di successo, -1 se il thread non è registrato
+ *         (in tal caso il chiamante deve usare il percorso con lock)
+ */
+int epoch_enter();
+
+
+/**
+ * @function epoch_exit
+ * @brief Esce dalla sezione critica di lettura aperta con epoch_enter
+ */
+void epoch_exit();
+
+
+/**
+ * @function epoch_pause
+ * @brief Esce temporaneamente dalla sezione critica più esterna prima di un'operazione
+ *        che può bloccarsi a lungo (scrittura sul socket di un client), così un client
+ *        lento non impedisce di liberare gli elementi ritirati
+ *
+ * @return 1 se il thread è uscito dalla sezione, 0 se non era in una sezione o se
+ *         la sezione è annidata (da passare ad epoch_resume)
+ *
+ * @note: gli elementi letti nella sezione ed usati dopo epoch_resume devono essere
+ *        tenuti con un riferimento (vedi get_user e get_group)
+ */
+int epoch_pause();
+
+
+/**
+ * @function epoch_resume
+ * @brief Rientra nella sezione critica lasciata con epoch_pause
+ *
+ * @param paused  valore ritornato da epoch_pause
+ */
+void epoch_resume(int paused);
+
+
+/**
+ * @function epoch_retire
+ * @brief Ritira un elemento già rimosso dalla struttura condivisa, verrà liberato
+ *        con clean_data quando nessun lettore potrà più accedervi
+ *
+ * @param data        elemento da liberare
+ * @param clean_data  funzione da chiamare per liberarlo (se NULL viene usata free)
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (errno settato)
+ *
+ * @note: se non è possibile allocare il descrittore dell'elemento ritirato,
+ *        il chiamante NON deve liberare data (viene ritornato -1)
+ */
+int epoch_retire(void *data, void (* clean_data )(void *));
+
+
+/**
+ * @function epoch_reclaim
+ * @brief Libera tutti gli elementi ritirati che non possono più essere letti
+ *
+ * @return numero di elementi liberati
+ */
+int epoch_reclaim();
+
+
+/**
+ * @function epoch_cleanup
+ * @brief Libera tutti gli elementi ritirati senza controllare i lettori
+ *
+ * @note: da chiamare solo quando tutti i thread lettori sono terminati
+ */
+void epoch_cleanup();
+
+
+#endif /* EPOCH_H_ */
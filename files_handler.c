@@ -17,6 +17,7 @@
 
 #include <error_handler.h>
 #include <files_handler.h>
+#include <arena.h>
 
 
 //mutex per operare nella directory dei file del server
@@ -83,8 +84,8 @@ char* get_filename(char *pathfile){
 
     //adesso pathfile contiene solo il file name
     int len = strlen(pathfile) + 1;
-    char *file_name = malloc(sizeof(char)*len);
-    err_return_msg(file_name,NULL,NULL,"Errore: malloc\n");
+    char *file_name = arena_alloc(sizeof(char)*len);
+    err_return_msg(file_name,NULL,NULL,"Errore: arena_alloc\n");
     strncpy(file_name, pathfile, len);
     
     return file_name;
@@ -111,23 +112,23 @@ int save_file(char *dir_file, char *file_name, char *buf, int len_buf){
 
     //creo il path per il nuovo file
     int len = strlen(dir_file) + strlen(file_name) + 2;
-    char *new_file = malloc(sizeof(char)*len);
-    err_return_msg(new_file,NULL,-1,"Errore: malloc\n");
+    char *new_file = arena_alloc(sizeof(char)*len);
+    err_return_msg(new_file,NULL,-1,"Errore: arena_alloc\n");
     if (snprintf(new_file, len, "%s/%s", dir_file, file_name) < 0) {
         fprintf(stderr, "Errore: snprintf\n");
-        free(new_file);
+        arena_free(new_file);
         return -1;
     }
 
     int check = lock_dirfile();
-    if (check != 0 )free(new_file);
+    if (check != 0 )arena_free(new_file);
     err_check_return(check != 0, check, "lock_dirfile", -1);
 
     //creo (o sovrascrivo) il file
     FILE *fp = fopen(new_file, "w");
     if(fp == NULL) {
         fprintf(stderr, "Errore: impossibile creare/aprire file %s\n", new_file);
-        free(new_file);
+        arena_free(new_file);
         unlock_dirfile();
         return -1;
     }
@@ -136,7 +137,7 @@ int save_file(char *dir_file, char *file_name, char *buf, int len_buf){
         if (fwrite(buf, len_buf, 1, fp) <= 0) {
             fprintf(stderr, "Errore: impossibile scrivere sul file %s\n", new_file);
             fclose(fp);
-            free(new_file);
+            arena_free(new_file);
             unlock_dirfile();
             return -1;
         }
@@ -144,7 +145,7 @@ int save_file(char *dir_file, char *file_name, char *buf, int len_buf){
         fclose(fp);
     }
 
-    free(new_file);
+    arena_free(new_file);
 
     check = unlock_dirfile();
     err_check_return(check != 0, check, "unlock_dirfile", -1);
@@ -171,11 +172,11 @@ int get_mappedfile(char **mappedfile, char *dir_file, char *file_name){
 
     //creo il path del file da mappare
     int len = strlen(dir_file) + strlen(file_name) + 2;
-    char *file_tomap = malloc(sizeof(char)*len);
-    err_return_msg(file_tomap,NULL,-1,"Errore: malloc\n");
+    char *file_tomap = arena_alloc(sizeof(char)*len);
+    err_return_msg(file_tomap,NULL,-1,"Errore: arena_alloc\n");
     if (snprintf(file_tomap, len, "%s/%s", dir_file, file_name) < 0) {
         fprintf(stderr, "Errore: snprintf\n");
-        free(file_tomap);
+        arena_free(file_tomap);
         return -1;
     }
 
@@ -185,7 +186,7 @@ int get_mappedfile(char **mappedfile, char *dir_file, char *file_name){
     struct stat st;
 	if (stat(file_tomap, &st) == -1) {
         check = unlock_dirfile();
-        if(check != 0) free(file_tomap);
+        arena_free(file_tomap);
         err_check_return(check != 0, check, "unlock_dirfile", -1);
         return 0;
     }
@@ -194,7 +195,7 @@ int get_mappedfile(char **mappedfile, char *dir_file, char *file_name){
 	if (fd<0) {
 		fprintf(stderr, "ERRORE: aprendo il file %s\n", file_tomap);
 		close(fd);
-        free(file_tomap);
+        arena_free(file_tomap);
         unlock_dirfile();
 		return -1;
 	}
@@ -203,12 +204,12 @@ int get_mappedfile(char **mappedfile, char *dir_file, char *file_name){
 	if (*mappedfile == MAP_FAILED) {
 		fprintf(stderr, "ERRORE: mappando il file %s in memoria\n", file_tomap);
 		close(fd);
-        free(file_tomap);
+        arena_free(file_tomap);
         unlock_dirfile();
 		return -1;
 	}
 	close(fd);
-    free(file_tomap);
+    arena_free(file_tomap);
 
     check = unlock_dirfile();
     err_check_return(check != 0, check, "unlock_dirfile", -1);
@@ -16,6 +16,8 @@
  * @param pathfile  path del file
  * 
  * @return filename se successo, NULL in caso di fallimento (o file non valido)
+ *
+ * @note: il nome è nell'arena del thread (vedi arena.h), va liberato con arena_free
  */
 char* get_filename(char *pathfile);
 
@@ -11,11 +11,10 @@
 #include <error_handler.h>
 #include <group.h>
 #include <user.h>
+#include <intern.h>
 
 
-//funzioni necessarie per la creazione e la gestione della lista 
-//degli utenti membri del gruppo
-extern int cmp_user_by_name(void *us, void *name);
+//funzioni applicate agli utenti membri del gruppo
 extern int postmsg_all(void *us, void *param);
 extern int gen_unsubscribe(void *us, void *str);
 
@@ -48,6 +47,152 @@ static int unlock_group(group_t *group){
 }
 
 
+/**
+ * @function member_hash
+ * @brief Slot ideale di un membro nell'indice (hash moltiplicativo dell'id)
+ */
+static inline unsigned int member_hash(unsigned int id, unsigned int cap) {
+    return (id * 2654435761U) & (cap - 1);
+}
+
+
+/**
+ * @function find_slot
+ * @brief Cerca l'utente con id nell'indice dei membri
+ *
+ * @param group  gruppo (con l'indice allocato)
+ * @param id     id del nome dell'utente
+ * @param slot   slot dell'indice in cui si trova il membro, oppure slot vuoto
+ *               in cui inserirlo
+ *
+ * @return posizione del membro in members, -1 se non è membro del gruppo
+ */
+static int find_slot(group_t *group, unsigned int id, unsigned int *slot) {
+    unsigned int mask = group->capindex - 1;
+    unsigned int i = member_hash(id, group->capindex);
+
+    while (group->index[i] != 0) {
+        unsigned int pos = group->index[i] - 1;
+        if (group->members[pos]->id == id) {
+            *slot = i;
+            return pos;
+        }
+        i = (i + 1) & mask;
+    }
+
+    *slot = i;
+    return -1;
+}
+
+
+/**
+ * @function rebuild_index
+ * @brief Ricostruisce l'indice dei membri con cap slot
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int rebuild_index(group_t *group, unsigned int cap) {
+    unsigned int *index = calloc(cap, sizeof(unsigned int));
+    err_return_msg(index,NULL,-1,"Errore: calloc\n");
+
+    free(group->index);
+    group->index    = index;
+    group->capindex = cap;
+
+    unsigned int slot = 0;
+    for (unsigned int pos = 0; pos < group->nmembers; pos++) {
+        find_slot(group, group->members[pos]->id, &slot);
+        group->index[slot] = pos + 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function insert_member
+ * @brief Aggiunge l'utente in fondo al vettore dei membri ed all'indice (vanno
+ *        chiamate con la lock del gruppo, come le altre funzioni sui membri)
+ *
+ * @return 1 in caso di successo, 0 se l'utente è già membro del gruppo,
+ *         -1 ed errno settato in caso di errore
+ *
+ * @note: un membro con lo stesso id ma un'altra struttura è l'utente che aveva il
+ *        nome prima di una deregistrazione (inattivo, release_user non l'ha ancora
+ *        tolto dal gruppo): viene sostituito
+ */
+static int insert_member(group_t *group, user_t *user) {
+    //l'indice rimane pieno al più per metà
+    if (2 * (group->nmembers + 1) > group->capindex) {
+        unsigned int cap = (group->capindex == 0) ? GROUP_MIN_INDEX : 2 * group->capindex;
+        if (rebuild_index(group, cap) == -1) return -1;
+    }
+
+    unsigned int slot = 0;
+    int pos = find_slot(group, user->id, &slot);
+    if (pos != -1) {
+        if (group->members[pos] == user) return 0;
+        group->members[pos] = user;
+        return 1;
+    }
+
+    if (group->nmembers == group->capmembers) {
+        unsigned int cap = (group->capmembers == 0) ? GROUP_MIN_MEMBERS : 2 * group->capmembers;
+        user_t **members = realloc(group->members, cap * sizeof(user_t *));
+        err_return_msg(members,NULL,-1,"Errore: realloc\n");
+        group->members    = members;
+        group->capmembers = cap;
+    }
+
+    group->members[group->nmembers] = user;
+    group->nmembers++;
+    group->index[slot] = group->nmembers;
+
+    return 1;
+}
+
+
+/**
+ * @function delete_member
+ * @brief Rimuove il membro con id: al suo posto nel vettore va l'ultimo membro,
+ *        nell'indice gli slot successivi vengono spostati indietro (niente lapidi)
+ *
+ * @return puntatore all'utente rimosso, NULL se non è membro del gruppo
+ */
+static user_t *delete_member(group_t *group, unsigned int id) {
+    if (group->nmembers == 0 || id == 0) return NULL;
+
+    unsigned int mask = group->capindex - 1;
+    unsigned int i = 0;
+    int pos = find_slot(group, id, &i);
+    if (pos == -1) return NULL;
+    user_t *us = group->members[pos];
+
+    //svuoto lo slot e riporto indietro i membri che lo avevano scavalcato
+    group->index[i] = 0;
+    for (unsigned int j = (i + 1) & mask; group->index[j] != 0; j = (j + 1) & mask) {
+        unsigned int home = member_hash(group->members[group->index[j] - 1]->id, group->capindex);
+        //il membro in j resta dov'è se il suo slot ideale è tra i (escluso) e j
+        int stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        group->index[i] = group->index[j];
+        group->index[j] = 0;
+        i = j;
+    }
+
+    //sposto l'ultimo membro al posto di quello rimosso
+    group->nmembers--;
+    unsigned int last = group->nmembers;
+    if ((unsigned int)pos != last) {
+        group->members[pos] = group->members[last];
+        find_slot(group, group->members[pos]->id, &i);
+        group->index[i] = pos + 1;
+    }
+
+    return us;
+}
+
+
 
 /* ------------------------- implementazione interfaccia group ------------------------- */
 
@@ -74,30 +219,57 @@ group_t *create_group(char *name, user_t *user){
 
     //inizializzo i parametri del gruppo
     gr->status   = ACTIVE;
+    gr->refs     = 1;
     gr->mtx      = NULL;
+    gr->members    = NULL;
+    gr->nmembers   = 0;
+    gr->capmembers = 0;
+    gr->index      = NULL;
+    gr->capindex   = 0;
+    gr->key        = group_key(name);
     strncpy(gr->groupname, name, MAX_NAME_LENGTH+1);
-    strncpy(gr->creator, user->nickname, MAX_NAME_LENGTH+1);
-    gr->members = init_list(DEFAULT_LEN, NULL, NULL, cmp_user_by_name);
-    err_return_msg_clean(gr->members, NULL, NULL, "Errore: init_list\n", clean_group(gr));
+    gr->creator    = user->id;
+    //il gruppo ha il suo riferimento al nome del creatore (vedi intern.h)
+    intern_ref(gr->creator);
 
     //aggiungo il creatore ai membri del gruppo
-    int check = add_data(gr->members, user, user->nickname);
-    err_return_msg_clean(check, -1, NULL, "Errore: add_data\n", clean_group(gr));
+    int check = insert_member(gr, user);
+    err_return_msg_clean(check, -1, NULL, "Errore: insert_member\n", clean_group(gr));
 
     return gr;
 }
 
 
+/**
+ * @function get_group
+ * @brief Prende un riferimento al gruppo: non verrà liberato finchè il riferimento
+ *        non viene rilasciato con clean_group, anche se nel frattempo viene ritirato
+ * 
+ * @param group  gruppo letto all'interno di una sezione epoch_enter/epoch_exit
+ * 
+ * @return il gruppo passato
+ */
+group_t *get_group(group_t *group){
+    __atomic_add_fetch(&group->refs, 1, __ATOMIC_RELAXED);
+    return group;
+}
+
+
 /**
  * @function clean_group
- * @brief Libera la memoria allocata per il gruppo
+ * @brief Rilascia un riferimento al gruppo e libera la memoria allocata per il
+ *        gruppo se era l'ultimo
  * 
  * @param group puntatore al gruppo da cancellare
  */
 void clean_group(void *gr){
     if (gr == NULL) return;
     group_t *group = (group_t *)gr;
-    if (group->members != NULL) clean_list(group->members);
+    //altri thread lo stanno ancora usando
+    if (__atomic_sub_fetch(&group->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    intern_release(group->creator);
+    free(group->members);
+    free(group->index);
     free(group);
 }
 
@@ -113,19 +285,49 @@ void clean_group(void *gr){
  * @return 1 se successo, 0 se era già in fase di cancellazione il gruppo o se l'utente 
  *         che ha fatto richiesta non è il creatore del gruppo, -1 se in caso di errore
  */
-int disable_group(group_t *group, char* user_name){
+int disable_group(group_t *group, const char* user_name){
     //controllo gli argomenti
     err_check_return(group == NULL, EINVAL, "disable_group", -1);
     err_check_return(user_name == NULL, EINVAL, "disable_group", -1);
 
+    //metto lo status del gruppo in 'cancellazione' se l'utente è il creatore
+    int check = mark_group(group, user_name);
+
+    //se l'utente passato non è il creatore, se il gruppo è già in fase di
+    //cancellazione o se errore
+    if (check != 1) return check;
+
+    //rimuovo il gruppo da tutti i gruppi d'iscrizione dei propri membri
+    if (release_group(group) == -1) return -1;
+
+    return 1;
+}
+
+
+/**
+ * @function mark_group
+ * @brief Pone a 'cancellazione' lo stato del gruppo se user_name è il suo creatore
+ *        (prima parte di disable_group: da qui in poi il gruppo non accetta più
+ *        iscrizioni, rimozioni e messaggi)
+ * 
+ * @param group      gruppo da 'disabilitare'
+ * @param user_name  nome dell'utente che ha richiesto la cancellazione del gruppo
+ * 
+ * @return 1 se successo, 0 se era già in fase di cancellazione il gruppo o se l'utente 
+ *         che ha fatto richiesta non è il creatore del gruppo, -1 se in caso di errore
+ */
+int mark_group(group_t *group, const char* user_name){
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "mark_group", -1);
+    err_check_return(user_name == NULL, EINVAL, "mark_group", -1);
+
     //variabile di appoggio
     int check = 0, checklock = 0;
 
-    //metto lo status del gruppo in 'cancellazione' se l'utente è il creatore
     checklock = lock_group(group);
     err_check_return(checklock != 0, checklock, "lock_group", -1);
 
-    if(strncmp(group->creator, user_name, MAX_NAME_LENGTH) == 0) {
+    if(group->creator == intern_find(user_name)) {
         if (group->status != DELETION) {
             group->status = DELETION;
             check = 1;
@@ -135,14 +337,71 @@ int disable_group(group_t *group, char* user_name){
     checklock = unlock_group(group);
     err_check_return(checklock != 0, checklock, "unlock_group", -1);
 
-    //se l'utente passato non è il creatore o se il gruppo è già in fase di cancellazione
-    if (check == 0) return 0;
+    return check;
+}
 
-    //rimuovo il gruppo da tutti i gruppi d'iscrizione dei propri membri
-    check = apply_fun_param(group->members, gen_unsubscribe, (void *)group->groupname);
-    err_return_msg(check,-1,-1,"Errore: disable user\n");
 
-    return 1;
+/**
+ * @function release_group
+ * @brief Rimuove il gruppo, già in fase di cancellazione (vedi mark_group), da tutti
+ *        i gruppi d'iscrizione dei propri membri
+ * 
+ * @param group  gruppo in fase di cancellazione
+ * 
+ * @return 0 se successo, -1 in caso di errore
+ */
+int release_group(group_t *group){
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "release_group", -1);
+
+    //in cancellazione i membri non cambiano più: li scorro senza la lock del gruppo
+    for (unsigned int i = 0; i < group->nmembers; i++) {
+        int check = gen_unsubscribe(group->members[i], (void *)group);
+        err_return_msg(check,-1,-1,"Errore: release group\n");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function dump_group
+ * @brief Scrive il gruppo ed i nomi dei suoi membri su fp (record della snapshot)
+ * 
+ * @param group  gruppo da scrivere
+ * @param fp     file della snapshot
+ * 
+ * @return 1 se successo, 0 se il gruppo era in fase di cancellazione, -1 in caso di errore
+ */
+int dump_group(group_t *group, FILE *fp){
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "dump_group", -1);
+    err_check_return(fp == NULL, EINVAL, "dump_group", -1);
+
+    //variabile di appoggio
+    int check = 1;
+
+    int checklock = lock_group(group);
+    err_check_return(checklock != 0, checklock, "lock_group", -1);
+
+    if (group->status == DELETION) check = 0;
+    else {
+        group_rec_t rec;
+        memset(&rec, 0, sizeof(group_rec_t));
+        strncpy(rec.groupname, group->groupname, MAX_NAME_LENGTH+1);
+        strncpy(rec.creator, intern_str(group->creator), MAX_NAME_LENGTH+1);
+        rec.n = group->nmembers;
+        if (fwrite(&rec, sizeof(group_rec_t), 1, fp) != 1) check = -1;
+
+        for (unsigned int i = 0; check != -1 && i < group->nmembers; i++) {
+            if (fwrite(group->members[i]->nickname, MAX_NAME_LENGTH+1, 1, fp) != 1) check = -1;
+        }
+    }
+
+    checklock = unlock_group(group);
+    err_check_return(checklock != 0, checklock, "unlock_group", -1);
+
+    return check;
 }
 
 
@@ -174,7 +433,7 @@ int add_member(group_t *group, user_t *user){
         return 0;
     }
 
-    check = add_data(group->members, user, user->nickname);
+    check = insert_member(group, user);
 
     checklock = unlock_group(group);
     err_check_return(checklock != 0, checklock, "unlock_group", -1);
@@ -188,18 +447,19 @@ int add_member(group_t *group, user_t *user){
  * @brief Rimuove un utente tra i membri del gruppo
  * 
  * @param group       gruppo da cui rimuovere l'utente
- * @param name        nome dell' utente da rimuovere dal gruppo
+ * @param user        utente da rimuovere dal gruppo
  * @param is_creator  per sapere all'esterno se l'utente rimosso dal gruppo era
  *                    il creatore di esso
  * 
- * @return puntatore all'utente rimosso, NULL ed errno non settato se non esiste 
- *         nessun membro con tale nome o se il gruppo è in fase di cancellazione,
- *         NULL ed errno settato se errore
+ * @return puntatore all'utente rimosso, NULL ed errno non settato se l'utente non
+ *         è membro (anche se al suo posto c'è chi ha ripreso il suo nome dopo la
+ *         deregistrazione) o se il gruppo è in fase di cancellazione, NULL ed errno
+ *         settato se errore
  */
-user_t *remove_member(group_t *group, char *name, int *is_creator){
+user_t *remove_member(group_t *group, user_t *user, int *is_creator){
     //controllo gli argomenti
     err_check_return(group == NULL, EINVAL, "remove_member", NULL);
-    err_check_return(name == NULL, EINVAL, "remove_member", NULL);
+    err_check_return(user == NULL, EINVAL, "remove_member", NULL);
     err_check_return(is_creator == NULL, EINVAL, "remove_member", NULL);
 
     //variabile di appoggio
@@ -216,11 +476,13 @@ user_t *remove_member(group_t *group, char *name, int *is_creator){
         return NULL;
     }
 
-    //rimuovo l'utente dalla lista dei membri
-    us = remove_data(group->members, name);
+    //rimuovo l'utente dalla lista dei membri se il membro con il suo id è proprio lui
+    unsigned int slot = 0;
+    int pos = (group->nmembers > 0) ? find_slot(group, user->id, &slot) : -1;
+    if (pos != -1 && group->members[pos] == user) us = delete_member(group, user->id);
 
     //se l'utente rimosso è il creatore del gruppo
-    if(strncmp(group->creator, name, MAX_NAME_LENGTH) == 0) *is_creator = 1;
+    if(group->creator == user->id) *is_creator = 1;
 
     checklock = unlock_group(group);
     err_check_return(checklock != 0, checklock, "unlock_group", NULL);
@@ -229,6 +491,108 @@ user_t *remove_member(group_t *group, char *name, int *is_creator){
 }
 
 
+/**
+ * @function add_members
+ * @brief Iscrive al gruppo n utenti prendendo la lock del gruppo una volta sola
+ *        (inserisce anche il gruppo tra quelli di ogni utente, vedi subscribe)
+ * 
+ * @param group  gruppo a cui iscrivere gli utenti
+ * @param users  utenti da iscrivere (NULL se l'utente non esiste)
+ * @param n      numero di utenti
+ * @param res    vi viene scritto l'esito per ogni utente: OP_OK se iscritto, OP_FAIL se
+ *               era già membro, OP_NICK_UNKNOWN se non esiste o è inattivo
+ * 
+ * @return 1 in caso di successo, 0 se il gruppo è in fase di cancellazione (res non
+ *         viene scritto), -1 in caso di errore
+ */
+int add_members(group_t *group, user_t **users, unsigned int n, unsigned char *res){
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "add_members", -1);
+    err_check_return(users == NULL || res == NULL, EINVAL, "add_members", -1);
+
+    //variabile di appoggio
+    int check = 1, checklock = 0;
+
+    checklock = lock_group(group);
+    err_check_return(checklock != 0, checklock, "lock_group", -1);
+
+    //se è inattivo non faccio niente
+    if (group->status == DELETION) check = 0;
+
+    //la lock dell'utente si può prendere dentro quella del gruppo (vedi postmsg_all_group)
+    for (unsigned int i = 0; check == 1 && i < n; i++) {
+        int ins = (users[i] != NULL) ? insert_member(group, users[i]) : 0;
+        if (users[i] == NULL) res[i] = OP_NICK_UNKNOWN;
+        else if (ins == -1) check = -1;
+        else if (ins == 0) res[i] = OP_FAIL;
+        else {
+            int sub = subscribe(users[i], group);
+            //se è inattivo lo tolgo dai membri
+            if (sub != 1) delete_member(group, users[i]->id);
+            if (sub == -1) check = -1;
+            res[i] = (sub == 1) ? OP_OK : OP_NICK_UNKNOWN;
+        }
+    }
+
+    checklock = unlock_group(group);
+    err_check_return(checklock != 0, checklock, "unlock_group", -1);
+
+    return check;
+}
+
+
+/**
+ * @function remove_members
+ * @brief Rimuove dal gruppo n utenti prendendo la lock del gruppo una volta sola
+ *        (rimuove anche il gruppo da quelli di ogni utente, vedi gen_unsubscribe)
+ * 
+ * @param group  gruppo da cui rimuovere gli utenti
+ * @param users  utenti da rimuovere (NULL se l'utente non esiste)
+ * @param n      numero di utenti
+ * @param res    vi viene scritto l'esito per ogni utente: OP_OK se rimosso, OP_FAIL se
+ *               è il creatore (che non può essere rimosso così), OP_NICK_UNKNOWN se
+ *               non è membro (anche se al suo posto c'è chi ha ripreso il suo nome
+ *               dopo la deregistrazione)
+ * 
+ * @return 1 in caso di successo, 0 se il gruppo è in fase di cancellazione (res non
+ *         viene scritto), -1 in caso di errore
+ */
+int remove_members(group_t *group, user_t **users, unsigned int n, unsigned char *res){
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "remove_members", -1);
+    err_check_return(users == NULL || res == NULL, EINVAL, "remove_members", -1);
+
+    //variabile di appoggio
+    int check = 1, checklock = 0;
+
+    checklock = lock_group(group);
+    err_check_return(checklock != 0, checklock, "lock_group", -1);
+
+    //se è inattivo non faccio niente
+    if (group->status == DELETION) check = 0;
+
+    for (unsigned int i = 0; check == 1 && i < n; i++) {
+        unsigned int slot = 0;
+        int pos = -1;
+        if (users[i] != NULL && group->nmembers > 0) pos = find_slot(group, users[i]->id, &slot);
+
+        if (users[i] != NULL && group->creator == users[i]->id) res[i] = OP_FAIL;
+        //rimuovo solo se il membro con quell'id è proprio l'utente attuale
+        else if (pos == -1 || group->members[pos] != users[i]) res[i] = OP_NICK_UNKNOWN;
+        else {
+            delete_member(group, users[i]->id);
+            if (gen_unsubscribe(users[i], group) == -1) check = -1;
+            res[i] = OP_OK;
+        }
+    }
+
+    checklock = unlock_group(group);
+    err_check_return(checklock != 0, checklock, "unlock_group", -1);
+
+    return check;
+}
+
+
 /**
  * @function postmsg_all_group
  * @brief Invia il messaggio param->msg_to_send a tutti i membri nel gruppo
@@ -257,8 +621,11 @@ int postmsg_all_group(group_t *group, param_postmsg_all_t *param){
         return 0;
     }
 
-    //mando il messaggio a tutti gli utenti membri
-    if (apply_fun_param(group->members, postmsg_all, (void*)param) == 0) check = 1;
+    //mando il messaggio a tutti gli utenti membri (scansione del vettore denso)
+    check = 1;
+    for (unsigned int i = 0; check == 1 && i < group->nmembers; i++) {
+        if (postmsg_all(group->members[i], (void*)param) == -1) check = -1;
+    }
 
     checklock = unlock_group(group);
     err_check_return(checklock != 0, checklock, "unlock_group", -1);
@@ -367,7 +734,7 @@ int gen_remove_member(void *gr, void *us){
 
     //rimuovo l'utente
     errno = 0;
-    user_t *u = remove_member(group, user->nickname, &is_creator);
+    user_t *u = remove_member(group, user, &is_creator);
     //se errore
     if (u == NULL && errno != 0) return -1;
 
@@ -377,11 +744,7 @@ int gen_remove_member(void *gr, void *us){
     //solo i gruppi di cui è anche il creatore 
     //(si presuppone che questa funzione sia chiamata al momento
     //della de-registrazione dell'utente)
-    if (is_creator == 0) {
-        void *v = remove_data(user->groups, (void*)group->groupname);
-        //in caso di errore
-        if (v == NULL && errno != 0) return -1;
-    }
+    if (is_creator == 0) drop_group(user, group->groupname);
 
     return 0;
 }
\ No newline at end of file
@@ -13,6 +13,11 @@
 #include <config.h>
 
 
+//capacità iniziale del vettore dei membri e dell'indice (potenze di 2)
+#define  GROUP_MIN_MEMBERS   4
+#define  GROUP_MIN_INDEX     8
+
+
 //stati assumibili da una struttura gruppo
 typedef enum {
     ACTIVE    = 0,   //il gruppo è 'attivo'
@@ -25,20 +30,88 @@ typedef enum {
  * @brief Struttura dati gruppo
  * 
  * @var groupname  nome del gruppo
- * @var creator    nome dell'utente che ha creato il gruppo
+ * @var creator    id del nome dell'utente che ha creato il gruppo (vedi intern.h)
  * @var status     indica se il gruppo è attivo o in fase di cancellazione
- * @var members    lista degli utenti membri del gruppo
+ * @var refs       riferimenti al gruppo: quello della tabella hash più quelli presi
+ *                 dai workers che lo usano fuori dalla sezione epoch (vedi get_group)
+ * @var members    vettore denso degli utenti membri del gruppo (nmembers elementi,
+ *                 in ordine di iscrizione finchè non ne viene rimosso qualcuno)
+ * @var nmembers   numero di membri
+ * @var capmembers dimensione del vettore dei membri
+ * @var index      indice hash dei membri per id (indirizzamento aperto con scansione
+ *                 lineare): ogni slot contiene la posizione del membro in members + 1,
+ *                 0 = slot vuoto
+ * @var capindex   numero di slot dell'indice (potenza di 2, almeno il doppio dei membri)
+ * @var key        chiave del gruppo nelle iscrizioni degli utenti (vedi group_key)
  * @var mtx        puntatore al mutex per controllare l'accesso alla struttura del gruppo
+ * @var ht_node    nodo per la lista della tabella hash in cui è inserito il gruppo
  */
 typedef struct group {
     char             groupname[MAX_NAME_LENGTH+1];
-    char             creator[MAX_NAME_LENGTH+1];
+    unsigned int     creator;
     status_gr_t      status;
-    list_t           *members;
+    unsigned int     refs;
+    user_t           **members;
+    unsigned int     nmembers;
+    unsigned int     capmembers;
+    unsigned int     *index;
+    unsigned int     capindex;
+    unsigned int     key;
     pthread_mutex_t  *mtx;
+    node_t           ht_node;
 } group_t;
 
 
+/**
+ * @function group_name_cmp
+ * @brief Versione inline di cmp_group per le funzioni specializzate
+ */
+static inline int group_name_cmp(group_t *gr, const char *name) {
+    return typed_namecmp(gr->groupname, name);
+}
+
+
+/**
+ * @function group_key
+ * @brief Ritorna la chiave di un gruppo nelle iscrizioni degli utenti: hash del nome
+ *        (djb2 come typed_strhash, ma a 32 bit), calcolata una volta alla creazione
+ *        del gruppo e per ogni ricerca per nome
+ */
+static inline unsigned int group_key(const char *name) {
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = *name++) != 0) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+
+    return hash;
+}
+
+
+//tabella hash dei gruppi (chiave nome del gruppo)
+DEFINE_TYPED_HASHTABLE(groups_ht, group_t, const char *, group_name_cmp, typed_strhash)
+
+//lista di gruppi ordinata per nome (i gruppi di un utente sono in user_groups_t,
+//la lista resta per il confronto in test/bench_containers.c)
+DEFINE_TYPED_LIST(user_groups, group_t, const char *, group_name_cmp)
+
+
+/**
+ * @struct group_rec_t
+ * @brief Record di un gruppo nella snapshot (seguito dai nomi degli n membri)
+ *
+ * @var groupname  nome del gruppo
+ * @var creator    nome del creatore del gruppo
+ * @var n          numero di membri
+ */
+typedef struct {
+    char          groupname[MAX_NAME_LENGTH+1];
+    char          creator[MAX_NAME_LENGTH+1];
+    unsigned int  n;
+} group_rec_t;
+
+
 
 /* ---------------------------- interfaccia group ------------------------- */
 
@@ -57,9 +130,22 @@ typedef struct group {
 group_t *create_group(char *name, user_t *user);
 
 
+/**
+ * @function get_group
+ * @brief Prende un riferimento al gruppo: non verrà liberato finchè il riferimento
+ *        non viene rilasciato con clean_group, anche se nel frattempo viene ritirato
+ * 
+ * @param group  gruppo letto all'interno di una sezione epoch_enter/epoch_exit
+ * 
+ * @return il gruppo passato
+ */
+group_t *get_group(group_t *group);
+
+
 /**
  * @function clean_group
- * @brief Libera la memoria allocata per il gruppo
+ * @brief Rilascia un riferimento al gruppo e libera la memoria allocata per il
+ *        gruppo se era l'ultimo
  * 
  * @param group puntatore al gruppo da cancellare
  */
@@ -77,7 +163,46 @@ void clean_group(void *gr);
  * @return 1 se successo, 0 se era già in fase di cancellazione il gruppo o se l'utente 
  *         che ha fatto richiesta non è il creatore del gruppo, -1 se in caso di errore
  */
-int disable_group(group_t *group, char* user_name);
+int disable_group(group_t *group, const char* user_name);
+
+
+/**
+ * @function mark_group
+ * @brief Pone a 'cancellazione' lo stato del gruppo se user_name è il suo creatore
+ *        (prima parte di disable_group: da qui in poi il gruppo non accetta più
+ *        iscrizioni, rimozioni e messaggi)
+ * 
+ * @param group      gruppo da 'disabilitare'
+ * @param user_name  nome dell'utente che ha richiesto la cancellazione del gruppo
+ * 
+ * @return 1 se successo, 0 se era già in fase di cancellazione il gruppo o se l'utente 
+ *         che ha fatto richiesta non è il creatore del gruppo, -1 se in caso di errore
+ */
+int mark_group(group_t *group, const char* user_name);
+
+
+/**
+ * @function release_group
+ * @brief Rimuove il gruppo, già in fase di cancellazione (vedi mark_group), da tutti
+ *        i gruppi d'iscrizione dei propri membri
+ * 
+ * @param group  gruppo in fase di cancellazione
+ * 
+ * @return 0 se successo, -1 in caso di errore
+ */
+int release_group(group_t *group);
+
+
+/**
+ * @function dump_group
+ * @brief Scrive il gruppo ed i nomi dei suoi membri su fp (record della snapshot)
+ * 
+ * @param group  gruppo da scrivere
+ * @param fp     file della snapshot
+ * 
+ * @return 1 se successo, 0 se il gruppo era in fase di cancellazione, -1 in caso di errore
+ */
+int dump_group(group_t *group, FILE *fp);
 
 
 /**
@@ -98,15 +223,52 @@ int add_member(group_t *group, user_t *user);
  * @brief Rimuove un utente tra i membri del gruppo
  * 
  * @param group       gruppo da cui rimuovere l'utente
- * @param name        nome dell' utente da rimuovere dal gruppo
+ * @param user        utente da rimuovere dal gruppo
  * @param is_creator  per sapere all'esterno se l'utente rimosso dal gruppo era
  *                    il creatore di esso
  * 
- * @return puntatore all'utente rimosso, NULL ed errno non settato se non esiste 
- *         nessun membro con tale nome o se il gruppo è in fase di cancellazione,
- *         NULL ed errno settato se errore
+ * @return puntatore all'utente rimosso, NULL ed errno non settato se l'utente non
+ *         è membro (anche se al suo posto c'è chi ha ripreso il suo nome dopo la
+ *         deregistrazione) o se il gruppo è in fase di cancellazione, NULL ed errno
+ *         settato se errore
+ */
+user_t *remove_member(group_t *group, user_t *user, int *is_creator);
+
+
+/**
+ * @function add_members
+ * @brief Iscrive al gruppo n utenti prendendo la lock del gruppo una volta sola
+ *        (inserisce anche il gruppo tra quelli di ogni utente, vedi subscribe)
+ * 
+ * @param group  gruppo a cui iscrivere gli utenti
+ * @param users  utenti da iscrivere (NULL se l'utente non esiste)
+ * @param n      numero di utenti
+ * @param res    vi viene scritto l'esito per ogni utente: OP_OK se iscritto, OP_FAIL se
+ *               era già membro, OP_NICK_UNKNOWN se non esiste o è inattivo
+ * 
+ * @return 1 in caso di successo, 0 se il gruppo è in fase di cancellazione (res non
+ *         viene scritto), -1 in caso di errore
+ */
+int add_members(group_t *group, user_t **users, unsigned int n, unsigned char *res);
+
+
+/**
+ * @function remove_members
+ * @brief Rimuove dal gruppo n utenti prendendo la lock del gruppo una volta sola
+ *        (rimuove anche il gruppo da quelli di ogni utente, vedi gen_unsubscribe)
+ * 
+ * @param group  gruppo da cui rimuovere gli utenti
+ * @param users  utenti da rimuovere (NULL se l'utente non esiste)
+ * @param n      numero di utenti
+ * @param res    vi viene scritto l'esito per ogni utente: OP_OK se rimosso, OP_FAIL se
+ *               è il creatore (che non può essere rimosso così), OP_NICK_UNKNOWN se
+ *               non è membro (anche se al suo posto c'è chi ha ripreso il suo nome
+ *               dopo la deregistrazione)
+ * 
+ * @return 1 in caso di successo, 0 se il gruppo è in fase di cancellazione (res non
+ *         viene scritto), -1 in caso di errore
  */
-user_t *remove_member(group_t *group, char *name, int *is_creator);
+int remove_members(group_t *group, user_t **users, unsigned int n, unsigned char *res);
 
 
 /**
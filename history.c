@@ -0,0 +1,1209 @@
+/**
+ * @file history.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in history.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <error_handler.h>
+#include <history.h>
+#include <lz.h>
+#include <intern.h>
+#include <slab.h>
+#include <arena.h>
+
+
+//valore all'inizio di ogni record scaricato su disco
+#define  SPILL_MAGIC   0x48495354
+
+/**
+ * @struct spill_rec_t
+ * @brief Intestazione di un record su disco, seguita da n coppie
+ *        (spill_entry_t, dati del messaggio); next_seq è quello della history
+ */
+typedef struct {
+    unsigned int   magic;
+    unsigned int   n;
+    unsigned long  next_seq;
+} spill_rec_t;
+
+/**
+ * @struct spill_entry_t
+ * @brief Intestazione su disco di un messaggio della history
+ */
+typedef struct {
+    message_hdr_t       hdr;
+    message_data_hdr_t  dhdr;
+    int                 delivered;
+    unsigned long       seq;
+    time_t              expire;
+} spill_entry_t;
+
+/**
+ * @struct spill_link_t
+ * @brief Segue l'intestazione di un record nei segmenti (non nelle snapshot):
+ *        posizione del record precedente della stessa history, numero di record e
+ *        di messaggi su disco della history compreso questo record, byte dei dati
+ *        dei messaggi del record e di quelli già consegnati
+ */
+typedef struct {
+    off_t         prev_off;
+    size_t        prev_size;
+    unsigned int  nrec;
+    unsigned int  total;
+    size_t        bytes;
+    size_t        dbytes;
+} spill_link_t;
+
+/**
+ * @struct spill_ref_t
+ * @brief Posizione, numero di messaggi e byte (tutti e già consegnati) di un record
+ *        su disco
+ */
+typedef struct {
+    off_t         off;
+    size_t        size;
+    unsigned int  n;
+    size_t        bytes;
+    size_t        dbytes;
+} spill_ref_t;
+
+//byte delle intestazioni di un record nei segmenti
+#define  SPILL_HEAD    (sizeof(spill_rec_t) + sizeof(spill_link_t))
+
+
+
+//byte dei dati dei messaggi in tutte le history (in memoria e su disco)
+static size_t total_bytes = 0;
+
+//messaggi più recenti di ogni history che non vengono compressi (0 = mai compressi)
+static unsigned int compress_age = 0;
+
+//byte originali e compressi dei messaggi compressi in memoria, tempo di cpu (ns)
+//speso per comprimere e decomprimere
+static size_t        zraw   = 0;
+static size_t        zbytes = 0;
+static unsigned long znsec  = 0;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function account
+ * @brief Aggiunge (o toglie) len byte alla history ed al totale di tutte le history
+ */
+static void account(history_t *hist, size_t len, int add) {
+    if (len == 0) return;
+    if (add) {
+        hist->bytes += len;
+        __atomic_add_fetch(&total_bytes, len, __ATOMIC_RELAXED);
+    }
+    else {
+        hist->bytes -= len;
+        __atomic_sub_fetch(&total_bytes, len, __ATOMIC_RELAXED);
+    }
+}
+
+
+/**
+ * @function slot_bytes
+ * @brief Ritorna i byte occupati dai dati del messaggio nello slot
+ */
+static inline size_t slot_bytes(message_node_t *slot) {
+    return (slot->zlen != 0) ? slot->zlen : slot->len;
+}
+
+
+/**
+ * @function free_slot
+ * @brief Libera il buffer dei dati dello slot, lo toglie dai byte della history e
+ *        rilascia i nomi di mittente e destinatario
+ */
+static void free_slot(history_t *hist, message_node_t *slot) {
+    account(hist, slot_bytes(slot), 0);
+    if (slot->zlen != 0) {
+        __atomic_sub_fetch(&zraw, slot->len, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&zbytes, slot->zlen, __ATOMIC_RELAXED);
+    }
+    slab_free(slot->buf);
+    intern_release(slot->sender);
+    intern_release(slot->receiver);
+}
+
+
+/**
+ * @function cpu_nsec
+ * @brief Ritorna il tempo di cpu usato dal thread chiamante in nanosecondi
+ */
+static unsigned long cpu_nsec() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+
+/**
+ * @function compress_slot
+ * @brief Comprime i dati del messaggio nello slot se è un messaggio testuale già
+ *        consegnato di almeno HIST_COMPRESS_MIN byte e si risparmia almeno un ottavo
+ *        della memoria (altrimenti lo slot non viene toccato)
+ */
+static void compress_slot(history_t *hist, message_node_t *slot) {
+    size_t len = slot->len;
+    if (slot->zlen != 0 || !slot->delivered || slot->op != TXT_MESSAGE) return;
+    if (len < HIST_COMPRESS_MIN) return;
+
+    unsigned long start = cpu_nsec();
+
+    //si comprime nell'arena del thread, il risultato va in un buffer delle slab
+    //(se manca memoria il messaggio resta non compresso)
+    char *tmp = arena_alloc(len - len / 8);
+    if (tmp == NULL) return;
+    size_t zlen = lz_compress(slot->buf, len, tmp, len - len / 8);
+    char *z = (zlen != 0) ? slab_alloc_buf(zlen) : NULL;
+    if (z != NULL) {
+        memcpy(z, tmp, zlen);
+        account(hist, len, 0);
+        account(hist, zlen, 1);
+        slab_free(slot->buf);
+        slot->buf = z;
+        slot->zlen = zlen;
+        __atomic_add_fetch(&zraw, len, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&zbytes, zlen, __ATOMIC_RELAXED);
+    }
+    arena_free(tmp);
+
+    __atomic_add_fetch(&znsec, cpu_nsec() - start, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @function unpack_slot
+ * @brief Copia in dst i dati originali del messaggio nello slot (decomprimendoli
+ *        se necessario), dst deve essere lungo len byte
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int unpack_slot(message_node_t *slot, char *dst) {
+    size_t len = slot->len;
+    if (len == 0) return 0;
+    if (slot->zlen == 0) {
+        memcpy(dst, slot->buf, len);
+        return 0;
+    }
+
+    unsigned long start = cpu_nsec();
+    int check = lz_decompress(slot->buf, slot->zlen, dst, len);
+    __atomic_add_fetch(&znsec, cpu_nsec() - start, __ATOMIC_RELAXED);
+    if (check == -1) perror("unpack_slot");
+
+    return check;
+}
+
+
+/**
+ * @function compress_cold
+ * @brief Comprime i messaggi degli slot da from (compreso) a to (escluso) che non
+ *        sono tra i compress_age più recenti
+ */
+static void compress_cold(history_t *hist, unsigned int from, unsigned int to) {
+    if (compress_age == 0 || hist->len <= compress_age) return;
+    if (to > hist->len - compress_age) to = hist->len - compress_age;
+    for (unsigned int i = from; i < to; i++) compress_slot(hist, get_history(hist, i));
+}
+
+
+/**
+ * @function free_snap
+ * @brief Libera una copia della history e rilascia i nomi dei suoi messaggi
+ */
+static void free_snap(history_snap_t *snap) {
+    for (unsigned int i = 0; i < snap->len; i++) {
+        intern_release(snap->slots[i].sender);
+        intern_release(snap->slots[i].receiver);
+    }
+    free(snap);
+}
+
+
+/**
+ * @function drop_snap
+ * @brief Toglie dalla cache la copia della history (la history è stata modificata)
+ */
+static void drop_snap(history_t *hist) {
+    if (hist->snap == NULL) return;
+    release_snapshot_history(hist->snap);
+    hist->snap = NULL;
+}
+
+
+/**
+ * @function fill_slot
+ * @brief Riempie il messaggio di uno slot con header e dati di un messaggio: i nomi
+ *        di mittente e destinatario diventano i loro id, con un riferimento ciascuno
+ *        (rilasciati da free_slot, vedi intern.h)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: il buffer dei dati passa allo slot solo in caso di successo
+ */
+static int fill_slot(message_node_t *slot, message_hdr_t *hdr, message_data_hdr_t *dhdr, char *buf) {
+    slot->sender = intern_name(hdr->sender);
+    if (slot->sender == 0) return -1;
+    slot->receiver = intern_name(dhdr->receiver);
+    if (slot->receiver == 0) {
+        int err = errno;
+        intern_release(slot->sender);
+        errno = err;
+        return -1;
+    }
+
+    slot->op   = hdr->op;
+    slot->len  = dhdr->len;
+    slot->buf  = buf;
+    slot->zlen = 0;
+
+    return 0;
+}
+
+
+/**
+ * @function push_slot
+ * @brief Copia lo slot src in fondo alla history (gli slot devono essere già
+ *        allocati), se è piena viene eliminato il messaggio più vecchio
+ */
+static void push_slot(history_t *hist, message_node_t *src) {
+    message_node_t *slot = NULL;
+
+    drop_snap(hist);
+
+    //se è piena sovrascrivo il messaggio più vecchio
+    if (hist->len == hist->cap) {
+        slot = &hist->slots[hist->head];
+        free_slot(hist, slot);
+        hist->head = (hist->head + 1 == hist->cap) ? 0 : hist->head + 1;
+    }
+    else {
+        slot = get_history(hist, hist->len);
+        hist->len++;
+    }
+
+    //copio il messaggio nello slot
+    account(hist, slot_bytes(src), 1);
+    *slot = *src;
+}
+
+
+
+/**
+ * @struct drop_t
+ * @brief Criterio con cui drop_slots sceglie i messaggi da eliminare
+ *
+ * @var kind    DROP_EXPIRED = scaduti entro now, DROP_DELIVERED = già consegnati,
+ *              dal più vecchio, finchè non sono stati liberati excess byte
+ * @var now     istante corrente
+ * @var excess  byte ancora da liberare
+ */
+typedef struct {
+    enum { DROP_EXPIRED, DROP_DELIVERED } kind;
+    time_t  now;
+    size_t  excess;
+} drop_t;
+
+
+/**
+ * @function drop_slots
+ * @brief Elimina i messaggi scelti da d compattando gli slot rimasti (l'ordine non
+ *        cambia), se la history rimane vuota libera anche gli slot
+ *
+ * @return numero di messaggi eliminati
+ */
+static unsigned int drop_slots(history_t *hist, drop_t *d, history_expired_t *out) {
+    if (hist->slots == NULL) return 0;
+
+    unsigned int kept = 0, n = 0;
+    for (unsigned int i = 0; i < hist->len; i++) {
+        message_node_t *slot = get_history(hist, i);
+        int drop = 0;
+        if (d->kind == DROP_EXPIRED) drop = (slot->expire != 0 && slot->expire <= d->now);
+        else drop = (d->excess > 0 && slot->delivered);
+
+        if (!drop) {
+            if (kept != i) *get_history(hist, kept) = *slot;
+            kept++;
+            continue;
+        }
+
+        size_t len = slot_bytes(slot);
+        if (slot->op == FILE_MESSAGE) {
+            out->files++;
+            if (!slot->delivered) out->filenotdelivered++;
+        }
+        else {
+            out->msgs++;
+            if (!slot->delivered) out->notdelivered++;
+        }
+        out->bytes += len;
+        d->excess = (d->excess > len) ? d->excess - len : 0;
+        free_slot(hist, slot);
+        n++;
+    }
+    if (n == 0) return 0;
+
+    drop_snap(hist);
+    hist->len = kept;
+
+    //history vuota: libero anche gli slot (riallocati al prossimo messaggio)
+    if (hist->len == 0) {
+        out->bytes += hist->cap * sizeof(message_node_t);
+        free(hist->slots);
+        hist->slots = NULL;
+        hist->head  = 0;
+    }
+
+    return n;
+}
+
+
+
+/**
+ * @function read_chain
+ * @brief Legge le intestazioni dei record su disco della history, dal più recente
+ *        al più vecchio
+ *
+ * @param hist   puntatore alla history (con almeno un record su disco)
+ * @param nrec   numero di record (in uscita)
+ * @param total  numero di messaggi nei record (in uscita)
+ *
+ * @return vettore dei record da liberare con free, NULL ed errno settato in caso di errore
+ */
+static spill_ref_t *read_chain(history_t *hist, unsigned int *nrec, unsigned int *total) {
+    spill_ref_t *recs = NULL;
+    off_t off = hist->off;
+    size_t size = hist->size;
+    unsigned int n = 1, i = 0;
+
+    for (i = 0; i < n; i++) {
+        char head[SPILL_HEAD];
+        spill_rec_t rhdr;
+        spill_link_t link;
+        if (size < SPILL_HEAD || spill_read(hist->shard, off, head, SPILL_HEAD) == -1) break;
+        memcpy(&rhdr, head, sizeof(spill_rec_t));
+        memcpy(&link, head + sizeof(spill_rec_t), sizeof(spill_link_t));
+        if (rhdr.magic != SPILL_MAGIC) break;
+
+        //il record più recente dice quanti sono i record ed i messaggi su disco
+        if (i == 0) {
+            if (link.nrec == 0) break;
+            n = link.nrec;
+            *total = link.total;
+            recs = malloc(n * sizeof(spill_ref_t));
+            err_return_msg(recs,NULL,NULL,"Errore: malloc\n");
+        }
+        recs[i].off  = off;
+        recs[i].size = size;
+        recs[i].n    = rhdr.n;
+        recs[i].bytes  = link.bytes;
+        recs[i].dbytes = link.dbytes;
+        off  = link.prev_off;
+        size = link.prev_size;
+    }
+
+    if (recs != NULL && i == n) {
+        *nrec = n;
+        return recs;
+    }
+    if (recs != NULL) free(recs);
+    errno = EIO;
+    return NULL;
+}
+
+
+/**
+ * @function release_chain
+ * @brief Rilascia tutti i record su disco della history
+ */
+static void release_chain(history_t *hist) {
+    if (hist->size == 0) return;
+
+    //i byte su disco sono quelli della history che non sono in memoria
+    size_t mem = 0;
+    for (unsigned int i = 0; i < hist->len; i++) mem += slot_bytes(get_history(hist, i));
+    if (hist->bytes > mem) account(hist, hist->bytes - mem, 0);
+
+    unsigned int nrec = 0, total = 0;
+    spill_ref_t *recs = read_chain(hist, &nrec, &total);
+    //senza memoria (o se la catena è rovinata) rilascio almeno il record più recente
+    if (recs == NULL) spill_release(hist->shard, hist->off, hist->size);
+    else {
+        for (unsigned int i = 0; i < nrec; i++) spill_release(hist->shard, recs[i].off, recs[i].size);
+        free(recs);
+    }
+
+    hist->size = 0;
+}
+
+
+/**
+ * @function clean_slots
+ * @brief Libera i messaggi in memoria della history e gli slot
+ */
+static void clean_slots(history_t *hist) {
+    if (hist->slots == NULL) return;
+
+    for (unsigned int i = 0; i < hist->len; i++) free_slot(hist, get_history(hist, i));
+
+    free(hist->slots);
+    hist->slots = NULL;
+    hist->head  = 0;
+    hist->len   = 0;
+}
+
+
+/**
+ * @function write_entry
+ * @brief Scrive in p l'intestazione su disco ed i dati originali del messaggio di
+ *        uno slot
+ *
+ * @return byte scritti, 0 ed errno settato in caso di errore
+ */
+static size_t write_entry(message_node_t *slot, char *p) {
+    message_t msg;
+    msg_history(slot, &msg);
+    spill_entry_t entry;
+    memset(&entry, 0, sizeof(spill_entry_t));
+    entry.hdr       = msg.hdr;
+    entry.dhdr      = msg.data.hdr;
+    entry.delivered = slot->delivered;
+    entry.seq       = slot->seq;
+    entry.expire    = slot->expire;
+    memcpy(p, &entry, sizeof(spill_entry_t));
+    //su disco i messaggi sono scritti non compressi
+    if (unpack_slot(slot, p + sizeof(spill_entry_t)) == -1) {
+        errno = EIO;
+        return 0;
+    }
+    return sizeof(spill_entry_t) + entry.dhdr.len;
+}
+
+
+
+/* -------------------------- interfaccia history ------------------------------ */
+
+
+/**
+ * @function init_history
+ * @brief Inizializza la history (gli slot vengono allocati al primo messaggio)
+ *
+ * @param hist  puntatore alla history
+ * @param cap   numero massimo di messaggi nella history
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int init_history(history_t *hist, unsigned int cap) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "init_history", -1);
+
+    hist->slots = NULL;
+    hist->cap   = cap;
+    hist->head  = 0;
+    hist->len   = 0;
+    hist->shard = 0;
+    hist->off   = 0;
+    hist->size  = 0;
+    hist->next_seq = 1;
+    hist->snap     = NULL;
+    hist->bytes    = 0;
+
+    return 0;
+}
+
+
+/**
+ * @function clean_history
+ * @brief Libera la memoria allocata per la history e per i messaggi contenuti
+ *
+ * @param hist  puntatore alla history
+ */
+void clean_history(history_t *hist) {
+    if (hist == NULL) return;
+
+    drop_snap(hist);
+
+    //i record su disco non servono più
+    release_chain(hist);
+
+    clean_slots(hist);
+}
+
+
+/**
+ * @function add_history
+ * @brief Aggiunge un messaggio in fondo alla history, se è piena viene eliminato
+ *        il messaggio più vecchio
+ *
+ * @param hist       puntatore alla history
+ * @param msg        messaggio da inserire
+ * @param delivered  0 = da consegnare, 1 = già consegnato
+ * @param expire     istante in cui il messaggio scade (0 = mai)
+ *
+ * @return 1 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: in caso di successo la history diventa proprietaria del buffer dei dati di msg
+ *        e la struttura msg viene liberata, in caso di errore msg non viene toccato
+ */
+int add_history(history_t *hist, message_t *msg, int delivered, time_t expire) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "add_history", -1);
+    err_check_return(msg == NULL, EINVAL, "add_history", -1);
+    err_check_return(delivered != 0 && delivered != 1, EINVAL, "add_history", -1);
+
+    //history disabilitata
+    if (hist->cap == 0) {
+        hist->next_seq++;
+        free_msg(msg);
+        return 1;
+    }
+
+    //alloco gli slot al primo messaggio
+    if (hist->slots == NULL) {
+        hist->slots = malloc(hist->cap * sizeof(message_node_t));
+        err_return_msg(hist->slots,NULL,-1,"Errore: malloc\n");
+    }
+
+    message_node_t node;
+    if (fill_slot(&node, &msg->hdr, &msg->data.hdr, msg->data.buf) == -1) return -1;
+    node.delivered = delivered;
+    node.seq       = hist->next_seq++;
+    node.expire    = expire;
+    push_slot(hist, &node);
+    slab_free(msg);
+
+    //il messaggio che esce dai compress_age più recenti viene compresso
+    if (compress_age != 0 && hist->len > compress_age) {
+        compress_cold(hist, hist->len - compress_age - 1, hist->len - compress_age);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @function msg_history
+ * @brief Ricostruisce il messaggio di uno slot della history: i nomi di mittente e
+ *        destinatario vengono presi dai loro id, il buffer dei dati resta quello
+ *        dello slot (non va liberato)
+ *
+ * @param slot  slot della history
+ * @param msg   vi viene scritto il messaggio
+ */
+void msg_history(message_node_t *slot, message_t *msg) {
+    if (slot == NULL || msg == NULL) return;
+
+    const char *sender   = intern_str(slot->sender);
+    const char *receiver = intern_str(slot->receiver);
+
+    memset(msg, 0, sizeof(message_t));
+    msg->hdr.op = slot->op;
+    if (sender != NULL) strncpy(msg->hdr.sender, sender, MAX_NAME_LENGTH);
+    if (receiver != NULL) strncpy(msg->data.hdr.receiver, receiver, MAX_NAME_LENGTH);
+    msg->data.hdr.len = slot->len;
+    msg->data.buf     = slot->buf;
+}
+
+
+/**
+ * @function spill_history
+ * @brief Scarica su disco i messaggi in memoria della history e libera la memoria che
+ *        occupavano: vengono scritti in un nuovo record collegato a quello già su disco,
+ *        ed i record più vecchi che contengono solo messaggi oltre la capacità della
+ *        history vengono rilasciati
+ *
+ * @param hist  puntatore alla history
+ * @param key   chiave che sceglie il segmento su disco (nome dell'utente)
+ *
+ * @return 1 se la history è stata scaricata, 0 se non c'era niente da scaricare o se
+ *         i segmenti non sono inizializzati, -1 ed errno settato in caso di errore
+ */
+int spill_history(history_t *hist, const char *key) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "spill_history", -1);
+    err_check_return(key == NULL, EINVAL, "spill_history", -1);
+
+    if (!spill_enabled() || hist->len == 0) return 0;
+
+    //record già su disco: tengo i più recenti finchè insieme ai nuovi messaggi non
+    //riempiono la history, i più vecchi contengono solo messaggi ormai eliminati
+    spill_link_t link = { 0, 0, 1, hist->len, 0, 0 };
+    spill_ref_t *recs = NULL;
+    unsigned int nrec = 0, total = 0, keep = 0;
+    if (hist->size > 0) {
+        recs = read_chain(hist, &nrec, &total);
+        if (recs == NULL) return -1;
+        while (keep < nrec && link.total < hist->cap) link.total += recs[keep++].n;
+        if (keep > 0) {
+            link.prev_off  = hist->off;
+            link.prev_size = hist->size;
+            link.nrec     += keep;
+        }
+    }
+
+    //calcolo la lunghezza del record (solo i messaggi in memoria)
+    size_t size = SPILL_HEAD;
+    for (unsigned int i = 0; i < hist->len; i++) {
+        message_node_t *slot = get_history(hist, i);
+        size += sizeof(spill_entry_t) + slot->len;
+        link.bytes += slot->len;
+        if (slot->delivered) link.dbytes += slot->len;
+    }
+
+    char *rec = malloc(size);
+    err_return_msg_clean(rec,NULL,-1,"Errore: malloc\n",free(recs));
+
+    //serializzo i messaggi, collegando il record a quelli già su disco
+    spill_rec_t rhdr = { SPILL_MAGIC, hist->len, hist->next_seq };
+    memcpy(rec, &rhdr, sizeof(spill_rec_t));
+    memcpy(rec + sizeof(spill_rec_t), &link, sizeof(spill_link_t));
+    char *p = rec + SPILL_HEAD;
+
+    for (unsigned int i = 0; i < hist->len; i++) {
+        size_t w = write_entry(get_history(hist, i), p);
+        if (w == 0) {
+            free(rec);
+            free(recs);
+            return -1;
+        }
+        p += w;
+    }
+
+    //scrivo il record nel segmento (tutti i record della history sono nello stesso)
+    unsigned int shard = (hist->size > 0) ? hist->shard : spill_shard(key);
+    off_t off = 0;
+    if (spill_append(shard, rec, size, &off) == -1) {
+        int err = errno;
+        free(rec);
+        free(recs);
+        errno = err;
+        return -1;
+    }
+    free(rec);
+
+    //rilascio i record che non sono più collegati
+    for (unsigned int i = keep; i < nrec; i++) {
+        spill_release(shard, recs[i].off, recs[i].size);
+        account(hist, recs[i].bytes, 0);
+    }
+    free(recs);
+
+    //libero la memoria e ricordo dove si trova il record (i messaggi su disco restano
+    //nei byte della history, non compressi)
+    drop_snap(hist);
+    clean_slots(hist);
+    account(hist, link.bytes, 1);
+    hist->shard = shard;
+    hist->off   = off;
+    hist->size  = size;
+
+    return 1;
+}
+
+
+/**
+ * @function load_history
+ * @brief Riporta in memoria la parte della history scaricata su disco, i messaggi
+ *        arrivati nel frattempo vengono messi dopo quelli su disco
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return 1 se è stato caricato un record, 0 se non c'era niente su disco,
+ *         -1 ed errno settato in caso di errore (la history non viene modificata)
+ */
+int load_history(history_t *hist) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "load_history", -1);
+
+    if (hist->size == 0) return 0;
+
+    //leggo la catena dei record
+    unsigned int nrec = 0, total = 0;
+    spill_ref_t *recs = read_chain(hist, &nrec, &total);
+    if (recs == NULL) {
+        perror("load_history");
+        return -1;
+    }
+
+    //nuova history: prima i messaggi su disco, poi quelli in memoria
+    history_t tmp;
+    init_history(&tmp, hist->cap);
+    tmp.slots = malloc(hist->cap * sizeof(message_node_t));
+    if (tmp.slots == NULL) {
+        free(recs);
+        fprintf(stderr, "Errore: malloc\n");
+        return -1;
+    }
+
+    //salto i messaggi su disco che verrebbero comunque eliminati
+    unsigned int skip = 0, ind = 0;
+    if (total + hist->len > hist->cap) {
+        skip = total + hist->len - hist->cap;
+        if (skip > total) skip = total;
+    }
+
+    //i record vanno letti dal più vecchio
+    for (unsigned int r = nrec; r-- > 0; ) {
+        if (ind + recs[r].n <= skip) {
+            ind += recs[r].n;
+            continue;
+        }
+
+        //mappo il record in memoria
+        void *base = NULL;
+        size_t maplen = 0;
+        char *p = spill_map(hist->shard, recs[r].off, recs[r].size, &base, &maplen);
+        if (p == NULL) {
+            clean_history(&tmp);
+            free(recs);
+            return -1;
+        }
+        p += SPILL_HEAD;
+
+        for (unsigned int i = 0; i < recs[r].n; i++, ind++) {
+            spill_entry_t entry;
+            memcpy(&entry, p, sizeof(spill_entry_t));
+            p += sizeof(spill_entry_t);
+
+            if (ind >= skip) {
+                char *buf = NULL;
+                if (entry.dhdr.len > 0) {
+                    buf = malloc(entry.dhdr.len);
+                    if (buf == NULL) {
+                        clean_history(&tmp);
+                        spill_unmap(base, maplen);
+                        free(recs);
+                        fprintf(stderr, "Errore: malloc\n");
+                        return -1;
+                    }
+                    memcpy(buf, p, entry.dhdr.len);
+                }
+                message_node_t node;
+                if (fill_slot(&node, &entry.hdr, &entry.dhdr, buf) == -1) {
+                    int err = errno;
+                    if (buf != NULL) free(buf);
+                    clean_history(&tmp);
+                    spill_unmap(base, maplen);
+                    free(recs);
+                    errno = err;
+                    return -1;
+                }
+                node.delivered = entry.delivered;
+                node.seq       = entry.seq;
+                node.expire    = entry.expire;
+                push_slot(&tmp, &node);
+            }
+            p += entry.dhdr.len;
+        }
+
+        spill_unmap(base, maplen);
+    }
+    free(recs);
+
+    //sposto i messaggi in memoria (i buffer passano a tmp)
+    for (unsigned int i = 0; i < hist->len; i++) {
+        message_node_t *slot = get_history(hist, i);
+        push_slot(&tmp, slot);
+    }
+
+    //i record su disco non servono più
+    release_chain(hist);
+
+    //i messaggi spostati sono già contati nel totale tramite tmp
+    __atomic_sub_fetch(&total_bytes, hist->bytes, __ATOMIC_RELAXED);
+
+    drop_snap(hist);
+    if (hist->slots != NULL) free(hist->slots);
+    hist->slots = tmp.slots;
+    hist->head  = tmp.head;
+    hist->len   = tmp.len;
+    hist->bytes = tmp.bytes;
+
+    //i messaggi ricaricati vengono compressi come quelli inseriti in memoria
+    compress_cold(hist, 0, hist->len);
+
+    return 1;
+}
+
+
+/**
+ * @function delivered_spilled_history
+ * @brief Ritorna i byte dei messaggi già consegnati nella parte della history
+ *        scaricata su disco (che si possono liberare solo ricaricandola)
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return byte dei messaggi, 0 se non ce ne sono o in caso di errore
+ */
+size_t delivered_spilled_history(history_t *hist) {
+    if (hist == NULL || hist->size == 0) return 0;
+
+    unsigned int nrec = 0, total = 0;
+    spill_ref_t *recs = read_chain(hist, &nrec, &total);
+    if (recs == NULL) return 0;
+
+    size_t dbytes = 0;
+    for (unsigned int i = 0; i < nrec; i++) dbytes += recs[i].dbytes;
+    free(recs);
+
+    return dbytes;
+}
+
+
+/**
+ * @function dump_history
+ * @brief Scrive su fp tutta la history (anche la parte scaricata su disco)
+ *        senza modificarla
+ *
+ * @param hist  puntatore alla history
+ * @param fp    file in cui scrivere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int dump_history(history_t *hist, FILE *fp) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "dump_history", -1);
+    err_check_return(fp == NULL, EINVAL, "dump_history", -1);
+
+    //il record su disco più recente dice quanti messaggi ci sono
+    unsigned int nrec = 0, total = 0;
+    spill_ref_t *recs = NULL;
+    if (hist->size > 0) {
+        recs = read_chain(hist, &nrec, &total);
+        if (recs == NULL) return -1;
+    }
+
+    spill_rec_t rhdr = { SPILL_MAGIC, total + hist->len, hist->next_seq };
+    if (fwrite(&rhdr, sizeof(spill_rec_t), 1, fp) != 1) {
+        free(recs);
+        return -1;
+    }
+
+    //i messaggi dei record su disco hanno lo stesso formato: li copio così come sono,
+    //dal record più vecchio
+    if (recs != NULL) {
+        for (unsigned int r = nrec; r-- > 0; ) {
+            void *base = NULL;
+            size_t maplen = 0;
+            char *p = spill_map(hist->shard, recs[r].off, recs[r].size, &base, &maplen);
+            if (p == NULL) {
+                free(recs);
+                return -1;
+            }
+            size_t body = recs[r].size - SPILL_HEAD;
+            if (body > 0 && fwrite(p + SPILL_HEAD, body, 1, fp) != 1) {
+                spill_unmap(base, maplen);
+                free(recs);
+                return -1;
+            }
+            spill_unmap(base, maplen);
+        }
+        free(recs);
+    }
+
+    for (unsigned int i = 0; i < hist->len; i++) {
+        message_node_t *slot = get_history(hist, i);
+        message_t msg;
+        msg_history(slot, &msg);
+        spill_entry_t entry;
+        memset(&entry, 0, sizeof(spill_entry_t));
+        entry.hdr       = msg.hdr;
+        entry.dhdr      = msg.data.hdr;
+        entry.delivered = slot->delivered;
+        entry.seq       = slot->seq;
+        entry.expire    = slot->expire;
+        if (fwrite(&entry, sizeof(spill_entry_t), 1, fp) != 1) return -1;
+        if (entry.dhdr.len == 0) continue;
+        if (slot->zlen == 0) {
+            if (fwrite(slot->buf, entry.dhdr.len, 1, fp) != 1) return -1;
+            continue;
+        }
+
+        //nella snapshot i messaggi sono scritti non compressi
+        char *raw = malloc(entry.dhdr.len);
+        err_return_msg(raw,NULL,-1,"Errore: malloc\n");
+        if (unpack_slot(slot, raw) == -1 || fwrite(raw, entry.dhdr.len, 1, fp) != 1) {
+            free(raw);
+            errno = EIO;
+            return -1;
+        }
+        free(raw);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function undump_history
+ * @brief Aggiunge alla history i messaggi scritti su fp da dump_history
+ *
+ * @param hist  puntatore alla history (non scaricata su disco)
+ * @param fp    file da cui leggere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int undump_history(history_t *hist, FILE *fp) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "undump_history", -1);
+    err_check_return(fp == NULL, EINVAL, "undump_history", -1);
+    err_check_return(hist->size > 0, EINVAL, "undump_history", -1);
+
+    spill_rec_t rhdr;
+    if (fread(&rhdr, sizeof(spill_rec_t), 1, fp) != 1 || rhdr.magic != SPILL_MAGIC) {
+        errno = EIO;
+        return -1;
+    }
+    if (rhdr.next_seq > hist->next_seq) hist->next_seq = rhdr.next_seq;
+
+    for (unsigned int i = 0; i < rhdr.n; i++) {
+        spill_entry_t entry;
+        if (fread(&entry, sizeof(spill_entry_t), 1, fp) != 1) {
+            errno = EIO;
+            return -1;
+        }
+
+        char *buf = NULL;
+        if (entry.dhdr.len > 0) {
+            buf = malloc(entry.dhdr.len);
+            err_return_msg(buf,NULL,-1,"Errore: malloc\n");
+            if (fread(buf, entry.dhdr.len, 1, fp) != 1) {
+                free(buf);
+                errno = EIO;
+                return -1;
+            }
+        }
+
+        //history disabilitata: leggo comunque il messaggio
+        if (hist->cap == 0) {
+            if (buf != NULL) free(buf);
+            continue;
+        }
+        if (hist->slots == NULL) {
+            hist->slots = malloc(hist->cap * sizeof(message_node_t));
+            err_return_msg_clean(hist->slots,NULL,-1,"Errore: malloc\n",free(buf));
+        }
+        message_node_t node;
+        if (fill_slot(&node, &entry.hdr, &entry.dhdr, buf) == -1) {
+            if (buf != NULL) free(buf);
+            return -1;
+        }
+        node.delivered = entry.delivered;
+        node.seq       = entry.seq;
+        node.expire    = entry.expire;
+        push_slot(hist, &node);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function get_snapshot_history
+ * @brief Ritorna una copia dei messaggi in memoria della history, se la history non
+ *        è stata modificata dall'ultima copia creata viene riusata quella
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return puntatore alla copia, NULL ed errno settato in caso di errore
+ *
+ * @note: va chiamata con la lock dell'utente, la copia invece può essere letta
+ *        senza e va rilasciata con release_snapshot_history
+ */
+history_snap_t *get_snapshot_history(history_t *hist) {
+    //controllo gli argomenti
+    err_check_return(hist == NULL, EINVAL, "get_snapshot_history", NULL);
+
+    //riuso la copia in cache
+    if (hist->snap != NULL) {
+        __atomic_add_fetch(&hist->snap->refcount, 1, __ATOMIC_ACQ_REL);
+        return hist->snap;
+    }
+
+    //un'unica allocazione per struttura, slot e buffer dei dati
+    size_t size = sizeof(history_snap_t) + hist->len * sizeof(message_node_t);
+    for (unsigned int i = 0; i < hist->len; i++) size += get_history(hist, i)->len;
+
+    history_snap_t *snap = malloc(size);
+    err_return_msg(snap,NULL,NULL,"Errore: malloc\n");
+    snap->slots    = (message_node_t *)(snap + 1);
+    snap->len      = hist->len;
+    snap->refcount = 2;   //quello del chiamante e quello della cache
+
+    char *data = (char *)(snap->slots + hist->len);
+    for (unsigned int i = 0; i < hist->len; i++) {
+        message_node_t *slot = get_history(hist, i);
+        if (slot->len > 0) {
+            //i messaggi compressi vengono decompressi solo qui
+            if (unpack_slot(slot, data) == -1) {
+                snap->len = i;
+                free_snap(snap);
+                errno = EIO;
+                return NULL;
+            }
+        }
+        //la copia può sopravvivere ai messaggi: ha i suoi riferimenti ai nomi
+        snap->slots[i] = *slot;
+        snap->slots[i].zlen = 0;
+        snap->slots[i].buf  = (slot->len > 0) ? data : NULL;
+        data += slot->len;
+        intern_ref(slot->sender);
+        intern_ref(slot->receiver);
+    }
+
+    hist->snap = snap;
+    return snap;
+}
+
+
+/**
+ * @function release_snapshot_history
+ * @brief Rilascia un riferimento alla copia, che viene liberata quando non
+ *        è più referenziata
+ *
+ * @param snap  copia da rilasciare
+ */
+void release_snapshot_history(history_snap_t *snap) {
+    if (snap == NULL) return;
+    if (__atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL) == 0) free_snap(snap);
+}
+
+
+/**
+ * @function set_delivered_history
+ * @brief Segna come consegnati i messaggi con numero di sequenza tra first e last
+ *        (compresi) ancora presenti nella history
+ *
+ * @param hist   puntatore alla history
+ * @param first  primo numero di sequenza
+ * @param last   ultimo numero di sequenza
+ */
+void set_delivered_history(history_t *hist, unsigned long first, unsigned long last) {
+    if (hist == NULL) return;
+
+    int changed = 0;
+    for (unsigned int i = 0; i < hist->len; i++) {
+        message_node_t *slot = get_history(hist, i);
+        if (slot->seq < first || slot->seq > last || slot->delivered) continue;
+        slot->delivered = 1;
+        changed = 1;
+
+        //un messaggio consegnato oltre i compress_age più recenti può essere compresso
+        compress_cold(hist, i, i + 1);
+    }
+
+    //la copia in cache ha i vecchi valori di delivered
+    if (changed) drop_snap(hist);
+}
+
+
+/**
+ * @function expire_history
+ * @brief Elimina dalla history in memoria i messaggi scaduti (expire <= now), se la
+ *        history rimane vuota vengono liberati anche gli slot
+ *
+ * @param hist  puntatore alla history
+ * @param now   istante corrente
+ * @param out   messaggi eliminati e memoria liberata (vengono sommati ai valori presenti)
+ *
+ * @return numero di messaggi eliminati
+ */
+unsigned int expire_history(history_t *hist, time_t now, history_expired_t *out) {
+    if (hist == NULL || out == NULL) return 0;
+
+    drop_t d = { DROP_EXPIRED, now, 0 };
+    return drop_slots(hist, &d, out);
+}
+
+
+/**
+ * @function evict_history
+ * @brief Elimina dalla history in memoria i messaggi già consegnati, dal più vecchio,
+ *        finchè i byte dei messaggi non scendono a target (quelli da consegnare
+ *        non vengono mai eliminati)
+ *
+ * @param hist    puntatore alla history
+ * @param target  byte a cui portare la history
+ * @param out     messaggi eliminati e memoria liberata (vengono sommati ai valori presenti)
+ *
+ * @return numero di messaggi eliminati
+ *
+ * @note: i messaggi scaricati su disco contano nei byte della history ma non vengono
+ *        eliminati (vedi delivered_spilled_history)
+ */
+unsigned int evict_history(history_t *hist, size_t target, history_expired_t *out) {
+    if (hist == NULL || out == NULL || hist->bytes <= target) return 0;
+
+    drop_t d = { DROP_DELIVERED, 0, hist->bytes - target };
+    return drop_slots(hist, &d, out);
+}
+
+
+/**
+ * @function total_bytes_history
+ * @brief Ritorna i byte dei dati dei messaggi in tutte le history (in memoria e su disco)
+ */
+size_t total_bytes_history() {
+    return __atomic_load_n(&total_bytes, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @function next_expire_history
+ * @brief Ritorna il primo istante in cui scade un messaggio della history in memoria
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return istante, 0 se nessun messaggio ha una scadenza
+ */
+time_t next_expire_history(history_t *hist) {
+    if (hist == NULL) return 0;
+
+    time_t next = 0;
+    for (unsigned int i = 0; i < hist->len; i++) {
+        time_t e = get_history(hist, i)->expire;
+        if (e != 0 && (next == 0 || e < next)) next = e;
+    }
+
+    return next;
+}
+
+
+/**
+ * @function set_compress_history
+ * @brief Fissa quanti messaggi più recenti di ogni history restano non compressi
+ *
+ * @param age  numero di messaggi (0 = i messaggi non vengono mai compressi)
+ *
+ * @note: va chiamata prima che vengano inseriti messaggi nelle history
+ */
+void set_compress_history(unsigned int age) {
+    compress_age = age;
+}
+
+
+/**
+ * @function compress_stats_history
+ * @brief Ritorna i dati sulla compressione dei messaggi in tutte le history
+ *
+ * @param out  byte originali e compressi dei messaggi compressi in memoria e tempo
+ *             di cpu speso per comprimere e decomprimere
+ */
+void compress_stats_history(history_zstats_t *out) {
+    if (out == NULL) return;
+    out->raw   = __atomic_load_n(&zraw, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&zbytes, __ATOMIC_RELAXED);
+    out->usec  = __atomic_load_n(&znsec, __ATOMIC_RELAXED) / 1000;
+}
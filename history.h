@@ -0,0 +1,382 @@
+/**
+ * @file history.h
+ * @brief File per la gestione della history dei messaggi di un utente: un buffer
+ *        circolare di capacità fissa (MaxHistMsgs) allocato al primo messaggio.
+ *        Inserimenti ed eliminazioni del messaggio più vecchio non allocano memoria.
+ *        La history di un utente offline può essere scaricata su disco (spill.h)
+ *        e viene ricaricata quando l'utente torna online. I messaggi testuali già
+ *        consegnati che non sono tra gli HistCompressAge più recenti vengono compressi
+ *        in memoria (lz.h) e decompressi solo nelle copie lette da GETPREVMSGS.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdio.h>
+#include <message.h>
+#include <spill.h>
+
+//messaggi arrivati ad un utente offline oltre i quali vengono aggiunti su disco (in un
+//nuovo record collegato al precedente)
+#define  SPILL_BATCH     8
+
+//superato il limite globale dei byte nelle history (MaxHistBytes) si liberano messaggi
+//fino a scendere sotto HIST_BYTES_LOW, la liberazione parte oltre HIST_BYTES_HIGH
+#define  HIST_BYTES_LOW(cap)    ((cap) - (cap) / 8)
+#define  HIST_BYTES_HIGH(cap)   ((cap) - (cap) / 16)
+
+//lunghezza minima di un messaggio perchè venga compresso
+#define  HIST_COMPRESS_MIN      64
+
+
+/**
+ * @struct history_snap_t
+ * @brief Copia dei messaggi della history che può essere letta (ed inviata) senza
+ *        la lock dell'utente
+ *
+ * @var slots     copia dei messaggi, dal più vecchio (i buffer dei dati sono
+ *                allocati insieme agli slot, i nomi hanno i loro riferimenti)
+ * @var len       numero di messaggi
+ * @var refcount  numero di riferimenti alla copia (la history ne mantiene uno
+ *                finchè la copia è quella in cache)
+ */
+typedef struct {
+    message_node_t  *slots;
+    unsigned int    len;
+    int             refcount;
+} history_snap_t;
+
+
+/**
+ * @struct history_expired_t
+ * @brief Messaggi eliminati da expire_history o evict_history (per le statistiche)
+ *
+ * @var msgs              messaggi testuali eliminati
+ * @var files             messaggi files eliminati
+ * @var notdelivered      messaggi testuali eliminati prima di essere consegnati
+ * @var filenotdelivered  messaggi files eliminati prima di essere consegnati
+ * @var bytes             memoria liberata (buffer dei dati ed eventualmente slot)
+ */
+typedef struct {
+    unsigned long  msgs;
+    unsigned long  files;
+    unsigned long  notdelivered;
+    unsigned long  filenotdelivered;
+    size_t         bytes;
+} history_expired_t;
+
+
+/**
+ * @struct history_zstats_t
+ * @brief Dati sulla compressione dei messaggi (per le statistiche)
+ *
+ * @var raw    byte originali dei messaggi compressi in memoria
+ * @var bytes  byte occupati dagli stessi messaggi compressi
+ * @var usec   tempo di cpu speso per comprimere e decomprimere (microsecondi)
+ */
+typedef struct {
+    size_t         raw;
+    size_t         bytes;
+    unsigned long  usec;
+} history_zstats_t;
+
+
+/**
+ * @struct history_t
+ * @brief History dei messaggi di un utente
+ *
+ * @var slots  vettore circolare degli slot (NULL finchè non arriva il primo messaggio)
+ * @var cap    numero massimo di messaggi nella history
+ * @var head   indice dello slot con il messaggio più vecchio
+ * @var len    numero di messaggi nella history
+ * @var shard  segmento su disco in cui è scaricata la history
+ * @var off    offset del record più recente nel segmento (ogni record contiene l'offset
+ *             del precedente)
+ * @var size   lunghezza del record più recente (0 = niente su disco)
+ * @var next_seq  numero di sequenza che verrà assegnato al prossimo messaggio (parte da 1
+ *                e cresce sempre, anche quando i messaggi più vecchi vengono eliminati)
+ * @var snap      ultima copia creata con get_snapshot_history (riusata finchè la
+ *                history non viene modificata)
+ * @var bytes     byte dei dati dei messaggi, in memoria (compressi se lo sono) e su
+ *                disco (non compressi); sono sommati anche nel totale di tutte le
+ *                history, vedi total_bytes_history
+ */
+typedef struct {
+    message_node_t  *slots;
+    unsigned int    cap;
+    unsigned int    head;
+    unsigned int    len;
+    unsigned int    shard;
+    off_t           off;
+    size_t          size;
+    unsigned long   next_seq;
+    history_snap_t  *snap;
+    size_t          bytes;
+} history_t;
+
+
+
+/* ---------------------- interfaccia history  --------------------- */
+
+/**
+ * @function init_history
+ * @brief Inizializza la history (gli slot vengono allocati al primo messaggio)
+ *
+ * @param hist  puntatore alla history
+ * @param cap   numero massimo di messaggi nella history
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int init_history(history_t *hist, unsigned int cap);
+
+
+/**
+ * @function clean_history
+ * @brief Libera la memoria allocata per la history e per i messaggi contenuti
+ *
+ * @param hist  puntatore alla history
+ */
+void clean_history(history_t *hist);
+
+
+/**
+ * @function add_history
+ * @brief Aggiunge un messaggio in fondo alla history, se è piena viene eliminato
+ *        il messaggio più vecchio. Al messaggio viene assegnato il numero di sequenza next_seq
+ *
+ * @param hist       puntatore alla history
+ * @param msg        messaggio da inserire
+ * @param delivered  0 = da consegnare, 1 = già consegnato
+ * @param expire     istante in cui il messaggio scade (0 = mai)
+ *
+ * @return 1 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: in caso di successo la history diventa proprietaria del buffer dei dati di msg
+ *        e la struttura msg viene liberata, in caso di errore msg non viene toccato
+ */
+int add_history(history_t *hist, message_t *msg, int delivered, time_t expire);
+
+
+/**
+ * @function msg_history
+ * @brief Ricostruisce il messaggio di uno slot della history: i nomi di mittente e
+ *        destinatario vengono presi dai loro id, il buffer dei dati resta quello
+ *        dello slot (non va liberato)
+ *
+ * @param slot  slot della history
+ * @param msg   vi viene scritto il messaggio
+ */
+void msg_history(message_node_t *slot, message_t *msg);
+
+
+/**
+ * @function spill_history
+ * @brief Scarica su disco i messaggi in memoria della history e libera la memoria che
+ *        occupavano: vengono scritti in un nuovo record collegato a quello già su disco,
+ *        ed i record più vecchi che contengono solo messaggi oltre la capacità della
+ *        history vengono rilasciati
+ *
+ * @param hist  puntatore alla history
+ * @param key   chiave che sceglie il segmento su disco (nome dell'utente)
+ *
+ * @return 1 se la history è stata scaricata, 0 se non c'era niente da scaricare o se
+ *         i segmenti non sono inizializzati, -1 ed errno settato in caso di errore
+ */
+int spill_history(history_t *hist, const char *key);
+
+
+/**
+ * @function load_history
+ * @brief Riporta in memoria la parte della history scaricata su disco, i messaggi
+ *        arrivati nel frattempo vengono messi dopo quelli su disco
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return 1 se è stato caricato un record, 0 se non c'era niente su disco,
+ *         -1 ed errno settato in caso di errore (la history non viene modificata)
+ */
+int load_history(history_t *hist);
+
+
+/**
+ * @function dump_history
+ * @brief Scrive su fp tutta la history (anche la parte scaricata su disco)
+ *        senza modificarla
+ *
+ * @param hist  puntatore alla history
+ * @param fp    file in cui scrivere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int dump_history(history_t *hist, FILE *fp);
+
+
+/**
+ * @function undump_history
+ * @brief Aggiunge alla history i messaggi scritti su fp da dump_history
+ *
+ * @param hist  puntatore alla history (non scaricata su disco)
+ * @param fp    file da cui leggere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int undump_history(history_t *hist, FILE *fp);
+
+
+/**
+ * @function get_snapshot_history
+ * @brief Ritorna una copia dei messaggi in memoria della history, se la history non
+ *        è stata modificata dall'ultima copia creata viene riusata quella
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return puntatore alla copia, NULL ed errno settato in caso di errore
+ *
+ * @note: va chiamata con la lock dell'utente, la copia invece può essere letta
+ *        senza e va rilasciata con release_snapshot_history
+ */
+history_snap_t *get_snapshot_history(history_t *hist);
+
+
+/**
+ * @function release_snapshot_history
+ * @brief Rilascia un riferimento alla copia, che viene liberata quando non
+ *        è più referenziata
+ *
+ * @param snap  copia da rilasciare
+ */
+void release_snapshot_history(history_snap_t *snap);
+
+
+/**
+ * @function set_delivered_history
+ * @brief Segna come consegnati i messaggi con numero di sequenza tra first e last
+ *        (compresi) ancora presenti nella history
+ *
+ * @param hist   puntatore alla history
+ * @param first  primo numero di sequenza
+ * @param last   ultimo numero di sequenza
+ */
+void set_delivered_history(history_t *hist, unsigned long first, unsigned long last);
+
+
+/**
+ * @function expire_history
+ * @brief Elimina dalla history in memoria i messaggi scaduti (expire <= now), se la
+ *        history rimane vuota vengono liberati anche gli slot
+ *
+ * @param hist  puntatore alla history
+ * @param now   istante corrente
+ * @param out   messaggi eliminati e memoria liberata (vengono sommati ai valori presenti)
+ *
+ * @return numero di messaggi eliminati
+ */
+unsigned int expire_history(history_t *hist, time_t now, history_expired_t *out);
+
+
+/**
+ * @function evict_history
+ * @brief Elimina dalla history in memoria i messaggi già consegnati, dal più vecchio,
+ *        finchè i byte dei messaggi non scendono a target (quelli da consegnare
+ *        non vengono mai eliminati)
+ *
+ * @param hist    puntatore alla history
+ * @param target  byte a cui portare la history
+ * @param out     messaggi eliminati e memoria liberata (vengono sommati ai valori presenti)
+ *
+ * @return numero di messaggi eliminati
+ *
+ * @note: i messaggi scaricati su disco contano nei byte della history ma non vengono
+ *        eliminati (vedi delivered_spilled_history)
+ */
+unsigned int evict_history(history_t *hist, size_t target, history_expired_t *out);
+
+
+/**
+ * @function delivered_spilled_history
+ * @brief Ritorna i byte dei messaggi già consegnati nella parte della history
+ *        scaricata su disco (che si possono liberare solo ricaricandola)
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return byte dei messaggi, 0 se non ce ne sono o in caso di errore
+ */
+size_t delivered_spilled_history(history_t *hist);
+
+
+/**
+ * @function total_bytes_history
+ * @brief Ritorna i byte dei dati dei messaggi in tutte le history (in memoria e su disco)
+ */
+size_t total_bytes_history();
+
+
+/**
+ * @function set_compress_history
+ * @brief Fissa quanti messaggi più recenti di ogni history restano non compressi
+ *
+ * @param age  numero di messaggi (0 = i messaggi non vengono mai compressi)
+ *
+ * @note: va chiamata prima che vengano inseriti messaggi nelle history
+ */
+void set_compress_history(unsigned int age);
+
+
+/**
+ * @function compress_stats_history
+ * @brief Ritorna i dati sulla compressione dei messaggi in tutte le history
+ *
+ * @param out  byte originali e compressi dei messaggi compressi in memoria e tempo
+ *             di cpu speso per comprimere e decomprimere
+ */
+void compress_stats_history(history_zstats_t *out);
+
+
+/**
+ * @function next_expire_history
+ * @brief Ritorna il primo istante in cui scade un messaggio della history in memoria
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return istante, 0 se nessun messaggio ha una scadenza
+ */
+time_t next_expire_history(history_t *hist);
+
+
+/**
+ * @function len_history
+ * @brief Ritorna il numero di messaggi nella history
+ *
+ * @param hist  puntatore alla history
+ *
+ * @return numero di messaggi
+ *
+ * @note: conta solo i messaggi in memoria (vedi load_history)
+ */
+static inline unsigned int len_history(history_t *hist) {
+    return hist->len;
+}
+
+
+/**
+ * @function get_history
+ * @brief Ritorna l'i-esimo messaggio della history (0 = il più vecchio)
+ *
+ * @param hist  puntatore alla history
+ * @param i     indice del messaggio (minore di len_history)
+ *
+ * @return puntatore allo slot del messaggio
+ *
+ * @note: i dati dei messaggi già consegnati possono essere compressi (zlen != 0),
+ *        quelli da consegnare non lo sono mai
+ */
+static inline message_node_t *get_history(history_t *hist, unsigned int i) {
+    unsigned int ind = hist->head + i;
+    if (ind >= hist->cap) ind -= hist->cap;
+    return &hist->slots[ind];
+}
+
+
+#endif /* HISTORY_H_ */
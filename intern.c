@@ -0,0 +1,451 @@
+/**
+ * @file intern.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in intern.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <error_handler.h>
+#include <intern.h>
+#include <epoch.h>
+
+
+/**
+ * @struct intern_index_t
+ * @brief Indice per nome (indirizzamento aperto con scansione lineare)
+ *
+ * @var cap    numero di slot (potenza di 2, almeno il doppio dei nomi e delle lapidi)
+ * @var slots  id dei nomi, 0 = slot vuoto, INTERN_TOMB = nome liberato (lapide)
+ */
+typedef struct {
+    unsigned int  cap;
+    unsigned int  slots[];
+} intern_index_t;
+
+//un nome nella tabella
+typedef char intern_name_t[MAX_NAME_LENGTH+1];
+
+#define  INTERN_CHUNK_SIZE   (1U << INTERN_CHUNK_BITS)
+#define  INTERN_CHUNK_MASK   (INTERN_CHUNK_SIZE - 1)
+
+//slot dell'indice di un nome liberato (la scansione dei lettori prosegue)
+#define  INTERN_TOMB         0xFFFFFFFFU
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//blocchi dei nomi: il nome con id i è chunks[i >> INTERN_CHUNK_BITS][i & INTERN_CHUNK_MASK]
+static intern_name_t *chunks[INTERN_CHUNKS];
+
+//riferimenti ai nomi, negli stessi blocchi: 0 = id libero
+static unsigned int *refs[INTERN_CHUNKS];
+
+//indice per nome
+static intern_index_t *index_names = NULL;
+
+//primo id mai assegnato (l'id 0 non viene assegnato)
+static unsigned int next_id = 1;
+
+//nomi con almeno un riferimento e lapidi nell'indice
+static unsigned int nlive = 0;
+static unsigned int ntombs = 0;
+
+//mutex per gli inserimenti e per il rilascio dell'ultimo riferimento
+static pthread_mutex_t mtx_intern = PTHREAD_MUTEX_INITIALIZER;
+
+//id liberati e riusabili (nessun lettore senza lock può più vederli), con la loro
+//mutex: recycle_id viene chiamata da epoch_retire anche con mtx_intern presa
+static unsigned int *free_ids = NULL;
+static unsigned int nfree = 0, capfree = 0;
+static pthread_mutex_t mtx_free = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function name_hash
+ * @brief Hash del nome (djb2 sui primi MAX_NAME_LENGTH caratteri, come typed_namecmp)
+ */
+static inline unsigned int name_hash(const char *str) {
+    unsigned int hash = 5381;
+    int c, n = 0;
+
+    while (n++ < MAX_NAME_LENGTH && (c = *str++) != 0) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+
+    return hash;
+}
+
+
+/**
+ * @function name_of
+ * @brief Ritorna il nome con un certo id (l'id deve essere già stato assegnato)
+ */
+static inline const char *name_of(unsigned int id) {
+    intern_name_t *chunk = __atomic_load_n(&chunks[id >> INTERN_CHUNK_BITS], __ATOMIC_ACQUIRE);
+    return chunk[id & INTERN_CHUNK_MASK];
+}
+
+
+/**
+ * @function refs_of
+ * @brief Ritorna il contatore dei riferimenti del nome con un certo id
+ */
+static inline unsigned int *refs_of(unsigned int id) {
+    return &refs[id >> INTERN_CHUNK_BITS][id & INTERN_CHUNK_MASK];
+}
+
+
+/**
+ * @function ref_unless_zero
+ * @brief Prende un riferimento al nome se ne ha ancora almeno uno (senza lock,
+ *        l'ultimo riferimento viene rilasciato solo con mtx_intern)
+ *
+ * @return 1 se il riferimento è stato preso, 0 se il nome è stato liberato
+ */
+static int ref_unless_zero(unsigned int id) {
+    unsigned int *r = refs_of(id);
+    unsigned int n = __atomic_load_n(r, __ATOMIC_ACQUIRE);
+
+    while (n != 0) {
+        if (__atomic_compare_exchange_n(r, &n, n + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function probe
+ * @brief Cerca un nome nell'indice
+ *
+ * @param slot  se diverso da NULL vi viene scritto lo slot del nome
+ *
+ * @return id del nome, 0 se non presente
+ */
+static unsigned int probe(intern_index_t *idx, const char *name, unsigned int hash, unsigned int *slot) {
+    if (idx == NULL) return 0;
+
+    unsigned int mask = idx->cap - 1;
+    for (unsigned int i = hash & mask; ; i = (i + 1) & mask) {
+        unsigned int id = __atomic_load_n(&idx->slots[i], __ATOMIC_ACQUIRE);
+        if (id == 0) return 0;
+        if (id == INTERN_TOMB) continue;
+        if (strncmp(name_of(id), name, MAX_NAME_LENGTH) == 0) {
+            if (slot != NULL) *slot = i;
+            return id;
+        }
+    }
+}
+
+
+/**
+ * @function rebuild_index
+ * @brief Sostituisce l'indice con uno senza lapidi, di capacità almeno doppia dei nomi
+ *        (i lettori senza lock possono ancora usare quello vecchio, che viene ritirato)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata con mtx_intern
+ */
+static int rebuild_index() {
+    unsigned int cap = INTERN_MIN_INDEX;
+    while (2 * (nlive + 1) > cap) cap *= 2;
+
+    intern_index_t *idx = calloc(1, sizeof(intern_index_t) + cap * sizeof(unsigned int));
+    err_return_msg(idx,NULL,-1,"Errore: calloc\n");
+    idx->cap = cap;
+
+    //gli id liberati non vengono reinseriti
+    for (unsigned int id = 1; id < next_id; id++) {
+        if (__atomic_load_n(refs_of(id), __ATOMIC_ACQUIRE) == 0) continue;
+        unsigned int i = name_hash(name_of(id)) & (cap - 1);
+        while (idx->slots[i] != 0) i = (i + 1) & (cap - 1);
+        idx->slots[i] = id;
+    }
+
+    intern_index_t *old = index_names;
+    __atomic_store_n(&index_names, idx, __ATOMIC_RELEASE);
+    ntombs = 0;
+    if (old != NULL && epoch_retire(old, free) == -1) return -1;
+
+    return 0;
+}
+
+
+/**
+ * @function recycle_id
+ * @brief Rende di nuovo assegnabile un id liberato (chiamata da epoch_retire quando
+ *        nessun lettore senza lock può più trovarlo nell'indice)
+ */
+static void recycle_id(void *data) {
+    unsigned int id = (unsigned int)(uintptr_t)data;
+
+    if (pthread_mutex_lock(&mtx_free) != 0) return;
+
+    if (nfree == capfree) {
+        unsigned int cap = (capfree == 0) ? INTERN_MIN_INDEX : 2 * capfree;
+        unsigned int *ids = realloc(free_ids, cap * sizeof(unsigned int));
+        //senza memoria l'id non viene più riusato
+        if (ids == NULL) {
+            pthread_mutex_unlock(&mtx_free);
+            return;
+        }
+        free_ids = ids;
+        capfree  = cap;
+    }
+    free_ids[nfree++] = id;
+
+    pthread_mutex_unlock(&mtx_free);
+}
+
+
+/**
+ * @function take_id
+ * @brief Ritorna un id da assegnare: uno liberato se ce ne sono, altrimenti next_id
+ *
+ * @return id, 0 ed errno settato se gli id sono finiti
+ *
+ * @note: va chiamata con mtx_intern
+ */
+static unsigned int take_id() {
+    unsigned int id = 0;
+
+    if (pthread_mutex_lock(&mtx_free) == 0) {
+        if (nfree > 0) id = free_ids[--nfree];
+        pthread_mutex_unlock(&mtx_free);
+    }
+    if (id != 0) return id;
+
+    err_check_return((next_id >> INTERN_CHUNK_BITS) >= INTERN_CHUNKS, ENOSPC, "intern_name", 0);
+    return next_id;
+}
+
+
+/**
+ * @function insert_name
+ * @brief Assegna un nuovo id al nome
+ *
+ * @return id del nome, 0 ed errno settato in caso di errore
+ *
+ * @note: va chiamata con mtx_intern, dopo aver controllato che il nome non ci sia
+ */
+static unsigned int insert_name(const char *name, unsigned int hash) {
+    //l'indice resta pieno (nomi e lapidi) al più per metà
+    if (index_names == NULL || 2 * (nlive + ntombs + 1) > index_names->cap) {
+        if (rebuild_index() == -1) return 0;
+    }
+
+    unsigned int id = take_id();
+    if (id == 0) return 0;
+    unsigned int c = id >> INTERN_CHUNK_BITS;
+
+    if (chunks[c] == NULL) {
+        intern_name_t *chunk = malloc(INTERN_CHUNK_SIZE * sizeof(intern_name_t));
+        err_return_msg(chunk,NULL,0,"Errore: malloc\n");
+        refs[c] = calloc(INTERN_CHUNK_SIZE, sizeof(unsigned int));
+        err_return_msg_clean(refs[c],NULL,0,"Errore: calloc\n",free(chunk));
+        __atomic_store_n(&chunks[c], chunk, __ATOMIC_RELEASE);
+    }
+
+    //il nome è scritto prima di essere raggiungibile dall'indice
+    char *dst = chunks[c][id & INTERN_CHUNK_MASK];
+    strncpy(dst, name, MAX_NAME_LENGTH);
+    dst[MAX_NAME_LENGTH] = '\0';
+    __atomic_store_n(refs_of(id), 1, __ATOMIC_RELEASE);
+    if (id == next_id) __atomic_store_n(&next_id, id + 1, __ATOMIC_RELEASE);
+    nlive++;
+
+    //il nuovo nome può prendere il posto di una lapide
+    unsigned int mask = index_names->cap - 1;
+    unsigned int i = hash & mask;
+    while (index_names->slots[i] != 0 && index_names->slots[i] != INTERN_TOMB) i = (i + 1) & mask;
+    if (index_names->slots[i] == INTERN_TOMB) ntombs--;
+    __atomic_store_n(&index_names->slots[i], id, __ATOMIC_RELEASE);
+
+    return id;
+}
+
+
+
+/* -------------------------- interfaccia intern ------------------------------ */
+
+
+/**
+ * @function intern_name
+ * @brief Ritorna l'id del nome prendendo un riferimento ad esso, assegnandone uno
+ *        nuovo se il nome non ne ha ancora
+ *
+ * @param name  nome (al più MAX_NAME_LENGTH caratteri)
+ *
+ * @return id del nome (> 0), 0 ed errno settato in caso di errore
+ */
+unsigned int intern_name(const char *name) {
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "intern_name", 0);
+
+    unsigned int hash = name_hash(name), id = 0;
+
+    //nome già presente: riferimento senza lock (se non sta per essere liberato)
+    if (epoch_enter() == 0) {
+        id = probe(__atomic_load_n(&index_names, __ATOMIC_ACQUIRE), name, hash, NULL);
+        if (id != 0 && !ref_unless_zero(id)) id = 0;
+        epoch_exit();
+        if (id != 0) return id;
+    }
+
+    int check = pthread_mutex_lock(&mtx_intern);
+    err_check_return(check != 0, check, "pthread_mutex_lock", 0);
+
+    //un altro thread può averlo inserito nel frattempo (con la lock i nomi
+    //nell'indice hanno almeno un riferimento)
+    id = probe(index_names, name, hash, NULL);
+    if (id != 0) __atomic_add_fetch(refs_of(id), 1, __ATOMIC_ACQ_REL);
+    else id = insert_name(name, hash);
+
+    int err = errno;
+    check = pthread_mutex_unlock(&mtx_intern);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", 0);
+    errno = err;
+
+    return id;
+}
+
+
+/**
+ * @function intern_ref
+ * @brief Prende un altro riferimento al nome con un certo id
+ *
+ * @param id  id del nome (il chiamante ne ha già un riferimento)
+ */
+void intern_ref(unsigned int id) {
+    if (id == 0) return;
+    __atomic_add_fetch(refs_of(id), 1, __ATOMIC_ACQ_REL);
+}
+
+
+/**
+ * @function intern_release
+ * @brief Rilascia un riferimento al nome con un certo id: con l'ultimo il nome
+ *        viene tolto dall'indice e l'id viene riusato quando nessun lettore senza
+ *        lock può più vederlo
+ *
+ * @param id  id del nome
+ */
+void intern_release(unsigned int id) {
+    if (id == 0) return;
+
+    //non è l'ultimo riferimento: senza lock
+    unsigned int *r = refs_of(id);
+    unsigned int n = __atomic_load_n(r, __ATOMIC_ACQUIRE);
+    while (n > 1) {
+        if (__atomic_compare_exchange_n(r, &n, n - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+    }
+
+    //l'ultimo riferimento si rilascia con la lock, intanto può esserne stato preso un altro
+    if (pthread_mutex_lock(&mtx_intern) != 0) {
+        perror("pthread_mutex_lock");
+        return;
+    }
+
+    int freed = 0;
+    if (__atomic_sub_fetch(r, 1, __ATOMIC_ACQ_REL) == 0) {
+        unsigned int slot = 0;
+        const char *name = name_of(id);
+        if (probe(index_names, name, name_hash(name), &slot) == id) {
+            __atomic_store_n(&index_names->slots[slot], INTERN_TOMB, __ATOMIC_RELEASE);
+            ntombs++;
+        }
+        nlive--;
+        freed = 1;
+    }
+
+    pthread_mutex_unlock(&mtx_intern);
+
+    //fuori da mtx_intern: epoch_retire può chiamare subito recycle_id
+    if (freed && epoch_retire((void *)(uintptr_t)id, recycle_id) == -1) {
+        perror("intern_release");
+    }
+}
+
+
+/**
+ * @function intern_find
+ * @brief Ritorna l'id del nome senza assegnarne uno nuovo e senza prendere riferimenti
+ *
+ * @param name  nome da cercare
+ *
+ * @return id del nome, 0 ed errno a 0 se il nome non ha un id, 0 ed errno settato
+ *         in caso di errore
+ */
+unsigned int intern_find(const char *name) {
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "intern_find", 0);
+
+    unsigned int hash = name_hash(name), id = 0;
+
+    //thread non registrato: ricerca con la lock
+    if (epoch_enter() == -1) {
+        int check = pthread_mutex_lock(&mtx_intern);
+        err_check_return(check != 0, check, "pthread_mutex_lock", 0);
+        id = probe(index_names, name, hash, NULL);
+        pthread_mutex_unlock(&mtx_intern);
+    }
+    else {
+        id = probe(__atomic_load_n(&index_names, __ATOMIC_ACQUIRE), name, hash, NULL);
+        epoch_exit();
+    }
+
+    errno = 0;
+    return id;
+}
+
+
+/**
+ * @function intern_str
+ * @brief Ritorna il nome con un certo id
+ *
+ * @param id  id del nome
+ *
+ * @return puntatore al nome (valido finchè il chiamante ne ha un riferimento), NULL
+ *         se l'id non è mai stato assegnato
+ */
+const char *intern_str(unsigned int id) {
+    if (id == 0 || id >= __atomic_load_n(&next_id, __ATOMIC_ACQUIRE)) return NULL;
+    return name_of(id);
+}
+
+
+/**
+ * @function intern_cleanup
+ * @brief Libera la tabella dei nomi
+ *
+ * @note: va chiamata alla terminazione, quando nessuno usa più gli id
+ */
+void intern_cleanup() {
+    for (unsigned int c = 0; c < INTERN_CHUNKS && chunks[c] != NULL; c++) {
+        free(chunks[c]);
+        free(refs[c]);
+        chunks[c] = NULL;
+        refs[c]   = NULL;
+    }
+    free(index_names);
+    index_names = NULL;
+    next_id = 1;
+    nlive   = 0;
+    ntombs  = 0;
+
+    free(free_ids);
+    free_ids = NULL;
+    nfree    = 0;
+    capfree  = 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file intern.h
+ * @brief File per la tabella dei nomi interni: ogni nome di utente o gruppo riceve
+ *        un id intero che resta lo stesso finchè qualcuno ha un riferimento al nome
+ *        (l'utente registrato, il creatore di un gruppo, i messaggi nelle history e
+ *        nelle loro copie). Le history, i membri dei gruppi ed il creatore dei gruppi
+ *        usano gli id; i nomi vengono ricostruiti solo quando i messaggi escono dal
+ *        server (client, snapshot, disco).
+ *
+ *        Le letture (intern_find, intern_str) sono senza lock: i nomi sono in blocchi
+ *        che non vengono mai spostati e l'indice per nome viene sostituito (e ritirato
+ *        con epoch_retire) quando cresce. Con l'ultimo riferimento il nome viene tolto
+ *        dall'indice ed il suo id viene riusato solo dopo epoch_retire, quando nessun
+ *        lettore senza lock può più vederlo.
+ *
+ *        Al più INTERN_CHUNKS << INTERN_CHUNK_BITS nomi possono avere un riferimento
+ *        nello stesso momento, oltre intern_name fallisce con ENOSPC.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <config.h>
+
+
+//nomi per blocco (2^INTERN_CHUNK_BITS) e numero massimo di blocchi
+#define  INTERN_CHUNK_BITS   10
+#define  INTERN_CHUNKS       65536
+
+//capacità iniziale dell'indice per nome (potenza di 2)
+#define  INTERN_MIN_INDEX    1024
+
+
+
+/* ---------------------- interfaccia intern  --------------------- */
+
+/**
+ * @function intern_name
+ * @brief Ritorna l'id del nome prendendo un riferimento ad esso, assegnandone uno
+ *        nuovo se il nome non ne ha ancora
+ *
+ * @param name  nome (al più MAX_NAME_LENGTH caratteri)
+ *
+ * @return id del nome (> 0), 0 ed errno settato in caso di errore
+ *
+ * @note: il riferimento va rilasciato con intern_release
+ */
+unsigned int intern_name(const char *name);
+
+
+/**
+ * @function intern_ref
+ * @brief Prende un altro riferimento al nome con un certo id
+ *
+ * @param id  id del nome (il chiamante ne ha già un riferimento)
+ */
+void intern_ref(unsigned int id);
+
+
+/**
+ * @function intern_release
+ * @brief Rilascia un riferimento al nome con un certo id: con l'ultimo il nome
+ *        viene tolto dall'indice e l'id viene riusato quando nessun lettore senza
+ *        lock può più vederlo
+ *
+ * @param id  id del nome
+ */
+void intern_release(unsigned int id);
+
+
+/**
+ * @function intern_find
+ * @brief Ritorna l'id del nome senza assegnarne uno nuovo e senza prendere riferimenti
+ *
+ * @param name  nome da cercare
+ *
+ * @return id del nome, 0 ed errno a 0 se il nome non ha un id, 0 ed errno settato
+ *         in caso di errore
+ */
+unsigned int intern_find(const char *name);
+
+
+/**
+ * @function intern_str
+ * @brief Ritorna il nome con un certo id
+ *
+ * @param id  id del nome
+ *
+ * @return puntatore al nome (valido finchè il chiamante ne ha un riferimento), NULL
+ *         se l'id non è mai stato assegnato
+ */
+const char *intern_str(unsigned int id);
+
+
+/**
+ * @function intern_cleanup
+ * @brief Libera la tabella dei nomi
+ *
+ * @note: va chiamata alla terminazione, quando nessuno usa più gli id
+ */
+void intern_cleanup();
+
+
+#endif /* INTERN_H_ */
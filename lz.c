@@ -0,0 +1,210 @@
+/**
+ * @file lz.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in lz.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <lz.h>
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function hash4
+ * @brief Hash dei 4 byte che iniziano in p
+ */
+static inline unsigned int hash4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+
+/**
+ * @function put_len
+ * @brief Scrive la parte di una lunghezza che non entra nel token (255 per byte)
+ *
+ * @return 0 in caso di successo, -1 se non c'è spazio in dst
+ */
+static int put_len(unsigned char **op, unsigned char *oend, size_t n) {
+    while (n >= 255) {
+        if (*op >= oend) return -1;
+        *(*op)++ = 255;
+        n -= 255;
+    }
+    if (*op >= oend) return -1;
+    *(*op)++ = (unsigned char)n;
+    return 0;
+}
+
+
+/**
+ * @function put_seq
+ * @brief Scrive una sequenza: lit letterali seguiti da una copia di mlen byte a
+ *        distanza off (mlen = 0 solo per l'ultima sequenza, senza copia)
+ *
+ * @return 0 in caso di successo, -1 se non c'è spazio in dst
+ */
+static int put_seq(unsigned char **op, unsigned char *oend, const unsigned char *lit,
+                   size_t nlit, size_t off, size_t mlen) {
+    size_t ml = (mlen > 0) ? mlen - LZ_MIN_MATCH : 0;
+
+    if (*op >= oend) return -1;
+    unsigned char *token = (*op)++;
+    *token = (unsigned char)(((nlit < 15) ? nlit : 15) << 4);
+    if (nlit >= 15 && put_len(op, oend, nlit - 15) == -1) return -1;
+
+    if ((size_t)(oend - *op) < nlit) return -1;
+    memcpy(*op, lit, nlit);
+    *op += nlit;
+
+    if (mlen == 0) return 0;
+
+    *token |= (unsigned char)((ml < 15) ? ml : 15);
+    if (oend - *op < 2) return -1;
+    *(*op)++ = (unsigned char)(off & 0xff);
+    *(*op)++ = (unsigned char)(off >> 8);
+    if (ml >= 15 && put_len(op, oend, ml - 15) == -1) return -1;
+
+    return 0;
+}
+
+
+/**
+ * @function get_len
+ * @brief Legge la parte di una lunghezza che non entra nel token
+ *
+ * @return 0 in caso di successo, -1 se i dati finiscono prima
+ */
+static int get_len(const unsigned char **ip, const unsigned char *iend, size_t *n) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+
+
+/* -------------------------- interfaccia lz ------------------------------ */
+
+
+/**
+ * @function lz_compress
+ * @brief Comprime len byte di src in dst
+ *
+ * @param src  dati da comprimere
+ * @param len  lunghezza di src
+ * @param dst  buffer in cui scrivere i dati compressi
+ * @param cap  lunghezza di dst
+ *
+ * @return lunghezza dei dati compressi, 0 se non entrano in cap byte
+ */
+size_t lz_compress(const char *src, size_t len, char *dst, size_t cap) {
+    if (src == NULL || dst == NULL || len == 0) return 0;
+
+    const unsigned char *in     = (const unsigned char *)src;
+    const unsigned char *ip     = in;
+    const unsigned char *anchor = in;
+    const unsigned char *end    = in + len;
+    unsigned char *op   = (unsigned char *)dst;
+    unsigned char *oend = op + cap;
+
+    //ultima posizione (+1) di ogni hash di 4 byte, 0 = nessuna
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    while (len >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+        unsigned int h = hash4(ip);
+        const unsigned char *ref = (table[h] != 0) ? in + table[h] - 1 : NULL;
+        table[h] = (uint32_t)(ip - in) + 1;
+
+        if (ref == NULL || ip - ref > LZ_MAX_OFFSET || memcmp(ref, ip, LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+
+        //allungo la copia più che posso
+        const unsigned char *m = ip + LZ_MIN_MATCH, *r = ref + LZ_MIN_MATCH;
+        while (m < end && *m == *r) {
+            m++;
+            r++;
+        }
+
+        if (put_seq(&op, oend, anchor, ip - anchor, ip - ref, m - ip) == -1) return 0;
+        ip = anchor = m;
+    }
+
+    //letterali rimasti
+    if (put_seq(&op, oend, anchor, end - anchor, 0, 0) == -1) return 0;
+
+    return op - (unsigned char *)dst;
+}
+
+
+/**
+ * @function lz_decompress
+ * @brief Decomprime len byte di src (scritti da lz_compress) in dst
+ *
+ * @param src   dati compressi
+ * @param len   lunghezza di src
+ * @param dst   buffer in cui scrivere i dati originali
+ * @param dlen  lunghezza dei dati originali
+ *
+ * @return 0 in caso di successo, -1 ed errno settato (EIO) se i dati compressi
+ *         non sono validi o non corrispondono a dlen byte
+ */
+int lz_decompress(const char *src, size_t len, char *dst, size_t dlen) {
+    if (src == NULL || dst == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const unsigned char *ip   = (const unsigned char *)src;
+    const unsigned char *iend = ip + len;
+    unsigned char *out  = (unsigned char *)dst;
+    unsigned char *op   = out;
+    unsigned char *oend = out + dlen;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+
+        //letterali
+        size_t nlit = token >> 4;
+        if (nlit == 15 && get_len(&ip, iend, &nlit) == -1) break;
+        if ((size_t)(iend - ip) < nlit || (size_t)(oend - op) < nlit) break;
+        memcpy(op, ip, nlit);
+        ip += nlit;
+        op += nlit;
+
+        //l'ultima sequenza non ha la copia
+        if (ip == iend) {
+            if (op == oend) return 0;
+            break;
+        }
+
+        //copia (può sovrapporsi ai byte che scrive: va fatta un byte alla volta)
+        if (iend - ip < 2) break;
+        size_t off = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && get_len(&ip, iend, &mlen) == -1) break;
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > (size_t)(op - out) || (size_t)(oend - op) < mlen) break;
+
+        const unsigned char *r = op - off;
+        for (size_t i = 0; i < mlen; i++) op[i] = r[i];
+        op += mlen;
+    }
+
+    errno = EIO;
+    return -1;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file lz.h
+ * @brief File per la compressione dei messaggi nelle history (vedi history.h). Il
+ *        formato è un LZ77 a byte (come i blocchi LZ4): ogni sequenza è un token con
+ *        le lunghezze dei letterali e della copia, i letterali e l'offset (2 byte)
+ *        della copia. Nessuna entropia: comprime e decomprime in poche decine di
+ *        nanosecondi per messaggio, a scapito del rapporto di compressione.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <stddef.h>
+
+
+//lunghezza minima di una copia
+#define  LZ_MIN_MATCH    4
+
+//distanza massima di una copia (l'offset è su 2 byte)
+#define  LZ_MAX_OFFSET   65535
+
+//bit della tabella hash usata per cercare le copie
+#define  LZ_HASH_BITS    12
+
+
+
+/* ---------------------- interfaccia lz  --------------------- */
+
+/**
+ * @function lz_compress
+ * @brief Comprime len byte di src in dst
+ *
+ * @param src  dati da comprimere
+ * @param len  lunghezza di src
+ * @param dst  buffer in cui scrivere i dati compressi
+ * @param cap  lunghezza di dst
+ *
+ * @return lunghezza dei dati compressi, 0 se non entrano in cap byte
+ */
+size_t lz_compress(const char *src, size_t len, char *dst, size_t cap);
+
+
+/**
+ * @function lz_decompress
+ * @brief Decomprime len byte di src (scritti da lz_compress) in dst
+ *
+ * @param src   dati compressi
+ * @param len   lunghezza di src
+ * @param dst   buffer in cui scrivere i dati originali
+ * @param dlen  lunghezza dei dati originali
+ *
+ * @return 0 in caso di successo, -1 ed errno settato (EIO) se i dati compressi
+ *         non sono validi o non corrispondono a dlen byte
+ */
+int lz_decompress(const char *src, size_t len, char *dst, size_t dlen);
+
+
+#endif /* LZ_H_ */
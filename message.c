@@ -7,6 +7,8 @@
  */
 #include <message.h>
 #include <connections.h>
+#include <history.h>
+#include <slab.h>
 
 
 /**
@@ -23,14 +25,14 @@ message_t *duplicate_msg(message_t *msg, op_t op) {
     err_check_return(msg == NULL,  EINVAL, "duplicate_msg", NULL);
 
     //alloco la memoria per il duplicato
-    message_t *msg_dup = malloc(sizeof(message_t));
-    err_return_msg(msg_dup,NULL,NULL,"Errore: malloc\n");
+    message_t *msg_dup = slab_alloc(SLAB_MSG);
+    err_return_msg(msg_dup,NULL,NULL,"Errore: slab_alloc\n");
 
     //copio il buffer dei dati
-    char *buff_data = malloc(sizeof(char)*(msg->data.hdr.len));
+    char *buff_data = slab_alloc_buf(sizeof(char)*(msg->data.hdr.len));
     if (buff_data == NULL){
-        fprintf(stderr, "Errore: malloc\n");
-        free(msg);
+        fprintf(stderr, "Errore: slab_alloc_buf\n");
+        slab_free(msg_dup);
         return NULL;
     }
     strncpy(buff_data, msg->data.buf, msg->data.hdr.len);
@@ -57,48 +59,9 @@ message_t *duplicate_msg(message_t *msg, op_t op) {
  */
 void free_msg(message_t *msg) {
     if (msg == NULL) return;
-    if (msg->data.buf != NULL) free(msg->data.buf);
-    free(msg);
-}
-
-
-/**
- * @function clean_msg_node
- * @brief Libera la memoria allocata per il nodo della lista messaggi
- * 
- * @param msg_node nodo della lista messaggi da cancellare
- */
-void clean_msg_node(void *node) {
-    if (node == NULL) return;
-    message_node_t *msg_node = (message_node_t *)node;
-    if (msg_node->msg != NULL) free_msg(msg_node->msg);
-    free(msg_node);
-}
-
-
-/**
- * @function init_msg_node
- * @brief Inizializza un struttura 'message_node_t'
- * 
- * @param msg        messaggio da inserire nel nodo 
- * @param delivere   variabile per le statistiche (0 = da consegnare, 1 = già consegnato)
- * 
- * @return p puntatore alla nuova struttura, NULL in caso di fallimento
- */
-message_node_t *init_msg_node(message_t *msg, int delivered){
-    //controllo gli argomenti
-    err_check_return(msg == NULL, EINVAL, "init_msg_node", NULL);
-    err_check_return(delivered != 0 && delivered != 1, EINVAL, "init_msg_node", NULL);
-
-    //alloco la memoria per la struttura 'message_node_t'
-    message_node_t *msg_node = malloc(sizeof(message_node_t));
-    err_return_msg(msg_node,NULL,NULL,"Errore: malloc\n");
-
-    //inizializzo i parametri della lista
-    msg_node->msg = msg;
-    msg_node->delivered = delivered;
-
-    return msg_node;
+    //messaggio e buffer possono venire dalle slab (vedi slab_free)
+    slab_free(msg->data.buf);
+    slab_free(msg);
 }
 
 
@@ -132,7 +95,7 @@ param_send_msgs_t *init_param_send_msgs(long fd){
  * @function send_list_msgs
  * @brief Invia il messaggio presente in node all'fd specificato in param
  *        
- * @param us      puntatore al nodo contenente il messaggio da inviare
+ * @param node    puntatore allo slot della history contenente il messaggio da inviare
  * @param param   struttura in cui ci sono i dati da aggiornare/usare per la funzione
  * 
  * @return 0 in caso di successo, -1 in caso di errore
@@ -148,16 +111,18 @@ int send_list_msgs(void *node, void *param){
     //se l'fd si è disconnesso non spedisco niente
     if (prm->disconnected == 1) return 0;
 
-    //invio il messaggio in 'msg_node'
-    int check = sendMsg_toClient(prm->fd, msg_node->msg);
+    //invio il messaggio in 'msg_node' (con i nomi ricostruiti dagli id)
+    message_t msg;
+    msg_history(msg_node, &msg);
+    int check = sendMsg_toClient(prm->fd, &msg);
     //se l'invio del messaggio è avvenuto correttamente
     if (check == 1) {
         //se ancora non era mai stato consegnato
         if (msg_node->delivered == 0){
             msg_node->delivered = 1;
             //aggiorno i contatori passati da parametro
-            if (msg_node->msg->hdr.op == TXT_MESSAGE) prm->msgsdelivered++;
-            else if (msg_node->msg->hdr.op == FILE_MESSAGE) prm->filesdelivered++;
+            if (msg_node->op == TXT_MESSAGE) prm->msgsdelivered++;
+            else if (msg_node->op == FILE_MESSAGE) prm->filesdelivered++;
         }
     }
     //se si è disconnesso il client 
@@ -14,6 +14,7 @@
 #include <ops.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <error_handler.h>
 
@@ -77,17 +78,64 @@ typedef struct {
 
 /**
  * @struct message_node_t
- * @brief Nodo della lista messaggi degli utenti
+ * @brief Slot della history messaggi degli utenti (vedi history.h): mittente e
+ *        destinatario sono gli id dei loro nomi (vedi intern.h), l'header del
+ *        messaggio viene ricostruito solo per l'invio (msg_history)
  * 
- * @var msg         puntatore al messaggio
+ * @var op          tipo del messaggio
+ * @var sender      id del nome del mittente
+ * @var receiver    id del nome del destinatario (utente o gruppo)
+ * @var len         lunghezza dei dati del messaggio
+ * @var buf         buffer dei dati
  * @var delivered   variabile per le statistiche (0 = da consegnare, 1 = già consegnato)
+ * @var zlen        lunghezza dei dati compressi nel buffer (0 = dati non compressi, vedi
+ *                  HistCompressAge in history.h)
+ * @var seq         numero di sequenza del messaggio nella history dell'utente
+ * @var expire      istante in cui il messaggio scade e viene eliminato (0 = mai, vedi ttl.h)
  */
 typedef struct {
-    message_t   *msg;
-    int         delivered;
+    op_t           op;
+    unsigned int   sender;
+    unsigned int   receiver;
+    unsigned int   len;
+    char           *buf;
+    int            delivered;
+    unsigned int   zlen;
+    unsigned long  seq;
+    time_t         expire;
 } message_node_t;
 
 
+/**
+ * @struct prevmsgs_req_t
+ * @brief Cursore della richiesta GETPREVMSGS_SINCE_OP, inviato dal client come
+ *        stringa "since:page" (":page" può mancare)
+ * 
+ * @var since  numero di sequenza dell'ultimo messaggio già ricevuto (0 = tutta la history)
+ * @var page   numero massimo di messaggi da ricevere (0 = nessun limite)
+ */
+typedef struct {
+    unsigned long  since;
+    unsigned long  page;
+} prevmsgs_req_t;
+
+
+/**
+ * @struct prevmsgs_reply_t
+ * @brief Dati della risposta (OP_OK) a GETPREVMSGS_SINCE_OP, a cui seguono n messaggi
+ * 
+ * @var n     numero di messaggi che seguono la risposta (primo campo, come la
+ *            risposta a GETPREVMSGS_OP)
+ * @var next  cursore da passare come since alla richiesta successiva
+ * @var more  1 se nella history ci sono altri messaggi dopo quelli inviati
+ */
+typedef struct {
+    size_t         n;
+    unsigned long  next;
+    unsigned long  more;
+} prevmsgs_reply_t;
+
+
 /**
  * @struct param_send_msgs_t
  * @brief Struttura dati per i parametri della funzione 'send_msgs'
@@ -163,27 +211,6 @@ message_t *duplicate_msg(message_t *msg, op_t op);
 void free_msg(message_t *msg);
 
 
-/**
- * @function clean_msg_node
- * @brief Libera la memoria allocata per il nodo della lista messaggi
- * 
- * @param msg_node nodo della lista messaggi da cancellare
- */
-void clean_msg_node(void *node);
-
-
-/**
- * @function init_msg_node
- * @brief Inizializza un struttura 'message_node_t'
- * 
- * @param msg        messaggio da inserire nel nodo 
- * @param delivere   variabile per le statistiche (0 = da consegnare, 1 = già consegnato)
- * 
- * @return p puntatore alla nuova struttura, NULL in caso di fallimento
- */
-message_node_t *init_msg_node(message_t *msg, int delivered);
-
-
 /**
  * @function init_param_send_msgs
  * @brief Inizializza un struttura 'param_send_msgs_t'
@@ -199,7 +226,7 @@ param_send_msgs_t *init_param_send_msgs(long fd);
  * @function send_list_msgs
  * @brief Invia il messaggio presente in node all'fd specificato in param
  *        
- * @param us      puntatore al nodo contenente il messaggio da inviare
+ * @param node    puntatore allo slot della history contenente il messaggio da inviare
  * @param param   struttura in cui ci sono i dati da aggiornare/usare per la funzione
  * 
  * @return 0 in caso di successo, -1 in caso di errore
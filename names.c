@@ -0,0 +1,410 @@
+/**
+ * @file names.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in names.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <error_handler.h>
+#include <names.h>
+#include <epoch.h>
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//tabelle hash in cui sono inseriti utenti e gruppi
+static hashtable_t *names_us = NULL;
+static hashtable_t *names_gr = NULL;
+
+//lock per gli inserimenti (scelta con l'hash del nome)
+static pthread_mutex_t mtx_names[NAMES_STRIPES];
+static int initialized = 0;
+
+//contatori del filtro (saturati a FILTER_SAT non vengono più decrementati)
+static unsigned char *filter = NULL;
+#define  FILTER_MASK   ((1UL << NAMES_FILTER_BITS) - 1)
+#define  FILTER_SAT    255
+
+//statistiche del filtro (aggiornate con operazioni atomiche)
+static names_stats_t fstats;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function names_hash
+ * @brief Calcola con una sola scansione del nome i due hash usati dal registro:
+ *        djb2 come typed_strhash (senza modulo: il modulo con la dimensione di ogni
+ *        tabella dà la lista in cui si trova il nome) ed FNV-1a per il filtro
+ *
+ * @param str  nome
+ * @param h2   vi viene scritto il secondo hash (dispari)
+ *
+ * @return hash djb2 del nome
+ */
+static inline unsigned long names_hash(const char *str, unsigned long *h2) {
+    unsigned long hash = 5381, fnv = 14695981039346656037UL;
+    int c;
+
+    while ((c = *str++) != 0) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+        fnv  = (fnv ^ (unsigned char)c) * 1099511628211UL;
+    }
+
+    *h2 = fnv | 1;
+    return hash;
+}
+
+
+/**
+ * @function filter_test
+ * @brief Controlla se il nome può essere registrato (tutti i contatori non nulli)
+ *
+ * @return 0 se il nome sicuramente non è registrato, 1 altrimenti
+ */
+static int filter_test(unsigned long h1, unsigned long h2) {
+    for (int i = 0; i < NAMES_FILTER_HASHES; i++) {
+        unsigned char *cnt = &filter[(h1 + i * h2) & FILTER_MASK];
+        if (__atomic_load_n(cnt, __ATOMIC_ACQUIRE) == 0) return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * @function filter_update
+ * @brief Incrementa (delta = 1) o decrementa (delta = -1) i contatori di un nome
+ *
+ * @note: un contatore saturo resta tale, i nomi che lo usano non danno mai
+ *        falsi negativi
+ */
+static void filter_update(unsigned long h1, unsigned long h2, int delta) {
+    for (int i = 0; i < NAMES_FILTER_HASHES; i++) {
+        unsigned char *cnt = &filter[(h1 + i * h2) & FILTER_MASK];
+        unsigned char old = __atomic_load_n(cnt, __ATOMIC_RELAXED);
+        do {
+            if (old == FILTER_SAT || (delta < 0 && old == 0)) break;
+        } while (!__atomic_compare_exchange_n(cnt, &old, (unsigned char)(old + delta), 0,
+                                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    }
+}
+
+
+/**
+ * @function user_name
+ * @brief Ritorna il nome di un utente (vedi filter_add_all)
+ */
+static const char *user_name(void *us) {
+    return ((user_t *)us)->nickname;
+}
+
+
+/**
+ * @function group_name
+ * @brief Ritorna il nome di un gruppo (vedi filter_add_all)
+ */
+static const char *group_name(void *gr) {
+    return ((group_t *)gr)->groupname;
+}
+
+
+/**
+ * @function filter_add_all
+ * @brief Inserisce nel filtro i nomi degli elementi di una tabella hash
+ *
+ * @param ht       tabella hash
+ * @param name_of  funzione che ritorna il nome di un elemento
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int filter_add_all(hashtable_t *ht, const char *(*name_of)(void *)) {
+    ht_snapshot_t *snap = get_snapshot_ht(ht);
+    if (snap == NULL) return -1;
+
+    unsigned long h1 = 0, h2 = 0;
+    for (int i = 0; i < snap->len; i++) {
+        h1 = names_hash(name_of(snap->elements[i]), &h2);
+        filter_update(h1, h2, 1);
+    }
+
+    release_snapshot_ht(ht, snap);
+    return 0;
+}
+
+
+/**
+ * @function names_add
+ * @brief Inserisce un elemento nella sua tabella hash se il nome non è presente
+ *        nè in quella nè nell'altra, con la lock del nome
+ *
+ * @param own    tabella in cui inserire l'elemento
+ * @param other  tabella in cui controllare che il nome non sia presente
+ * @param data   elemento da inserire
+ * @param name   nome dell'elemento
+ *
+ * @return 1 se inserito, 0 (errno a 0) se il nome è già registrato,
+ *         -1 ed errno settato in caso di errore
+ */
+static int names_add(hashtable_t *own, hashtable_t *other, void *data, const char *name) {
+    unsigned long h2 = 0, h1 = names_hash(name, &h2);
+    pthread_mutex_t *mtx = &mtx_names[h1 % NAMES_STRIPES];
+
+    int check = pthread_mutex_lock(mtx);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    errno = 0;
+    int ret = 0;
+    //se il filtro dice che il nome non c'è non cerco nell'altra tabella (un
+    //inserimento concorrente dello stesso nome attende la mtx)
+    int maybe = filter_test(h1, h2);
+    void *found = (maybe) ? search_data_ht(other, (void*)name) : NULL;
+    if (found == NULL && errno == 0) {
+        //i contatori vanno incrementati prima che l'elemento sia visibile
+        filter_update(h1, h2, 1);
+        ret = add_data_ht(own, data, (void*)name);
+        if (ret != 1) filter_update(h1, h2, -1);
+        if (ret == 1) __atomic_add_fetch((maybe) ? &fstats.false_pos : &fstats.negatives, 1, __ATOMIC_RELAXED);
+    }
+    else if (found == NULL) ret = -1;
+
+    int err = errno;
+    check = pthread_mutex_unlock(mtx);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+    errno = err;
+
+    return ret;
+}
+
+
+
+/* -------------------------- interfaccia names ------------------------------ */
+
+
+/**
+ * @function names_init
+ * @brief Inizializza il registro dei nomi ed inserisce nel filtro i nomi già
+ *        presenti nelle tabelle hash
+ *
+ * @param hash_us  tabella hash degli utenti registrati
+ * @param hash_gr  tabella hash dei gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata dopo il ripristino dello stato salvato (persist_start), che
+ *        inserisce gli elementi direttamente nelle tabelle
+ */
+int names_init(hashtable_t *hash_us, hashtable_t *hash_gr) {
+    //controllo gli argomenti
+    err_check_return(hash_us == NULL, EINVAL, "names_init", -1);
+    err_check_return(hash_gr == NULL, EINVAL, "names_init", -1);
+
+    filter = calloc(1UL << NAMES_FILTER_BITS, sizeof(unsigned char));
+    err_return_msg(filter,NULL,-1,"Errore: calloc\n");
+
+    for (int i = 0; i < NAMES_STRIPES; i++) {
+        int check = pthread_mutex_init(&mtx_names[i], NULL);
+        if (check != 0) {
+            while (--i >= 0) pthread_mutex_destroy(&mtx_names[i]);
+            free(filter);
+            filter = NULL;
+            errno = check;
+            perror("pthread_mutex_init");
+            return -1;
+        }
+    }
+
+    names_us = hash_us;
+    names_gr = hash_gr;
+    initialized = 1;
+
+    //nomi ripristinati da persist.c
+    if (filter_add_all(hash_us, user_name) == -1 ||
+        filter_add_all(hash_gr, group_name) == -1) {
+        names_cleanup();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function names_cleanup
+ * @brief Libera le risorse del registro (non le tabelle hash)
+ */
+void names_cleanup() {
+    if (!initialized) return;
+
+    for (int i = 0; i < NAMES_STRIPES; i++) pthread_mutex_destroy(&mtx_names[i]);
+    free(filter);
+    filter = NULL;
+    names_us = NULL;
+    names_gr = NULL;
+    initialized = 0;
+}
+
+
+/**
+ * @function names_search
+ * @brief Cerca un nome tra gli utenti ed i gruppi con un solo calcolo dell'hash
+ *
+ * @param name  nome da cercare
+ * @param kind  vi viene scritto il tipo dell'elemento trovato (NAME_NONE se assente)
+ *
+ * @return puntatore all'utente o al gruppo, NULL ed errno a 0 se il nome non è
+ *         registrato, NULL ed errno settato in caso di errore
+ *
+ * @note: stessa semantica di users_ht_search (senza lock se il thread è registrato
+ *        con epoch_register)
+ */
+void *names_search(const char *name, name_kind_t *kind) {
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "names_search", NULL);
+    err_check_return(kind == NULL, EINVAL, "names_search", NULL);
+    err_check_return(!initialized, EINVAL, "names_search", NULL);
+
+    unsigned long h2 = 0, hash = names_hash(name, &h2);
+
+    *kind = NAME_NONE;
+    errno = 0;
+    //il nome sicuramente non è registrato: nessuna lista da scorrere
+    if (!filter_test(hash, h2)) {
+        __atomic_add_fetch(&fstats.negatives, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    list_t *lus = names_us->lists[hash % names_us->dim];
+    list_t *lgr = names_gr->lists[hash % names_gr->dim];
+    void *ret = NULL;
+    int err = 0;
+
+    //thread non registrato: ricerca con le lock delle liste
+    if (epoch_enter() == -1) {
+        ret = users_ht_bucket_search(lus, name);
+        if (ret != NULL) *kind = NAME_USER;
+        else if (errno == 0 && (ret = groups_ht_bucket_search(lgr, name)) != NULL) *kind = NAME_GROUP;
+        err = errno;
+    }
+    else {
+        ret = users_ht_bucket_search_rcu(lus, name);
+        if (ret != NULL) *kind = NAME_USER;
+        else if (errno == 0 && (ret = groups_ht_bucket_search_rcu(lgr, name)) != NULL) *kind = NAME_GROUP;
+        err = errno;
+        epoch_exit();
+    }
+
+    if (ret == NULL && err == 0) __atomic_add_fetch(&fstats.false_pos, 1, __ATOMIC_RELAXED);
+    errno = err;
+
+    return ret;
+}
+
+
+/**
+ * @function names_add_user
+ * @brief Registra un utente se il nome non è già usato da un utente o da un gruppo
+ *
+ * @param user  utente da inserire nella tabella hash degli utenti
+ *
+ * @return 1 se inserito, 0 (errno a 0) se il nome è già registrato,
+ *         -1 ed errno settato in caso di errore
+ */
+int names_add_user(user_t *user) {
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "names_add_user", -1);
+    err_check_return(!initialized, EINVAL, "names_add_user", -1);
+
+    return names_add(names_us, names_gr, (void*)user, user->nickname);
+}
+
+
+/**
+ * @function names_add_group
+ * @brief Registra un gruppo se il nome non è già usato da un utente o da un gruppo
+ *
+ * @param group  gruppo da inserire nella tabella hash dei gruppi
+ *
+ * @return 1 se inserito, 0 (errno a 0) se il nome è già registrato,
+ *         -1 ed errno settato in caso di errore
+ */
+int names_add_group(group_t *group) {
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "names_add_group", -1);
+    err_check_return(!initialized, EINVAL, "names_add_group", -1);
+
+    return names_add(names_gr, names_us, (void*)group, group->groupname);
+}
+
+
+/**
+ * @function names_detach
+ * @brief Toglie un elemento dalla sua tabella hash e decrementa i contatori del nome
+ */
+static void *names_detach(hashtable_t *ht, const char *name) {
+    errno = 0;
+    void *data = detach_data_ht(ht, (void*)name);
+
+    //i contatori vanno decrementati dopo che l'elemento non è più visibile
+    if (data != NULL) {
+        unsigned long h2 = 0, h1 = names_hash(name, &h2);
+        filter_update(h1, h2, -1);
+    }
+
+    return data;
+}
+
+
+/**
+ * @function names_detach_user
+ * @brief Toglie un utente dalla tabella hash degli utenti (vedi detach_data_ht)
+ *
+ * @param name  nome dell'utente
+ *
+ * @return utente rimosso, NULL ed errno a 0 se non presente,
+ *         NULL ed errno settato in caso di errore
+ */
+user_t *names_detach_user(const char *name) {
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "names_detach_user", NULL);
+    err_check_return(!initialized, EINVAL, "names_detach_user", NULL);
+
+    return (user_t *)names_detach(names_us, name);
+}
+
+
+/**
+ * @function names_detach_group
+ * @brief Toglie un gruppo dalla tabella hash dei gruppi (vedi detach_data_ht)
+ *
+ * @param name  nome del gruppo
+ *
+ * @return gruppo rimosso, NULL ed errno a 0 se non presente,
+ *         NULL ed errno settato in caso di errore
+ */
+group_t *names_detach_group(const char *name) {
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "names_detach_group", NULL);
+    err_check_return(!initialized, EINVAL, "names_detach_group", NULL);
+
+    return (group_t *)names_detach(names_gr, name);
+}
+
+
+/**
+ * @function names_stats
+ * @brief Legge le statistiche del filtro dei nomi
+ *
+ * @param st  vi vengono scritte le statistiche
+ */
+void names_stats(names_stats_t *st) {
+    if (st == NULL) return;
+
+    st->negatives = __atomic_load_n(&fstats.negatives, __ATOMIC_RELAXED);
+    st->false_pos = __atomic_load_n(&fstats.false_pos, __ATOMIC_RELAXED);
+}
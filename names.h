@@ -0,0 +1,159 @@
+/**
+ * @file names.h
+ * @brief File per il registro dei nomi: utenti e gruppi condividono lo stesso spazio
+ *        dei nomi. Gli elementi restano nelle due tabelle hash (ognuna con le proprie
+ *        mutex, in modo da non mescolare le lock degli utenti con quelle dei gruppi),
+ *        il registro calcola l'hash del nome una sola volta e restituisce l'elemento
+ *        insieme al suo tipo, ed esegue il controllo di esistenza e l'inserimento
+ *        come un'unica operazione atomica (lock per nome, vedi NAMES_STRIPES).
+ *        Davanti alle tabelle c'è un counting Bloom filter su tutti i nomi registrati,
+ *        letto ed aggiornato senza lock: se il filtro risponde che il nome non c'è
+ *        (nessun falso negativo) non si scorrono le liste di trabocco.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef NAMES_H_
+#define NAMES_H_
+
+#include <abs_hashtable.h>
+#include <user.h>
+#include <group.h>
+
+
+//numero di lock per gli inserimenti (un nome usa sempre la stessa lock,
+//sia che venga registrato come utente sia come gruppo)
+#define  NAMES_STRIPES   64
+
+//contatori del filtro (2^NAMES_FILTER_BITS da un byte) e numero di contatori per
+//nome: con 100000 nomi registrati i falsi positivi sono circa uno su mille
+#define  NAMES_FILTER_BITS     20
+#define  NAMES_FILTER_HASHES   4
+
+
+/**
+ * @enum name_kind_t
+ * @brief Tipo dell'elemento registrato con un nome
+ */
+typedef enum {
+    NAME_NONE   = 0,
+    NAME_USER   = 1,
+    NAME_GROUP  = 2
+} name_kind_t;
+
+
+
+/**
+ * @struct names_stats_t
+ * @brief Statistiche del filtro dei nomi
+ *
+ * @var negatives  ricerche di nomi non registrati risolte dal filtro
+ * @var false_pos  ricerche di nomi non registrati per cui il filtro ha risposto
+ *                 che il nome poteva esserci
+ */
+typedef struct {
+    unsigned long  negatives;
+    unsigned long  false_pos;
+} names_stats_t;
+
+
+
+/* ---------------------- interfaccia names  --------------------- */
+
+/**
+ * @function names_init
+ * @brief Inizializza il registro dei nomi ed inserisce nel filtro i nomi già
+ *        presenti nelle tabelle hash
+ *
+ * @param hash_us  tabella hash degli utenti registrati
+ * @param hash_gr  tabella hash dei gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata dopo il ripristino dello stato salvato (persist_start), che
+ *        inserisce gli elementi direttamente nelle tabelle
+ */
+int names_init(hashtable_t *hash_us, hashtable_t *hash_gr);
+
+
+/**
+ * @function names_cleanup
+ * @brief Libera le risorse del registro (non le tabelle hash)
+ */
+void names_cleanup();
+
+
+/**
+ * @function names_search
+ * @brief Cerca un nome tra gli utenti ed i gruppi con un solo calcolo dell'hash
+ *
+ * @param name  nome da cercare
+ * @param kind  vi viene scritto il tipo dell'elemento trovato (NAME_NONE se assente)
+ *
+ * @return puntatore all'utente o al gruppo, NULL ed errno a 0 se il nome non è
+ *         registrato, NULL ed errno settato in caso di errore
+ *
+ * @note: stessa semantica di users_ht_search (senza lock se il thread è registrato
+ *        con epoch_register)
+ */
+void *names_search(const char *name, name_kind_t *kind);
+
+
+/**
+ * @function names_add_user
+ * @brief Registra un utente se il nome non è già usato da un utente o da un gruppo
+ *
+ * @param user  utente da inserire nella tabella hash degli utenti
+ *
+ * @return 1 se inserito, 0 (errno a 0) se il nome è già registrato,
+ *         -1 ed errno settato in caso di errore
+ */
+int names_add_user(user_t *user);
+
+
+/**
+ * @function names_add_group
+ * @brief Registra un gruppo se il nome non è già usato da un utente o da un gruppo
+ *
+ * @param group  gruppo da inserire nella tabella hash dei gruppi
+ *
+ * @return 1 se inserito, 0 (errno a 0) se il nome è già registrato,
+ *         -1 ed errno settato in caso di errore
+ */
+int names_add_group(group_t *group);
+
+
+/**
+ * @function names_detach_user
+ * @brief Toglie un utente dalla tabella hash degli utenti (vedi detach_data_ht)
+ *
+ * @param name  nome dell'utente
+ *
+ * @return utente rimosso, NULL ed errno a 0 se non presente,
+ *         NULL ed errno settato in caso di errore
+ */
+user_t *names_detach_user(const char *name);
+
+
+/**
+ * @function names_detach_group
+ * @brief Toglie un gruppo dalla tabella hash dei gruppi (vedi detach_data_ht)
+ *
+ * @param name  nome del gruppo
+ *
+ * @return gruppo rimosso, NULL ed errno a 0 se non presente,
+ *         NULL ed errno settato in caso di errore
+ */
+group_t *names_detach_group(const char *name);
+
+
+/**
+ * @function names_stats
+ * @brief Legge le statistiche del filtro dei nomi
+ *
+ * @param st  vi vengono scritte le statistiche
+ */
+void names_stats(names_stats_t *st);
+
+
+#endif /* NAMES_H_ */
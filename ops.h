@@ -41,6 +41,20 @@ typedef enum {
     /* NOTA: la richiesta di cancellazione di un gruppo e' lasciata come task opzionale */
     CANCGROUP_OP     = 13,  /// richiesta di cancellazione di un gruppo
 
+    GETPREVMSGS_SINCE_OP = 14,  /// richiesta dei messaggi della history successivi ad un
+                                /// cursore ("since:page", vedi prevmsgs_req_t), a pagine
+    POSTTXT_TTL_OP   = 15,  /// come POSTTXT_OP ma il messaggio scade dopo ttl secondi
+                            /// (dati "ttl:testo", vedi ttl.h)
+    GROUPADD_OP      = 16,  /// richiesta di iscrizione ad un gruppo di una lista di utenti
+                            /// (nomi da MAX_NAME_LENGTH+1 byte come in USRLIST_OP, solo
+                            /// il creatore del gruppo), la risposta ha un esito per utente
+    GROUPDEL_OP      = 17,  /// come GROUPADD_OP ma rimuove gli utenti dal gruppo
+    CREATEGROUPWITH_OP = 18,  /// richiesta di creazione di un gruppo con una lista di membri
+                              /// (come CREATEGROUP_OP seguita da GROUPADD_OP)
+    POSTTXTMULTI_OP  = 19,  /// richiesta di invio di un messaggio testuale ad una lista di
+                            /// utenti (dati "n:" + n nomi da MAX_NAME_LENGTH+1 byte + testo),
+                            /// la risposta ha un esito per destinatario
+
 
     /* 
      * aggiungere qui eltre operazioni che si vogliono implementare 
@@ -65,10 +79,19 @@ typedef enum {
      * aggiungere qui altri messaggi di ritorno che possono servire 
      */
     OP_NO_CREATOR        = 30,  // l'utente non è il creatore del gruppo
+    OP_MSG_NOSPACE       = 31,  // la history del destinatario ha esaurito i byte disponibili
 
     OP_END          = 100 // limite superiore agli id usati per le operazioni
 
 } op_t;
+
+
+/*
+ * opzione della richiesta CONNECT_OP (stringa nel buffer dati): subito dopo
+ * l'OP_OK con la lista degli utenti online il server invia i messaggi della
+ * history non ancora consegnati, senza bisogno di GETPREVMSGS_OP
+ */
+#define CONNECT_PUSH  "push"
     
 
 #endif /* OPS_H_ */
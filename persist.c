@@ -0,0 +1,1423 @@
+/**
+ * @file persist.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in persist.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <error_handler.h>
+#include <persist.h>
+#include <user.h>
+#include <group.h>
+#include <stats.h>
+#include <epoch.h>
+#include <spill.h>
+#include <slab.h>
+
+
+//configurazioni del server (definita in chatty.c)
+extern configs_t conf_server;
+
+//statistiche del server (definita in chatty.c)
+extern struct statistics chattyStats;
+
+//dimensione dei buffer dei file di snapshot
+#define  SNAP_BUF_SIZE   (1024*1024)
+
+//dimensione massima del payload di un record (controllo sui record corrotti)
+#define  WAL_MAX_RECORD  (1024*1024*1024)
+
+//tentativi (ogni 100 us) di prendere tutte le lock per la fork, poi la snapshot viene
+//scritta da questo thread (i workers tengono la lock di un utente anche durante l'I/O
+//sul suo socket, un client lento non deve bloccare le snapshot)
+#define  SNAP_FORK_TRIES  200
+
+
+/**
+ * @struct wal_hdr_t
+ * @brief Intestazione di un record del log
+ *
+ * @var len  lunghezza del payload
+ * @var sum  checksum del payload
+ * @var lsn  posizione del record nel log (cresce tra una generazione e l'altra)
+ */
+typedef struct {
+    unsigned int   len;
+    unsigned int   sum;
+    unsigned long  lsn;
+} wal_hdr_t;
+
+/**
+ * @struct wal_op_t
+ * @brief Payload di un record del log (per P_POST è seguito da wal_post_t e dai dati)
+ */
+typedef struct {
+    int   op;
+    char  name[MAX_NAME_LENGTH+1];
+    char  arg[MAX_NAME_LENGTH+1];
+} wal_op_t;
+
+/**
+ * @struct wal_post_t
+ * @brief Messaggio inserito nella history di un utente
+ */
+typedef struct {
+    message_hdr_t       hdr;
+    message_data_hdr_t  dhdr;
+    int                 delivered;
+    time_t              expire;
+} wal_post_t;
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//directory di log e snapshot (NULL se la persistenza non è attiva)
+static char *pdir = NULL;
+
+//tabelle hash di utenti e gruppi
+static hashtable_t *hus = NULL;
+static hashtable_t *hgr = NULL;
+
+//mutex e variabili di condizione del log
+static pthread_mutex_t mtx_log    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_flush   = PTHREAD_COND_INITIALIZER;   //sveglia il flusher
+static pthread_cond_t cond_durable = PTHREAD_COND_INITIALIZER;   //sveglia chi aspetta il flusher
+static pthread_cond_t cond_snap    = PTHREAD_COND_INITIALIZER;   //sveglia lo snapshotter
+
+//record non ancora scritti (log_buf) e buffer in scrittura (spare_buf)
+static char   *log_buf   = NULL;
+static size_t log_len    = 0;
+static size_t log_cap    = 0;
+static char   *spare_buf = NULL;
+static size_t spare_cap  = 0;
+
+//posizione del prossimo record, di fine della parte su disco e di inizio del log corrente
+static unsigned long lsn_next    = 0;
+static unsigned long lsn_durable = 0;
+static unsigned long lsn_start   = 0;
+
+//log corrente e sua generazione
+static int           wal_fd = -1;
+static unsigned long gen    = 1;
+
+//errore di scrittura del log (i workers vengono terminati)
+static int wal_err = 0;
+
+//richieste ai threads
+static int rotate_req = 0;
+static int snap_req   = 0;
+static int snap_stop  = 0;
+static int stopping   = 0;
+
+//istante dell'ultima snapshot
+static time_t last_snap = 0;
+
+//latenza della fork e pagine copiate dall'ultima snapshot scritta da un processo figlio
+static long          last_fork_us   = 0;
+static unsigned long last_cow_pages = 0;
+
+//threads che scrivono log e snapshot
+static pthread_t th_flusher;
+static pthread_t th_snap;
+static int       started = 0;
+
+//fine dell'ultimo record aggiunto dal thread
+static __thread unsigned long my_lsn = 0;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function checksum
+ * @brief Aggiorna la checksum (FNV-1a) con len byte di buf
+ */
+static unsigned int checksum(unsigned int sum, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    for (size_t i = 0; i < len; i++) {
+        sum ^= p[i];
+        sum *= 16777619u;
+    }
+    return sum;
+}
+
+
+/**
+ * @function persist_path
+ * @brief Ritorna il path di un file nella directory di persistenza (da liberare con free)
+ *
+ * @param name   "wal", "snap" oppure "CURRENT"
+ * @param g      generazione del file
+ * @param shard  indice del file della snapshot (-1 per gli altri file)
+ */
+static char *persist_path(const char *name, unsigned long g, int shard) {
+    int len = strlen(pdir) + strlen(name) + 48;
+    char *path = malloc(len);
+    err_return_msg(path,NULL,NULL,"Errore: malloc\n");
+
+    if (strcmp(name, "CURRENT") == 0) snprintf(path, len, "%s/%s", pdir, name);
+    else if (shard < 0) snprintf(path, len, "%s/%s.%lu", pdir, name, g);
+    else snprintf(path, len, "%s/%s.%lu.%d", pdir, name, g, shard);
+
+    return path;
+}
+
+
+/**
+ * @function write_all
+ * @brief Scrive len byte di buf su fd
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+
+/**
+ * @function sync_dir
+ * @brief Rende persistenti creazioni e rinomine dei file nella directory
+ */
+static void sync_dir() {
+    int fd = open(pdir, O_RDONLY);
+    if (fd == -1) return;
+    fsync(fd);
+    close(fd);
+}
+
+
+/**
+ * @function remove_old
+ * @brief Elimina log e snapshot delle generazioni precedenti a g (e le snapshot
+ *        incomplete delle generazioni successive)
+ */
+static void remove_old(unsigned long g) {
+    DIR *d = opendir(pdir);
+    if (d == NULL) return;
+
+    struct dirent *file = NULL;
+    while ((file = readdir(d)) != NULL) {
+        unsigned long fg = 0;
+        int is_wal = 0;
+        if (sscanf(file->d_name, "wal.%lu", &fg) == 1) is_wal = 1;
+        else if (sscanf(file->d_name, "snap.%lu.", &fg) != 1) continue;
+
+        if (fg < g || (!is_wal && fg != g)) {
+            int len = strlen(pdir) + strlen(file->d_name) + 2;
+            char *path = malloc(len);
+            if (path == NULL) break;
+            snprintf(path, len, "%s/%s", pdir, file->d_name);
+            unlink(path);
+            free(path);
+        }
+    }
+
+    closedir(d);
+}
+
+
+/**
+ * @function log_append
+ * @brief Aggiunge un record (payload p1 seguito da p2) al buffer del log
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int log_append(const void *p1, size_t l1, const void *p2, size_t l2) {
+    wal_hdr_t hdr;
+    memset(&hdr, 0, sizeof(wal_hdr_t));
+    hdr.len = l1 + l2;
+    hdr.sum = checksum(checksum(2166136261u, p1, l1), p2, l2);
+    size_t total = sizeof(wal_hdr_t) + l1 + l2;
+
+    int check = pthread_mutex_lock(&mtx_log);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    if (wal_err != 0) {
+        pthread_mutex_unlock(&mtx_log);
+        errno = wal_err;
+        return -1;
+    }
+
+    //allargo il buffer se serve
+    if (log_len + total > log_cap) {
+        size_t cap = (log_cap == 0) ? 4096 : log_cap;
+        while (cap < log_len + total) cap *= 2;
+        char *tmp = realloc(log_buf, cap);
+        if (tmp == NULL) {
+            pthread_mutex_unlock(&mtx_log);
+            fprintf(stderr, "Errore: realloc\n");
+            errno = ENOMEM;
+            return -1;
+        }
+        log_buf = tmp;
+        log_cap = cap;
+    }
+
+    hdr.lsn = lsn_next;
+    memcpy(log_buf + log_len, &hdr, sizeof(wal_hdr_t));
+    memcpy(log_buf + log_len + sizeof(wal_hdr_t), p1, l1);
+    if (l2 > 0) memcpy(log_buf + log_len + sizeof(wal_hdr_t) + l1, p2, l2);
+    log_len  += total;
+    lsn_next += total;
+    my_lsn    = lsn_next;
+
+    pthread_cond_signal(&cond_flush);
+
+    check = pthread_mutex_unlock(&mtx_log);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+
+    return 0;
+}
+
+
+
+/* ------------------------- thread che scrive il log -------------------------- */
+
+/**
+ * @function flusher
+ * @brief Scrive su disco i record accumulati dai workers con un'unica write e
+ *        fdatasync per volta; quando richiesto passa al log della generazione successiva
+ */
+static void *flusher(void *arg) {
+    pthread_mutex_lock(&mtx_log);
+
+    while (1) {
+        //controllo se è ora di fare una snapshot
+        if (!snap_req && !snap_stop && lsn_next != lsn_start &&
+            (lsn_next - lsn_start > PERSIST_SNAP_BYTES ||
+             (conf_server.snap_interval > 0 && time(NULL) - last_snap >= conf_server.snap_interval))) {
+            snap_req = 1;
+            pthread_cond_signal(&cond_snap);
+        }
+
+        if (log_len == 0 && !rotate_req) {
+            if (stopping) break;
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait(&cond_flush, &mtx_log, &ts);
+            continue;
+        }
+
+        //prendo i record accumulati
+        char *buf = log_buf;
+        size_t len = log_len, cap = log_cap;
+        log_buf   = spare_buf;
+        log_cap   = spare_cap;
+        log_len   = 0;
+        spare_buf = buf;
+        spare_cap = cap;
+        unsigned long end = lsn_next;
+        int fd = wal_fd, old_fd = -1;
+
+        //i record successivi vanno nel log della nuova generazione
+        if (rotate_req) {
+            char *path = persist_path("wal", gen + 1, -1);
+            int new_fd = (path != NULL) ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600) : -1;
+            if (path != NULL) free(path);
+            if (new_fd == -1) wal_err = (errno != 0) ? errno : EIO;
+            else {
+                old_fd    = fd;
+                wal_fd    = new_fd;
+                gen       = gen + 1;
+                lsn_start = lsn_next;
+            }
+            rotate_req = 0;
+        }
+
+        pthread_mutex_unlock(&mtx_log);
+
+        int err = 0;
+        if (write_all(fd, buf, len) == -1 || fdatasync(fd) == -1) err = errno;
+        if (old_fd != -1) {
+            close(old_fd);
+            sync_dir();
+        }
+
+        pthread_mutex_lock(&mtx_log);
+        if (err != 0) wal_err = err;
+        lsn_durable = end;
+        pthread_cond_broadcast(&cond_durable);
+    }
+
+    pthread_mutex_unlock(&mtx_log);
+    return NULL;
+}
+
+
+
+/* ----------------------------- snapshot ---------------------------------- */
+
+/**
+ * @function open_snap_files
+ * @brief Apre i PERSIST_SHARDS file di una snapshot
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int open_snap_files(FILE **fp, unsigned long g, int base, const char *mode) {
+    for (int i = 0; i < PERSIST_SHARDS; i++) {
+        fp[i] = NULL;
+        char *path = persist_path("snap", g, base + i);
+        if (path == NULL) return -1;
+        fp[i] = fopen(path, mode);
+        free(path);
+        if (fp[i] == NULL) return -1;
+        setvbuf(fp[i], NULL, _IOFBF, SNAP_BUF_SIZE);
+    }
+    return 0;
+}
+
+
+/**
+ * @function close_snap_files
+ * @brief Chiude i file di una snapshot (rendendoli persistenti se sync)
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int close_snap_files(FILE **fp, int sync) {
+    int ret = 0;
+    for (int i = 0; i < PERSIST_SHARDS; i++) {
+        if (fp[i] == NULL) continue;
+        if (sync && (fflush(fp[i]) != 0 || fsync(fileno(fp[i])) == -1)) ret = -1;
+        if (fclose(fp[i]) != 0) ret = -1;
+        fp[i] = NULL;
+    }
+    return ret;
+}
+
+
+/**
+ * @function dump_tables
+ * @brief Scrive utenti e gruppi nei file della snapshot g. La snapshot non blocca
+ *        i workers: ogni utente è copiato con la sua lock insieme alla posizione nel
+ *        log, i record P_POST precedenti vengono ignorati al riavvio mentre le altre
+ *        operazioni possono essere rieseguite senza effetti
+ *
+ * @param g       generazione della snapshot
+ * @param frozen  1 se chiamata nel processo figlio di fork_snapshot (nessun altro
+ *                thread, le liste vengono scorse direttamente), 0 altrimenti
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int dump_tables(unsigned long g, int frozen) {
+    FILE *fu[PERSIST_SHARDS], *fg[PERSIST_SHARDS];
+    int check = 0;
+    if (open_snap_files(fu, g, 0, "w") == -1 || open_snap_files(fg, g, PERSIST_SHARDS, "w") == -1) {
+        perror("Errore: file snapshot");
+        close_snap_files(fu, 0);
+        close_snap_files(fg, 0);
+        return -1;
+    }
+
+    if (frozen) {
+        //la copia delle tabelle non può cambiare, le scorro senza snapshot ed epoch
+        user_t *us = NULL;
+        group_t *gr = NULL;
+        for (int i = 0; i < hus->dim && check != -1; i++) {
+            TYPED_LIST_FOREACH(hus->lists[i], user_t, us) {
+                if (dump_user(us, fu[typed_strhash(PERSIST_SHARDS, us->nickname)]) == -1) {
+                    check = -1;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < hgr->dim && check != -1; i++) {
+            TYPED_LIST_FOREACH(hgr->lists[i], group_t, gr) {
+                if (dump_group(gr, fg[typed_strhash(PERSIST_SHARDS, gr->groupname)]) == -1) {
+                    check = -1;
+                    break;
+                }
+            }
+        }
+    }
+    else {
+        int in_epoch = (epoch_enter() == 0);
+
+        //utenti, divisi tra i file in base al nome
+        ht_snapshot_t *snap = get_snapshot_ht(hus);
+        if (snap == NULL) check = -1;
+        for (int i = 0; snap != NULL && i < snap->len && check != -1; i++) {
+            user_t *us = (user_t *)snap->elements[i];
+            if (dump_user(us, fu[typed_strhash(PERSIST_SHARDS, us->nickname)]) == -1) check = -1;
+        }
+        if (snap != NULL) release_snapshot_ht(hus, snap);
+
+        //gruppi
+        snap = (check == -1) ? NULL : get_snapshot_ht(hgr);
+        if (snap == NULL) check = -1;
+        for (int i = 0; snap != NULL && i < snap->len && check != -1; i++) {
+            group_t *gr = (group_t *)snap->elements[i];
+            if (dump_group(gr, fg[typed_strhash(PERSIST_SHARDS, gr->groupname)]) == -1) check = -1;
+        }
+        if (snap != NULL) release_snapshot_ht(hgr, snap);
+
+        if (in_epoch) epoch_exit();
+    }
+
+    if (close_snap_files(fu, 1) == -1 || close_snap_files(fg, 1) == -1) check = -1;
+    if (check == -1) perror("Errore: scrittura snapshot");
+
+    return check;
+}
+
+
+/**
+ * @function cow_kb
+ * @brief Ritorna i kB di memoria privata modificata dal processo chiamante (nel
+ *        figlio di una fork sono le pagine copiate perchè scritte dal padre o dal figlio)
+ */
+static unsigned long cow_kb() {
+    unsigned long kb = 0, tot = 0;
+    char line[256];
+
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+    if (fp == NULL) fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL) return 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "Private_Dirty: %lu kB", &kb) == 1) tot += kb;
+    }
+    fclose(fp);
+
+    return tot;
+}
+
+
+/**
+ * @function fork_snapshot
+ * @brief Scrive la snapshot g da un processo figlio (BGSAVE): le tabelle vengono
+ *        congelate (tutte le lock prese) solo per la durata della fork, poi il figlio
+ *        scrive la sua copia copy-on-write mentre i workers continuano a lavorare.
+ *        Stampa la latenza della fork e le pagine copiate durante la scrittura
+ *
+ * @param g  generazione della snapshot
+ *
+ * @return 0 in caso di successo, 1 se le lock non sono state prese entro
+ *         SNAP_FORK_TRIES tentativi (la snapshot non è stata scritta),
+ *         -1 in caso di errore
+ */
+static int fork_snapshot(unsigned long g) {
+    //il figlio comunica al padre i kB copiati
+    int pfd[2];
+    if (pipe(pfd) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    //prendo tutte le lock (gruppi e poi utenti, come nei workers): nessun utente o
+    //gruppo è a metà di una modifica e nessun record P_POST può essere aggiunto al
+    //log (persist_lsn resta fermo)
+    int check = 0, tries = 0;
+    while (1) {
+        check = trylock_all_ht(hgr);
+        if (check == 0) {
+            check = trylock_all_ht(hus);
+            if (check == 0) break;
+            unlock_all_ht(hgr);
+        }
+        if (check != EBUSY || ++tries == SNAP_FORK_TRIES) {
+            close(pfd[0]);
+            close(pfd[1]);
+            if (check == EBUSY) return 1;
+            errno = check;
+            perror("Errore: lock tabelle");
+            return -1;
+        }
+        struct timespec ts = { 0, 100000 };
+        nanosleep(&ts, NULL);
+    }
+
+    //il figlio legge i record delle history scaricate su disco: finchè non ha finito
+    //lo spazio dei record rilasciati dal padre non può essere riusato
+    spill_hold();
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (pid == 0) {
+        //figlio: è rimasto solo questo thread, le lock prese sopra vanno reinizializzate
+        close(pfd[0]);
+        int ret = -1;
+        if (reset_locks_ht(hus) == 0 && reset_locks_ht(hgr) == 0) ret = dump_tables(g, 1);
+        unsigned long kb = cow_kb();
+        write_all(pfd[1], (char *)&kb, sizeof(kb));
+        _exit((ret == 0) ? 0 : 1);
+    }
+
+    unlock_all_ht(hus);
+    unlock_all_ht(hgr);
+    close(pfd[1]);
+    if (pid == -1) {
+        perror("fork");
+        close(pfd[0]);
+        spill_unhold();
+        return -1;
+    }
+
+    long fork_us = (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000;
+
+    //aspetto il figlio
+    unsigned long kb = 0;
+    size_t got = 0;
+    while (got < sizeof(kb)) {
+        ssize_t r = read(pfd[0], (char *)&kb + got, sizeof(kb) - got);
+        if (r == -1 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += r;
+    }
+    close(pfd[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            spill_unhold();
+            return -1;
+        }
+    }
+    spill_unhold();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Errore: snapshot del processo figlio\n");
+        return -1;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned long pages = (got == sizeof(kb)) ? kb * 1024 / page : 0;
+    pthread_mutex_lock(&mtx_log);
+    last_fork_us   = fork_us;
+    last_cow_pages = pages;
+    pthread_mutex_unlock(&mtx_log);
+    fprintf(stdout, "BGSAVE snapshot %lu: fork %ld us, copy-on-write %lu pagine (%lu kB)\n",
+            g, fork_us, pages, pages * page / 1024);
+    fflush(stdout);
+
+    return 0;
+}
+
+
+/**
+ * @function take_snapshot
+ * @brief Passa ad un nuovo log e scrive una snapshot di utenti e gruppi
+ *
+ * @param use_fork  1 per scriverla da un processo figlio (fork_snapshot),
+ *                  0 per scriverla da questo thread (dump_tables)
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int take_snapshot(int use_fork) {
+    //passo ad un nuovo log, la snapshot parte dall'inizio di questo
+    pthread_mutex_lock(&mtx_log);
+    unsigned long old = gen;
+    rotate_req = 1;
+    pthread_cond_signal(&cond_flush);
+    while (gen == old && wal_err == 0) pthread_cond_wait(&cond_durable, &mtx_log);
+    unsigned long g = gen, start = lsn_start;
+    int err = wal_err;
+    pthread_mutex_unlock(&mtx_log);
+    if (err != 0) return -1;
+
+    int check = use_fork ? fork_snapshot(g) : dump_tables(g, 0);
+    //tabelle sempre occupate: la scrivo da questo thread
+    if (check == 1) {
+        fprintf(stdout, "BGSAVE snapshot %lu: lock occupate, scritta senza fork\n", g);
+        fflush(stdout);
+        check = dump_tables(g, 0);
+    }
+    if (check == -1) return -1;
+
+    //rendo valida la snapshot
+    char *path = persist_path("CURRENT", 0, -1);
+    int len = (path != NULL) ? strlen(path) + 5 : 0;
+    char *tmp = (path != NULL) ? malloc(len) : NULL;
+    if (tmp == NULL) {
+        if (path != NULL) free(path);
+        fprintf(stderr, "Errore: malloc\n");
+        return -1;
+    }
+    snprintf(tmp, len, "%s.tmp", path);
+
+    FILE *fc = fopen(tmp, "w");
+    if (fc == NULL || fprintf(fc, "%lu %lu\n", g, start) < 0 || fflush(fc) != 0 ||
+        fsync(fileno(fc)) == -1 || fclose(fc) != 0 || rename(tmp, path) == -1) {
+        perror("Errore: CURRENT");
+        free(path);
+        free(tmp);
+        return -1;
+    }
+    free(path);
+    free(tmp);
+    sync_dir();
+
+    //log e snapshot precedenti non servono più
+    remove_old(g);
+    last_snap = time(NULL);
+
+    return 0;
+}
+
+
+/**
+ * @function snapshotter
+ * @brief Scrive una snapshot quando richiesto dal flusher
+ */
+static void *snapshotter(void *arg) {
+    int registered = (epoch_register() == 0);
+
+    pthread_mutex_lock(&mtx_log);
+    while (1) {
+        while (!snap_stop && !snap_req) pthread_cond_wait(&cond_snap, &mtx_log);
+        if (snap_stop) break;
+        pthread_mutex_unlock(&mtx_log);
+
+        take_snapshot(conf_server.snap_fork != 0);
+
+        pthread_mutex_lock(&mtx_log);
+        snap_req  = 0;
+        last_snap = time(NULL);
+    }
+    pthread_mutex_unlock(&mtx_log);
+
+    if (registered) epoch_unregister();
+    return NULL;
+}
+
+
+
+/* ------------------------------ ripristino ---------------------------------- */
+
+/**
+ * @function restore_user
+ * @brief Crea un utente offline e lo inserisce nella tabella hash
+ *
+ * @return puntatore all'utente, NULL se esiste già, NULL ed errno settato in caso di errore
+ */
+static user_t *restore_user(char *name) {
+    user_t *us = create_user(name, 0);
+    err_return(us, NULL, NULL);
+    us->status = OFFLINE;
+    us->fd     = -1;
+
+    errno = 0;
+    int check = add_data_ht(hus, us, (void *)us->nickname);
+    if (check != 1) {
+        int err = errno;
+        clean_user(us);
+        errno = err;
+        return NULL;
+    }
+    return us;
+}
+
+
+/**
+ * @function cancel_group
+ * @brief Cancella un gruppo se user è il suo creatore (vedi cancgroup_fun in worker.c)
+ */
+static int cancel_group(group_t *gr, user_t *user) {
+    int check = disable_group(gr, user->nickname);
+    if (check != 1) return check;
+    if (remove_data_ht(hgr, gr->groupname) == -1) return -1;
+    return 1;
+}
+
+
+/**
+ * @function unregister_user
+ * @brief Deregistra un utente (vedi unregister_fun in worker.c)
+ */
+static int unregister_user(user_t *user) {
+    char name[MAX_NAME_LENGTH+1];
+    strncpy(name, user->nickname, MAX_NAME_LENGTH);
+    name[MAX_NAME_LENGTH] = '\0';
+
+    if (disable_user(user) == -1) return -1;
+
+    //cancello i gruppi di cui l'utente era creatore
+    group_t *gr = (group_t *)pop_group(user);
+    while (gr != NULL) {
+        if (cancel_group(gr, user) == -1) return -1;
+        gr = (group_t *)pop_group(user);
+    }
+
+    return remove_data_ht(hus, name);
+}
+
+
+/**
+ * @function join_group
+ * @brief Iscrive un utente ad un gruppo (vedi addgroup_fun in worker.c)
+ */
+static int join_group(group_t *gr, user_t *user) {
+    errno = 0;
+    if (check_subscription(user, gr->groupname) != NULL) return 0;
+    int check = add_member(gr, user);
+    if (check != 1) return check;
+    return subscribe(user, gr);
+}
+
+
+/**
+ * @function new_group
+ * @brief Crea un gruppo e lo inserisce nella tabella hash (vedi creategroup_fun in worker.c)
+ *
+ * @return puntatore al gruppo, NULL se esiste già, NULL ed errno settato in caso di errore
+ */
+static group_t *new_group(char *name, user_t *creator) {
+    errno = 0;
+    if (users_ht_search(hus, name) != NULL) return NULL;
+
+    group_t *gr = create_group(name, creator);
+    err_return(gr, NULL, NULL);
+
+    errno = 0;
+    if (add_data_ht(hgr, gr, gr->groupname) != 1) {
+        int err = errno;
+        clean_group(gr);
+        errno = err;
+        return NULL;
+    }
+    if (subscribe(creator, gr) == -1) return NULL;
+
+    return gr;
+}
+
+
+/**
+ * @function load_users
+ * @brief Carica un file di utenti della snapshot (eseguita in parallelo)
+ */
+static void *load_users(void *arg) {
+    FILE *fp = (FILE *)arg;
+    user_rec_t rec;
+    long ret = 0;
+
+    while (fread(&rec, sizeof(user_rec_t), 1, fp) == 1) {
+        rec.nickname[MAX_NAME_LENGTH] = '\0';
+        user_t *us = restore_user(rec.nickname);
+        if (us == NULL) { ret = (errno != 0) ? errno : EIO; break; }
+        us->lsn = rec.lsn;
+        if (undump_history(&us->history, fp) == -1) { ret = errno; break; }
+    }
+    if (ret == 0 && ferror(fp)) ret = EIO;
+
+    return (void *)ret;
+}
+
+
+/**
+ * @function load_groups
+ * @brief Carica un file di gruppi della snapshot (eseguita in parallelo)
+ */
+static void *load_groups(void *arg) {
+    FILE *fp = (FILE *)arg;
+    group_rec_t rec;
+    char member[MAX_NAME_LENGTH+1];
+    long ret = 0;
+
+    while (ret == 0 && fread(&rec, sizeof(group_rec_t), 1, fp) == 1) {
+        rec.groupname[MAX_NAME_LENGTH] = '\0';
+        rec.creator[MAX_NAME_LENGTH]   = '\0';
+        user_t *creator = users_ht_search(hus, rec.creator);
+        group_t *gr = (creator != NULL) ? new_group(rec.groupname, creator) : NULL;
+        if (gr == NULL && errno != 0) ret = errno;
+
+        for (unsigned int i = 0; ret == 0 && i < rec.n; i++) {
+            if (fread(member, MAX_NAME_LENGTH+1, 1, fp) != 1) { ret = EIO; break; }
+            member[MAX_NAME_LENGTH] = '\0';
+            if (gr == NULL) continue;
+            user_t *us = users_ht_search(hus, member);
+            if (us != NULL && us != creator && join_group(gr, us) == -1) ret = errno;
+        }
+    }
+    if (ret == 0 && ferror(fp)) ret = EIO;
+
+    return (void *)ret;
+}
+
+
+/**
+ * @function load_snapshot
+ * @brief Carica in parallelo i file della snapshot di generazione g
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int load_snapshot(unsigned long g) {
+    FILE *fp[PERSIST_SHARDS];
+    pthread_t th[PERSIST_SHARDS];
+    int ret = 0;
+
+    //prima gli utenti, poi i gruppi che fanno riferimento agli utenti
+    for (int step = 0; step < 2 && ret == 0; step++) {
+        if (open_snap_files(fp, g, step * PERSIST_SHARDS, "r") == -1) {
+            perror("Errore: apertura snapshot");
+            close_snap_files(fp, 0);
+            return -1;
+        }
+
+        int n = 0;
+        for (n = 0; n < PERSIST_SHARDS; n++) {
+            if (pthread_create(&th[n], NULL, (step == 0) ? load_users : load_groups, fp[n]) != 0) {
+                ret = -1;
+                break;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            void *status = NULL;
+            pthread_join(th[i], &status);
+            if (status != NULL) {
+                errno = (long)status;
+                perror("Errore: caricamento snapshot");
+                ret = -1;
+            }
+        }
+
+        close_snap_files(fp, 0);
+    }
+
+    return ret;
+}
+
+
+/**
+ * @function replay_record
+ * @brief Riesegue un record del log
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int replay_record(char *payload, size_t len, unsigned long lsn) {
+    wal_op_t op;
+    if (len < sizeof(wal_op_t)) return 0;
+    memcpy(&op, payload, sizeof(wal_op_t));
+    op.name[MAX_NAME_LENGTH] = '\0';
+    op.arg[MAX_NAME_LENGTH]  = '\0';
+
+    errno = 0;
+    user_t *us = NULL;
+    group_t *gr = NULL;
+
+    switch (op.op) {
+        case P_REGISTER:
+            if (users_ht_search(hus, op.name) == NULL && groups_ht_search(hgr, op.name) == NULL) {
+                if (restore_user(op.name) == NULL && errno != 0) return -1;
+            }
+            break;
+
+        case P_UNREGISTER:
+            us = users_ht_search(hus, op.name);
+            if (us != NULL && unregister_user(us) == -1) return -1;
+            break;
+
+        case P_CREATEGROUP:
+            us = users_ht_search(hus, op.arg);
+            if (us != NULL && groups_ht_search(hgr, op.name) == NULL) {
+                if (new_group(op.name, us) == NULL && errno != 0) return -1;
+            }
+            break;
+
+        case P_ADDGROUP:
+            us = users_ht_search(hus, op.arg);
+            gr = groups_ht_search(hgr, op.name);
+            if (us != NULL && gr != NULL && join_group(gr, us) == -1) return -1;
+            break;
+
+        case P_DELGROUP:
+            us = users_ht_search(hus, op.arg);
+            gr = (us != NULL) ? unsubscribe(us, op.name) : NULL;
+            if (gr != NULL) {
+                int is_creator = 0;
+                if (remove_member(gr, us, &is_creator) == NULL && errno != 0) return -1;
+                if (is_creator && cancel_group(gr, us) == -1) return -1;
+            }
+            break;
+
+        case P_CANCGROUP:
+            us = users_ht_search(hus, op.arg);
+            gr = groups_ht_search(hgr, op.name);
+            if (us != NULL && gr != NULL && cancel_group(gr, us) == -1) return -1;
+            break;
+
+        case P_POST: {
+            wal_post_t post;
+            if (len < sizeof(wal_op_t) + sizeof(wal_post_t)) return 0;
+            memcpy(&post, payload + sizeof(wal_op_t), sizeof(wal_post_t));
+            if (len < sizeof(wal_op_t) + sizeof(wal_post_t) + post.dhdr.len) return 0;
+
+            //il messaggio è già nella history salvata nella snapshot
+            us = users_ht_search(hus, op.name);
+            if (us == NULL || lsn < us->lsn) break;
+
+            message_t *msg = slab_alloc(SLAB_MSG);
+            err_return_msg(msg,NULL,-1,"Errore: slab_alloc\n");
+            msg->hdr      = post.hdr;
+            msg->data.hdr = post.dhdr;
+            msg->data.buf = NULL;
+            if (post.dhdr.len > 0) {
+                msg->data.buf = slab_alloc_buf(post.dhdr.len);
+                err_return_msg_clean(msg->data.buf,NULL,-1,"Errore: slab_alloc_buf\n",slab_free(msg));
+                memcpy(msg->data.buf, payload + sizeof(wal_op_t) + sizeof(wal_post_t), post.dhdr.len);
+            }
+            if (add_history(&us->history, msg, post.delivered, post.expire) == -1) {
+                free_msg(msg);
+                return -1;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function replay_wal
+ * @brief Riesegue i record del log di generazione g a partire dalla posizione *lsn,
+ *        un record incompleto o corrotto (scrittura interrotta) e tutto ciò che
+ *        segue viene eliminato dal file
+ *
+ * @param g    generazione del log
+ * @param lsn  posizione del primo record (in uscita quella dopo l'ultimo)
+ *
+ * @return 1 se il log è terminato correttamente, 0 se è stato troncato o non esiste,
+ *         -1 in caso di errore
+ */
+static int replay_wal(unsigned long g, unsigned long *lsn) {
+    char *path = persist_path("wal", g, -1);
+    err_return(path, NULL, -1);
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        free(path);
+        return 0;
+    }
+    setvbuf(fp, NULL, _IOFBF, SNAP_BUF_SIZE);
+
+    char *payload = NULL;
+    size_t cap = 0;
+    long good = 0;
+    int ret = 1;
+    wal_hdr_t hdr;
+
+    while (1) {
+        size_t r = fread(&hdr, 1, sizeof(wal_hdr_t), fp);
+        if (r == 0 && feof(fp)) break;
+        if (r != sizeof(wal_hdr_t) || hdr.lsn != *lsn || hdr.len > WAL_MAX_RECORD) { ret = 0; break; }
+
+        if (hdr.len > cap) {
+            char *tmp = realloc(payload, hdr.len);
+            if (tmp == NULL) { ret = -1; break; }
+            payload = tmp;
+            cap = hdr.len;
+        }
+        if (fread(payload, 1, hdr.len, fp) != hdr.len ||
+            checksum(2166136261u, payload, hdr.len) != hdr.sum) { ret = 0; break; }
+
+        if (replay_record(payload, hdr.len, hdr.lsn) == -1) { ret = -1; break; }
+
+        good += sizeof(wal_hdr_t) + hdr.len;
+        *lsn += sizeof(wal_hdr_t) + hdr.len;
+    }
+
+    fclose(fp);
+    if (payload != NULL) free(payload);
+
+    //elimino la parte finale non valida
+    if (ret == 0 && truncate(path, good) == -1) ret = -1;
+    free(path);
+
+    return ret;
+}
+
+
+/**
+ * @function finish_restore
+ * @brief Ricalcola le statistiche e scarica su disco le history degli utenti ripristinati
+ *        (sono tutti offline)
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int finish_restore() {
+    unsigned long notdelivered = 0, filenotdelivered = 0;
+
+    ht_snapshot_t *snap = get_snapshot_ht(hus);
+    err_return(snap, NULL, -1);
+
+    for (int i = 0; i < snap->len; i++) {
+        user_t *us = (user_t *)snap->elements[i];
+        for (unsigned int j = 0; j < len_history(&us->history); j++) {
+            message_node_t *slot = get_history(&us->history, j);
+            if (slot->delivered == 1) continue;
+            if (slot->op == FILE_MESSAGE) filenotdelivered++;
+            else notdelivered++;
+        }
+        //timer per i messaggi con scadenza (quelli già scaduti vengono eliminati subito)
+        if (schedule_expire_user(us) == -1) {
+            release_snapshot_ht(hus, snap);
+            return -1;
+        }
+        if (spill_history(&us->history, us->nickname) == -1) {
+            release_snapshot_ht(hus, snap);
+            return -1;
+        }
+    }
+    unsigned long nusers = snap->len;
+    release_snapshot_ht(hus, snap);
+
+    snap = get_snapshot_ht(hgr);
+    err_return(snap, NULL, -1);
+    unsigned long ngroups = snap->len;
+    release_snapshot_ht(hgr, snap);
+
+    int check = lock_stats();
+    err_check_return(check != 0, check, "lock_stats", -1);
+    chattyStats.nusers            = nusers;
+    chattyStats.ngroups           = ngroups;
+    chattyStats.nnotdelivered     = notdelivered;
+    chattyStats.nfilenotdelivered = filenotdelivered;
+    check = unlock_stats();
+    err_check_return(check != 0, check, "unlock_stats", -1);
+
+    return 0;
+}
+
+
+
+/* -------------------------- interfaccia persist ------------------------------ */
+
+/**
+ * @function persist_start
+ * @brief Ricostruisce utenti, gruppi e history da snapshot e log presenti in dir,
+ *        poi fa partire i threads che scrivono log e snapshot
+ *
+ * @param dir      directory in cui sono salvati log e snapshot
+ * @param hash_us  tabella hash degli utenti registrati (vuota)
+ * @param hash_gr  tabella hash dei gruppi (vuota)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata prima di far partire i workers
+ */
+int persist_start(char *dir, hashtable_t *hash_us, hashtable_t *hash_gr) {
+    //controllo gli argomenti
+    err_check_return(dir == NULL, EINVAL, "persist_start", -1);
+    err_check_return(hash_us == NULL, EINVAL, "persist_start", -1);
+    err_check_return(hash_gr == NULL, EINVAL, "persist_start", -1);
+    err_check_return(pdir != NULL, EINVAL, "persist_start", -1);
+
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        return -1;
+    }
+
+    pdir = dir;
+    hus  = hash_us;
+    hgr  = hash_gr;
+
+    //leggo generazione e posizione dell'ultima snapshot valida
+    unsigned long g = 1, lsn = 0;
+    int has_snap = 0;
+    char *path = persist_path("CURRENT", 0, -1);
+    err_return_msg_clean(path, NULL, -1, "Errore: persist_path\n", pdir = NULL);
+    FILE *fc = fopen(path, "r");
+    free(path);
+    if (fc != NULL) {
+        if (fscanf(fc, "%lu %lu", &g, &lsn) == 2) has_snap = 1;
+        else {
+            g   = 1;
+            lsn = 0;
+        }
+        fclose(fc);
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    //carico la snapshot
+    if (has_snap && load_snapshot(g) == -1) {
+        pdir = NULL;
+        return -1;
+    }
+
+    //rieseguo i log successivi alla snapshot (più di uno se è stata interrotta una snapshot)
+    unsigned long last = g, start = lsn;
+    while (1) {
+        unsigned long before = lsn;
+        int check = replay_wal(last, &lsn);
+        if (check == -1) {
+            fprintf(stderr, "Errore: ripristino del log %lu\n", last);
+            pdir = NULL;
+            return -1;
+        }
+        start = before;
+
+        //c'è il log della generazione successiva?
+        char *next = persist_path("wal", last + 1, -1);
+        err_return_msg_clean(next, NULL, -1, "Errore: persist_path\n", pdir = NULL);
+        int exists = (access(next, F_OK) == 0);
+        free(next);
+        if (!exists) break;
+        //dopo un log troncato non possono esserci record validi
+        if (check == 0) {
+            for (unsigned long i = last + 1; ; i++) {
+                next = persist_path("wal", i, -1);
+                err_return_msg_clean(next, NULL, -1, "Errore: persist_path\n", pdir = NULL);
+                exists = (unlink(next) == 0);
+                free(next);
+                if (!exists) break;
+            }
+            break;
+        }
+        last++;
+    }
+    remove_old(g);
+
+    if (finish_restore() == -1) {
+        pdir = NULL;
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    #if defined(PRINT_STATUS)
+        fprintf(stdout, "PERSIST: ripristinati %lu utenti e %lu gruppi in %.3f s\n",
+                chattyStats.nusers, chattyStats.ngroups,
+                (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    #endif
+
+    //continuo a scrivere sull'ultimo log
+    path = persist_path("wal", last, -1);
+    err_return_msg_clean(path, NULL, -1, "Errore: persist_path\n", pdir = NULL);
+    wal_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    free(path);
+    if (wal_fd == -1) {
+        perror("open log");
+        pdir = NULL;
+        return -1;
+    }
+    sync_dir();
+
+    gen         = last;
+    lsn_start   = start;
+    lsn_next    = lsn;
+    lsn_durable = lsn;
+    last_snap   = time(NULL);
+
+    //faccio partire i threads
+    if (pthread_create(&th_flusher, NULL, flusher, NULL) != 0) {
+        close(wal_fd);
+        pdir = NULL;
+        return -1;
+    }
+    if (pthread_create(&th_snap, NULL, snapshotter, NULL) != 0) {
+        pthread_mutex_lock(&mtx_log);
+        stopping = 1;
+        pthread_cond_signal(&cond_flush);
+        pthread_mutex_unlock(&mtx_log);
+        pthread_join(th_flusher, NULL);
+        close(wal_fd);
+        pdir = NULL;
+        return -1;
+    }
+    started = 1;
+
+    return 0;
+}
+
+
+/**
+ * @function persist_stop
+ * @brief Scrive il log rimasto, salva una snapshot finale e termina i threads
+ *
+ * @note: va chiamata dopo la terminazione dei workers e prima di liberare le tabelle hash
+ */
+void persist_stop() {
+    if (pdir == NULL || !started) return;
+
+    //termino lo snapshotter
+    pthread_mutex_lock(&mtx_log);
+    snap_stop = 1;
+    pthread_cond_signal(&cond_snap);
+    pthread_mutex_unlock(&mtx_log);
+    pthread_join(th_snap, NULL);
+
+    //la snapshot finale rende immediato il prossimo avvio
+    if (wal_err == 0 && take_snapshot(0) == -1) fprintf(stderr, "Errore: snapshot finale\n");
+
+    //termino il flusher (scrive i record rimasti)
+    pthread_mutex_lock(&mtx_log);
+    stopping = 1;
+    pthread_cond_signal(&cond_flush);
+    pthread_mutex_unlock(&mtx_log);
+    pthread_join(th_flusher, NULL);
+
+    close(wal_fd);
+    wal_fd = -1;
+    if (log_buf != NULL) free(log_buf);
+    if (spare_buf != NULL) free(spare_buf);
+    log_buf   = NULL;
+    spare_buf = NULL;
+    log_len = log_cap = spare_cap = 0;
+    started = 0;
+    pdir    = NULL;
+}
+
+
+/**
+ * @function persist_bgsave
+ * @brief Chiede allo snapshotter di scrivere subito una snapshot (con SnapshotFork
+ *        viene scritta da un processo figlio senza fermare i workers)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato se la persistenza non è attiva
+ */
+int persist_bgsave() {
+    err_check_return(pdir == NULL || !started, EINVAL, "persist_bgsave", -1);
+
+    pthread_mutex_lock(&mtx_log);
+    if (!snap_stop) {
+        snap_req = 1;
+        pthread_cond_signal(&cond_snap);
+    }
+    pthread_mutex_unlock(&mtx_log);
+
+    return 0;
+}
+
+
+/**
+ * @function persist_bgsave_info
+ * @brief Ritorna latenza della fork e pagine copiate (copy-on-write) durante
+ *        l'ultima snapshot scritta da un processo figlio
+ *
+ * @param fork_us    microsecondi impiegati dalla fork (in uscita)
+ * @param cow_pages  pagine copiate durante la scrittura della snapshot (in uscita)
+ */
+void persist_bgsave_info(long *fork_us, unsigned long *cow_pages) {
+    pthread_mutex_lock(&mtx_log);
+    if (fork_us != NULL) *fork_us = last_fork_us;
+    if (cow_pages != NULL) *cow_pages = last_cow_pages;
+    pthread_mutex_unlock(&mtx_log);
+}
+
+
+/**
+ * @function persist_log_op
+ * @brief Aggiunge un'operazione su utenti/gruppi al log
+ *
+ * @param op    operazione
+ * @param name  utente o gruppo su cui è stata fatta l'operazione
+ * @param arg   secondo nome (utente per le operazioni sui gruppi), può essere NULL
+ *
+ * @return 0 in caso di successo (o se la persistenza non è attiva),
+ *         -1 ed errno settato in caso di errore
+ *
+ * @note: l'operazione è su disco solo dopo persist_commit
+ */
+int persist_log_op(persist_op_t op, const char *name, const char *arg) {
+    if (pdir == NULL) return 0;
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "persist_log_op", -1);
+
+    wal_op_t rec;
+    memset(&rec, 0, sizeof(wal_op_t));
+    rec.op = op;
+    strncpy(rec.name, name, MAX_NAME_LENGTH);
+    if (arg != NULL) strncpy(rec.arg, arg, MAX_NAME_LENGTH);
+
+    return log_append(&rec, sizeof(wal_op_t), NULL, 0);
+}
+
+
+/**
+ * @function persist_log_post
+ * @brief Aggiunge al log un messaggio inserito nella history di un utente
+ *
+ * @param receiver   nome dell'utente
+ * @param msg        messaggio inserito nella history
+ * @param delivered  0 = da consegnare, 1 = già consegnato
+ * @param expire     istante in cui il messaggio scade (0 = mai)
+ *
+ * @return 0 in caso di successo (o se la persistenza non è attiva),
+ *         -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata con la lock dell'utente, in modo che il record sia ordinato
+ *        rispetto alla copia della history scritta nella snapshot
+ */
+int persist_log_post(const char *receiver, message_t *msg, int delivered, time_t expire) {
+    if (pdir == NULL) return 0;
+    //controllo gli argomenti
+    err_check_return(receiver == NULL, EINVAL, "persist_log_post", -1);
+    err_check_return(msg == NULL, EINVAL, "persist_log_post", -1);
+
+    //wal_op_t e wal_post_t sono contigui nel payload
+    struct {
+        wal_op_t   op;
+        wal_post_t post;
+    } rec;
+    memset(&rec, 0, sizeof(rec));
+
+    rec.op.op          = P_POST;
+    strncpy(rec.op.name, receiver, MAX_NAME_LENGTH);
+    rec.post.hdr       = msg->hdr;
+    rec.post.dhdr      = msg->data.hdr;
+    rec.post.delivered = delivered;
+    rec.post.expire    = expire;
+
+    return log_append(&rec, sizeof(rec), msg->data.buf, (msg->data.buf != NULL) ? msg->data.hdr.len : 0);
+}
+
+
+/**
+ * @function persist_commit
+ * @brief Aspetta che tutte le operazioni aggiunte al log dal thread chiamante siano
+ *        su disco (le fdatasync sono condivise tra tutti i threads in attesa)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int persist_commit() {
+    if (pdir == NULL || my_lsn == 0) return 0;
+
+    int check = pthread_mutex_lock(&mtx_log);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    while (lsn_durable < my_lsn && wal_err == 0) pthread_cond_wait(&cond_durable, &mtx_log);
+    int err = wal_err;
+
+    check = pthread_mutex_unlock(&mtx_log);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+    err_check_return(err != 0, err, "persist_commit", -1);
+
+    return 0;
+}
+
+
+/**
+ * @function persist_lsn
+ * @brief Ritorna la posizione nel log del prossimo record
+ */
+unsigned long persist_lsn() {
+    return __atomic_load_n(&lsn_next, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file persist.h
+ * @brief File per la persistenza dello stato del server (utenti, gruppi e history).
+ *        Ogni modifica viene scritta in un log append-only (WAL, wal.<gen>) da un thread
+ *        che raggruppa le scritture di più workers in un'unica fdatasync (group commit).
+ *        Periodicamente viene scritta una snapshot compatta divisa in PERSIST_SHARDS
+ *        file (snap.<gen>.*), che all'avvio vengono caricati in parallelo prima di
+ *        rieseguire la coda del log. Con SnapshotFork la snapshot viene scritta da un
+ *        processo figlio (BGSAVE) su una copia copy-on-write dello stato.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef PERSIST_H_
+#define PERSIST_H_
+
+#include <message.h>
+#include <abs_hashtable.h>
+
+
+//numero di file in cui è divisa una snapshot (e di threads che la caricano)
+#define  PERSIST_SHARDS       8
+
+//dimensione del log oltre la quale viene scritta una nuova snapshot
+#define  PERSIST_SNAP_BYTES   (64*1024*1024)
+
+
+//operazioni scritte nel log
+typedef enum {
+    P_REGISTER     = 1,   //registrazione di un utente
+    P_UNREGISTER   = 2,   //deregistrazione di un utente
+    P_CREATEGROUP  = 3,   //creazione di un gruppo (arg = creatore)
+    P_ADDGROUP     = 4,   //iscrizione di un utente ad un gruppo
+    P_DELGROUP     = 5,   //disiscrizione di un utente da un gruppo
+    P_CANCGROUP    = 6,   //cancellazione di un gruppo (arg = utente richiedente)
+    P_POST         = 7,   //messaggio inserito nella history di un utente
+} persist_op_t;
+
+
+
+/* ---------------------- interfaccia persist  --------------------- */
+
+/**
+ * @function persist_start
+ * @brief Ricostruisce utenti, gruppi e history da snapshot e log presenti in dir,
+ *        poi fa partire i threads che scrivono log e snapshot
+ *
+ * @param dir      directory in cui sono salvati log e snapshot
+ * @param hash_us  tabella hash degli utenti registrati (vuota)
+ * @param hash_gr  tabella hash dei gruppi (vuota)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata prima di far partire i workers
+ */
+int persist_start(char *dir, hashtable_t *hash_us, hashtable_t *hash_gr);
+
+
+/**
+ * @function persist_stop
+ * @brief Scrive il log rimasto, salva una snapshot finale e termina i threads
+ *
+ * @note: va chiamata dopo la terminazione dei workers e prima di liberare le tabelle hash
+ */
+void persist_stop();
+
+
+/**
+ * @function persist_bgsave
+ * @brief Chiede allo snapshotter di scrivere subito una snapshot (con SnapshotFork
+ *        viene scritta da un processo figlio senza fermare i workers)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato se la persistenza non è attiva
+ */
+int persist_bgsave();
+
+
+/**
+ * @function persist_bgsave_info
+ * @brief Ritorna latenza della fork e pagine copiate (copy-on-write) durante
+ *        l'ultima snapshot scritta da un processo figlio
+ *
+ * @param fork_us    microsecondi impiegati dalla fork (in uscita)
+ * @param cow_pages  pagine copiate durante la scrittura della snapshot (in uscita)
+ */
+void persist_bgsave_info(long *fork_us, unsigned long *cow_pages);
+
+
+/**
+ * @function persist_log_op
+ * @brief Aggiunge un'operazione su utenti/gruppi al log
+ *
+ * @param op    operazione
+ * @param name  utente o gruppo su cui è stata fatta l'operazione
+ * @param arg   secondo nome (utente per le operazioni sui gruppi), può essere NULL
+ *
+ * @return 0 in caso di successo (o se la persistenza non è attiva),
+ *         -1 ed errno settato in caso di errore
+ *
+ * @note: l'operazione è su disco solo dopo persist_commit
+ */
+int persist_log_op(persist_op_t op, const char *name, const char *arg);
+
+
+/**
+ * @function persist_log_post
+ * @brief Aggiunge al log un messaggio inserito nella history di un utente
+ *
+ * @param receiver   nome dell'utente
+ * @param msg        messaggio inserito nella history
+ * @param delivered  0 = da consegnare, 1 = già consegnato
+ * @param expire     istante in cui il messaggio scade (0 = mai)
+ *
+ * @return 0 in caso di successo (o se la persistenza non è attiva),
+ *         -1 ed errno settato in caso di errore
+ *
+ * @note: va chiamata con la lock dell'utente, in modo che il record sia ordinato
+ *        rispetto alla copia della history scritta nella snapshot
+ */
+int persist_log_post(const char *receiver, message_t *msg, int delivered, time_t expire);
+
+
+/**
+ * @function persist_commit
+ * @brief Aspetta che tutte le operazioni aggiunte al log dal thread chiamante siano
+ *        su disco (le fdatasync sono condivise tra tutti i threads in attesa)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int persist_commit();
+
+
+/**
+ * @function persist_lsn
+ * @brief Ritorna la posizione nel log del prossimo record
+ */
+unsigned long persist_lsn();
+
+
+#endif /* PERSIST_H_ */
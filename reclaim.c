@@ -0,0 +1,232 @@
+/**
+ * @file reclaim.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in reclaim.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <error_handler.h>
+#include <reclaim.h>
+#include <epoch.h>
+
+
+/**
+ * @struct reclaim_job_t
+ * @brief Cancellazione in attesa del thread
+ *
+ * @var next     cancellazione successiva nella coda
+ * @var user     utente da cancellare (NULL se si cancellano solo gruppi)
+ * @var ngroups  numero di gruppi da cancellare
+ * @var groups   gruppi da cancellare (prima dell'utente)
+ */
+typedef struct reclaim_job {
+    struct reclaim_job  *next;
+    user_t              *user;
+    unsigned int        ngroups;
+    group_t             *groups[];
+} reclaim_job_t;
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//coda delle cancellazioni (in ordine di arrivo)
+static reclaim_job_t *head = NULL;
+static reclaim_job_t *tail = NULL;
+
+//mutex per la coda e per le richieste al thread
+static pthread_mutex_t mtx_jobs  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond_jobs = PTHREAD_COND_INITIALIZER;
+
+//thread che esegue le cancellazioni
+static pthread_t   th_reclaimer;
+static int         started = 0;
+static int         stop    = 0;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function push_job
+ * @brief Inserisce in coda una cancellazione e sveglia il thread
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int push_job(reclaim_job_t *job) {
+    job->next = NULL;
+
+    int check = pthread_mutex_lock(&mtx_jobs);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    if (tail == NULL) head = job;
+    else tail->next = job;
+    tail = job;
+    pthread_cond_signal(&cond_jobs);
+
+    check = pthread_mutex_unlock(&mtx_jobs);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+
+    return 0;
+}
+
+
+/**
+ * @function run_job
+ * @brief Rimuove gruppi ed utente dai gruppi e dai membri e li ritira
+ *
+ * @note: prima i gruppi, i cui membri possono contenere ancora l'utente
+ */
+static void run_job(reclaim_job_t *job) {
+    epoch_enter();
+
+    for (unsigned int i = 0; i < job->ngroups; i++) {
+        if (release_group(job->groups[i]) == -1) perror("reclaim: release_group");
+        if (epoch_retire(job->groups[i], clean_group) == -1) perror("reclaim: epoch_retire");
+    }
+
+    if (job->user != NULL) {
+        if (release_user(job->user) == -1) perror("reclaim: release_user");
+        if (epoch_retire(job->user, clean_user) == -1) perror("reclaim: epoch_retire");
+    }
+
+    epoch_exit();
+    free(job);
+}
+
+
+/**
+ * @function reclaimer
+ * @brief Esegue le cancellazioni in coda, alla terminazione svuota la coda
+ */
+static void *reclaimer(void *arg) {
+    int registered = (epoch_register() == 0);
+
+    pthread_mutex_lock(&mtx_jobs);
+    while (1) {
+        while (head == NULL && !stop) pthread_cond_wait(&cond_jobs, &mtx_jobs);
+        if (head == NULL) break;
+
+        reclaim_job_t *job = head;
+        head = job->next;
+        if (head == NULL) tail = NULL;
+        pthread_mutex_unlock(&mtx_jobs);
+
+        run_job(job);
+
+        pthread_mutex_lock(&mtx_jobs);
+    }
+    pthread_mutex_unlock(&mtx_jobs);
+
+    if (registered) epoch_unregister();
+    return NULL;
+}
+
+
+
+/* -------------------------- interfaccia reclaim ------------------------------ */
+
+
+/**
+ * @function reclaim_start
+ * @brief Fa partire il thread che cancella utenti e gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reclaim_start() {
+    stop = 0;
+
+    int check = pthread_create(&th_reclaimer, NULL, reclaimer, NULL);
+    err_check_return(check != 0, check, "pthread_create", -1);
+    started = 1;
+
+    return 0;
+}
+
+
+/**
+ * @function reclaim_stop
+ * @brief Esegue le cancellazioni rimaste e termina il thread
+ *
+ * @note: va chiamata dopo la terminazione dei workers
+ */
+void reclaim_stop() {
+    if (started) {
+        pthread_mutex_lock(&mtx_jobs);
+        stop = 1;
+        pthread_cond_signal(&cond_jobs);
+        pthread_mutex_unlock(&mtx_jobs);
+        pthread_join(th_reclaimer, NULL);
+        started = 0;
+    }
+
+    //senza thread (non partito) eseguo io le cancellazioni rimaste
+    while (head != NULL) {
+        reclaim_job_t *job = head;
+        head = job->next;
+        run_job(job);
+    }
+    tail = NULL;
+}
+
+
+/**
+ * @function reclaim_user
+ * @brief Accoda la cancellazione di un utente inattivo e dei gruppi, già in
+ *        'cancellazione', di cui era il creatore
+ *
+ * @param user     utente inattivo, già tolto dalla tabella hash degli utenti
+ * @param groups   gruppi da cancellare (già tolti dalla tabella hash dei gruppi)
+ * @param ngroups  numero di gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reclaim_user(user_t *user, group_t **groups, unsigned int ngroups) {
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "reclaim_user", -1);
+    err_check_return(groups == NULL && ngroups > 0, EINVAL, "reclaim_user", -1);
+
+    reclaim_job_t *job = malloc(sizeof(reclaim_job_t) + ngroups * sizeof(group_t *));
+    err_return_msg(job,NULL,-1,"Errore: malloc\n");
+    job->user    = user;
+    job->ngroups = ngroups;
+    for (unsigned int i = 0; i < ngroups; i++) job->groups[i] = groups[i];
+
+    if (push_job(job) == -1) {
+        free(job);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function reclaim_group
+ * @brief Accoda la cancellazione di un gruppo in 'cancellazione'
+ *
+ * @param group  gruppo, già tolto dalla tabella hash dei gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reclaim_group(group_t *group) {
+    //controllo gli argomenti
+    err_check_return(group == NULL, EINVAL, "reclaim_group", -1);
+
+    reclaim_job_t *job = malloc(sizeof(reclaim_job_t) + sizeof(group_t *));
+    err_return_msg(job,NULL,-1,"Errore: malloc\n");
+    job->user      = NULL;
+    job->ngroups   = 1;
+    job->groups[0] = group;
+
+    if (push_job(job) == -1) {
+        free(job);
+        return -1;
+    }
+
+    return 0;
+}
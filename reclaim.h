@@ -0,0 +1,66 @@
+/**
+ * @file reclaim.h
+ * @brief File per la cancellazione in background di utenti e gruppi. UNREGISTER e
+ *        CANCGROUP pongono subito l'utente ad inattivo ed i gruppi in 'cancellazione',
+ *        li tolgono dalle tabelle hash e rispondono al client: un thread si occupa
+ *        poi di rimuoverli dai gruppi e dai membri (release_user, release_group) e di
+ *        ritirarli (epoch_retire). Il thread è uno solo ed esegue le richieste in
+ *        ordine, quindi utenti e gruppi vengono ritirati solo da lui.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef RECLAIM_H_
+#define RECLAIM_H_
+
+#include <user.h>
+#include <group.h>
+
+
+
+/* ---------------------- interfaccia reclaim  --------------------- */
+
+/**
+ * @function reclaim_start
+ * @brief Fa partire il thread che cancella utenti e gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reclaim_start();
+
+
+/**
+ * @function reclaim_stop
+ * @brief Esegue le cancellazioni rimaste e termina il thread
+ *
+ * @note: va chiamata dopo la terminazione dei workers
+ */
+void reclaim_stop();
+
+
+/**
+ * @function reclaim_user
+ * @brief Accoda la cancellazione di un utente inattivo e dei gruppi, già in
+ *        'cancellazione', di cui era il creatore
+ *
+ * @param user     utente inattivo, già tolto dalla tabella hash degli utenti
+ * @param groups   gruppi da cancellare (già tolti dalla tabella hash dei gruppi)
+ * @param ngroups  numero di gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reclaim_user(user_t *user, group_t **groups, unsigned int ngroups);
+
+
+/**
+ * @function reclaim_group
+ * @brief Accoda la cancellazione di un gruppo in 'cancellazione'
+ *
+ * @param group  gruppo, già tolto dalla tabella hash dei gruppi
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int reclaim_group(group_t *group);
+
+
+#endif /* RECLAIM_H_ */
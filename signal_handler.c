@@ -10,6 +10,11 @@
 #include <errno.h>
 #include <stats.h>
 #include <config.h>
+#include <persist.h>
+#include <history.h>
+#include <names.h>
+#include <spill.h>
+#include <slab.h>
 
 
 /**
@@ -21,8 +26,9 @@
  * @return 0 in caso di successo, altrimenti error
  */
 void *signal_handler(void *arg) {
-    //configurazioni del server (definita in chatty.c)
+    //configurazioni del server e statistiche (definite in chatty.c)
     extern configs_t conf_server;
+    extern struct statistics chattyStats;
 
     sigset_t *set         = ((args_sig_handler_t*)arg)->set;
     void (*fun_clean) ()  = ((args_sig_handler_t*)arg)->fun_clean;
@@ -80,7 +86,21 @@ void *signal_handler(void *arg) {
                         ret = checklock;
                         pthread_exit((void *) ret);
                     }
-                    if (printStats(fl) == -1) {
+                    chattyStats.nhistbytes = total_bytes_history();
+                    history_zstats_t zst;
+                    compress_stats_history(&zst);
+                    chattyStats.nzraw   = zst.raw;
+                    chattyStats.nzbytes = zst.bytes;
+                    chattyStats.nzusec  = zst.usec;
+                    names_stats_t nst;
+                    names_stats(&nst);
+                    chattyStats.nnamesneg = nst.negatives;
+                    chattyStats.nnamesfp  = nst.false_pos;
+                    chattyStats.nnamesfpr = (nst.negatives + nst.false_pos > 0) ?
+                        (nst.false_pos * 1000000UL) / (nst.negatives + nst.false_pos) : 0;
+                    //righe di commento per i segmenti e le classi delle slab, prima delle statistiche
+                    if (spill_print_stats(fl) == -1 || slab_print_stats(fl) == -1 ||
+                        printStats(fl) == -1) {
                         fprintf(stderr,"errore stampa statistiche nel relativo file");
                         unlock_stats();
                         fclose(fl);
@@ -98,6 +118,12 @@ void *signal_handler(void *arg) {
                     }
                 }
 	            break;
+            case SIGHUP:
+                //scrivere subito una snapshot dello stato (se la persistenza è attiva)
+                if (conf_server.persist_dir != NULL && persist_bgsave() == -1) {
+                    perror("persist_bgsave");
+                }
+                break;
 	        case SIGPIPE:
                 //da ignorare
 	            ;
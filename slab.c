@@ -0,0 +1,560 @@
+/**
+ * @file slab.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in slab.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include <error_handler.h>
+#include <slab.h>
+#include <message.h>
+#include <arena.h>
+
+
+//oggetti di dimensione fissa ed indice della prima classe dei buffer
+#define  SLAB_NOBJS     1
+
+//numero massimo di classi (oggetti fissi e buffer da SLAB_MIN_BUF a SLAB_MAX_BUF)
+#define  SLAB_CLASSES   (SLAB_NOBJS + 13)
+
+//gli oggetti sono allineati a 16 byte
+#define  SLAB_ALIGN(s)  (((s) + 15) & ~((size_t)15))
+
+
+/**
+ * @struct slab_free_t
+ * @brief Oggetto libero (il puntatore al successivo è scritto nell'oggetto)
+ */
+typedef struct slab_free {
+    struct slab_free  *next;
+} slab_free_t;
+
+
+/**
+ * @struct slab_tcache_t
+ * @brief Cache di una classe in un thread
+ *
+ * @var head      primo oggetto libero
+ * @var len       oggetti liberi nella cache
+ * @var allocs    oggetti allocati dal thread
+ * @var frees     oggetti liberati dal thread
+ * @var reqbytes  byte chiesti dal thread
+ */
+typedef struct {
+    slab_free_t    *head;
+    unsigned int   len;
+    unsigned long  allocs;
+    unsigned long  frees;
+    unsigned long  reqbytes;
+} slab_tcache_t;
+
+
+/**
+ * @struct slab_thread_t
+ * @brief Cache di un thread (scritta solo dal thread, letta dalle statistiche)
+ */
+typedef struct slab_thread {
+    struct slab_thread  *next;
+    slab_tcache_t       cache[SLAB_CLASSES];
+} slab_thread_t;
+
+
+/**
+ * @struct slab_class_t
+ * @brief Classe dell'allocatore (i contatori sono quelli dei thread senza cache e
+ *        delle cache già chiuse)
+ *
+ * @var mtx       mutex del deposito e dei contatori
+ * @var head      primo oggetto libero del deposito
+ * @var size      byte di un oggetto
+ * @var per_slab  oggetti in una slab
+ * @var tmax      oggetti liberi al più nella cache di un thread
+ * @var slabs     slab prese dalla classe
+ */
+typedef struct {
+    pthread_mutex_t  mtx;
+    slab_free_t      *head;
+    size_t           size;
+    unsigned int     per_slab;
+    unsigned int     tmax;
+    unsigned long    slabs;
+    unsigned long    allocs;
+    unsigned long    frees;
+    unsigned long    reqbytes;
+    char             name[16];
+} slab_class_t;
+
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//regione delle slab (NULL se l'allocatore non è inizializzato)
+static char *region = NULL;
+
+//numero di slab nella regione e prima slab non ancora usata
+static unsigned long region_slabs = 0;
+static unsigned long next_slab    = 0;
+
+//classe di ogni slab della regione
+static unsigned char *slab_class = NULL;
+
+//mutex per prendere nuove slab
+static pthread_mutex_t mtx_region = PTHREAD_MUTEX_INITIALIZER;
+
+//classi: prima gli oggetti fissi, poi i buffer
+static slab_class_t classes[SLAB_CLASSES];
+static int nclasses = 0;
+
+//cache dei thread che l'hanno abilitata
+static slab_thread_t   *threads = NULL;
+static pthread_mutex_t mtx_threads = PTHREAD_MUTEX_INITIALIZER;
+
+//cache del thread
+static __thread slab_thread_t me;
+static __thread int me_on = 0;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function count
+ * @brief Aggiorna un contatore della cache del thread (letto senza lock dalle statistiche)
+ */
+static inline void count(unsigned long *cnt, unsigned long n) {
+    __atomic_store_n(cnt, *cnt + n, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @function in_region
+ * @brief Ritorna 1 se l'oggetto appartiene ad una slab, 0 altrimenti
+ */
+static inline int in_region(void *ptr) {
+    return region != NULL && (char *)ptr >= region &&
+           (char *)ptr < region + region_slabs * SLAB_BYTES;
+}
+
+
+/**
+ * @function grow
+ * @brief Aggiunge al deposito della classe gli oggetti di una nuova slab
+ *
+ * @return 0 in caso di successo, -1 ed errno settato se la regione è esaurita
+ *
+ * @note: va chiamata con la mutex della classe
+ */
+static int grow(slab_class_t *cl) {
+    pthread_mutex_lock(&mtx_region);
+    if (next_slab == region_slabs) {
+        pthread_mutex_unlock(&mtx_region);
+        errno = ENOMEM;
+        return -1;
+    }
+    unsigned long idx = next_slab++;
+    slab_class[idx] = (unsigned char)(cl - classes);
+    pthread_mutex_unlock(&mtx_region);
+
+    char *base = region + idx * SLAB_BYTES;
+    for (unsigned int i = cl->per_slab; i > 0; i--) {
+        slab_free_t *obj = (slab_free_t *)(base + (i - 1) * cl->size);
+        obj->next = cl->head;
+        cl->head  = obj;
+    }
+    cl->slabs++;
+
+    return 0;
+}
+
+
+/**
+ * @function refill
+ * @brief Sposta fino a SLAB_BATCH oggetti dal deposito nella cache del thread
+ *
+ * @return 0 in caso di successo, -1 ed errno settato se la regione è esaurita
+ */
+static int refill(slab_class_t *cl, slab_tcache_t *tc) {
+    pthread_mutex_lock(&cl->mtx);
+    if (cl->head == NULL && grow(cl) == -1) {
+        pthread_mutex_unlock(&cl->mtx);
+        return -1;
+    }
+    for (int i = 0; i < SLAB_BATCH && cl->head != NULL; i++) {
+        slab_free_t *obj = cl->head;
+        cl->head  = obj->next;
+        obj->next = tc->head;
+        tc->head  = obj;
+        tc->len++;
+    }
+    pthread_mutex_unlock(&cl->mtx);
+
+    return 0;
+}
+
+
+/**
+ * @function flush
+ * @brief Restituisce al deposito n oggetti della cache del thread
+ */
+static void flush(slab_class_t *cl, slab_tcache_t *tc, unsigned int n) {
+    if (n == 0) return;
+
+    slab_free_t *first = tc->head, *last = first;
+    for (unsigned int i = 1; i < n; i++) last = last->next;
+    tc->head = last->next;
+    tc->len -= n;
+
+    pthread_mutex_lock(&cl->mtx);
+    last->next = cl->head;
+    cl->head   = first;
+    pthread_mutex_unlock(&cl->mtx);
+}
+
+
+/**
+ * @function class_alloc
+ * @brief Alloca un oggetto della classe c (dalla cache del thread se abilitata)
+ *
+ * @return puntatore all'oggetto, NULL ed errno settato se la regione è esaurita
+ */
+static void *class_alloc(int c, size_t len) {
+    slab_class_t *cl = &classes[c];
+    slab_free_t *obj = NULL;
+
+    if (me_on) {
+        slab_tcache_t *tc = &me.cache[c];
+        if (tc->head == NULL && refill(cl, tc) == -1) return NULL;
+        obj = tc->head;
+        tc->head = obj->next;
+        tc->len--;
+        count(&tc->allocs, 1);
+        count(&tc->reqbytes, len);
+        return obj;
+    }
+
+    pthread_mutex_lock(&cl->mtx);
+    if (cl->head != NULL || grow(cl) == 0) {
+        obj = cl->head;
+        cl->head = obj->next;
+        cl->allocs++;
+        cl->reqbytes += len;
+    }
+    pthread_mutex_unlock(&cl->mtx);
+
+    return obj;
+}
+
+
+/**
+ * @function init_class
+ * @brief Prepara la classe successiva per oggetti di una certa dimensione
+ */
+static int init_class(const char *name, size_t size) {
+    slab_class_t *cl = &classes[nclasses];
+
+    int check = pthread_mutex_init(&cl->mtx, NULL);
+    err_check_return(check != 0, check, "pthread_mutex_init", -1);
+
+    cl->head     = NULL;
+    cl->size     = SLAB_ALIGN(size);
+    cl->per_slab = SLAB_BYTES / cl->size;
+    cl->tmax     = SLAB_TCACHE_BYTES / cl->size;
+    if (cl->tmax > SLAB_TCACHE_MAX) cl->tmax = SLAB_TCACHE_MAX;
+    if (cl->tmax < 2) cl->tmax = 2;
+    cl->slabs    = 0;
+    cl->allocs   = 0;
+    cl->frees    = 0;
+    cl->reqbytes = 0;
+    snprintf(cl->name, sizeof(cl->name), "%s", name);
+    nclasses++;
+
+    return 0;
+}
+
+
+
+/* -------------------------- interfaccia slab ------------------------------ */
+
+
+/**
+ * @function slab_init
+ * @brief Riserva la regione delle slab e prepara le classi
+ *
+ * @param max_buf  dimensione massima dei buffer da gestire con le classi (MaxMsgSize)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: senza slab_init (o se fallisce) tutte le allocazioni usano malloc
+ */
+int slab_init(size_t max_buf) {
+    unsigned long nslabs = (1UL << SLAB_REGION_BITS) / SLAB_BYTES;
+
+    //oggetti fissi
+    if (init_class("message_t", sizeof(message_t)) == -1) {
+        slab_cleanup();
+        return -1;
+    }
+
+    //buffer fino alla prima potenza di 2 che contiene max_buf
+    for (size_t size = SLAB_MIN_BUF; size <= SLAB_MAX_BUF; size <<= 1) {
+        char name[16];
+        snprintf(name, sizeof(name), "buf%zu", size);
+        if (init_class(name, size) == -1) {
+            slab_cleanup();
+            return -1;
+        }
+        if (size >= max_buf) break;
+    }
+
+    slab_class = calloc(nslabs, sizeof(unsigned char));
+    if (slab_class == NULL) {
+        slab_cleanup();
+        errno = ENOMEM;
+        return -1;
+    }
+
+    //solo spazio di indirizzi: le pagine vengono assegnate quando le slab sono usate
+    void *reg = mmap(NULL, nslabs * SLAB_BYTES, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reg == MAP_FAILED) {
+        int err = errno;
+        slab_cleanup();
+        errno = err;
+        return -1;
+    }
+
+    next_slab    = 0;
+    region_slabs = nslabs;
+    region       = reg;
+
+    return 0;
+}
+
+
+/**
+ * @function slab_cleanup
+ * @brief Libera la regione delle slab
+ *
+ * @note: va chiamata alla terminazione, quando nessuno usa più gli oggetti delle slab
+ */
+void slab_cleanup() {
+    if (region != NULL) munmap(region, region_slabs * SLAB_BYTES);
+    region       = NULL;
+    region_slabs = 0;
+    next_slab    = 0;
+
+    if (slab_class != NULL) free(slab_class);
+    slab_class = NULL;
+
+    for (int c = 0; c < nclasses; c++) pthread_mutex_destroy(&classes[c].mtx);
+    nclasses = 0;
+    threads  = NULL;
+}
+
+
+/**
+ * @function slab_enable_cache
+ * @brief Abilita la cache locale del thread chiamante
+ */
+void slab_enable_cache() {
+    if (region == NULL || me_on) return;
+
+    memset(&me, 0, sizeof(slab_thread_t));
+
+    pthread_mutex_lock(&mtx_threads);
+    me.next = threads;
+    threads = &me;
+    pthread_mutex_unlock(&mtx_threads);
+
+    me_on = 1;
+}
+
+
+/**
+ * @function slab_clean_cache
+ * @brief Restituisce al deposito comune gli oggetti nella cache del thread chiamante
+ *        e la disabilita
+ *
+ * @note: da chiamare prima della terminazione del thread
+ */
+void slab_clean_cache() {
+    if (!me_on) return;
+
+    pthread_mutex_lock(&mtx_threads);
+    for (int c = 0; c < nclasses; c++) {
+        slab_tcache_t *tc = &me.cache[c];
+        flush(&classes[c], tc, tc->len);
+
+        //i contatori del thread passano alla classe
+        pthread_mutex_lock(&classes[c].mtx);
+        classes[c].allocs   += tc->allocs;
+        classes[c].frees    += tc->frees;
+        classes[c].reqbytes += tc->reqbytes;
+        pthread_mutex_unlock(&classes[c].mtx);
+    }
+
+    slab_thread_t **p = &threads;
+    while (*p != NULL && *p != &me) p = &(*p)->next;
+    if (*p != NULL) *p = me.next;
+    pthread_mutex_unlock(&mtx_threads);
+
+    me_on = 0;
+}
+
+
+/**
+ * @function slab_alloc
+ * @brief Alloca un oggetto di dimensione fissa
+ *
+ * @param type  tipo dell'oggetto
+ *
+ * @return puntatore all'oggetto, NULL ed errno settato in caso di errore
+ */
+void *slab_alloc(slab_obj_t type) {
+    static const size_t sizes[SLAB_NOBJS] = { sizeof(message_t) };
+
+    //controllo gli argomenti
+    err_check_return(type < 0 || type >= SLAB_NOBJS, EINVAL, "slab_alloc", NULL);
+
+    void *obj = (region != NULL) ? class_alloc(type, sizes[type]) : NULL;
+    if (obj == NULL) obj = malloc(sizes[type]);
+
+    return obj;
+}
+
+
+/**
+ * @function slab_alloc_buf
+ * @brief Alloca un buffer dalla classe più piccola che lo contiene (con malloc
+ *        se è più grande di tutte le classi)
+ *
+ * @param len  byte del buffer
+ *
+ * @return puntatore al buffer, NULL ed errno settato in caso di errore
+ */
+void *slab_alloc_buf(size_t len) {
+    void *buf = NULL;
+
+    if (region != NULL) {
+        int c = SLAB_NOBJS;
+        while (c < nclasses && classes[c].size < len) c++;
+        if (c < nclasses) buf = class_alloc(c, len);
+    }
+    if (buf == NULL) buf = malloc(len);
+
+    return buf;
+}
+
+
+/**
+ * @function slab_free
+ * @brief Libera un oggetto delle slab, o con free se non appartiene alle slab
+ *        (niente se è nell'arena del thread)
+ *
+ * @param ptr  oggetto da liberare (può essere NULL)
+ */
+void slab_free(void *ptr) {
+    if (ptr == NULL) return;
+    if (!in_region(ptr)) {
+        arena_free(ptr);
+        return;
+    }
+
+    int c = slab_class[((char *)ptr - region) / SLAB_BYTES];
+    slab_class_t *cl  = &classes[c];
+    slab_free_t  *obj = ptr;
+
+    if (me_on) {
+        slab_tcache_t *tc = &me.cache[c];
+        obj->next = tc->head;
+        tc->head  = obj;
+        tc->len++;
+        count(&tc->frees, 1);
+        //la cache piena restituisce metà degli oggetti al deposito
+        if (tc->len > cl->tmax) flush(cl, tc, tc->len / 2);
+        return;
+    }
+
+    pthread_mutex_lock(&cl->mtx);
+    obj->next = cl->head;
+    cl->head  = obj;
+    cl->frees++;
+    pthread_mutex_unlock(&cl->mtx);
+}
+
+
+/**
+ * @function slab_stats
+ * @brief Legge le statistiche delle classi
+ *
+ * @param st  vettore in cui scrivere le statistiche
+ * @param n   numero di elementi del vettore
+ *
+ * @return numero di classi scritte nel vettore
+ */
+int slab_stats(slab_stats_t *st, int n) {
+    if (st == NULL) return 0;
+    if (n > nclasses) n = nclasses;
+
+    pthread_mutex_lock(&mtx_threads);
+    for (int c = 0; c < n; c++) {
+        slab_class_t *cl = &classes[c];
+
+        pthread_mutex_lock(&cl->mtx);
+        st[c].name     = cl->name;
+        st[c].size     = cl->size;
+        st[c].allocs   = cl->allocs;
+        st[c].frees    = cl->frees;
+        st[c].slabs    = cl->slabs;
+        st[c].reqbytes = cl->reqbytes;
+        pthread_mutex_unlock(&cl->mtx);
+
+        for (slab_thread_t *th = threads; th != NULL; th = th->next) {
+            st[c].allocs   += __atomic_load_n(&th->cache[c].allocs, __ATOMIC_RELAXED);
+            st[c].frees    += __atomic_load_n(&th->cache[c].frees, __ATOMIC_RELAXED);
+            st[c].reqbytes += __atomic_load_n(&th->cache[c].reqbytes, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&mtx_threads);
+
+    return n;
+}
+
+
+/**
+ * @function slab_print_stats
+ * @brief Scrive una riga di commento ('#') per classe con allocazioni, oggetti in uso
+ *        e frammentazione (parti per milione della memoria delle slab non occupata
+ *        da oggetti in uso, e dei byte persi arrotondando le richieste alla classe)
+ *
+ * @param fout  file su cui scrivere
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int slab_print_stats(FILE *fout) {
+    slab_stats_t st[SLAB_CLASSES];
+    int n = slab_stats(st, SLAB_CLASSES);
+
+    for (int c = 0; c < n; c++) {
+        //gli oggetti liberati da un thread possono essere contati prima di quelli allocati
+        unsigned long inuse = (st[c].allocs > st[c].frees) ? st[c].allocs - st[c].frees : 0;
+        unsigned long bytes = st[c].slabs * SLAB_BYTES;
+        unsigned long used  = inuse * st[c].size;
+        unsigned long frag  = (bytes > used) ? (unsigned long)((1e6 * (bytes - used)) / bytes) : 0;
+        double chunk = (double)st[c].allocs * st[c].size;
+        unsigned long round = (chunk > 0) ? (unsigned long)(1e6 * (chunk - st[c].reqbytes) / chunk) : 0;
+
+        if (fprintf(fout, "# slab %s %zu %lu %lu %lu %lu %lu %lu\n", st[c].name, st[c].size,
+                    st[c].allocs, st[c].frees, inuse, st[c].slabs, frag, round) < 0) return -1;
+    }
+
+    return 0;
+}
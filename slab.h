@@ -0,0 +1,173 @@
+/**
+ * @file slab.h
+ * @brief File per l'allocatore a slab dei messaggi che sopravvivono alla richiesta
+ *        (copie inserite nelle history o da inviare): message_t ha una cache, i buffer
+ *        dei dati fino a MaxMsgSize byte sono divisi in classi (potenze di 2). Gli
+ *        oggetti temporanei delle richieste sono nell'arena del worker (vedi arena.h).
+ *        Ogni classe prende le slab da un'unica regione di indirizzi riservata
+ *        all'avvio, ha un deposito comune protetto da una mutex e, nei thread che
+ *        l'abilitano (i workers), una cache locale senza lock.
+ *
+ *        slab_free riconosce dall'indirizzo gli oggetti delle slab e quelli dell'arena
+ *        del thread (che non libera): tutto il resto (buffer letti da readData, file,
+ *        oggetti allocati prima di slab_init o quando la regione è esaurita) viene
+ *        liberato con free. Per questo i messaggi ed i loro buffer vanno sempre
+ *        liberati con slab_free (o free_msg).
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+//byte di una slab (multiplo della pagina) e spazio di indirizzi riservato (2^SLAB_REGION_BITS)
+#define  SLAB_BYTES         (256 * 1024)
+#define  SLAB_REGION_BITS   30
+
+//classi dei buffer: potenze di 2 da SLAB_MIN_BUF a SLAB_MAX_BUF byte
+#define  SLAB_MIN_BUF       16
+#define  SLAB_MAX_BUF       (64 * 1024)
+
+//oggetti liberi tenuti nella cache di un thread per classe (al più SLAB_TCACHE_BYTES
+//byte) ed oggetti spostati in una volta tra la cache ed il deposito comune
+#define  SLAB_TCACHE_MAX    256
+#define  SLAB_TCACHE_BYTES  (128 * 1024)
+#define  SLAB_BATCH         32
+
+
+/**
+ * @enum slab_obj_t
+ * @brief Oggetti di dimensione fissa con una cache propria
+ */
+typedef enum {
+    SLAB_MSG      = 0
+} slab_obj_t;
+
+
+
+/**
+ * @struct slab_stats_t
+ * @brief Statistiche di una classe dell'allocatore
+ *
+ * @var name      nome della classe
+ * @var size      byte di un oggetto della classe
+ * @var allocs    oggetti allocati
+ * @var frees     oggetti liberati
+ * @var slabs     slab prese dalla classe
+ * @var reqbytes  byte chiesti in tutte le allocazioni (<= allocs * size)
+ */
+typedef struct {
+    const char     *name;
+    size_t         size;
+    unsigned long  allocs;
+    unsigned long  frees;
+    unsigned long  slabs;
+    unsigned long  reqbytes;
+} slab_stats_t;
+
+
+
+/* ---------------------- interfaccia slab  --------------------- */
+
+/**
+ * @function slab_init
+ * @brief Riserva la regione delle slab e prepara le classi
+ *
+ * @param max_buf  dimensione massima dei buffer da gestire con le classi (MaxMsgSize)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: senza slab_init (o se fallisce) tutte le allocazioni usano malloc
+ */
+int slab_init(size_t max_buf);
+
+
+/**
+ * @function slab_cleanup
+ * @brief Libera la regione delle slab
+ *
+ * @note: va chiamata alla terminazione, quando nessuno usa più gli oggetti delle slab
+ */
+void slab_cleanup();
+
+
+/**
+ * @function slab_enable_cache
+ * @brief Abilita la cache locale del thread chiamante
+ */
+void slab_enable_cache();
+
+
+/**
+ * @function slab_clean_cache
+ * @brief Restituisce al deposito comune gli oggetti nella cache del thread chiamante
+ *        e la disabilita
+ *
+ * @note: da chiamare prima della terminazione del thread
+ */
+void slab_clean_cache();
+
+
+/**
+ * @function slab_alloc
+ * @brief Alloca un oggetto di dimensione fissa
+ *
+ * @param type  tipo dell'oggetto
+ *
+ * @return puntatore all'oggetto, NULL ed errno settato in caso di errore
+ */
+void *slab_alloc(slab_obj_t type);
+
+
+/**
+ * @function slab_alloc_buf
+ * @brief Alloca un buffer dalla classe più piccola che lo contiene (con malloc
+ *        se è più grande di tutte le classi)
+ *
+ * @param len  byte del buffer
+ *
+ * @return puntatore al buffer, NULL ed errno settato in caso di errore
+ */
+void *slab_alloc_buf(size_t len);
+
+
+/**
+ * @function slab_free
+ * @brief Libera un oggetto delle slab, o con free se non appartiene alle slab
+ *        (niente se è nell'arena del thread)
+ *
+ * @param ptr  oggetto da liberare (può essere NULL)
+ */
+void slab_free(void *ptr);
+
+
+/**
+ * @function slab_stats
+ * @brief Legge le statistiche delle classi
+ *
+ * @param st  vettore in cui scrivere le statistiche
+ * @param n   numero di elementi del vettore
+ *
+ * @return numero di classi scritte nel vettore
+ */
+int slab_stats(slab_stats_t *st, int n);
+
+
+/**
+ * @function slab_print_stats
+ * @brief Scrive una riga di commento ('#') per classe con allocazioni, oggetti in uso
+ *        e frammentazione (parti per milione della memoria delle slab non occupata
+ *        da oggetti in uso, e dei byte persi arrotondando le richieste alla classe)
+ *
+ * @param fout  file su cui scrivere
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int slab_print_stats(FILE *fout);
+
+
+#endif /* SLAB_H_ */
@@ -0,0 +1,480 @@
+/**
+ * @file spill.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in spill.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <error_handler.h>
+#include <spill.h>
+
+
+/**
+ * @struct spill_range_t
+ * @brief Record rilasciato il cui spazio non è ancora stato liberato (vedi spill_hold)
+ */
+typedef struct {
+    off_t   off;
+    size_t  size;
+} spill_range_t;
+
+/**
+ * @struct spill_seg_t
+ * @brief Segmento su disco
+ *
+ * @var fd     descrittore del file del segmento
+ * @var end    offset a cui verrà scritto il prossimo record (multiplo della pagina)
+ * @var live   numero di record ancora validi nel segmento
+ * @var bytes  byte dei record validi
+ * @var dead   byte dei record rilasciati da quando il segmento è stato troncato
+ * @var hold   numero di spill_hold in corso
+ * @var pend   record rilasciati durante spill_hold (npend, di capacità cpend)
+ * @var mtx    mutex per le scritture ed i contatori del segmento
+ */
+typedef struct {
+    int              fd;
+    off_t            end;
+    long             live;
+    size_t           bytes;
+    size_t           dead;
+    int              hold;
+    spill_range_t    *pend;
+    size_t           npend;
+    size_t           cpend;
+    pthread_mutex_t  mtx;
+} spill_seg_t;
+
+
+//segmenti
+static spill_seg_t segs[SPILL_SHARDS];
+
+//path della directory dei segmenti (NULL se non inizializzati)
+static char *spill_path = NULL;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function seg_path
+ * @brief Ritorna il path del file dell'i-esimo segmento (da liberare con free)
+ */
+static char *seg_path(unsigned int i) {
+    int len = strlen(spill_path) + 16;
+    char *path = malloc(len);
+    err_return_msg(path,NULL,NULL,"Errore: malloc\n");
+    snprintf(path, len, "%s/seg%02u", spill_path, i);
+    return path;
+}
+
+
+/**
+ * @function page_up
+ * @brief Arrotonda off al multiplo della pagina successivo
+ */
+static off_t page_up(off_t off) {
+    off_t page = sysconf(_SC_PAGESIZE);
+    return (off + page - 1) / page * page;
+}
+
+
+/**
+ * @function reclaim
+ * @brief Restituisce al filesystem lo spazio di un record rilasciato: tronca il
+ *        segmento se non ha più record validi, altrimenti fa un buco nelle pagine
+ *        del record (che non sono condivise con altri record)
+ *
+ * @note: va chiamata con la lock del segmento, se fallisce lo spazio viene
+ *        comunque recuperato quando il segmento viene troncato
+ */
+static void reclaim(spill_seg_t *seg, off_t off, size_t size) {
+    if (seg->live == 0) {
+        if (seg->end > 0 && ftruncate(seg->fd, 0) == 0) {
+            seg->end  = 0;
+            seg->dead = 0;
+        }
+        return;
+    }
+    fallocate(seg->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, page_up(off + size) - off);
+}
+
+
+
+/* -------------------------- interfaccia spill ------------------------------ */
+
+/**
+ * @function init_spill
+ * @brief Crea la directory dei segmenti in dir_name ed apre (troncandoli) i segmenti
+ *
+ * @param dir_name  directory dei file del server
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int init_spill(char *dir_name) {
+    //controllo gli argomenti
+    err_check_return(dir_name == NULL, EINVAL, "init_spill", -1);
+    err_check_return(spill_path != NULL, EINVAL, "init_spill", -1);
+
+    int len = strlen(dir_name) + strlen(SPILL_DIR) + 2;
+    spill_path = malloc(len);
+    err_return_msg(spill_path,NULL,-1,"Errore: malloc\n");
+    snprintf(spill_path, len, "%s/%s", dir_name, SPILL_DIR);
+
+    if (mkdir(spill_path, 0700) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        free(spill_path);
+        spill_path = NULL;
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < SPILL_SHARDS; i++) segs[i].fd = -1;
+
+    for (unsigned int i = 0; i < SPILL_SHARDS; i++) {
+        char *path = seg_path(i);
+        err_return_msg_clean(path, NULL, -1, "Errore: seg_path\n", clean_spill());
+
+        segs[i].fd   = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        segs[i].end   = 0;
+        segs[i].live  = 0;
+        segs[i].bytes = 0;
+        segs[i].dead  = 0;
+        segs[i].hold  = 0;
+        segs[i].pend  = NULL;
+        segs[i].npend = 0;
+        segs[i].cpend = 0;
+        free(path);
+        err_return_msg_clean(segs[i].fd, -1, -1, "Errore: open segmento\n", clean_spill());
+
+        int check = pthread_mutex_init(&segs[i].mtx, NULL);
+        if (check != 0) {
+            close(segs[i].fd);
+            segs[i].fd = -1;
+            clean_spill();
+            errno = check;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function clean_spill
+ * @brief Chiude ed elimina i segmenti e la loro directory
+ */
+void clean_spill() {
+    if (spill_path == NULL) return;
+
+    for (unsigned int i = 0; i < SPILL_SHARDS; i++) {
+        char *path = seg_path(i);
+        if (path != NULL) {
+            unlink(path);
+            free(path);
+        }
+        if (segs[i].fd != -1) {
+            close(segs[i].fd);
+            pthread_mutex_destroy(&segs[i].mtx);
+            segs[i].fd = -1;
+        }
+        if (segs[i].pend != NULL) {
+            free(segs[i].pend);
+            segs[i].pend = NULL;
+        }
+    }
+
+    rmdir(spill_path);
+    free(spill_path);
+    spill_path = NULL;
+}
+
+
+/**
+ * @function spill_enabled
+ * @brief Dice se i segmenti sono stati inizializzati
+ *
+ * @return 1 se è possibile scaricare le history su disco, 0 altrimenti
+ */
+int spill_enabled() {
+    return (spill_path != NULL);
+}
+
+
+/**
+ * @function spill_shard
+ * @brief Ritorna il segmento in cui scrivere i record di una chiave (nome utente)
+ *
+ * @param key  chiave del record
+ *
+ * @return indice del segmento (tra 0 e SPILL_SHARDS-1)
+ *
+ * @note: è stato ripreso l'algoritmo "djb2" by Dan Bernstein.
+ */
+unsigned int spill_shard(const char *key) {
+    unsigned long hash = 5381;
+    int c;
+
+    while ((c = *key++) != 0) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+
+    return hash % SPILL_SHARDS;
+}
+
+
+/**
+ * @function spill_append
+ * @brief Scrive un record in fondo al segmento indicato (all'inizio di una pagina)
+ *
+ * @param shard  indice del segmento
+ * @param buf    dati del record
+ * @param size   lunghezza del record
+ * @param off    offset del record nel segmento (in uscita)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int spill_append(unsigned int shard, const char *buf, size_t size, off_t *off) {
+    //controllo gli argomenti
+    err_check_return(spill_path == NULL, EINVAL, "spill_append", -1);
+    err_check_return(shard >= SPILL_SHARDS, EINVAL, "spill_append", -1);
+    err_check_return(buf == NULL, EINVAL, "spill_append", -1);
+    err_check_return(off == NULL, EINVAL, "spill_append", -1);
+
+    spill_seg_t *seg = &segs[shard];
+
+    int check = pthread_mutex_lock(&seg->mtx);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    //scrivo il record in fondo al segmento
+    size_t written = 0;
+    while (written < size) {
+        ssize_t w = pwrite(seg->fd, buf + written, size - written, seg->end + written);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            pthread_mutex_unlock(&seg->mtx);
+            errno = err;
+            return -1;
+        }
+        written += w;
+    }
+
+    //il prossimo record inizia alla pagina successiva (il resto della pagina è un buco)
+    *off = seg->end;
+    seg->end = page_up(seg->end + size);
+    seg->live++;
+    seg->bytes += size;
+
+    check = pthread_mutex_unlock(&seg->mtx);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+
+    return 0;
+}
+
+
+/**
+ * @function spill_read
+ * @brief Legge len byte di un record scritto con spill_append (l'intestazione)
+ *
+ * @param shard  indice del segmento
+ * @param off    offset da cui leggere
+ * @param buf    buffer in cui scrivere i dati
+ * @param len    byte da leggere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int spill_read(unsigned int shard, off_t off, void *buf, size_t len) {
+    //controllo gli argomenti
+    err_check_return(spill_path == NULL, EINVAL, "spill_read", -1);
+    err_check_return(shard >= SPILL_SHARDS, EINVAL, "spill_read", -1);
+    err_check_return(buf == NULL, EINVAL, "spill_read", -1);
+
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = pread(segs[shard].fd, (char *)buf + got, len - got, off + got);
+        if (r == -1 && errno == EINTR) continue;
+        if (r == -1) return -1;
+        if (r == 0) {
+            errno = EIO;
+            return -1;
+        }
+        got += r;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @function spill_map
+ * @brief Mappa in memoria (sola lettura) un record scritto con spill_append
+ *
+ * @param shard   indice del segmento
+ * @param off     offset del record
+ * @param size    lunghezza del record
+ * @param base    indirizzo della mappatura da passare a spill_unmap (in uscita)
+ * @param maplen  lunghezza della mappatura da passare a spill_unmap (in uscita)
+ *
+ * @return puntatore all'inizio del record, NULL ed errno settato in caso di errore
+ *
+ * @note: il record è già stato scritto e non viene troncato finchè non viene
+ *        chiamata spill_release, quindi non serve la lock del segmento
+ */
+char *spill_map(unsigned int shard, off_t off, size_t size, void **base, size_t *maplen) {
+    //controllo gli argomenti
+    err_check_return(spill_path == NULL, EINVAL, "spill_map", NULL);
+    err_check_return(shard >= SPILL_SHARDS, EINVAL, "spill_map", NULL);
+    err_check_return(size == 0, EINVAL, "spill_map", NULL);
+    err_check_return(base == NULL, EINVAL, "spill_map", NULL);
+    err_check_return(maplen == NULL, EINVAL, "spill_map", NULL);
+
+    //mmap vuole un offset allineato alla pagina
+    off_t page  = sysconf(_SC_PAGESIZE);
+    off_t start = off - (off % page);
+
+    *maplen = size + (off - start);
+    *base   = mmap(NULL, *maplen, PROT_READ, MAP_SHARED, segs[shard].fd, start);
+    if (*base == MAP_FAILED) {
+        perror("mmap");
+        *base = NULL;
+        return NULL;
+    }
+
+    return (char *)*base + (off - start);
+}
+
+
+/**
+ * @function spill_unmap
+ * @brief Rilascia una mappatura ottenuta con spill_map
+ */
+void spill_unmap(void *base, size_t maplen) {
+    if (base != NULL) munmap(base, maplen);
+}
+
+
+/**
+ * @function spill_release
+ * @brief Segnala che un record del segmento non serve più: le sue pagine vengono
+ *        restituite al filesystem e quando il segmento non ha più record validi
+ *        viene troncato
+ *
+ * @param shard  indice del segmento
+ * @param off    offset del record
+ * @param size   lunghezza del record
+ */
+void spill_release(unsigned int shard, off_t off, size_t size) {
+    if (spill_path == NULL || shard >= SPILL_SHARDS) return;
+
+    spill_seg_t *seg = &segs[shard];
+
+    if (pthread_mutex_lock(&seg->mtx) != 0) return;
+
+    seg->live--;
+    seg->bytes -= size;
+    seg->dead  += size;
+
+    //durante spill_hold lo spazio viene liberato dopo (se manca memoria per ricordare
+    //il record lo recupera il troncamento del segmento)
+    if (seg->hold == 0) reclaim(seg, off, size);
+    else {
+        if (seg->npend == seg->cpend) {
+            size_t ncap = (seg->cpend == 0) ? 16 : seg->cpend * 2;
+            spill_range_t *tmp = realloc(seg->pend, ncap * sizeof(spill_range_t));
+            if (tmp != NULL) {
+                seg->pend  = tmp;
+                seg->cpend = ncap;
+            }
+        }
+        if (seg->npend < seg->cpend) {
+            seg->pend[seg->npend].off  = off;
+            seg->pend[seg->npend].size = size;
+            seg->npend++;
+        }
+    }
+
+    pthread_mutex_unlock(&seg->mtx);
+}
+
+
+/**
+ * @function spill_hold
+ * @brief Sospende la liberazione dello spazio dei record rilasciati (i segmenti non
+ *        vengono modificati se non in fondo), finchè non viene chiamata spill_unhold
+ *
+ * @note: serve mentre un processo figlio (BGSAVE) legge i record dei segmenti, che
+ *        sono condivisi con il padre
+ */
+void spill_hold() {
+    if (spill_path == NULL) return;
+
+    for (unsigned int i = 0; i < SPILL_SHARDS; i++) {
+        if (pthread_mutex_lock(&segs[i].mtx) != 0) continue;
+        segs[i].hold++;
+        pthread_mutex_unlock(&segs[i].mtx);
+    }
+}
+
+
+/**
+ * @function spill_unhold
+ * @brief Libera lo spazio dei record rilasciati dopo spill_hold
+ */
+void spill_unhold() {
+    if (spill_path == NULL) return;
+
+    for (unsigned int i = 0; i < SPILL_SHARDS; i++) {
+        spill_seg_t *seg = &segs[i];
+        if (pthread_mutex_lock(&seg->mtx) != 0) continue;
+        if (seg->hold > 0 && --seg->hold == 0) {
+            for (size_t j = 0; j < seg->npend; j++) reclaim(seg, seg->pend[j].off, seg->pend[j].size);
+            //troncamento mancato (segmento svuotato senza record da ricordare)
+            if (seg->live == 0) reclaim(seg, 0, 0);
+            seg->npend = 0;
+        }
+        pthread_mutex_unlock(&seg->mtx);
+    }
+}
+
+
+/**
+ * @function spill_print_stats
+ * @brief Scrive una riga di commento ('#') per ogni segmento non vuoto con record
+ *        validi, byte validi, byte rilasciati dall'ultimo troncamento, lunghezza del
+ *        file e kB occupati su disco
+ *
+ * @param fout  file su cui scrivere
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int spill_print_stats(FILE *fout) {
+    if (spill_path == NULL) return 0;
+
+    for (unsigned int i = 0; i < SPILL_SHARDS; i++) {
+        spill_seg_t *seg = &segs[i];
+        struct stat st;
+        if (pthread_mutex_lock(&seg->mtx) != 0) return -1;
+        long live = seg->live;
+        size_t bytes = seg->bytes, dead = seg->dead;
+        off_t end = seg->end;
+        int check = fstat(seg->fd, &st);
+        pthread_mutex_unlock(&seg->mtx);
+
+        if (end == 0) continue;
+        unsigned long kb = (check == 0) ? (unsigned long)st.st_blocks / 2 : 0;
+        if (fprintf(fout, "# spill seg%02u %ld %zu %zu %lld %lu\n", i, live, bytes, dead,
+                    (long long)end, kb) < 0) return -1;
+    }
+
+    return 0;
+}
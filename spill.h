@@ -0,0 +1,165 @@
+/**
+ * @file spill.h
+ * @brief File per la gestione dei segmenti su disco in cui vengono scaricate le history
+ *        degli utenti offline. I segmenti sono SPILL_SHARDS file append-only nella
+ *        sottodirectory SPILL_DIR di DirName; ogni blocco di messaggi scaricato è un
+ *        record contiguo di un segmento, che viene mappato in memoria per rileggerlo.
+ *        I record iniziano ad un confine di pagina: lo spazio di un record rilasciato
+ *        viene restituito subito al filesystem (FALLOC_FL_PUNCH_HOLE) ed il segmento
+ *        viene troncato quando non ha più record validi.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef SPILL_H_
+#define SPILL_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+
+//numero di segmenti (ognuno con la propria lock)
+#define  SPILL_SHARDS    16
+
+//sottodirectory di DirName che contiene i segmenti (gli utenti non possono
+//salvare file che iniziano con '.', vedi get_filename in files_handler.h)
+#define  SPILL_DIR       ".history"
+
+
+
+/* ---------------------- interfaccia spill  --------------------- */
+
+/**
+ * @function init_spill
+ * @brief Crea la directory dei segmenti in dir_name ed apre (troncandoli) i segmenti
+ *
+ * @param dir_name  directory dei file del server
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int init_spill(char *dir_name);
+
+
+/**
+ * @function clean_spill
+ * @brief Chiude ed elimina i segmenti e la loro directory
+ */
+void clean_spill();
+
+
+/**
+ * @function spill_enabled
+ * @brief Dice se i segmenti sono stati inizializzati
+ *
+ * @return 1 se è possibile scaricare le history su disco, 0 altrimenti
+ */
+int spill_enabled();
+
+
+/**
+ * @function spill_shard
+ * @brief Ritorna il segmento in cui scrivere i record di una chiave (nome utente)
+ *
+ * @param key  chiave del record
+ *
+ * @return indice del segmento (tra 0 e SPILL_SHARDS-1)
+ */
+unsigned int spill_shard(const char *key);
+
+
+/**
+ * @function spill_append
+ * @brief Scrive un record in fondo al segmento indicato (all'inizio di una pagina)
+ *
+ * @param shard  indice del segmento
+ * @param buf    dati del record
+ * @param size   lunghezza del record
+ * @param off    offset del record nel segmento (in uscita)
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int spill_append(unsigned int shard, const char *buf, size_t size, off_t *off);
+
+
+/**
+ * @function spill_read
+ * @brief Legge len byte di un record scritto con spill_append (l'intestazione)
+ *
+ * @param shard  indice del segmento
+ * @param off    offset da cui leggere
+ * @param buf    buffer in cui scrivere i dati
+ * @param len    byte da leggere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int spill_read(unsigned int shard, off_t off, void *buf, size_t len);
+
+
+/**
+ * @function spill_map
+ * @brief Mappa in memoria (sola lettura) un record scritto con spill_append
+ *
+ * @param shard   indice del segmento
+ * @param off     offset del record
+ * @param size    lunghezza del record
+ * @param base    indirizzo della mappatura da passare a spill_unmap (in uscita)
+ * @param maplen  lunghezza della mappatura da passare a spill_unmap (in uscita)
+ *
+ * @return puntatore all'inizio del record, NULL ed errno settato in caso di errore
+ */
+char *spill_map(unsigned int shard, off_t off, size_t size, void **base, size_t *maplen);
+
+
+/**
+ * @function spill_unmap
+ * @brief Rilascia una mappatura ottenuta con spill_map
+ */
+void spill_unmap(void *base, size_t maplen);
+
+
+/**
+ * @function spill_release
+ * @brief Segnala che un record del segmento non serve più: le sue pagine vengono
+ *        restituite al filesystem e quando il segmento non ha più record validi
+ *        viene troncato
+ *
+ * @param shard  indice del segmento
+ * @param off    offset del record
+ * @param size   lunghezza del record
+ */
+void spill_release(unsigned int shard, off_t off, size_t size);
+
+
+/**
+ * @function spill_hold
+ * @brief Sospende la liberazione dello spazio dei record rilasciati (i segmenti non
+ *        vengono modificati se non in fondo), finchè non viene chiamata spill_unhold
+ *
+ * @note: serve mentre un processo figlio (BGSAVE) legge i record dei segmenti, che
+ *        sono condivisi con il padre
+ */
+void spill_hold();
+
+
+/**
+ * @function spill_unhold
+ * @brief Libera lo spazio dei record rilasciati dopo spill_hold
+ */
+void spill_unhold();
+
+
+
+/**
+ * @function spill_print_stats
+ * @brief Scrive una riga di commento ('#') per ogni segmento non vuoto con record
+ *        validi, byte validi, byte rilasciati dall'ultimo troncamento, lunghezza del
+ *        file e kB occupati su disco
+ *
+ * @param fout  file su cui scrivere
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int spill_print_stats(FILE *fout);
+
+
+#endif /* SPILL_H_ */
@@ -22,6 +22,16 @@ struct statistics {
     unsigned long nfilenotdelivered;            // n. di file non ancora consegnati
     unsigned long nerrors;                      // n. di messaggi di errore
     unsigned long ngroups;                      // n. di gruppi utenti 
+    unsigned long nexpired;                     // n. di messaggi eliminati perchè scaduti (MsgTTL)
+    unsigned long nexpiredbytes;                // memoria liberata dai messaggi scaduti
+    unsigned long nhistbytes;                   // byte dei messaggi nelle history (anche su disco)
+    unsigned long nevicted;                     // n. di messaggi eliminati per i limiti di memoria
+    unsigned long nzraw;                        // byte originali dei messaggi compressi in memoria
+    unsigned long nzbytes;                      // byte dei messaggi compressi in memoria
+    unsigned long nzusec;                       // tempo di cpu (us) per comprimere e decomprimere
+    unsigned long nnamesneg;                    // n. di nomi non registrati scartati dal filtro
+    unsigned long nnamesfp;                     // n. di falsi positivi del filtro dei nomi
+    unsigned long nnamesfpr;                    // falsi positivi del filtro per milione di nomi non registrati
 };
 
 
@@ -61,7 +71,7 @@ static inline int unlock_stats() {
 static inline int printStats(FILE *fout) {
     extern struct statistics chattyStats;
 
-    if (fprintf(fout, "%ld - %ld %ld %ld %ld %ld %ld %ld %ld\n",
+    if (fprintf(fout, "%ld - %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld\n",
 		(unsigned long)time(NULL),
 		chattyStats.nusers, 
 		chattyStats.nonline,
@@ -70,7 +80,17 @@ static inline int printStats(FILE *fout) {
 		chattyStats.nfiledelivered,
 		chattyStats.nfilenotdelivered,
 		chattyStats.nerrors,
-        chattyStats.ngroups
+        chattyStats.ngroups,
+        chattyStats.nexpired,
+        chattyStats.nexpiredbytes,
+        chattyStats.nhistbytes,
+        chattyStats.nevicted,
+        chattyStats.nzraw,
+        chattyStats.nzbytes,
+        chattyStats.nzusec,
+        chattyStats.nnamesneg,
+        chattyStats.nnamesfp,
+        chattyStats.nnamesfpr
 		) < 0) return -1;
     fflush(fout);
     return 0;
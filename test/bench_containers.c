@@ -0,0 +1,124 @@
+/**
+ * @file bench_containers.c
+ * @brief Microbenchmark che confronta le ricerche generiche (void* + puntatori a funzione)
+ *        di abs_list/abs_hashtable con quelle specializzate generate da abs_typed.h
+ *
+ *        uso: ./bench_containers [n_utenti] [n_ricerche]
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <user.h>
+#include <group.h>
+#include <stats.h>
+#include <intern.h>
+
+
+//variabili globali definite in chatty.c ed usate dalla libreria
+configs_t conf_server;
+struct statistics chattyStats = { 0,0,0,0,0,0,0 };
+pthread_mutex_t mtx_stats = PTHREAD_MUTEX_INITIALIZER;
+
+//numero di gruppi nella lista gruppi dell'utente di prova
+#define  N_GROUPS   64
+
+
+/**
+ * @function now_ns
+ * @brief Ritorna il tempo corrente in nanosecondi
+ */
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/**
+ * @function report
+ * @brief Stampa il risultato di un confronto generico/specializzato
+ */
+static void report(char *what, double generic, double typed, long n) {
+    printf("%-28s generic %8.1f ns/op   typed %8.1f ns/op   speedup %.2fx\n",
+           what, generic / n, typed / n, generic / typed);
+}
+
+
+int main(int argc, char *argv[]) {
+    long n_users  = (argc > 1) ? atol(argv[1]) : 10000;
+    long n_search = (argc > 2) ? atol(argv[2]) : 2000000;
+    long i = 0, found = 0;
+    double t0 = 0, generic = 0, typed = 0;
+
+    conf_server.max_conn     = 32;
+    conf_server.max_hist_msg = 16;
+
+    //i workers cercano senza lock, faccio lo stesso
+    if (epoch_register() == -1) return 1;
+
+    //tabella hash degli utenti come in thread_pool.c
+    hashtable_t *ht = init_hashtable(conf_server.max_conn, 10, clean_user, cmp_user_by_name,
+                                     hashfun_user, setmutex_user);
+    if (ht == NULL) return 1;
+    set_intrusive_ht(ht, offsetof(user_t, ht_node));
+
+    char (*names)[MAX_NAME_LENGTH+1] = malloc(n_users * sizeof(*names));
+    if (names == NULL) return 1;
+    for (i = 0; i < n_users; i++) {
+        snprintf(names[i], MAX_NAME_LENGTH+1, "user%ld", i);
+        user_t *us = create_user(names[i], 0);
+        if (us == NULL || add_data_ht(ht, us, (void *)us->nickname) != 1) return 1;
+    }
+
+    //ricerca nella tabella hash degli utenti
+    t0 = now_ns();
+    for (i = 0; i < n_search; i++) found += (search_data_ht(ht, names[(i * 7919) % n_users]) != NULL);
+    generic = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < n_search; i++) found += (users_ht_search(ht, names[(i * 7919) % n_users]) != NULL);
+    typed = now_ns() - t0;
+
+    report("users hashtable lookup", generic, typed, n_search);
+
+    //ricerca nella lista gruppi di un utente
+    list_t *groups = init_list(DEFAULT_LEN, NULL, NULL, cmp_group);
+    if (groups == NULL) return 1;
+    group_t *gr = calloc(N_GROUPS, sizeof(group_t));
+    if (gr == NULL) return 1;
+    for (i = 0; i < N_GROUPS; i++) {
+        snprintf(gr[i].groupname, MAX_NAME_LENGTH+1, "group%ld", i);
+        if (add_data(groups, &gr[i], gr[i].groupname) != 1) return 1;
+    }
+
+    t0 = now_ns();
+    for (i = 0; i < n_search; i++) found += (search_data(groups, gr[i % N_GROUPS].groupname) != NULL);
+    generic = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < n_search; i++) found += (user_groups_search(groups, gr[i % N_GROUPS].groupname) != NULL);
+    typed = now_ns() - t0;
+
+    report("groups-per-user lookup", generic, typed, n_search);
+
+    if (found != 4 * n_search) {
+        fprintf(stderr, "Errore: trovati %ld elementi su %ld\n", found, 4 * n_search);
+        return 1;
+    }
+
+    clean_list(groups);
+    free(gr);
+    clean_hashtable(ht);
+    free(names);
+    epoch_unregister();
+    epoch_cleanup();
+    intern_cleanup();
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file bench_groups.c
+ * @brief Benchmark delle operazioni sui membri di un gruppo grande: iscrizioni,
+ *        controlli di appartenenza (iscrizione di un membro già presente), invio di
+ *        un messaggio a tutti i membri e rimozioni
+ *
+ *        uso: ./bench_groups [n_membri] [n_invii]
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <user.h>
+#include <group.h>
+#include <stats.h>
+#include <intern.h>
+
+
+//variabili globali definite in chatty.c ed usate dalla libreria
+configs_t conf_server;
+struct statistics chattyStats = { 0,0,0,0,0,0,0 };
+pthread_mutex_t mtx_stats = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * @function now_ns
+ * @brief Ritorna il tempo corrente in nanosecondi
+ */
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+int main(int argc, char *argv[]) {
+    long n_members = (argc > 1) ? atol(argv[1]) : 10000;
+    long n_posts   = (argc > 2) ? atol(argv[2]) : 100;
+    long i = 0, ok = 0;
+    double t0 = 0;
+
+    //history disabilitata: l'invio misura la scansione dei membri, non le history
+    conf_server.max_hist_msg = 0;
+
+    if (n_members < 1 || epoch_register() == -1) return 1;
+
+    //mutex ricorsiva come quelle delle tabelle hash (vedi thread_pool.c)
+    pthread_mutexattr_t attr;
+    pthread_mutex_t mtx;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mtx, &attr);
+
+    //utenti offline, i messaggi finiscono nelle history
+    user_t **users = malloc(n_members * sizeof(user_t *));
+    if (users == NULL) return 1;
+    char name[MAX_NAME_LENGTH+1];
+    for (i = 0; i < n_members; i++) {
+        snprintf(name, MAX_NAME_LENGTH+1, "user%ld", i);
+        users[i] = create_user(name, 0);
+        if (users[i] == NULL) return 1;
+        setmutex_user(users[i], &mtx);
+        users[i]->status = OFFLINE;
+    }
+
+    group_t *gr = create_group("gruppo", users[0]);
+    if (gr == NULL) return 1;
+    setmutex_group(gr, &mtx);
+
+    //iscrizioni
+    t0 = now_ns();
+    for (i = 1; i < n_members; i++) ok += (add_member(gr, users[i]) == 1);
+    double join = now_ns() - t0;
+
+    //controlli di appartenenza: l'utente è già membro
+    t0 = now_ns();
+    for (i = 0; i < n_members; i++) ok += (add_member(gr, users[(i * 7919) % n_members]) == 0);
+    double member = now_ns() - t0;
+
+    //invio a tutti i membri
+    message_t msg;
+    memset(&msg, 0, sizeof(message_t));
+    setHeader(&msg.hdr, TXT_MESSAGE, "user0");
+    setData(&msg.data, "gruppo", "ciao", 5);
+    param_postmsg_all_t prm;
+    memset(&prm, 0, sizeof(param_postmsg_all_t));
+    prm.msg_to_send = &msg;
+    t0 = now_ns();
+    for (i = 0; i < n_posts; i++) ok += (postmsg_all_group(gr, &prm) == 1);
+    double post = now_ns() - t0;
+
+    //rimozioni
+    int is_creator = 0;
+    t0 = now_ns();
+    for (i = 1; i < n_members; i++) ok += (remove_member(gr, users[(i * 7919) % n_members], &is_creator) != NULL);
+    double leave = now_ns() - t0;
+
+    printf("membri                %ld\n", n_members);
+    printf("iscrizione            %10.1f ns/op\n", join / (n_members - 1));
+    printf("controllo membro      %10.1f ns/op\n", member / n_members);
+    printf("invio al gruppo       %10.1f ns/membro\n", post / (n_posts * (double)n_members));
+    printf("rimozione             %10.1f ns/op\n", leave / (n_members - 1));
+
+    long expected = 2 * (n_members - 1) + n_members + n_posts;
+    if (ok != expected || prm.notdelivered != n_posts * n_members) {
+        fprintf(stderr, "Errore: %ld operazioni riuscite su %ld\n", ok, expected);
+        return 1;
+    }
+
+    clean_group(gr);
+    for (i = 0; i < n_members; i++) clean_user(users[i]);
+    free(users);
+    pthread_mutex_destroy(&mtx);
+    epoch_unregister();
+    epoch_cleanup();
+    intern_cleanup();
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file bench_users.c
+ * @brief Benchmark della memoria occupata dagli utenti registrati: registra n utenti
+ *        nella tabella hash (come REGISTER_OP) e stampa la memoria residente (RSS)
+ *        per utente, insieme alla dimensione delle strutture di ogni utente
+ *
+ *        uso: ./bench_users [n_utenti]
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <user.h>
+#include <group.h>
+#include <stats.h>
+#include <intern.h>
+
+
+//variabili globali definite in chatty.c ed usate dalla libreria
+configs_t conf_server;
+struct statistics chattyStats = { 0,0,0,0,0,0,0 };
+pthread_mutex_t mtx_stats = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * @function rss_bytes
+ * @brief Ritorna la memoria residente del processo in byte (0 se non disponibile)
+ */
+static long rss_bytes() {
+    long pages = 0, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) rss = 0;
+    fclose(fp);
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+
+int main(int argc, char *argv[]) {
+    long n_users = (argc > 1) ? atol(argv[1]) : 1000000;
+    long i = 0;
+
+    //le liste di trabocco hanno al massimo DEFAULT_LEN elementi: la tabella è
+    //dimensionata come quella di un server con MaxConnections = 1024
+    conf_server.max_conn     = 1024;
+    conf_server.max_hist_msg = 16;
+
+    if (n_users < 1 || epoch_register() == -1) return 1;
+
+    //tabella hash degli utenti come in thread_pool.c
+    hashtable_t *ht = init_hashtable(conf_server.max_conn, 10, clean_user, cmp_user_by_name,
+                                     hashfun_user, setmutex_user);
+    if (ht == NULL) return 1;
+    set_intrusive_ht(ht, offsetof(user_t, ht_node));
+
+    long before = rss_bytes();
+
+    char name[MAX_NAME_LENGTH+1];
+    for (i = 0; i < n_users; i++) {
+        snprintf(name, MAX_NAME_LENGTH+1, "user%ld", i);
+        user_t *us = create_user(name, 0);
+        if (us == NULL || add_data_ht(ht, us, (void *)us->nickname) != 1) return 1;
+    }
+
+    long after = rss_bytes();
+
+    printf("sizeof(user_t)     %zu\n", sizeof(user_t));
+    printf("sizeof(history_t)  %zu\n", sizeof(history_t));
+    printf("utenti             %ld\n", n_users);
+    printf("rss prima          %ld KB\n", before / 1024);
+    printf("rss dopo           %ld KB\n", after / 1024);
+    printf("rss per utente     %.1f byte\n", (double)(after - before) / n_users);
+
+    clean_hashtable(ht);
+    epoch_unregister();
+    epoch_cleanup();
+    intern_cleanup();
+
+    return 0;
+}
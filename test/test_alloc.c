@@ -0,0 +1,227 @@
+/**
+ * @file test_alloc.c
+ * @brief Test delle allocazioni a regime: il thread pool del server riceve le
+ *        richieste su coppie di socket (il test fa da listener e da client), dopo
+ *        un riscaldamento si conta ogni malloc/calloc/realloc fatta dai thread del
+ *        server durante un ciclo di POSTTXT tra due utenti online. Il test passa se
+ *        il contatore resta a 0 (richieste nell'arena dei workers, messaggi delle
+ *        history nelle slab).
+ *
+ *        Il server gira con il log su disco (in una directory temporanea), con la
+ *        scadenza dei messaggi e con la compressione delle history, ed i messaggi
+ *        sono abbastanza lunghi da essere compressi: a regime non devono allocare
+ *        nemmeno log_append, il thread che scrive il log e compress_slot.
+ *        Restano fuori i messaggi agli utenti offline (spill su disco), le snapshot
+ *        ed i timer che scadono durante il test (MsgTTL è più lungo del test).
+ *
+ *        le allocazioni sono contate con -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,
+ *        che vede solo le chiamate dei file oggetto del server e non quelle fatte
+ *        dentro la libc (ad esempio da fopen)
+ *        uso: ./test_alloc [file_conf] [n_post]
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+
+#include <thread_pool.h>
+#include <fd_queue.h>
+#include <pipe_fd.h>
+#include <connections.h>
+#include <message.h>
+#include <config.h>
+#include <stats.h>
+#include <history.h>
+
+
+//variabili globali definite in chatty.c ed usate dalla libreria
+configs_t conf_server;
+struct statistics chattyStats = { 0,0,0,0,0,0,0 };
+pthread_mutex_t mtx_stats = PTHREAD_MUTEX_INITIALIZER;
+
+
+//allocazioni dei thread del server (quelle del test non contano)
+static pthread_t     main_tid;
+static int           counting = 0;
+static unsigned long nalloc   = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static void count_alloc() {
+    if (__atomic_load_n(&counting, __ATOMIC_RELAXED) && !pthread_equal(pthread_self(), main_tid)) {
+        __atomic_add_fetch(&nalloc, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    count_alloc();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    count_alloc();
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    count_alloc();
+    return __real_realloc(ptr, size);
+}
+
+
+//coda e pipe verso il thread pool (al posto del listener)
+static fd_queue_t *fd_queue = NULL;
+static pipe_fd_t  *pipe_fd  = NULL;
+
+
+/**
+ * @function request
+ * @brief Invia una richiesta dal client, la passa ai workers ed aspetta che sia eseguita
+ *
+ * @return op della risposta, -1 in caso di errore
+ */
+static int request(int cfd, int sfd, op_t op, char *sender, char *receiver, char *buf) {
+    message_t msg;
+    setHeader(&msg.hdr, op, sender);
+    setData(&msg.data, receiver, buf, (buf != NULL) ? strlen(buf) + 1 : 0);
+    if (sendRequest(cfd, &msg) <= 0) return -1;
+
+    //il worker esegue la richiesta e lo comunica al listener (come nel listener si
+    //aspetta con la select: read_pipe tiene la lock della pipe mentre legge)
+    int fd = 0;
+    op_pipe_t pop;
+    fd_set set;
+    if (push_fd(fd_queue, sfd) != 0) return -1;
+    FD_ZERO(&set);
+    FD_SET(pipe_fd->pipe_read, &set);
+    if (select(pipe_fd->pipe_read + 1, &set, NULL, NULL, NULL) != 1) return -1;
+    if (read_pipe(pipe_fd, &fd, &pop) == -1 || fd != sfd || pop != UPDATE) return -1;
+
+    //risposta: la lista degli utenti online arriva con l'esito di REGISTER_OP
+    if (readHeader(cfd, &msg.hdr) <= 0) return -1;
+    if (op == REGISTER_OP && msg.hdr.op == OP_OK) {
+        if (readData(cfd, &msg.data) <= 0) return -1;
+        free(msg.data.buf);
+    }
+
+    return msg.hdr.op;
+}
+
+
+/**
+ * @function receive
+ * @brief Legge un messaggio testuale arrivato al client
+ *
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int receive(int cfd) {
+    message_t msg;
+    if (readMsg(cfd, &msg) <= 0) return -1;
+    free(msg.data.buf);
+    return (msg.hdr.op == TXT_MESSAGE) ? 0 : -1;
+}
+
+
+/**
+ * @function remove_dir
+ * @brief Cancella la directory del log con i file che contiene
+ */
+static void remove_dir(const char *path) {
+    DIR *d = opendir(path);
+    if (d == NULL) return;
+
+    struct dirent *e = NULL;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        unlinkat(dirfd(d), e->d_name, 0);
+    }
+    closedir(d);
+    rmdir(path);
+}
+
+
+int main(int argc, char *argv[]) {
+    char *conf = (argc > 1) ? argv[1] : "DATA/chatty.conf1";
+    long n_posts = (argc > 2) ? atol(argv[2]) : 1000;
+    long n_warm  = 0, i = 0;
+    int a[2], b[2];
+
+    main_tid = pthread_self();
+
+    if (configura_server(conf, &conf_server) == -1) return 1;
+
+    //log su disco, messaggi con scadenza (il timer viene messo dal primo messaggio)
+    //e history compresse oltre i compress_age messaggi più recenti
+    char pdir[] = "/tmp/test_alloc_XXXXXX";
+    if (mkdtemp(pdir) == NULL) return 1;
+    free(conf_server.persist_dir);
+    conf_server.persist_dir   = strdup(pdir);
+    conf_server.snap_interval = 0;
+    conf_server.msg_ttl       = 3600;
+    if (conf_server.persist_dir == NULL) return 1;
+    if (conf_server.compress_age == 0 || conf_server.compress_age >= conf_server.max_hist_msg) {
+        conf_server.compress_age = conf_server.max_hist_msg / 2;
+    }
+    set_compress_history(conf_server.compress_age);
+    //riscaldamento: le history si riempiono e cominciano a scartare i messaggi
+    n_warm = 4 * conf_server.max_hist_msg + 64;
+
+    fd_queue = init_fd_queue();
+    pipe_fd  = init_pipe_fd();
+    if (fd_queue == NULL || pipe_fd == NULL) return 1;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, a) == -1) return 1;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, b) == -1) return 1;
+
+    //un errore nei workers termina il test (SIGUSR2 al thread principale)
+    hl_thread_pool_t *htp = starts_thread_pool(fd_queue, pipe_fd, main_tid);
+    if (htp == NULL) return 1;
+
+    int ok = (request(a[0], a[1], REGISTER_OP, "alice", "", NULL) == OP_OK &&
+              request(b[0], b[1], REGISTER_OP, "bob", "", NULL) == OP_OK);
+
+    //più lungo di HIST_COMPRESS_MIN e comprimibile
+    char text[] = "messaggio di prova per il test delle allocazioni, "
+                  "messaggio di prova per il test delle allocazioni";
+    for (i = 0; ok && i < n_warm + n_posts; i++) {
+        if (i == n_warm) __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+        ok = (request(a[0], a[1], POSTTXT_OP, "alice", "bob", text) == OP_OK &&
+              receive(b[0]) == 0);
+    }
+    __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+
+    //i messaggi consegnati devono essere stati compressi
+    history_zstats_t z;
+    compress_stats_history(&z);
+
+    ends_thread_pool(htp);
+    clean_fd_queue(fd_queue);
+    clean_pipe_fd(pipe_fd);
+    clean_configs(&conf_server);
+    close(a[0]); close(a[1]);
+    close(b[0]); close(b[1]);
+    remove_dir(pdir);
+
+    if (!ok) {
+        fprintf(stderr, "test_alloc: errore nelle richieste (post %ld)\n", i);
+        return 1;
+    }
+    if (z.raw == 0) {
+        fprintf(stderr, "test_alloc: nessun messaggio compresso\n");
+        return 1;
+    }
+
+    printf("test_alloc: %ld POSTTXT a regime (log, ttl, %zu -> %zu byte compressi), "
+           "%lu allocazioni nei thread del server\n", n_posts, z.raw, z.bytes, nalloc);
+    return (nalloc == 0) ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#!/bin/bash
+
+if [[ $# != 1 ]]; then
+    echo "usa $0 unix_path"
+    exit 1
+fi
+
+# esiti che mi aspetto per ogni utente
+OP_OK=20
+OP_FAIL=25
+OP_NICK_ALREADY=26
+OP_NICK_UNKNOWN=27
+OP_NO_CREATOR=30
+
+# controlla che il comando termini con successo e che gli esiti siano quelli attesi
+# uso: esiti "esiti attesi" opzioni del client
+esiti() {
+    local attesi=$1
+    shift
+    local out
+    out=$(./client -l $SOCK "$@")
+    if [[ $? != 0 ]]; then
+        echo "Operazione fallita: $*"
+        exit 1
+    fi
+    if [[ $(echo "$out" | grep "^Esiti:") != "Esiti: $attesi" ]]; then
+        echo "Esiti non corrispondenti per $*: $(echo "$out" | grep "^Esiti:")"
+        exit 1
+    fi
+}
+
+# controlla che il comando fallisca con l'errore atteso
+# uso: errore codice opzioni del client
+errore() {
+    local atteso=$1
+    shift
+    ./client -l $SOCK "$@"
+    e=$?
+    if [[ $((256-e)) != $atteso ]]; then
+        echo "Errore non corrispondente $e"
+        exit 1
+    fi
+}
+
+SOCK=$1
+
+# registro un po' di nickname
+./client -l $1 -c pippo &
+./client -l $1 -c pluto &
+./client -l $1 -c minni &
+./client -l $1 -c topolino &
+wait
+
+# pippo crea il gruppo1 con pluto e minni (nessuno non esiste, pippo è già membro)
+esiti "$OP_OK $OP_OK $OP_NICK_UNKNOWN $OP_FAIL" -k pippo -W gruppo1:pluto,minni,nessuno,pippo
+
+# il gruppo esiste già
+errore $OP_NICK_ALREADY -k pluto -W gruppo1:topolino
+
+# solo il creatore può iscrivere o rimuovere utenti
+errore $OP_NO_CREATOR -k pluto -A gruppo1:topolino
+errore $OP_NO_CREATOR -k pluto -D gruppo1:minni
+
+# il gruppo non esiste
+errore $OP_NICK_UNKNOWN -k pippo -A gruppo2:topolino
+
+# iscrivo topolino (minni è già membro)
+esiti "$OP_OK $OP_FAIL" -k pippo -A gruppo1:topolino,minni
+
+# rimuovo minni (il creatore non si può rimuovere, nessuno non è membro)
+esiti "$OP_OK $OP_FAIL $OP_NICK_UNKNOWN" -k pippo -D gruppo1:minni,pippo,nessuno
+
+# minni non è più iscritta, topolino sì
+errore $OP_NICK_UNKNOWN -k minni -S "Ciao sono minni":gruppo1
+./client -l $1 -k topolino -S "Ciao sono topolino":gruppo1
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+# cancello il gruppo3 (deregistrando il creatore) mentre i membri ci scrivono:
+# chi lo trova in fase di cancellazione deve vederlo come inesistente
+esiti "$OP_OK $OP_OK" -k pluto -W gruppo3:minni,topolino
+pids=""
+for u in minni topolino; do
+    (for((i=0;i<10;++i)); do
+        ./client -l $SOCK -k $u -S "Ciao da $u":gruppo3 >/dev/null 2>&1
+        e=$?
+        if [[ $e != 0 && $((256-e)) != $OP_NICK_UNKNOWN ]]; then exit $e; fi
+    done) &
+    pids+="$! "
+done
+./client -l $1 -k pluto -C pluto
+for p in $pids; do
+    wait $p
+    e=$?
+    if [[ $e != 0 ]]; then
+        echo "Errore non corrispondente $e"
+        exit 1
+    fi
+done
+
+# dopo la cancellazione il gruppo non esiste più ed il nome è di nuovo libero
+errore $OP_NICK_UNKNOWN -k minni -S "Ciao":gruppo3
+./client -l $1 -c pluto
+errore $OP_NICK_UNKNOWN -k pluto -A gruppo3:minni
+esiti "$OP_OK" -k pluto -W gruppo3:topolino
+
+echo "Test OK!"
+exit 0
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+if [[ $# != 2 ]]; then
+    echo "usa $0 unix_path stat_file"
+    exit 1
+fi
+
+# esiti che mi aspetto per ogni destinatario
+OP_OK=20
+OP_NICK_UNKNOWN=27
+
+./client -l $1 -c pippo
+./client -l $1 -c pluto
+./client -l $1 -c minni
+./client -l $1 -k pippo -g gruppo1
+
+# pippo manda un messaggio a pluto e minni (offline) ripetendo i nomi: un gruppo
+# ed un nome inesistente non sono destinatari validi
+out=$(./client -l $1 -k pippo -M pluto,minni,nessuno,pluto,gruppo1,minni,pluto:"Ciao a tutti")
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+if [[ $(echo "$out" | grep "^Esiti:") != "Esiti: $OP_OK $OP_OK $OP_NICK_UNKNOWN $OP_OK $OP_NICK_UNKNOWN $OP_OK $OP_OK" ]]; then
+    echo "Esiti non corrispondenti: $(echo "$out" | grep "^Esiti:")"
+    exit 1
+fi
+
+# ogni destinatario viene contato una volta sola
+killall -USR1 chatty
+sleep 1
+read deliv notdeliv <<< $(tail -1 $2 | cut -d\  -f 5,6)
+if [[ $deliv != 0 || $notdeliv != 2 ]]; then
+    echo "Test FALLITO"
+    exit 1
+fi
+
+# ed ha ricevuto il messaggio una volta sola
+for u in pluto minni; do
+    n=$(./client -l $1 -k $u -p | grep -c "Ciao a tutti")
+    if [[ $n != 1 ]]; then
+        echo "$u ha ricevuto $n messaggi"
+        exit 1
+    fi
+done
+
+echo "Test OK!"
+exit 0
@@ -0,0 +1,109 @@
+#!/bin/bash
+
+if [[ $# != 1 ]]; then
+    echo "usa $0 unix_path"
+    exit 1
+fi
+
+# messaggio di errore che mi aspetto per utenti/gruppi sconosciuti
+OP_NICK_UNKNOWN=27
+
+# configurazione con la persistenza abilitata
+PERSIST_DIR=/tmp/chatty_persist_test
+CONF=/tmp/chatty_persist_test.conf
+rm -rf $PERSIST_DIR
+sed -e "\$a PersistDir       = $PERSIST_DIR" DATA/chatty.conf1 > $CONF
+
+avvia() {
+    rm -f $1
+    ./chatty -f $CONF &
+    pid=$!
+    sleep 1
+}
+
+# il server viene terminato senza poter salvare niente
+crash() {
+    kill -9 $pid
+    wait $pid 2>/dev/null
+}
+
+# controlla che il comando fallisca con l'errore atteso
+errore() {
+    local atteso=$1
+    shift
+    ./client -l $SOCK "$@"
+    e=$?
+    if [[ $((256-e)) != $atteso ]]; then
+        echo "Errore non corrispondente $e"
+        exit 1
+    fi
+}
+
+SOCK=$1
+avvia $1
+# se il test fallisce non lascio il server attivo
+trap 'kill -9 $pid 2>/dev/null' EXIT
+
+# registro un po' di nickname, creo un gruppo e mando qualche messaggio
+./client -l $1 -c pippo
+./client -l $1 -c pluto
+./client -l $1 -c minni
+./client -l $1 -c qui
+./client -l $1 -k pippo -g gruppo1 && ./client -l $1 -k pluto -a gruppo1 && ./client -l $1 -k minni -a gruppo1
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+./client -l $1 -k pippo -S "Ciao pluto":pluto -S "Ciao a tutti":gruppo1
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+crash
+avvia $1
+
+# utenti, iscrizioni e history sopravvivono al crash
+./client -l $1 -c pippo
+if [[ $? == 0 ]]; then
+    echo "pippo doveva essere registrato"
+    exit 1
+fi
+n=$(./client -l $1 -k pluto -p | grep -c "Ciao pluto\|Ciao a tutti")
+if [[ $n != 2 ]]; then
+    echo "history di pluto persa"
+    exit 1
+fi
+n=$(./client -l $1 -k minni -p | grep -c "Ciao a tutti")
+if [[ $n != 1 ]]; then
+    echo "history di minni persa"
+    exit 1
+fi
+./client -l $1 -k minni -S "Ciao sono minni":gruppo1
+if [[ $? != 0 ]]; then
+    echo "iscrizione di minni persa"
+    exit 1
+fi
+errore $OP_NICK_UNKNOWN -k qui -S "Ciao sono qui":gruppo1
+
+# operazioni dopo il riavvio: minni lascia il gruppo, qui si deregistra
+./client -l $1 -k minni -d gruppo1 && ./client -l $1 -k qui -C qui && ./client -l $1 -k pluto -S "Ciao pippo":pippo
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+crash
+avvia $1
+
+# anche le operazioni successive al primo riavvio vengono ripristinate
+errore $OP_NICK_UNKNOWN -k qui
+errore $OP_NICK_UNKNOWN -k minni -S "Ciao sono minni":gruppo1
+n=$(./client -l $1 -k pippo -p | grep -c "Ciao pippo")
+if [[ $n != 1 ]]; then
+    echo "history di pippo persa"
+    exit 1
+fi
+
+killall -QUIT -w chatty
+rm -rf $PERSIST_DIR $CONF
+
+echo "Test OK!"
+exit 0
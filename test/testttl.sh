@@ -0,0 +1,49 @@
+#!/bin/bash
+
+if [[ $# != 2 ]]; then
+    echo "usa $0 unix_path stat_file"
+    exit 1
+fi
+
+./client -l $1 -c pippo
+./client -l $1 -c pluto
+
+# messaggi scaduti prima dell'invio
+killall -USR1 chatty
+sleep 1
+expired=$(tail -1 $2 | cut -d\  -f 11)
+
+# pippo manda a pluto (offline) un messaggio che scade dopo 1 secondo
+./client -l $1 -k pippo -T "1:messaggio a scadenza":pluto
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+# aspetto che il thread dei ttl lo elimini
+sleep 3
+
+# pluto non deve piu' trovarlo nella history
+n=$(./client -l $1 -k pluto -p | grep -c "messaggio a scadenza")
+if [[ $n != 0 ]]; then
+    echo "Messaggio scaduto ancora nella history"
+    exit 1
+fi
+
+killall -USR1 chatty
+sleep 1
+if [[ $(tail -1 $2 | cut -d\  -f 11) -le $expired ]]; then
+    echo "Test FALLITO"
+    exit 1
+fi
+
+# un ttl non valido viene rifiutato
+OP_FAIL=25
+./client -l $1 -k pippo -T "0:messaggio:pluto"
+e=$?
+if [[ $((256-e)) != $OP_FAIL ]]; then
+    echo "Errore non corrispondente $e"
+    exit 1
+fi
+
+echo "Test OK!"
+exit 0
@@ -9,6 +9,13 @@
 #include <error_handler.h>
 #include <ops.h>
 #include <group.h>
+#include <epoch.h>
+#include <persist.h>
+#include <ttl.h>
+#include <reclaim.h>
+#include <names.h>
+#include <intern.h>
+#include <slab.h>
 
 
 //configurazioni del server (definita in chatty.c)
@@ -88,6 +95,8 @@ hl_thread_pool_t* starts_thread_pool(fd_queue_t *fd_queue, pipe_fd_t *pipe_fd, p
     //      cresca/diminuisca di dimensione in base alle configurazioni date
     htp->hash_users = init_hashtable(conf_server.max_conn, 10, clean_user, cmp_user_by_name, hashfun_user, setmutex_user);
     err_return_msg_clean(htp->hash_users,NULL,NULL,"Errore: init_hashtable\n",ends_thread_pool(htp));
+    //i nodi delle liste sono contenuti nelle strutture utente
+    set_intrusive_ht(htp->hash_users, offsetof(user_t, ht_node));
 
     //creo la tabella hash dei gruppi utente
     //nota: passo come parametro la metà di max connessioni in modo che la tabella hash
@@ -96,6 +105,29 @@ hl_thread_pool_t* starts_thread_pool(fd_queue_t *fd_queue, pipe_fd_t *pipe_fd, p
     if (conf_server.max_conn > 1) n_mtx_groups = (int)(conf_server.max_conn / 2);
     htp->hash_groups = init_hashtable(n_mtx_groups, 10, clean_group, cmp_group, hashfun_group, setmutex_group);
     err_return_msg_clean(htp->hash_groups,NULL,NULL,"Errore: init_hashtable\n",ends_thread_pool(htp));
+    //i nodi delle liste sono contenuti nelle strutture gruppo
+    set_intrusive_ht(htp->hash_groups, offsetof(group_t, ht_node));
+
+    //allocatore delle richieste e dei messaggi (se non parte si usa malloc)
+    if (slab_init(conf_server.max_msg_size) == -1) perror("slab_init");
+
+    //ripristino lo stato salvato prima di far partire i workers
+    if (conf_server.persist_dir != NULL) {
+        check = persist_start(conf_server.persist_dir, htp->hash_users, htp->hash_groups);
+        err_return_msg_clean(check,-1,NULL,"Errore: persist_start\n",ends_thread_pool(htp));
+    }
+
+    //registro dei nomi di utenti e gruppi (dopo il ripristino, per il filtro)
+    check = names_init(htp->hash_users, htp->hash_groups);
+    err_return_msg_clean(check,-1,NULL,"Errore: names_init\n",ends_thread_pool(htp));
+
+    //avvio il thread che elimina i messaggi scaduti
+    check = ttl_start(htp->hash_users);
+    err_return_msg_clean(check,-1,NULL,"Errore: ttl_start\n",ends_thread_pool(htp));
+
+    //avvio il thread che cancella utenti e gruppi deregistrati
+    check = reclaim_start();
+    err_return_msg_clean(check,-1,NULL,"Errore: reclaim_start\n",ends_thread_pool(htp));
 
     //preparo i parametri per i threads
     for(int i=0; i<nth; i++) {
@@ -175,9 +207,23 @@ void ends_thread_pool(hl_thread_pool_t *htp){
 
     if (htp->th != NULL) free(htp->th);
     if (htp->thARGS != NULL) free(htp->thARGS);
+    //completo le cancellazioni in corso, termino il thread dei messaggi scaduti e salvo
+    //lo stato (i workers sono terminati)
+    reclaim_stop();
+    ttl_stop();
+    persist_stop();
+
+    names_cleanup();
     if (htp->users_on != NULL) clean_list(htp->users_on);
     if (htp->hash_users != NULL) clean_hashtable(htp->hash_users);
     if (htp->hash_groups != NULL) clean_hashtable(htp->hash_groups);
+    //libero gli elementi rimossi dalle tabelle hash non ancora liberati
+    //(i workers sono terminati, nessuno può più leggerli)
+    epoch_cleanup();
+    //i nomi servono fino all'ultimo messaggio liberato
+    intern_cleanup();
+    //gli ultimi messaggi sono stati liberati
+    slab_cleanup();
     //la coda delle richieste è liberata (ed anche creata) in chatty.c
 
     free(htp);
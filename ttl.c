@@ -0,0 +1,333 @@
+/**
+ * @file ttl.c
+ * @brief File contenente l'implementazioni delle funzioni dichiarate in ttl.h
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <error_handler.h>
+#include <ttl.h>
+#include <user.h>
+#include <stats.h>
+#include <epoch.h>
+
+
+//configurazioni del server (definita in chatty.c)
+extern configs_t conf_server;
+
+//statistiche del server (definita in chatty.c)
+extern struct statistics chattyStats;
+
+//secondi coperti dalla timing wheel
+#define  TTL_WHEEL_SPAN   (1UL << (TTL_WHEEL_BITS * TTL_WHEEL_LEVELS))
+
+
+/**
+ * @struct ttl_timer_t
+ * @brief Timer di un utente nella timing wheel
+ *
+ * @var next  timer successivo nello slot
+ * @var when  istante in cui scade il timer
+ * @var name  nome dell'utente
+ */
+typedef struct ttl_timer {
+    struct ttl_timer  *next;
+    time_t            when;
+    char              name[MAX_NAME_LENGTH+1];
+} ttl_timer_t;
+
+
+/* ------------------------------- stato del modulo ------------------------------- */
+
+//timing wheel: lo slot i del livello l contiene i timer che scadono nell'i-esimo
+//intervallo di 64^l secondi (gli slot del livello 0 sono di un secondo)
+static ttl_timer_t *wheel[TTL_WHEEL_LEVELS][TTL_WHEEL_SLOTS];
+
+//ultimo secondo elaborato (0 = wheel vuota e non ancora inizializzata)
+static time_t cur = 0;
+
+//mutex per la wheel e per le richieste al thread
+static pthread_mutex_t mtx_wheel = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond_stop = PTHREAD_COND_INITIALIZER;
+
+//thread che elimina i messaggi scaduti
+static pthread_t   th_sweeper;
+static int         started = 0;
+static int         stop    = 0;
+
+//tabella hash degli utenti
+static hashtable_t *hus = NULL;
+
+//ttl dei messaggi inseriti dal thread (0 = MsgTTL)
+static __thread unsigned int post_ttl = 0;
+
+
+
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function wheel_insert
+ * @brief Inserisce il timer nello slot del livello più basso che contiene la sua
+ *        scadenza (va chiamata con mtx_wheel)
+ */
+static void wheel_insert(ttl_timer_t *t) {
+    time_t when = (t->when <= cur) ? cur + 1 : t->when;
+
+    //oltre la wheel: il timer viene reinserito quando arriva all'ultimo livello
+    unsigned long delta = when - cur;
+    if (delta >= TTL_WHEEL_SPAN) {
+        delta = TTL_WHEEL_SPAN - 1;
+        when  = cur + delta;
+    }
+
+    int l = 0;
+    while (l < TTL_WHEEL_LEVELS - 1 && delta >= (1UL << (TTL_WHEEL_BITS * (l + 1)))) l++;
+
+    unsigned int i = (when >> (TTL_WHEEL_BITS * l)) & (TTL_WHEEL_SLOTS - 1);
+    t->next = wheel[l][i];
+    wheel[l][i] = t;
+}
+
+
+/**
+ * @function wheel_advance
+ * @brief Avanza la wheel fino a now e ritorna la lista dei timer scaduti
+ *        (va chiamata con mtx_wheel)
+ */
+static ttl_timer_t *wheel_advance(time_t now) {
+    ttl_timer_t *due = NULL;
+
+    if (cur == 0) cur = now;
+
+    while (cur < now) {
+        cur++;
+
+        //all'inizio di un intervallo di un livello ne ridistribuisco lo slot nei livelli
+        //sotto (dal più alto, in modo che i timer possano scendere di più livelli)
+        for (int l = TTL_WHEEL_LEVELS - 1; l > 0; l--) {
+            if ((cur & ((1UL << (TTL_WHEEL_BITS * l)) - 1)) != 0) continue;
+            unsigned int i = (cur >> (TTL_WHEEL_BITS * l)) & (TTL_WHEEL_SLOTS - 1);
+            ttl_timer_t *t = wheel[l][i];
+            wheel[l][i] = NULL;
+            while (t != NULL) {
+                ttl_timer_t *next = t->next;
+                if (t->when <= cur) {
+                    t->next = due;
+                    due = t;
+                }
+                else wheel_insert(t);
+                t = next;
+            }
+        }
+
+        //timer del secondo corrente
+        unsigned int i = cur & (TTL_WHEEL_SLOTS - 1);
+        ttl_timer_t *t = wheel[0][i];
+        wheel[0][i] = NULL;
+        while (t != NULL) {
+            ttl_timer_t *next = t->next;
+            if (t->when <= cur) {
+                t->next = due;
+                due = t;
+            }
+            else wheel_insert(t);
+            t = next;
+        }
+    }
+
+    return due;
+}
+
+
+/**
+ * @function expire_due
+ * @brief Elimina i messaggi scaduti degli utenti dei timer in due, libera i timer
+ *        ed aggiorna le statistiche
+ */
+static void expire_due(ttl_timer_t *due, time_t now) {
+    history_expired_t exp;
+    memset(&exp, 0, sizeof(history_expired_t));
+
+    epoch_enter();
+    while (due != NULL) {
+        ttl_timer_t *next = due->next;
+
+        errno = 0;
+        user_t *us = users_ht_search(hus, due->name);
+        if (us == NULL && errno != 0) perror("ttl: users_ht_search");
+        else if (us != NULL && expire_user(us, due->when, now, &exp) == -1) perror("ttl: expire_user");
+
+        free(due);
+        due = next;
+    }
+    epoch_exit();
+
+    if (exp.msgs == 0 && exp.files == 0) return;
+
+    if (lock_stats() != 0) return;
+    chattyStats.nnotdelivered     -= exp.notdelivered;
+    chattyStats.nfilenotdelivered -= exp.filenotdelivered;
+    chattyStats.nexpired          += exp.msgs + exp.files;
+    chattyStats.nexpiredbytes     += exp.bytes;
+    unlock_stats();
+}
+
+
+/**
+ * @function sweeper
+ * @brief Avanza la timing wheel ogni secondo ed elimina i messaggi scaduti, poi
+ *        libera gli elementi ritirati ancora in attesa (vedi epoch_exit)
+ */
+static void *sweeper(void *arg) {
+    int registered = (epoch_register() == 0);
+
+    pthread_mutex_lock(&mtx_wheel);
+    while (!stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec++;
+        pthread_cond_timedwait(&cond_stop, &mtx_wheel, &ts);
+        if (stop) break;
+
+        time_t now = time(NULL);
+        ttl_timer_t *due = wheel_advance(now);
+        pthread_mutex_unlock(&mtx_wheel);
+
+        //senza la lock della wheel: expire_user reinserisce il timer dell'utente
+        if (due != NULL) expire_due(due, now);
+
+        //libero gli elementi ritirati rimasti sotto la soglia di epoch_exit
+        epoch_reclaim();
+
+        pthread_mutex_lock(&mtx_wheel);
+    }
+    pthread_mutex_unlock(&mtx_wheel);
+
+    if (registered) epoch_unregister();
+    return NULL;
+}
+
+
+
+/* -------------------------- interfaccia ttl ------------------------------ */
+
+
+/**
+ * @function ttl_start
+ * @brief Fa partire il thread che elimina i messaggi scaduti
+ *
+ * @param hash_us  tabella hash degli utenti registrati
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int ttl_start(hashtable_t *hash_us) {
+    //controllo gli argomenti
+    err_check_return(hash_us == NULL, EINVAL, "ttl_start", -1);
+
+    hus  = hash_us;
+    stop = 0;
+
+    int check = pthread_create(&th_sweeper, NULL, sweeper, NULL);
+    err_check_return(check != 0, check, "pthread_create", -1);
+    started = 1;
+
+    return 0;
+}
+
+
+/**
+ * @function ttl_stop
+ * @brief Termina il thread e libera i timer rimasti nella timing wheel
+ *
+ * @note: va chiamata prima di liberare la tabella hash degli utenti
+ */
+void ttl_stop() {
+    if (started) {
+        pthread_mutex_lock(&mtx_wheel);
+        stop = 1;
+        pthread_cond_signal(&cond_stop);
+        pthread_mutex_unlock(&mtx_wheel);
+        pthread_join(th_sweeper, NULL);
+        started = 0;
+    }
+
+    //libero i timer rimasti
+    pthread_mutex_lock(&mtx_wheel);
+    for (int l = 0; l < TTL_WHEEL_LEVELS; l++) {
+        for (int i = 0; i < TTL_WHEEL_SLOTS; i++) {
+            while (wheel[l][i] != NULL) {
+                ttl_timer_t *t = wheel[l][i];
+                wheel[l][i] = t->next;
+                free(t);
+            }
+        }
+    }
+    cur = 0;
+    pthread_mutex_unlock(&mtx_wheel);
+    hus = NULL;
+}
+
+
+/**
+ * @function ttl_schedule
+ * @brief Inserisce nella timing wheel un timer per l'utente name
+ *
+ * @param name  nome dell'utente
+ * @param when  istante in cui scade il timer
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int ttl_schedule(const char *name, time_t when) {
+    //controllo gli argomenti
+    err_check_return(name == NULL, EINVAL, "ttl_schedule", -1);
+    err_check_return(when <= 0, EINVAL, "ttl_schedule", -1);
+
+    ttl_timer_t *t = malloc(sizeof(ttl_timer_t));
+    err_return_msg(t,NULL,-1,"Errore: malloc\n");
+    t->when = when;
+    strncpy(t->name, name, MAX_NAME_LENGTH+1);
+    t->name[MAX_NAME_LENGTH] = '\0';
+
+    int check = pthread_mutex_lock(&mtx_wheel);
+    err_check_return(check != 0, check, "pthread_mutex_lock", -1);
+
+    if (cur == 0) cur = time(NULL);
+    wheel_insert(t);
+
+    check = pthread_mutex_unlock(&mtx_wheel);
+    err_check_return(check != 0, check, "pthread_mutex_unlock", -1);
+
+    return 0;
+}
+
+
+/**
+ * @function ttl_set_post
+ * @brief Fissa il ttl dei messaggi inseriti nelle history dal thread chiamante
+ *        (vale fino alla prossima chiamata)
+ *
+ * @param ttl  secondi, 0 = si usa MsgTTL
+ */
+void ttl_set_post(unsigned int ttl) {
+    post_ttl = ttl;
+}
+
+
+/**
+ * @function ttl_post_expire
+ * @brief Ritorna la scadenza di un messaggio inserito ora dal thread chiamante
+ *
+ * @return istante, 0 se il messaggio non scade
+ */
+time_t ttl_post_expire() {
+    unsigned int ttl = (post_ttl != 0) ? post_ttl : conf_server.msg_ttl;
+    if (ttl == 0) return 0;
+    return time(NULL) + ttl;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file ttl.h
+ * @brief File per la scadenza dei messaggi nelle history degli utenti. Ogni messaggio
+ *        può avere una scadenza (MsgTTL per tutti i messaggi oppure ttl della singola
+ *        richiesta POSTTXT_TTL_OP). Per ogni utente c'è al più un timer, fissato alla
+ *        prima scadenza della sua history, inserito in una timing wheel gerarchica:
+ *        un thread avanza la wheel di un secondo alla volta ed elimina solo i messaggi
+ *        degli utenti i cui timer sono scaduti, senza scorrere tutti gli utenti.
+ * @author Emilio Panti 531844
+ * Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ * originale dell'autore
+ */
+#ifndef TTL_H_
+#define TTL_H_
+
+#include <time.h>
+#include <abs_hashtable.h>
+
+
+//livelli della timing wheel e slot per livello (64^4 secondi, circa 194 giorni;
+//le scadenze più lontane vengono reinserite quando raggiungono l'ultimo livello)
+#define  TTL_WHEEL_LEVELS   4
+#define  TTL_WHEEL_BITS     6
+#define  TTL_WHEEL_SLOTS    (1 << TTL_WHEEL_BITS)
+
+
+
+/* ---------------------- interfaccia ttl  --------------------- */
+
+/**
+ * @function ttl_start
+ * @brief Fa partire il thread che elimina i messaggi scaduti
+ *
+ * @param hash_us  tabella hash degli utenti registrati
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+int ttl_start(hashtable_t *hash_us);
+
+
+/**
+ * @function ttl_stop
+ * @brief Termina il thread e libera i timer rimasti nella timing wheel
+ *
+ * @note: va chiamata prima di liberare la tabella hash degli utenti
+ */
+void ttl_stop();
+
+
+/**
+ * @function ttl_schedule
+ * @brief Inserisce nella timing wheel un timer per l'utente name
+ *
+ * @param name  nome dell'utente
+ * @param when  istante in cui scade il timer
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ *
+ * @note: i timer non vengono mai rimossi, quando scadono vengono ignorati se l'utente
+ *        non esiste più o ha nel frattempo fissato un'altra scadenza (vedi expire_user)
+ */
+int ttl_schedule(const char *name, time_t when);
+
+
+/**
+ * @function ttl_set_post
+ * @brief Fissa il ttl dei messaggi inseriti nelle history dal thread chiamante
+ *        (vale fino alla prossima chiamata)
+ *
+ * @param ttl  secondi, 0 = si usa MsgTTL
+ */
+void ttl_set_post(unsigned int ttl);
+
+
+/**
+ * @function ttl_post_expire
+ * @brief Ritorna la scadenza di un messaggio inserito ora dal thread chiamante
+ *
+ * @return istante, 0 se il messaggio non scade
+ */
+time_t ttl_post_expire();
+
+
+#endif /* TTL_H_ */
@@ -7,24 +7,300 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include <error_handler.h>
 #include <user.h>
 #include <connections.h>
 #include <config.h>
 #include <group.h>
+#include <persist.h>
+#include <ttl.h>
+#include <arena.h>
+#include <stats.h>
+#include <intern.h>
+#include <epoch.h>
+
+//statistiche del server (definita in chatty.c)
+extern struct statistics chattyStats;
+
+//un solo thread alla volta libera le history degli utenti (vedi reclaim_users)
+static pthread_mutex_t mtx_reclaim = PTHREAD_MUTEX_INITIALIZER;
 
 //funzioni necessarie per la creazione e gestione della lista 
 //dei messaggi dell'utente (history)
-extern void clean_msg_node(void *node);
 extern int send_list_msgs(void *node, void *param);
 
-//funzioni necessarie per la creazione e gestione della lista 
-//dei gruppi a cui si iscriverà l'utente
-extern int cmp_group(void *gr, void *name);
+//funzione per la rimozione dell'utente dai gruppi a cui è iscritto
 extern int gen_remove_member(void *gr, void *us);
 
 
+/* ---------------------------- funzioni di utilita' -------------------------------- */
+
+/**
+ * @function find_group
+ * @brief Cerca il gruppo groupname (con chiave key) tra i gruppi dell'utente: finché
+ *        sono nella struttura utente li scorre confrontando prima le chiavi, nel
+ *        vettore fa una ricerca binaria sulla chiave
+ *
+ * @param pos  se non NULL vi scrive la posizione in cui inserire il gruppo se assente
+ *
+ * @return indice del gruppo, -1 se l'utente non è iscritto
+ */
+static int find_group(user_t *user, const char *groupname, unsigned int key, unsigned int *pos) {
+    unsigned int n = user->ngroups;
+
+    if (n <= USER_INLINE_GROUPS) {
+        if (pos != NULL) *pos = n;
+        for (unsigned int i = 0; i < n; i++) {
+            group_us_t *gr = user->groups.inl[i];
+            if (gr->key == key && group_name_cmp(gr, groupname) == 0) return i;
+        }
+        return -1;
+    }
+
+    //prima iscrizione con chiave >= key
+    user_sub_t *vec = user->groups.vec;
+    unsigned int lo = 0, hi = n;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (vec[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if (pos != NULL) *pos = lo;
+
+    //gruppi con la stessa chiave (collisioni)
+    for (unsigned int i = lo; i < n && vec[i].key == key; i++) {
+        if (group_name_cmp(vec[i].group, groupname) == 0) return i;
+    }
+    return -1;
+}
+
+
+/**
+ * @function add_group
+ * @brief Aggiunge il gruppo ai gruppi dell'utente in posizione pos (vedi find_group):
+ *        superati quelli nella struttura utente si alloca il vettore ordinato per
+ *        chiave, che viene raddoppiato quando è pieno
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int add_group(user_t *user, group_us_t *group, unsigned int pos) {
+    unsigned int n = user->ngroups;
+    err_check_return(n == USHRT_MAX, ENOSPC, "add_group", -1);
+
+    if (n < USER_INLINE_GROUPS) user->groups.inl[n] = group;
+    else if (n == USER_INLINE_GROUPS) {
+        //prima potenza di 2 oltre i gruppi inline
+        unsigned int cap = 1;
+        while (cap <= USER_INLINE_GROUPS) cap <<= 1;
+        user_sub_t *vec = malloc(cap * sizeof(user_sub_t));
+        err_return_msg(vec,NULL,-1,"Errore: malloc\n");
+
+        //ordino per chiave (insertion sort: sono USER_INLINE_GROUPS+1 elementi)
+        for (unsigned int i = 0; i <= n; i++) {
+            group_us_t *gr = (i < n) ? user->groups.inl[i] : group;
+            unsigned int j = i;
+            while (j > 0 && vec[j-1].key > gr->key) {
+                vec[j] = vec[j-1];
+                j--;
+            }
+            vec[j].key   = gr->key;
+            vec[j].group = gr;
+        }
+        user->groups.vec = vec;
+    }
+    else {
+        //la capacità del vettore è la potenza di 2 >= n: è pieno se n è una potenza di 2
+        if ((n & (n - 1)) == 0) {
+            user_sub_t *vec = realloc(user->groups.vec, 2 * n * sizeof(user_sub_t));
+            err_return_msg(vec,NULL,-1,"Errore: realloc\n");
+            user->groups.vec = vec;
+        }
+        user_sub_t *vec = user->groups.vec;
+        memmove(&vec[pos+1], &vec[pos], (n - pos) * sizeof(user_sub_t));
+        vec[pos].key   = group->key;
+        vec[pos].group = group;
+    }
+
+    user->ngroups++;
+    return 0;
+}
+
+
+/**
+ * @function remove_group
+ * @brief Rimuove l'i-esimo gruppo dell'utente (nella struttura utente al suo posto va
+ *        l'ultimo, nel vettore si mantiene l'ordine), se i gruppi rientrano nella
+ *        struttura utente il vettore viene liberato
+ *
+ * @return puntatore al gruppo rimosso
+ */
+static group_us_t *remove_group(user_t *user, unsigned int i) {
+    group_us_t *gr = NULL;
+
+    if (user->ngroups <= USER_INLINE_GROUPS) {
+        gr = user->groups.inl[i];
+        user->ngroups--;
+        user->groups.inl[i] = user->groups.inl[user->ngroups];
+        return gr;
+    }
+
+    user_sub_t *vec = user->groups.vec;
+    gr = vec[i].group;
+    user->ngroups--;
+    memmove(&vec[i], &vec[i+1], (user->ngroups - i) * sizeof(user_sub_t));
+
+    if (user->ngroups == USER_INLINE_GROUPS) {
+        for (unsigned int j = 0; j < USER_INLINE_GROUPS; j++) user->groups.inl[j] = vec[j].group;
+        free(vec);
+    }
+
+    return gr;
+}
+
+
+/**
+ * @function unlink_group
+ * @brief Rimuove il gruppo dai gruppi dell'utente solo se vi è proprio quel gruppo
+ *        (e non un gruppo omonimo)
+ *
+ * @return puntatore al gruppo rimosso, NULL se l'utente non è iscritto al gruppo
+ */
+static group_us_t *unlink_group(user_t *user, group_us_t *group) {
+    int i = find_group(user, group->groupname, group->key, NULL);
+    if (i == -1 || group_of_user(user, i) != group) return NULL;
+
+    return remove_group(user, i);
+}
+
+
+/**
+ * @function pack_msg
+ * @brief Aggiunge msg in fondo a buf nello stesso formato usato da sendHeader e
+ *        sendData (connections.c), in modo da inviare più messaggi con una sola write
+ *
+ * @param buf  buffer (riallocato se necessario)
+ * @param len  numero di byte usati in buf
+ * @param cap  dimensione di buf
+ * @param msg  messaggio da aggiungere
+ *
+ * @return 0 in caso di successo, -1 ed errno settato in caso di errore
+ */
+static int pack_msg(char **buf, size_t *len, size_t *cap, message_t *msg) {
+    int slen = strlen(msg->hdr.sender) + 1;
+    int rlen = strlen(msg->data.hdr.receiver) + 1;
+    int dlen = msg->data.hdr.len;
+    size_t need = sizeof(op_t) + 3*sizeof(int) + slen + rlen + dlen;
+
+    if (*len + need > *cap) {
+        size_t ncap = (*cap == 0) ? 1024 : *cap;
+        while (*len + need > ncap) ncap *= 2;
+        char *tmp = realloc(*buf, ncap);
+        err_return_msg(tmp,NULL,-1,"Errore: realloc\n");
+        *buf = tmp;
+        *cap = ncap;
+    }
+
+    char *p = *buf + *len;
+    memcpy(p, &msg->hdr.op, sizeof(op_t));       p += sizeof(op_t);
+    memcpy(p, &slen, sizeof(int));               p += sizeof(int);
+    memcpy(p, msg->hdr.sender, slen);            p += slen;
+    memcpy(p, &rlen, sizeof(int));               p += sizeof(int);
+    memcpy(p, msg->data.hdr.receiver, rlen);     p += rlen;
+    memcpy(p, &dlen, sizeof(int));               p += sizeof(int);
+    if (dlen > 0) memcpy(p, msg->data.buf, dlen);
+
+    *len += need;
+    return 0;
+}
+
+
+
+/**
+ * @function evict_user
+ * @brief Elimina i messaggi già consegnati dell'utente (dal più vecchio) finchè i
+ *        byte della sua history non scendono a target: se quelli in memoria non
+ *        bastano e su disco ce ne sono altri la history viene ricaricata (e
+ *        riscaricata se l'utente è offline)
+ *
+ * @note: va chiamata con la lock dell'utente
+ */
+static void evict_user(user_t *user, size_t target, history_expired_t *ev) {
+    history_t *hist = &user->history;
+
+    evict_history(hist, target, ev);
+    if (hist->bytes <= target || delivered_spilled_history(hist) == 0) return;
+
+    if (load_history(hist) != 1) return;
+    evict_history(hist, target, ev);
+    if (user->status == OFFLINE && spill_history(hist, user->nickname) == -1) {
+        perror("Errore: spill_history");
+    }
+}
+
+
+/**
+ * @function make_room
+ * @brief Controlla che nella history dell'utente ci sia spazio per need byte secondo
+ *        MaxUserHistBytes e MaxHistBytes (che contano anche i messaggi scaricati su
+ *        disco), eliminando se serve i messaggi già consegnati dell'utente (dal più vecchio)
+ *
+ * @return 1 se il messaggio può essere inserito, 0 altrimenti
+ *
+ * @note: va chiamata con la lock dell'utente
+ */
+static int make_room(user_t *user, size_t need) {
+    //configurazioni del server (definita in chatty.c)
+    extern configs_t conf_server;
+
+    size_t ucap = conf_server.user_hist_bytes, gcap = conf_server.hist_bytes;
+    history_t *hist = &user->history;
+    history_expired_t ev;
+    memset(&ev, 0, sizeof(history_expired_t));
+
+    //limite dell'utente
+    if (ucap != 0 && hist->bytes + need > ucap) {
+        evict_user(user, (need < ucap) ? ucap - need : 0, &ev);
+    }
+    //limite globale: libero la parte che supera il limite (se possibile) da questa history
+    if (gcap != 0 && total_bytes_history() + need > gcap) {
+        size_t excess = total_bytes_history() + need - gcap;
+        evict_user(user, (hist->bytes > excess) ? hist->bytes - excess : 0, &ev);
+    }
+
+    if (ev.msgs + ev.files > 0 && lock_stats() == 0) {
+        chattyStats.nevicted += ev.msgs + ev.files;
+        unlock_stats();
+    }
+
+    if (ucap != 0 && hist->bytes + need > ucap) return 0;
+    if (gcap != 0 && total_bytes_history() + need > gcap) return 0;
+    return 1;
+}
+
+
+/**
+ * @struct reclaim_t
+ * @brief Utente candidato per reclaim_users con i byte della sua history
+ */
+typedef struct {
+    user_t  *user;
+    size_t  bytes;
+} reclaim_t;
+
+
+/**
+ * @function cmp_reclaim
+ * @brief Ordina i candidati di reclaim_users per byte decrescenti
+ */
+static int cmp_reclaim(const void *a, const void *b) {
+    size_t ba = ((const reclaim_t *)a)->bytes, bb = ((const reclaim_t *)b)->bytes;
+    return (ba < bb) - (ba > bb);
+}
+
+
+
 /* ------------------------- implementazione interfaccia user ---------------------------- */
 
 /* ------------- funzioni strettamente legate alla strutture 'user_t' ---------------- */
@@ -78,29 +354,55 @@ user_t *create_user(char *name, long fd){
 
     //inizializzo i parametri dell'utente
     us->status   = ONLINE;
+    us->ngroups  = 0;
     us->fd       = fd;
+    us->refs     = 1;
     us->mtx      = NULL;
-    strncpy(us->nickname, name, MAX_NAME_LENGTH+1);
-    us->msg_list = init_list(conf_server.max_hist_msg, NULL, clean_msg_node, NULL);
-    err_return_msg_clean(us->msg_list, NULL, NULL, "Errore: init_list\n", clean_user(us));
-    us->groups = init_list(DEFAULT_LEN, NULL, NULL, cmp_group);
-    err_return_msg_clean(us->groups, NULL, NULL, "Errore: init_list\n", clean_user(us));
+    us->lsn      = 0;
+    us->stream_seq = 0;
+    us->expire_at  = 0;
+    init_history(&us->history, conf_server.max_hist_msg);
+
+    //il nickname è quello della tabella dei nomi: l'id resta lo stesso finchè
+    //qualcuno ha un riferimento al nome (anche dopo una deregistrazione)
+    us->id = intern_name(name);
+    err_return_msg_clean(us->id,0,NULL,"Errore: intern_name\n",free(us));
+    us->nickname = intern_str(us->id);
 
     return us;
 }
 
 
+/**
+ * @function get_user
+ * @brief Prende un riferimento all'utente: non verrà liberato finchè il riferimento
+ *        non viene rilasciato con clean_user, anche se nel frattempo viene ritirato
+ * 
+ * @param user   utente letto all'interno di una sezione epoch_enter/epoch_exit
+ * 
+ * @return l'utente passato
+ */
+user_t *get_user(user_t *user){
+    __atomic_add_fetch(&user->refs, 1, __ATOMIC_RELAXED);
+    return user;
+}
+
+
 /**
  * @function clean_user
- * @brief Libera la memoria allocata per l'utente
+ * @brief Rilascia un riferimento all'utente e libera la memoria allocata per
+ *        l'utente se era l'ultimo
  * 
  * @param us puntatore all'utente da cancellare
  */
 void clean_user(void *us){
     if(us == NULL) return;
     user_t *user = (user_t *)us;
-    if (user->msg_list != NULL) clean_list(user->msg_list);
-    if (user->groups != NULL) clean_list(user->groups);
+    //altri thread lo stanno ancora usando
+    if (__atomic_sub_fetch(&user->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    clean_history(&user->history);
+    if (user->ngroups > USER_INLINE_GROUPS) free(user->groups.vec);
+    intern_release(user->id);
     free(user);
 }
 
@@ -131,6 +433,8 @@ int set_online(user_t *user, long fd){
         user->fd = fd;
         user->status = ONLINE;
         ret = 1;
+        //riporto in memoria la history scaricata su disco
+        if (load_history(&user->history) == -1) ret = -1;
     }
     //altrimenti
     else ret = 0;
@@ -157,27 +461,204 @@ int disable_user(user_t *user){
     //controllo gli argomenti
     err_check_return(user == NULL, EINVAL, "disable_user", -1);
 
+    //metto lo status dell' utente ad inattivo
+    int check = deactivate_user(user);
+
+    //se era già inattivo o se errore
+    if (check != 1) return check;
+
+    //rimuovo l'utente da tutti i gruppi a cui appartiene (dall'ultimo: gen_remove_member
+    //toglie dai gruppi dell'utente quelli di cui non è il creatore)
+    for (int i = user->ngroups - 1; i >= 0; i--) {
+        check = gen_remove_member(group_of_user(user, i), (void *)user);
+        err_return_msg(check,-1,-1,"Errore: disable user\n");
+    }
+
+    return 1;
+}
+
+
+/**
+ * @function deactivate_user
+ * @brief Pone ad inattivo lo stato dell' utente (prima parte di disable_user: da qui
+ *        in poi l'utente non accetta più iscrizioni né messaggi)
+ * 
+ * @param user  utente da disattivare
+ * 
+ * @return 1 se successo, 0 se era già inattivo l'utente, -1 se in caso di errore
+ */
+int deactivate_user(user_t *user){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "deactivate_user", -1);
+
     //variabile di appoggio
     int check = 0, checklock = 0;
 
-    //metto lo status dell' utente ad inattivo
     checklock = lock_user(user);
     err_check_return(checklock != 0, checklock, "lock_user", -1);
 
-    if (user->status != INACTIVE) user->status = INACTIVE;
-    else check = 1;
+    if (user->status != INACTIVE) {
+        user->status = INACTIVE;
+        check = 1;
+    }
 
     checklock = unlock_user(user);
     err_check_return(checklock != 0, checklock, "unlock_user", -1);
 
-    //se era già inattivo
-    if (check == 1) return 0;
+    return check;
+}
 
-    //rimuovo l'utente da tutti i gruppi a cui appartiene
-    check = apply_fun_param(user->groups, gen_remove_member, (void *)user);
-    err_return_msg(check,-1,-1,"Errore: disable user\n");
 
-    return 1;
+/**
+ * @function release_user
+ * @brief Rimuove l'utente, già inattivo (vedi deactivate_user), da tutti i gruppi a
+ *        cui è iscritto e svuota i suoi gruppi (anche quelli di cui è il creatore)
+ * 
+ * @param user  utente inattivo
+ * 
+ * @return 0 se successo, -1 in caso di errore
+ */
+int release_user(user_t *user){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "release_user", -1);
+
+    //variabile di appoggio
+    int is_creator = 0, checklock = 0;
+
+    //un gruppo alla volta dall'ultimo: la lock dell'utente non può essere tenuta
+    //mentre si prende quella del gruppo (l'ordine è gruppo -> utente, vedi
+    //postmsg_all_group), intanto altri thread possono togliere gruppi (gen_unsubscribe)
+    while (1) {
+        checklock = lock_user(user);
+        err_check_return(checklock != 0, checklock, "lock_user", -1);
+        group_us_t *gr = (user->ngroups > 0) ? group_of_user(user, user->ngroups - 1) : NULL;
+        checklock = unlock_user(user);
+        err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+        if (gr == NULL) return 0;
+
+        //se il gruppo è in fase di cancellazione l'utente resta tra i membri
+        errno = 0;
+        if (remove_member(gr, user, &is_creator) == NULL && errno != 0) return -1;
+
+        checklock = lock_user(user);
+        err_check_return(checklock != 0, checklock, "lock_user", -1);
+        unlink_group(user, gr);
+        checklock = unlock_user(user);
+        err_check_return(checklock != 0, checklock, "unlock_user", -1);
+    }
+}
+
+
+/**
+ * @function owned_groups
+ * @brief Ritorna i gruppi dell'utente di cui è il creatore
+ * 
+ * @param user  utente
+ * @param n     vi viene scritto il numero di gruppi ritornati
+ * 
+ * @return vettore dei gruppi (da liberare con free), NULL ed errno non modificato se
+ *         l'utente non ha creato nessun gruppo, NULL ed errno settato in caso di errore
+ */
+group_us_t **owned_groups(user_t *user, unsigned int *n){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "owned_groups", NULL);
+    err_check_return(n == NULL, EINVAL, "owned_groups", NULL);
+
+    //variabile di appoggio
+    group_us_t **owned = NULL;
+    int err = 0;
+    *n = 0;
+
+    int checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", NULL);
+
+    //il creatore di un gruppo non cambia: lo leggo senza la lock del gruppo
+    for (unsigned int i = 0; err == 0 && i < user->ngroups; i++) {
+        group_us_t *gr = group_of_user(user, i);
+        if (gr->creator != user->id) continue;
+
+        if (owned == NULL && (owned = malloc(user->ngroups * sizeof(group_us_t *))) == NULL) err = ENOMEM;
+        else owned[(*n)++] = gr;
+    }
+
+    checklock = unlock_user(user);
+    if (checklock != 0) err = checklock;
+
+    if (err != 0) {
+        free(owned);
+        *n = 0;
+        errno = err;
+        perror("owned_groups");
+        return NULL;
+    }
+
+    return owned;
+}
+
+
+/**
+ * @function page_out_user
+ * @brief Se l'utente è offline scarica la sua history su disco (vedi spill_history)
+ * 
+ * @param user   utente appena disconnesso
+ * 
+ * @return 1 se la history è stata scaricata, 0 se l'utente non è offline o non c'era
+ *         niente da scaricare, -1 in caso di errore
+ */
+int page_out_user(user_t *user){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "page_out_user", -1);
+
+    int check = 0;
+
+    int checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", -1);
+
+    if (user->status == OFFLINE) check = spill_history(&user->history, user->nickname);
+
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+    return check;
+}
+
+
+/**
+ * @function dump_user
+ * @brief Scrive l'utente e la sua history su fp (record della snapshot)
+ * 
+ * @param user   utente da scrivere
+ * @param fp     file della snapshot
+ * 
+ * @return 1 se successo, 0 se l'utente era inattivo, -1 in caso di errore
+ */
+int dump_user(user_t *user, FILE *fp){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "dump_user", -1);
+    err_check_return(fp == NULL, EINVAL, "dump_user", -1);
+
+    //variabile di appoggio
+    int check = 1;
+
+    int checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", -1);
+
+    if (user->status == INACTIVE) check = 0;
+    else {
+        //i messaggi aggiunti al log da qui in poi non sono nella copia della history
+        user_rec_t rec;
+        memset(&rec, 0, sizeof(user_rec_t));
+        strncpy(rec.nickname, user->nickname, MAX_NAME_LENGTH);
+        rec.lsn = persist_lsn();
+        if (fwrite(&rec, sizeof(user_rec_t), 1, fp) != 1) check = -1;
+        else if (dump_history(&user->history, fp) == -1) check = -1;
+    }
+
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+    return check;
 }
 
 
@@ -190,7 +671,11 @@ int disable_user(user_t *user){
  * @param sent       per sapere all'esterno se è stato consegnato o meno il messaggio 
  * 
  * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio del messaggio o se era inattivo,
- *         -1 in caso di errore 
+ *         2 se il messaggio non consegnato è stato scartato perchè la history ha esaurito i
+ *         byte disponibili (MaxUserHistBytes/MaxHistBytes), -1 in caso di errore 
+ * 
+ * @note: il messaggio viene scritto fuori dalla sezione epoch (vedi epoch_pause), l'utente
+ *        deve essere tenuto con un riferimento (get_user) o con la lock di un suo gruppo
  */
 int sendMsg_toUser(user_t *user, message_t *msg, int *sent){
     //controllo gli argomenti
@@ -214,9 +699,13 @@ int sendMsg_toUser(user_t *user, message_t *msg, int *sent){
         return 0;
     }
 
-    //se è online invio il messaggio 
-    if (user->status == ONLINE) {
+    //se è in corso l'invio della history il messaggio verrà inviato alla fine
+    if (user->status == ONLINE && user->stream_seq != 0) check = 1;
+    //se è online invio il messaggio (fuori dalla sezione epoch, vedi epoch_pause)
+    else if (user->status == ONLINE) {
+        int paused = epoch_pause();
         check = sendMsg_toClient(user->fd, msg);
+        epoch_resume(paused);
         //se il messaggio è stato inviato
         if (check == 1) *sent = 1;
         //se si è disconnesso durante l'invio
@@ -232,20 +721,43 @@ int sendMsg_toUser(user_t *user, message_t *msg, int *sent){
     else check = 0;
 
     //se è un messaggio testuale o un file devo aggiungerlo alla history
-    if (op == TXT_MESSAGE || op == FILE_MESSAGE) {
-        //creo il nodo messaggio da inserire nella history
-        message_node_t *msg_node = init_msg_node(msg, *sent);
-        if (msg_node == NULL) {
+    if ((op == TXT_MESSAGE || op == FILE_MESSAGE) && !make_room(user, msg->data.hdr.len)) {
+        //non c'è spazio: se non è stato consegnato il mittente deve saperlo
+        free_msg(msg);
+        if (*sent == 0) check = 2;
+    }
+    else if (op == TXT_MESSAGE || op == FILE_MESSAGE) {
+        //lo scrivo nel log prima di inserirlo (add_history libera msg)
+        time_t expire = ttl_post_expire();
+        if (persist_log_post(user->nickname, msg, *sent, expire) == -1) {
             unlock_user(user);
             free_msg(msg);
             return -1;
         }
         //aggiungo il nuovo messaggio nella history
-        if (add_data(user->msg_list, (void*)msg_node, NULL) == -1) {
+        if (add_history(&user->history, msg, *sent, expire) == -1) {
             unlock_user(user);
-            clean_msg_node(msg_node);
+            free_msg(msg);
             return -1;
         }
+        //da qui il messaggio è già nel log e nella history: un errore non deve far
+        //fallire l'invio, il messaggio resta in memoria o senza il suo timer
+
+        //se scade prima degli altri anticipo il timer dell'utente (se non si riesce
+        //scadrà con il prossimo timer fissato per l'utente)
+        if (expire != 0 && (user->expire_at == 0 || expire < user->expire_at)) {
+            time_t prev = user->expire_at;
+            user->expire_at = expire;
+            if (ttl_schedule(user->nickname, expire) == -1) {
+                perror("Errore: ttl_schedule");
+                user->expire_at = prev;
+            }
+        }
+        //se è offline e la history è su disco ci aggiungo i nuovi messaggi a blocchi
+        if (user->status == OFFLINE && user->history.size > 0 &&
+            len_history(&user->history) >= SPILL_BATCH) {
+            if (spill_history(&user->history, user->nickname) == -1) perror("Errore: spill_history");
+        }
     }
 
     checklock = unlock_user(user);
@@ -264,6 +776,9 @@ int sendMsg_toUser(user_t *user, message_t *msg, int *sent){
  * 
  * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio del messaggio o se era inattivo,
  *         -1 in caso di errore 
+ * 
+ * @note: come per sendMsg_toUser l'utente deve essere tenuto con un riferimento o con
+ *        la lock di un suo gruppo
  */
 int sendHdr_toUser(user_t *user, message_hdr_t *hdr){
     //controllo gli argomenti
@@ -276,9 +791,13 @@ int sendHdr_toUser(user_t *user, message_hdr_t *hdr){
     checklock = lock_user(user);
     err_check_return(checklock != 0, checklock, "lock_user", -1);
 
-    //se è online invio il messaggio 
-    if (user->status == ONLINE) {
+    //se è in corso l'invio della history il messaggio verrà inviato alla fine
+    if (user->status == ONLINE && user->stream_seq != 0) check = 1;
+    //se è online invio il messaggio (fuori dalla sezione epoch, vedi epoch_pause)
+    else if (user->status == ONLINE) {
+        int paused = epoch_pause();
         check = sendHdr_toClient(user->fd, hdr);
+        epoch_resume(paused);
         if (check == 0) user->status = OFFLINE;
     }
 
@@ -291,16 +810,24 @@ int sendHdr_toUser(user_t *user, message_hdr_t *hdr){
 
 /**
  * @function send_history
- * @brief Spedisce la history dei messaggi all'utente passato da parametro
+ * @brief Spedisce la history dei messaggi all'utente passato da parametro. La history
+ *        viene copiata con la lock dell'utente ed inviata senza, i messaggi consegnati
+ *        vengono segnati alla fine
  * 
  * @param user            utente a cui inviare la history
+ * @param cursor          se NULL viene inviata tutta la history (GETPREVMSGS_OP), altrimenti
+ *                        solo i messaggi con numero di sequenza maggiore di cursor->since,
+ *                        al massimo cursor->page (GETPREVMSGS_SINCE_OP)
  * @param msgsdelivered   contatore dei messaggi testuali inviati all'utente in questa funzione
  * @param filesdelivered  contatore dei messaggi files inviati all'utente in questa funzione
  * 
  * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio dei messaggi o se era inattivo,
  *         -1 in caso di errore 
+ * 
+ * @note: i messaggi vengono scritti fuori dalla sezione epoch, l'utente deve essere
+ *        tenuto con un riferimento (vedi get_user)
  */
-int send_history(user_t *user, int *msgsdelivered, int *filesdelivered){
+int send_history(user_t *user, prevmsgs_req_t *cursor, int *msgsdelivered, int *filesdelivered){
     //controllo gli argomenti
     err_check_return(user == NULL, EINVAL, "send_history", -1);
     err_check_return(msgsdelivered == NULL, EINVAL, "send_history", -1);
@@ -319,81 +846,423 @@ int send_history(user_t *user, int *msgsdelivered, int *filesdelivered){
         return 0;
     }
 
-
-    //prendo il numero di messaggi nella history
-    int n = get_len_list(user->msg_list);
-    if (n == -1) {
+    //riporto in memoria la parte della history scaricata su disco
+    if (load_history(&user->history) == -1) {
         unlock_user(user);
         return -1;
     }
 
-    //buffer contenente il numero di messaggi in lista
-    char *buf = malloc(sizeof(size_t));
-    if (buf == NULL) {
+    //copio la history, i messaggi che arrivano da qui in poi vengono inviati alla fine
+    history_snap_t *snap = get_snapshot_history(&user->history);
+    if (snap == NULL) {
         unlock_user(user);
         return -1;
     }
-    memcpy(buf, (char*)&n, sizeof(size_t));
+    unsigned long from = user->history.next_seq;
+    user->stream_seq = from;
+    long fd = user->fd;
 
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+    //prendo i messaggi da inviare: [first, first+n)
+    size_t first = 0, n = snap->len;
+    prevmsgs_reply_t reply;
+    memset(&reply, 0, sizeof(prevmsgs_reply_t));
+    if (cursor != NULL) {
+        //i numeri di sequenza sono crescenti: salto quelli già ricevuti
+        while (first < snap->len && snap->slots[first].seq <= cursor->since) first++;
+        n = snap->len - first;
+        if (cursor->page > 0 && n > cursor->page) {
+            n = cursor->page;
+            reply.more = 1;
+        }
+        reply.n    = n;
+        reply.next = (n > 0) ? snap->slots[first + n - 1].seq : cursor->since;
+    }
+    size_t size = (cursor != NULL) ? sizeof(prevmsgs_reply_t) : sizeof(size_t);
+
+    //creo la struttura che contiene i parametri per la funzione send_list_msgs
+    param_send_msgs_t *prm = init_param_send_msgs(fd);
+    //buffer contenente il numero di messaggi in lista (ed il cursore)
+    char *buf = malloc(size);
     //messaggio contenente il numero di messaggi da inviare
     message_t *message = malloc(sizeof(message_t));
-    if (message == NULL) {
+    if (prm == NULL || buf == NULL || message == NULL) {
         fprintf(stderr, "Errore: malloc\n");
-        free(buf);
-        unlock_user(user);
+        if (prm != NULL) free(prm);
+        if (buf != NULL) free(buf);
+        if (message != NULL) free(message);
+        release_snapshot_history(snap);
         return -1;
     }
+    if (cursor != NULL) memcpy(buf, (char*)&reply, size);
+    else memcpy(buf, (char*)&n, size);
     setHeader(&message->hdr, OP_OK, "");
-    setData(&message->data, "", buf, strlen(buf)+1);
+    setData(&message->data, "", buf, size);
+
+    //le scritture avvengono fuori dalla sezione epoch (vedi epoch_pause)
+    int paused = epoch_pause();
 
     //invio il messaggio con il numero di messaggi da inviare
-    check = sendMsg_toClient(user->fd, message);
+    check = sendMsg_toClient(fd, message);
     free_msg(message);
-    //in caso di errore
+    if (check == 0) prm->disconnected = 1;
+
+    //invio i messaggi della copia all'utente (send_list_msgs segna come consegnata
+    //la copia locale dello slot, la history viene aggiornata alla fine)
+    for (size_t i = first; check != -1 && i < first + n; i++) {
+        message_node_t slot = snap->slots[i];
+        if (send_list_msgs(&slot, prm) == -1) {
+            fprintf(stderr, "Errore: send_list_msgs\n");
+            check = -1;
+        }
+    }
+
+    checklock = lock_user(user);
+    if (checklock != 0) {
+        epoch_resume(paused);
+        free(prm);
+        release_snapshot_history(snap);
+        errno = checklock;
+        perror("lock_user");
+        return -1;
+    }
+    user->stream_seq = 0;
+
+    if (check != -1 && prm->disconnected == 0) {
+        //segno come consegnati i messaggi inviati
+        if (n > 0) set_delivered_history(&user->history, snap->slots[first].seq, snap->slots[first + n - 1].seq);
+
+        //invio i messaggi arrivati durante l'invio della history
+        for (unsigned int i = 0; check != -1 && prm->disconnected == 0 && i < len_history(&user->history); i++) {
+            message_node_t *slot = get_history(&user->history, i);
+            if (slot->seq < from || slot->delivered) continue;
+            if (send_list_msgs(slot, prm) == -1) check = -1;
+        }
+    }
+
+    //se si è disconnesso durante l'invio della history
+    if (prm->disconnected == 1 && user->status == ONLINE) user->status = OFFLINE;
+
+    checklock = unlock_user(user);
+    epoch_resume(paused);
+    release_snapshot_history(snap);
     if (check == -1) {
-        unlock_user(user);
+        free(prm);
         return -1;
     }
-    //se si è disconnesso il client 
-    else if (check == 0) {
-        user->status = OFFLINE;
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+    
+    //aggiorno i dati per le statistiche
+    *msgsdelivered  = prm->msgsdelivered;
+    *filesdelivered = prm->filesdelivered;
+    check = (prm->disconnected == 1) ? 0 : 1;
+    free(prm);
+
+    return check;
+}
+
+
+/**
+ * @function send_undelivered
+ * @brief Invia all'utente reply seguito dai messaggi della history non ancora
+ *        consegnati con un'unica scrittura (CONNECT_OP con CONNECT_PUSH). Come in
+ *        send_history i messaggi vengono copiati con la lock dell'utente ed inviati
+ *        senza, quelli arrivati nel frattempo vengono inviati alla fine
+ * 
+ * @param user            utente a cui inviare i messaggi
+ * @param reply           risposta da inviare per prima (OP_OK + lista utenti online)
+ * @param msgsdelivered   contatore dei messaggi testuali inviati all'utente in questa funzione
+ * @param filesdelivered  contatore dei messaggi files inviati all'utente in questa funzione
+ * 
+ * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio dei messaggi o se era inattivo,
+ *         -1 in caso di errore 
+ * 
+ * @note: come per send_history l'utente deve essere tenuto con un riferimento
+ */
+int send_undelivered(user_t *user, message_t *reply, int *msgsdelivered, int *filesdelivered){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "send_undelivered", -1);
+    err_check_return(reply == NULL, EINVAL, "send_undelivered", -1);
+    err_check_return(msgsdelivered == NULL, EINVAL, "send_undelivered", -1);
+    err_check_return(filesdelivered == NULL, EINVAL, "send_undelivered", -1);
+
+    //variabili di appoggio
+    int check = 1, checklock = 0;
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+
+    *msgsdelivered  = 0;
+    *filesdelivered = 0;
+
+    checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", -1);
+
+    //se non è online non faccio niente
+    if (user->status != ONLINE) {
         checklock = unlock_user(user);
         err_check_return(checklock != 0, checklock, "unlock_user", -1);
         return 0;
     }
-    
 
-    //creo la struttura che contiene i parametri per la funzione send_list_msgs
-    param_send_msgs_t *prm = init_param_send_msgs(user->fd);
-    if (prm == NULL) {
-        fprintf(stderr, "Errore: init_param_postmsg_all\n");
+    //riporto in memoria la parte della history scaricata su disco
+    if (load_history(&user->history) == -1) {
         unlock_user(user);
         return -1;
     }
 
-    //invio tutta la history all' utente
-    if (apply_fun_param(user->msg_list, send_list_msgs, (void*)prm) == -1){
-        fprintf(stderr, "Errore: send_list_msgs\n");
-        free(prm);
+    //copio la history, i messaggi che arrivano da qui in poi vengono inviati alla fine
+    history_snap_t *snap = get_snapshot_history(&user->history);
+    if (snap == NULL) {
         unlock_user(user);
         return -1;
     }
+    unsigned long from = user->history.next_seq;
+    user->stream_seq = from;
+    long fd = user->fd;
 
-    //se si è disconnesso durante l'invio della history
-    if (prm->disconnected == 1) user->status = OFFLINE;
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+    //preparo la risposta ed i messaggi da consegnare
+    int msgs = 0, files = 0;
+    if (pack_msg(&buf, &len, &cap, reply) == -1) check = -1;
+    for (size_t i = 0; check != -1 && i < snap->len; i++) {
+        message_node_t *slot = &snap->slots[i];
+        if (slot->delivered != 0) continue;
+        message_t msg;
+        msg_history(slot, &msg);
+        if (pack_msg(&buf, &len, &cap, &msg) == -1) check = -1;
+        if (slot->op == TXT_MESSAGE) msgs++;
+        else if (slot->op == FILE_MESSAGE) files++;
+    }
+
+    //le scritture avvengono fuori dalla sezione epoch (vedi epoch_pause)
+    int paused = epoch_pause();
+
+    //li invio con un'unica scrittura
+    if (check != -1) {
+        errno = 0;
+        if (writen(fd, buf, len) == -1) check = (errno == EPIPE) ? 0 : -1;
+    }
+    if (buf != NULL) free(buf);
+
+    //parametri per inviare i messaggi arrivati durante la scrittura
+    param_send_msgs_t *prm = (check == 1) ? init_param_send_msgs(fd) : NULL;
+    if (check == 1 && prm == NULL) check = -1;
+
+    checklock = lock_user(user);
+    if (checklock != 0) {
+        epoch_resume(paused);
+        if (prm != NULL) free(prm);
+        release_snapshot_history(snap);
+        errno = checklock;
+        perror("lock_user");
+        return -1;
+    }
+    user->stream_seq = 0;
+
+    if (check == 1) {
+        //segno come consegnati i messaggi inviati
+        if (snap->len > 0) set_delivered_history(&user->history, snap->slots[0].seq, snap->slots[snap->len - 1].seq);
+
+        //invio i messaggi arrivati durante la scrittura
+        for (unsigned int i = 0; check != -1 && prm->disconnected == 0 && i < len_history(&user->history); i++) {
+            message_node_t *slot = get_history(&user->history, i);
+            if (slot->seq < from || slot->delivered) continue;
+            if (send_list_msgs(slot, prm) == -1) check = -1;
+        }
+        if (check == 1 && prm->disconnected == 1) check = 0;
+    }
+
+    //se si è disconnesso durante l'invio
+    if (check == 0 && user->status == ONLINE) user->status = OFFLINE;
 
     checklock = unlock_user(user);
+    epoch_resume(paused);
+    release_snapshot_history(snap);
+    if (check != -1 && prm != NULL) {
+        *msgsdelivered  = msgs + prm->msgsdelivered;
+        *filesdelivered = files + prm->filesdelivered;
+    }
+    if (prm != NULL) free(prm);
+    if (check == -1) return -1;
     err_check_return(checklock != 0, checklock, "unlock_user", -1);
-    
-    //aggiorno i dati per le statistiche
-    *msgsdelivered  = prm->msgsdelivered;
-    *filesdelivered = prm->filesdelivered;
-    free(prm);
 
     return check;
 }
 
 
+/**
+ * @function expire_user
+ * @brief Elimina i messaggi scaduti dalla history dell'utente (anche quelli scaricati
+ *        su disco) e fissa il timer alla prossima scadenza
+ * 
+ * @param user   utente
+ * @param when   scadenza del timer che è scattato
+ * @param now    istante corrente
+ * @param out    messaggi eliminati e memoria liberata (vengono sommati ai valori presenti)
+ * 
+ * @return 1 se successo, 0 se il timer non era più valido o l'utente è inattivo,
+ *         -1 in caso di errore 
+ */
+int expire_user(user_t *user, time_t when, time_t now, history_expired_t *out){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "expire_user", -1);
+    err_check_return(out == NULL, EINVAL, "expire_user", -1);
+
+    int check = 1;
+
+    int checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", -1);
+
+    //timer sostituito da uno con scadenza precedente (o utente in deregistrazione)
+    if (user->status == INACTIVE || user->expire_at != when) {
+        checklock = unlock_user(user);
+        err_check_return(checklock != 0, checklock, "unlock_user", -1);
+        return 0;
+    }
+    user->expire_at = 0;
+
+    //i messaggi scaricati su disco tornano in memoria e poi ci vengono riscritti
+    int spilled = (user->history.size > 0);
+    if (load_history(&user->history) == -1) check = -1;
+    else {
+        expire_history(&user->history, now, out);
+
+        //fisso il timer alla prossima scadenza
+        time_t next = next_expire_history(&user->history);
+        if (next != 0) {
+            user->expire_at = next;
+            if (ttl_schedule(user->nickname, next) == -1) {
+                user->expire_at = 0;
+                check = -1;
+            }
+        }
+
+        if (check != -1 && spilled && user->status == OFFLINE &&
+            spill_history(&user->history, user->nickname) == -1) check = -1;
+    }
+
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+    return check;
+}
+
+
+/**
+ * @function schedule_expire_user
+ * @brief Fissa il timer dell'utente alla prima scadenza dei messaggi nella history
+ *        in memoria (usata dopo il ripristino dello stato)
+ * 
+ * @param user   utente
+ * 
+ * @return 0 se successo, -1 in caso di errore 
+ */
+int schedule_expire_user(user_t *user){
+    //controllo gli argomenti
+    err_check_return(user == NULL, EINVAL, "schedule_expire_user", -1);
+
+    int check = 0;
+
+    int checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", -1);
+
+    time_t next = next_expire_history(&user->history);
+    if (next != 0 && (user->expire_at == 0 || next < user->expire_at)) {
+        user->expire_at = next;
+        check = ttl_schedule(user->nickname, next);
+    }
+
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
+
+    return check;
+}
+
+
+/**
+ * @function reclaim_users
+ * @brief Elimina i messaggi già consegnati degli utenti con la history più grande finchè
+ *        i byte in tutte le history non scendono sotto HIST_BYTES_LOW(MaxHistBytes)
+ * 
+ * @param hash_us  tabella hash degli utenti registrati
+ * 
+ * @return numero di messaggi eliminati (0 anche se un altro thread sta già liberando),
+ *         -1 in caso di errore 
+ * 
+ * @note: va chiamata senza lock di utenti ed all'interno di epoch_enter/epoch_exit
+ */
+int reclaim_users(hashtable_t *hash_us){
+    //controllo gli argomenti
+    err_check_return(hash_us == NULL, EINVAL, "reclaim_users", -1);
+
+    //configurazioni del server (definita in chatty.c)
+    extern configs_t conf_server;
+    size_t low = HIST_BYTES_LOW(conf_server.hist_bytes);
+
+    //basta un thread alla volta
+    if (pthread_mutex_trylock(&mtx_reclaim) != 0) return 0;
+
+    ht_snapshot_t *snap = get_snapshot_ht(hash_us);
+    err_return_msg_clean(snap,NULL,-1,"Errore: get_snapshot_ht\n",pthread_mutex_unlock(&mtx_reclaim));
+
+    reclaim_t *cand = malloc((snap->len + 1) * sizeof(reclaim_t));
+    if (cand == NULL) {
+        release_snapshot_ht(hash_us, snap);
+        pthread_mutex_unlock(&mtx_reclaim);
+        fprintf(stderr, "Errore: malloc\n");
+        return -1;
+    }
+
+    //ordino gli utenti per byte (letti senza lock, servono solo per scegliere l'ordine)
+    int n = 0;
+    for (int i = 0; i < snap->len; i++) {
+        user_t *us = (user_t *)snap->elements[i];
+        size_t bytes = __atomic_load_n(&us->history.bytes, __ATOMIC_RELAXED);
+        if (bytes == 0) continue;
+        cand[n].user  = us;
+        cand[n].bytes = bytes;
+        n++;
+    }
+    qsort(cand, n, sizeof(reclaim_t), cmp_reclaim);
+
+    history_expired_t ev;
+    memset(&ev, 0, sizeof(history_expired_t));
+    int check = 0;
+
+    for (int i = 0; i < n && total_bytes_history() > low; i++) {
+        user_t *us = cand[i].user;
+        int checklock = lock_user(us);
+        if (checklock != 0) {
+            errno = checklock;
+            check = -1;
+            break;
+        }
+        size_t total = total_bytes_history(), bytes = us->history.bytes;
+        if (total > low) {
+            size_t excess = total - low;
+            evict_user(us, (bytes > excess) ? bytes - excess : 0, &ev);
+        }
+        unlock_user(us);
+    }
+
+    free(cand);
+    release_snapshot_ht(hash_us, snap);
+    pthread_mutex_unlock(&mtx_reclaim);
+
+    if (ev.msgs + ev.files > 0 && lock_stats() == 0) {
+        chattyStats.nevicted += ev.msgs + ev.files;
+        unlock_stats();
+    }
+
+    if (check == -1) return -1;
+    return ev.msgs + ev.files;
+}
+
+
 /**
  * @function subscribe
  * @brief Inserisce il gruppo passato nella lista gruppi dell' utente
@@ -422,8 +1291,15 @@ int subscribe(user_t *user, group_us_t *group){
         return 0;
     }
 
-    //inserisco il gruppo nella lista dell'utente
-    check = add_data(user->groups, (void*)group, (void*)group->groupname);
+    //inserisco il gruppo tra quelli dell'utente
+    //un gruppo omonimo diverso è stato cancellato e non ancora rimosso dai gruppi
+    //dell'utente (vedi release_group): lo sostituisco
+    unsigned int pos = 0;
+    int i = find_group(user, group->groupname, group->key, &pos);
+    if (i != -1 && group_of_user(user, i) == group) check = 0;
+    else if (i != -1 && user->ngroups <= USER_INLINE_GROUPS) user->groups.inl[i] = group;
+    else if (i != -1) user->groups.vec[i].group = group;
+    else if (add_group(user, group, pos) == -1) check = -1;
 
     checklock = unlock_user(user);
     err_check_return(checklock != 0, checklock, "unlock_user", -1);
@@ -462,7 +1338,7 @@ group_us_t* unsubscribe(user_t *user, char *groupname){
     }
 
     //rimuovo il gruppo dalla lista dell'utente
-    gr = remove_data(user->groups, (void*)groupname);
+    gr = drop_group(user, groupname);
 
     checklock = unlock_user(user);
     err_check_return(checklock != 0, checklock, "unlock_user", NULL);
@@ -501,7 +1377,8 @@ group_us_t* check_subscription(user_t *user, char *groupname){
     }
 
     //cerco il gruppo dalla lista dell'utente
-    gr = search_data(user->groups, (void*)groupname);
+    int i = find_group(user, groupname, group_key(groupname), NULL);
+    if (i != -1) gr = group_of_user(user, i);
 
     checklock = unlock_user(user);
     err_check_return(checklock != 0, checklock, "unlock_user", NULL);
@@ -511,6 +1388,43 @@ group_us_t* check_subscription(user_t *user, char *groupname){
 
 
 
+/**
+ * @function drop_group
+ * @brief Rimuove il gruppo dai gruppi dell'utente senza prendere la lock dell'utente
+ *        (usata durante la deregistrazione, vedi gen_remove_member)
+ * 
+ * @param user        utente 
+ * @param groupname   nome del gruppo da rimuovere
+ * 
+ * @return puntatore al gruppo rimosso, NULL se l'utente non è iscritto al gruppo
+ */
+group_us_t* drop_group(user_t *user, const char *groupname){
+    if (user == NULL || groupname == NULL) return NULL;
+
+    int i = find_group(user, groupname, group_key(groupname), NULL);
+    if (i == -1) return NULL;
+
+    return remove_group(user, i);
+}
+
+
+/**
+ * @function pop_group
+ * @brief Rimuove e ritorna l'ultimo gruppo dell'utente senza prendere la lock
+ *        dell'utente (usata durante la deregistrazione)
+ * 
+ * @param user   utente 
+ * 
+ * @return puntatore al gruppo rimosso, NULL se l'utente non è iscritto a nessun gruppo
+ */
+group_us_t* pop_group(user_t *user){
+    if (user == NULL || user->ngroups == 0) return NULL;
+
+    return remove_group(user, user->ngroups - 1);
+}
+
+
+
 /* ------------- funzioni di inizializzazione delle varie struct  ---------------- */
 
 /**
@@ -525,15 +1439,15 @@ param_get_listname_t *init_param_get_listname(int max_user_in_list){
     //controllo gli argomenti
     err_check_return(max_user_in_list < 0, EINVAL, "init_param_get_listname", NULL);
 
-    //alloco la memoria per struttura 'param_get_listname_t'
-    param_get_listname_t *prm = malloc(sizeof(param_get_listname_t));
-    err_return_msg(prm,NULL,NULL,"Errore: malloc\n");
+    //alloco la memoria per struttura 'param_get_listname_t' (temporanea, nell'arena)
+    param_get_listname_t *prm = arena_alloc(sizeof(param_get_listname_t));
+    err_return_msg(prm,NULL,NULL,"Errore: arena_alloc\n");
 
     //inizializzo i parametri della lista
     prm->len = 0;
     prm->maxlen = (MAX_NAME_LENGTH+1) * (max_user_in_list);
-    prm->all_names = malloc(sizeof(char)*(prm->maxlen));
-    err_return_msg_clean(prm->all_names, NULL, NULL, "Errore: malloc\n", free(prm));
+    prm->all_names = arena_alloc(sizeof(char)*(prm->maxlen));
+    err_return_msg_clean(prm->all_names, NULL, NULL, "Errore: arena_alloc\n", arena_free(prm));
 
     return prm;
 }
@@ -551,14 +1465,15 @@ param_postmsg_all_t *init_param_postmsg_all(message_t *msg){
     //controllo gli argomenti
     err_check_return(msg == NULL, EINVAL, "init_param_postmsg_all", NULL);
 
-    //alloco la memoria per struttura 'param_postmsg_all_t'
-    param_postmsg_all_t *prm = malloc(sizeof(param_postmsg_all_t));
-    err_return_msg(prm,NULL,NULL,"Errore: malloc\n");
+    //alloco la memoria per struttura 'param_postmsg_all_t' (temporanea, nell'arena)
+    param_postmsg_all_t *prm = arena_alloc(sizeof(param_postmsg_all_t));
+    err_return_msg(prm,NULL,NULL,"Errore: arena_alloc\n");
 
     //inizializzo i parametri della lista
     prm->msg_to_send  = msg;
     prm->delivered    = 0;
     prm->notdelivered = 0;
+    prm->rejected     = 0;
 
     return prm;
 }
@@ -716,10 +1631,12 @@ int postmsg_all(void *us, void *param){
 
     //spedisco il messaggio all'utente
     int sent = 0;
-    if (sendMsg_toUser(user, msg, &sent) == -1) return -1;
+    int check = sendMsg_toUser(user, msg, &sent);
+    if (check == -1) return -1;
         
     //aggiorno i contatori all'interno di param
     if (sent == 1) prm->delivered = prm->delivered +1;
+    else if (check == 2) prm->rejected = prm->rejected +1;
     else prm->notdelivered = prm->notdelivered +1;
 
     return 0;
@@ -728,23 +1645,30 @@ int postmsg_all(void *us, void *param){
 
 /**
  * @function gen_unsubscribe
- * @brief Rimuove il gruppo passato dalla lista gruppi dell' utente
+ * @brief Rimuove il gruppo passato dalla lista gruppi dell' utente (anche se l'utente
+ *        è inattivo)
  * 
  * @param us    puntatore all' utente
- * @param str   nome del gruppo da rimuovere dai membri del gruppo
+ * @param gr    puntatore al gruppo da rimuovere (un gruppo omonimo creato dopo la
+ *              sua cancellazione non viene toccato)
  * 
  * @return 0 se successo, -1 in caso di errore
  */
-int gen_unsubscribe(void *us, void *str){
+int gen_unsubscribe(void *us, void *gr){
     //controllo gli argomenti
     err_check_return(us == NULL, EINVAL, "gen_unsubscribe", -1);
-    err_check_return(str == NULL, EINVAL, "gen_unsubscribe", -1);
+    err_check_return(gr == NULL, EINVAL, "gen_unsubscribe", -1);
 
     user_t *user = (user_t*)us;
-    char *name = (char*)str;
+
+    int checklock = lock_user(user);
+    err_check_return(checklock != 0, checklock, "lock_user", -1);
 
     //rimuovo il gruppo
-    unsubscribe(user, name);
+    unlink_group(user, (group_us_t*)gr);
+
+    checklock = unlock_user(user);
+    err_check_return(checklock != 0, checklock, "unlock_user", -1);
 
     return 0;
 }
\ No newline at end of file
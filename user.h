@@ -10,13 +10,20 @@
 
 #include <pthread.h>
 #include <message.h>
+#include <history.h>
 #include <abs_list.h>
+#include <abs_typed.h>
 
 
 //per usare la struttura group definita in group.h
 typedef struct group group_us_t;
 
 
+//gruppi memorizzati direttamente nella struttura utente, oltre si alloca un vettore
+//(due puntatori: la struttura occupa comunque lo stesso blocco di malloc)
+#define  USER_INLINE_GROUPS   2
+
+
 //stati assumibili da una struttura utente
 typedef enum {
     ONLINE    = 0,   //l'utente è online
@@ -25,27 +32,122 @@ typedef enum {
 } status_t;
 
 
+/**
+ * @struct user_sub_t
+ * @brief Iscrizione di un utente ad un gruppo nel vettore delle iscrizioni
+ *
+ * @var key    chiave del gruppo (hash del nome, vedi group_key in group.h)
+ * @var group  gruppo
+ */
+typedef struct {
+    unsigned int  key;
+    group_us_t    *group;
+} user_sub_t;
+
+
+/**
+ * @union user_groups_t
+ * @brief Gruppi a cui è iscritto un utente: fino a USER_INLINE_GROUPS nella struttura
+ *        utente, oltre in un vettore allocato (capacità = potenza di 2 >= ngroups)
+ *        ordinato per chiave, in cui le ricerche sono binarie
+ *
+ * @var inl  gruppi (se ngroups <= USER_INLINE_GROUPS)
+ * @var vec  vettore delle iscrizioni (se ngroups > USER_INLINE_GROUPS)
+ */
+typedef union {
+    group_us_t  *inl[USER_INLINE_GROUPS];
+    user_sub_t  *vec;
+} user_groups_t;
+
+
 /**
  * @struct user_t
  * @brief Struttura dati utente
  * 
- * @var nickname  nome dell'utente
- * @var status    status dell'utente
+ * @var nickname  nome dell'utente (nella tabella dei nomi, vedi intern.h)
+ * @var status    status dell'utente (status_t)
+ * @var ngroups   numero di gruppi a cui è iscritto l'utente
  * @var fd        descrittore aperto verso il client
+ * @var id        id del nickname, di cui l'utente ha un riferimento
+ * @var refs      riferimenti all'utente: quello della tabella hash (rilasciato quando
+ *                l'utente ritirato viene liberato) più quelli presi dai workers che
+ *                lo usano fuori dalla sezione epoch (vedi get_user)
  * @var mtx       puntatore al mutex per controllare l'accesso alla struttura utente
- * @var msg_list  lista dei messaggi arrivati all'utente
- * @var groups    lista di gruppi a cui è iscritto l'utente
+ * @var history   history dei messaggi arrivati all'utente
+ * @var ht_node   nodo per la lista della tabella hash in cui è inserito l'utente
+ * @var groups    gruppi a cui è iscritto l'utente
+ * @var lsn       posizione nel log della copia della history salvata nella snapshot
+ *                (usata solo durante il ripristino, vedi persist.h)
+ * @var stream_seq  se diverso da 0 è in corso l'invio della history senza lock (vedi
+ *                  send_history): i messaggi arrivati nel frattempo (numero di sequenza
+ *                  >= stream_seq) restano nella history e vengono inviati alla fine
+ * @var expire_at   scadenza del timer dell'utente nella timing wheel (prima scadenza dei
+ *                  messaggi nella history, 0 = nessun timer, vedi ttl.h)
  */
 typedef struct user {
-    char            nickname[MAX_NAME_LENGTH+1];
-    status_t        status;
-    long            fd;
+    const char      *nickname;
+    unsigned char   status;
+    unsigned short  ngroups;
+    int             fd;
+    unsigned int    id;
+    unsigned int    refs;
     pthread_mutex_t *mtx;
-    list_t          *msg_list;
-    list_t          *groups;
+    history_t       history;
+    node_t          ht_node;
+    user_groups_t   groups;
+    unsigned long   lsn;
+    unsigned long   stream_seq;
+    time_t          expire_at;
 } user_t;
 
 
+/**
+ * @struct user_rec_t
+ * @brief Record di un utente nella snapshot (seguito dalla sua history)
+ *
+ * @var nickname  nome dell'utente
+ * @var lsn       posizione nel log al momento della copia
+ */
+typedef struct {
+    char            nickname[MAX_NAME_LENGTH+1];
+    unsigned long   lsn;
+} user_rec_t;
+
+
+/**
+ * @function group_of_user
+ * @brief Ritorna l'i-esimo gruppo dell'utente (i minore di ngroups)
+ */
+static inline group_us_t *group_of_user(user_t *us, unsigned int i) {
+    return (us->ngroups <= USER_INLINE_GROUPS) ? us->groups.inl[i] : us->groups.vec[i].group;
+}
+
+
+/**
+ * @function user_name_cmp
+ * @brief Versione inline di cmp_user_by_name per le funzioni specializzate
+ */
+static inline int user_name_cmp(user_t *us, const char *name) {
+    return typed_namecmp(us->nickname, name);
+}
+
+
+/**
+ * @function user_fd_cmp
+ * @brief Versione inline di cmp_user_by_fd per le funzioni specializzate
+ */
+static inline int user_fd_cmp(user_t *us, const long *fd) {
+    return (int)(us->fd - *fd);
+}
+
+
+//tabella hash degli utenti registrati (chiave nickname)
+DEFINE_TYPED_HASHTABLE(users_ht, user_t, const char *, user_name_cmp, typed_strhash)
+
+//lista degli utenti online (chiave fd)
+DEFINE_TYPED_LIST(users_on, user_t, const long *, user_fd_cmp)
+
+
 /**
  * @struct param_get_listname_t
  * @brief Struttura dati per i parametri della funzione get_listname
@@ -68,11 +170,13 @@ typedef struct {
  * @var msg_to_send    messaggio da inviare
  * @var delivered      contatore degli utenti a cui è stato consegnato il messaggio
  * @var notdelivered   contatore degli utenti a cui non è stato consegnato il messaggio
+ * @var rejected       contatore degli utenti la cui history non aveva più byte disponibili
  */
 typedef struct {
     message_t *msg_to_send;
     int delivered;
     int notdelivered;
+    int rejected;
 } param_postmsg_all_t;
 
 
@@ -115,9 +219,22 @@ int unlock_user(user_t *user);
 user_t *create_user(char *name, long fd);
 
 
+/**
+ * @function get_user
+ * @brief Prende un riferimento all'utente: non verrà liberato finchè il riferimento
+ *        non viene rilasciato con clean_user, anche se nel frattempo viene ritirato
+ * 
+ * @param user   utente letto all'interno di una sezione epoch_enter/epoch_exit
+ * 
+ * @return l'utente passato
+ */
+user_t *get_user(user_t *user);
+
+
 /**
  * @function clean_user
- * @brief Libera la memoria allocata per l'utente
+ * @brief Rilascia un riferimento all'utente e libera la memoria allocata per
+ *        l'utente se era l'ultimo
  * 
  * @param us puntatore all'utente da cancellare
  */
@@ -151,6 +268,67 @@ int set_online(user_t *user, long fd);
 int disable_user(user_t *user);
 
 
+/**
+ * @function deactivate_user
+ * @brief Pone ad inattivo lo stato dell' utente (prima parte di disable_user: da qui
+ *        in poi l'utente non accetta più iscrizioni né messaggi)
+ * 
+ * @param user  utente da disattivare
+ * 
+ * @return 1 se successo, 0 se era già inattivo l'utente, -1 se in caso di errore
+ */
+int deactivate_user(user_t *user);
+
+
+/**
+ * @function release_user
+ * @brief Rimuove l'utente, già inattivo (vedi deactivate_user), da tutti i gruppi a
+ *        cui è iscritto e svuota i suoi gruppi (anche quelli di cui è il creatore)
+ * 
+ * @param user  utente inattivo
+ * 
+ * @return 0 se successo, -1 in caso di errore
+ */
+int release_user(user_t *user);
+
+
+/**
+ * @function owned_groups
+ * @brief Ritorna i gruppi dell'utente di cui è il creatore
+ * 
+ * @param user  utente
+ * @param n     vi viene scritto il numero di gruppi ritornati
+ * 
+ * @return vettore dei gruppi (da liberare con free), NULL ed errno non modificato se
+ *         l'utente non ha creato nessun gruppo, NULL ed errno settato in caso di errore
+ */
+group_us_t **owned_groups(user_t *user, unsigned int *n);
+
+
+/**
+ * @function page_out_user
+ * @brief Se l'utente è offline scarica la sua history su disco (vedi spill_history)
+ * 
+ * @param user   utente appena disconnesso
+ * 
+ * @return 1 se la history è stata scaricata, 0 se l'utente non è offline o non c'era
+ *         niente da scaricare, -1 in caso di errore
+ */
+int page_out_user(user_t *user);
+
+
+/**
+ * @function dump_user
+ * @brief Scrive l'utente e la sua history su fp (record della snapshot)
+ * 
+ * @param user   utente da scrivere
+ * @param fp     file della snapshot
+ * 
+ * @return 1 se successo, 0 se l'utente era inattivo, -1 in caso di errore
+ */
+int dump_user(user_t *user, FILE *fp);
+
+
 /**
  * @function sendMsg_toUser
  * @brief Spedisce il messaggio passato da parametro all'utente specificato.
@@ -160,7 +338,11 @@ int disable_user(user_t *user);
  * @param sent       per sapere all'esterno se è stato consegnato o meno il messaggio 
  * 
  * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio del messaggio o se era inattivo,
- *         -1 in caso di errore 
+ *         2 se il messaggio non consegnato è stato scartato perchè la history ha esaurito i
+ *         byte disponibili (MaxUserHistBytes/MaxHistBytes), -1 in caso di errore 
+ * 
+ * @note: il messaggio viene scritto fuori dalla sezione epoch (vedi epoch_pause), l'utente
+ *        deve essere tenuto con un riferimento (get_user) o con la lock di un suo gruppo
  */
 int sendMsg_toUser(user_t *user, message_t *msg, int *sent);
 
@@ -174,22 +356,96 @@ int sendMsg_toUser(user_t *user, message_t *msg, int *sent);
  * 
  * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio del messaggio o se era inattivo,
  *         -1 in caso di errore 
+ * 
+ * @note: come per sendMsg_toUser l'utente deve essere tenuto con un riferimento o con
+ *        la lock di un suo gruppo
  */
 int sendHdr_toUser(user_t *user, message_hdr_t *hdr);
 
 
 /**
  * @function send_history
- * @brief Spedisce la history dei messaggi all'utente passato da parametro
+ * @brief Spedisce la history dei messaggi all'utente passato da parametro. La history
+ *        viene copiata con la lock dell'utente ed inviata senza, i messaggi consegnati
+ *        vengono segnati alla fine
  * 
  * @param user            utente a cui inviare la history
+ * @param cursor          se NULL viene inviata tutta la history (GETPREVMSGS_OP), altrimenti
+ *                        solo i messaggi con numero di sequenza maggiore di cursor->since,
+ *                        al massimo cursor->page (GETPREVMSGS_SINCE_OP)
  * @param msgsdelivered   contatore dei messaggi testuali inviati all'utente in questa funzione
  * @param filesdelivered  contatore dei messaggi files inviati all'utente in questa funzione
  * 
  * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio dei messaggi o se era inattivo,
  *         -1 in caso di errore 
+ * 
+ * @note: i messaggi vengono scritti fuori dalla sezione epoch, l'utente deve essere
+ *        tenuto con un riferimento (vedi get_user)
  */
-int send_history(user_t *user, int *msgsdelivered, int *filesdelivered);
+int send_history(user_t *user, prevmsgs_req_t *cursor, int *msgsdelivered, int *filesdelivered);
+
+
+/**
+ * @function send_undelivered
+ * @brief Invia all'utente reply seguito dai messaggi della history non ancora
+ *        consegnati con un'unica scrittura (CONNECT_OP con CONNECT_PUSH). Come in
+ *        send_history i messaggi vengono copiati con la lock dell'utente ed inviati
+ *        senza, quelli arrivati nel frattempo vengono inviati alla fine
+ * 
+ * @param user            utente a cui inviare i messaggi
+ * @param reply           risposta da inviare per prima (OP_OK + lista utenti online)
+ * @param msgsdelivered   contatore dei messaggi testuali inviati all'utente in questa funzione
+ * @param filesdelivered  contatore dei messaggi files inviati all'utente in questa funzione
+ * 
+ * @return 1 se successo, 0 se l'utente si è disconnesso durante l'invio dei messaggi o se era inattivo,
+ *         -1 in caso di errore 
+ * 
+ * @note: come per send_history l'utente deve essere tenuto con un riferimento
+ */
+int send_undelivered(user_t *user, message_t *reply, int *msgsdelivered, int *filesdelivered);
+
+
+/**
+ * @function expire_user
+ * @brief Elimina i messaggi scaduti dalla history dell'utente (anche quelli scaricati
+ *        su disco) e fissa il timer alla prossima scadenza
+ * 
+ * @param user   utente
+ * @param when   scadenza del timer che è scattato
+ * @param now    istante corrente
+ * @param out    messaggi eliminati e memoria liberata (vengono sommati ai valori presenti)
+ * 
+ * @return 1 se successo, 0 se il timer non era più valido o l'utente è inattivo,
+ *         -1 in caso di errore 
+ */
+int expire_user(user_t *user, time_t when, time_t now, history_expired_t *out);
+
+
+/**
+ * @function schedule_expire_user
+ * @brief Fissa il timer dell'utente alla prima scadenza dei messaggi nella history
+ *        in memoria (usata dopo il ripristino dello stato)
+ * 
+ * @param user   utente
+ * 
+ * @return 0 se successo, -1 in caso di errore 
+ */
+int schedule_expire_user(user_t *user);
+
+
+/**
+ * @function reclaim_users
+ * @brief Elimina i messaggi già consegnati degli utenti con la history più grande finchè
+ *        i byte in tutte le history non scendono sotto HIST_BYTES_LOW(MaxHistBytes)
+ * 
+ * @param hash_us  tabella hash degli utenti registrati
+ * 
+ * @return numero di messaggi eliminati (0 anche se un altro thread sta già liberando),
+ *         -1 in caso di errore 
+ * 
+ * @note: va chiamata senza lock di utenti ed all'interno di epoch_enter/epoch_exit
+ */
+int reclaim_users(hashtable_t *hash_us);
 
 
 /**
@@ -233,6 +489,31 @@ group_us_t* unsubscribe(user_t *user, char *groupname);
 group_us_t* check_subscription(user_t *user, char *groupname);
 
 
+/**
+ * @function drop_group
+ * @brief Rimuove il gruppo dai gruppi dell'utente senza prendere la lock dell'utente
+ *        (usata durante la deregistrazione, vedi gen_remove_member)
+ * 
+ * @param user        utente 
+ * @param groupname   nome del gruppo da rimuovere
+ * 
+ * @return puntatore al gruppo rimosso, NULL se l'utente non è iscritto al gruppo
+ */
+group_us_t* drop_group(user_t *user, const char *groupname);
+
+
+/**
+ * @function pop_group
+ * @brief Rimuove e ritorna l'ultimo gruppo dell'utente senza prendere la lock
+ *        dell'utente (usata durante la deregistrazione)
+ * 
+ * @param user   utente 
+ * 
+ * @return puntatore al gruppo rimosso, NULL se l'utente non è iscritto a nessun gruppo
+ */
+group_us_t* pop_group(user_t *user);
+
+
 
 /* ------------- funzioni di inizializzazione delle varie struct  ---------------- */
 
@@ -243,6 +524,9 @@ group_us_t* check_subscription(user_t *user, char *groupname);
  * @param  max_user_in_list  numero massimo di nomi utente da inserire nella lista dei nomi
  * 
  * @return p puntatore alla nuova struttura, NULL in caso di fallimento
+ *
+ * @note: la struttura (e la lista dei nomi) è nell'arena del thread, va liberata
+ *        con arena_free
  */
 param_get_listname_t *init_param_get_listname(int max_user_in_list);
 
@@ -254,6 +538,8 @@ param_get_listname_t *init_param_get_listname(int max_user_in_list);
  * @param msg  messaggio da inviare
  * 
  * @return p puntatore alla nuova struttura, NULL in caso di fallimento
+ *
+ * @note: la struttura è nell'arena del thread, va liberata con arena_free
  */
 param_postmsg_all_t *init_param_postmsg_all(message_t *msg);
 
@@ -345,14 +631,16 @@ int postmsg_all(void *us, void *param);
 
 /**
  * @function gen_unsubscribe
- * @brief Rimuove il gruppo passato dalla lista gruppi dell' utente
+ * @brief Rimuove il gruppo passato dalla lista gruppi dell' utente (anche se l'utente
+ *        è inattivo)
  * 
  * @param us    puntatore all' utente
- * @param str   nome del gruppo da rimuovere dai membri del gruppo
+ * @param gr    puntatore al gruppo da rimuovere (un gruppo omonimo creato dopo la
+ *              sua cancellazione non viene toccato)
  * 
  * @return 0 se successo, -1 in caso di errore
  */
-int gen_unsubscribe(void *us, void *str);
+int gen_unsubscribe(void *us, void *gr);
 
 
 #endif /* USER_H_ */
\ No newline at end of file
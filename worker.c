@@ -9,6 +9,8 @@
 #include <sys/mman.h>
 #include <signal.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include <worker.h>
 #include <files_handler.h>
@@ -16,6 +18,13 @@
 #include <stats.h>
 #include <connections.h>
 #include <group.h>
+#include <epoch.h>
+#include <persist.h>
+#include <ttl.h>
+#include <reclaim.h>
+#include <names.h>
+#include <slab.h>
+#include <arena.h>
 
 
 //configurazioni del server (definita in chatty.c)
@@ -30,6 +39,34 @@ extern int get_listname(void *us, void *param);
 extern int postmsg_all(void *us, void *param);
 
 
+/**
+ * @struct rcpt_t
+ * @brief Destinatario di una POSTTXTMULTI_OP
+ *
+ * @var us     utente destinatario (NULL se non esiste)
+ * @var first  posizione nella lista della prima occorrenza dello stesso utente
+ */
+typedef struct {
+    user_t         *us;
+    unsigned long  first;
+} rcpt_t;
+
+
+/**
+ * @struct pin_t
+ * @brief Riferimento ad un utente o ad un gruppo cercato senza lock durante la
+ *        richiesta, viene rilasciato alla fine della richiesta (il worker esce
+ *        dalla sezione epoch prima di scrivere ai client, vedi epoch_pause)
+ *
+ * @var obj  utente o gruppo
+ * @var put  funzione che rilascia il riferimento (clean_user o clean_group)
+ */
+typedef struct {
+    void  *obj;
+    void  (* put )(void *);
+} pin_t;
+
+
 /* ---------------------- variabili globali nel file worker ------------------------- */
 
 //numero del thread all'interno del thread pool
@@ -53,6 +90,11 @@ static pipe_fd_t *pipe_fd;
 //id del thread worker
 static pthread_t tid_sh;
 
+//riferimenti presi dal worker durante la richiesta corrente (nella sua arena)
+static __thread pin_t         *pins   = NULL;
+static __thread unsigned int  npins   = 0;
+static __thread unsigned int  cappins = 0;
+
 
 /* --------------------------- funzioni di utilita' ------------------------------- */
 
@@ -71,6 +113,8 @@ static void quit_worker(pthread_t sh_tid) {
     if (pthread_kill(sh_tid, SIGUSR2) != 0) exit(EXIT_FAILURE);
     perror("quit_worker");
     long ret = errno;
+    slab_clean_cache();
+    arena_clean();
     pthread_exit((void *) ret);
 }
 
@@ -84,10 +128,124 @@ static void quit_worker(pthread_t sh_tid) {
 static void free_request(request_t *r) {
     if (r->msg != NULL) free_msg(r->msg); //funzione implementata nel file message.h
     if (r->data_file != NULL) {
-        if (r->data_file->buf != NULL) free(r->data_file->buf);
-        free(r->data_file);
+        slab_free(r->data_file->buf);
+        arena_free(r->data_file);
+    }
+    arena_free(r);
+}
+
+
+/**
+ * @function add_pin
+ * @brief Aggiunge un riferimento a quelli della richiesta corrente
+ * 
+ * @param obj  utente o gruppo di cui è già stato preso il riferimento
+ * @param put  funzione che rilascia il riferimento
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore (errno settato)
+ */
+static int add_pin(void *obj, void (* put )(void *)) {
+    if (npins == cappins) {
+        unsigned int cap = (cappins == 0) ? 8 : 2 * cappins;
+        pin_t *v = arena_alloc(cap * sizeof(pin_t));
+        err_return_msg(v,NULL,-1,"Errore: arena_alloc\n");
+        if (npins > 0) memcpy(v, pins, npins * sizeof(pin_t));
+        arena_free(pins);
+        pins    = v;
+        cappins = cap;
     }
-    free(r);
+    pins[npins].obj = obj;
+    pins[npins].put = put;
+    npins++;
+
+    return 0;
+}
+
+
+/**
+ * @function pin_user
+ * @brief Prende un riferimento all'utente fino alla fine della richiesta
+ * 
+ * @param user  utente cercato nella sezione epoch (se NULL non fa niente)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore (errno settato)
+ */
+static int pin_user(user_t *user) {
+    if (user == NULL) return 0;
+    if (add_pin(user, clean_user) == -1) return -1;
+    get_user(user);
+    return 0;
+}
+
+
+/**
+ * @function pin_group
+ * @brief Prende un riferimento al gruppo fino alla fine della richiesta
+ * 
+ * @param group  gruppo cercato nella sezione epoch (se NULL non fa niente)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore (errno settato)
+ */
+static int pin_group(group_t *group) {
+    if (group == NULL) return 0;
+    if (add_pin(group, clean_group) == -1) return -1;
+    get_group(group);
+    return 0;
+}
+
+
+/**
+ * @function release_pins
+ * @brief Rilascia i riferimenti presi durante la richiesta
+ * 
+ * @note: da chiamare prima di arena_reset
+ */
+static void release_pins() {
+    for (unsigned int i = 0; i < npins; i++) pins[i].put(pins[i].obj);
+    pins    = NULL;
+    npins   = 0;
+    cappins = 0;
+}
+
+
+/**
+ * @function read_data
+ * @brief Legge il body di un messaggio come readData, ma il buffer dei dati viene
+ *        allocato nell'arena del worker
+ * 
+ * @param connfd  fd del client
+ * @param data    puntatore al body del messaggio
+ * 
+ * @return 0 se descrittore chiuso (o nickname troppo lungo), -1 se errore (errno settato),
+ *         1 se ha successo.
+ */
+static int read_data(int connfd, message_data_t *data) {
+    int check, len;
+    data->buf = NULL;
+
+    //leggo la lunghezza del nickname del ricevente ed il nickname
+    check = readn(connfd, &len, sizeof(int));
+    if (check <= 0) return check;
+    //lunghezza non valida: il client viene disconnesso
+    if (len < 0 || len > MAX_NAME_LENGTH+1) return 0;
+    check = readn(connfd, data->hdr.receiver, sizeof(char)*len);
+    if (check <= 0) return check;
+
+    //leggo la lunghezza del buffer dati
+    check = readn(connfd, &(data->hdr.len), sizeof(int));
+    if (check <= 0) return check;
+    if (data->hdr.len == 0) return 1;
+
+    data->buf = arena_alloc(data->hdr.len);
+    err_return_msg(data->buf,NULL,-1,"Errore: arena_alloc\n");
+    //leggo il buffer dati
+    check = readn(connfd, data->buf, sizeof(char)*(data->hdr.len));
+    if (check <= 0) {
+        slab_free(data->buf);
+        data->buf = NULL;
+    }
+
+    return check;
 }
 
 
@@ -104,16 +262,17 @@ static int read_request(int connfd, request_t *req) {
     req->msg = NULL;
     req->data_file = NULL;
 
-    message_t *msg = malloc(sizeof(message_t));
+    message_t *msg = arena_alloc(sizeof(message_t));
     if (msg == NULL) {
         free_request(req);
-        fprintf(stderr, "Errore: malloc\n");
+        fprintf(stderr, "Errore: arena_alloc\n");
         return -1;
     }
     msg->data.buf = NULL;
     
     //leggo il messaggio del client
-    int check = readMsg(connfd, msg);
+    int check = readHeader(connfd, &msg->hdr);
+    if (check > 0) check = read_data(connfd, &msg->data);
     if(check <= 0) { //errore o connfd chiuso
         free_msg(msg);
         free_request(req);
@@ -124,18 +283,17 @@ static int read_request(int connfd, request_t *req) {
         req->msg = msg;
         //se devo leggere anche il file
         if (msg->hdr.op == POSTFILE_OP) {
-            message_data_t *data_file = malloc(sizeof(message_data_t));
+            message_data_t *data_file = arena_alloc(sizeof(message_data_t));
             if (data_file == NULL){
                 free_request(req);
-                fprintf(stderr, "Errore: malloc\n");
+                fprintf(stderr, "Errore: arena_alloc\n");
                 return -1;
             }
 
-            data_file->buf = NULL;
-            check = readData(connfd, data_file);
+            check = read_data(connfd, data_file);
             if(check<=0) { //errore o connfd chiuso
                 free_request(req);
-                free(data_file);
+                arena_free(data_file);
                 return check;
             }
 
@@ -168,6 +326,9 @@ static int disconnect_fun(long fd) {
         chattyStats.nonline--;
         check = unlock_stats();
         err_check_return(check != 0, check, "unlock_stats", -1);
+
+        //scarico su disco la history dell'utente
+        if (page_out_user(user) == -1) return -1;
     }
 
     return 0;
@@ -195,8 +356,12 @@ static int send_error(request_t *req, user_t *user, op_t op) {
     //se sto inviando il messaggio di errore ad un utente connesso
     if (user != NULL) check = sendHdr_toUser(user, &req->msg->hdr);
     //se l'utente non è passato da parametro invio il messaggio di
-    //errore al client che aveva fatto la richiesta
-    else check = sendHdr_toClient(req->fd, &req->msg->hdr);
+    //errore al client che aveva fatto la richiesta (fuori dalla sezione epoch)
+    else {
+        int paused = epoch_pause();
+        check = sendHdr_toClient(req->fd, &req->msg->hdr);
+        epoch_resume(paused);
+    }
 
     //controllo l'esito dell'invio del messaggio di errore
     //se errore
@@ -224,11 +389,13 @@ static int send_error(request_t *req, user_t *user, op_t op) {
  * 
  * @param req   richiesta dalla quale ricavare le informazioni per eseguire la funzione
  * @param user  utente a cui inviare la lista
+ * @param push  se 1 alla lista seguono, nella stessa scrittura, i messaggi non
+ *              ancora consegnati all'utente (CONNECT_OP con CONNECT_PUSH)
  * 
  * @return -1 se occorre qualche errore e si deve terminare il server chatty,
  *          0 altrimenti
  */
-static int usrlist_fun(request_t *req, user_t *user) {
+static int usrlist_fun(request_t *req, user_t *user, int push) {
     //creo la struttura per i parametri necessari alla funzione 
     //get_listname
     param_get_listname_t *prm = init_param_get_listname(10);
@@ -236,24 +403,34 @@ static int usrlist_fun(request_t *req, user_t *user) {
 
     //prendo la lista degli utenti online
     int check = apply_fun_param(us_on, get_listname, (void*)prm);
-    err_return_msg_clean(check, -1, -1, "Errore: get_listname\n", free(prm));
+    err_return_msg_clean(check, -1, -1, "Errore: get_listname\n", arena_free(prm));
 
-    //per risparmiare un po' di spazio
-    prm->all_names = realloc(prm->all_names, sizeof(char)*(prm->len));
-    err_return_msg_clean(prm->all_names, NULL, -1, "Errore: realloc\n", free(prm));
-    
     //preparo il messaggio da inviare all'utente
+    slab_free(req->msg->data.buf);
     setHeader(&req->msg->hdr, OP_OK, "");
     setData(&req->msg->data, "", prm->all_names, prm->len);
+    arena_free(prm);
 
     //invio il messaggio all'utente
-    int sent = 0;
-    if (sendMsg_toUser(user, req->msg, &sent) == -1) {
-        free(prm);
-        return -1;
+    if (!push) {
+        int sent = 0;
+        return sendMsg_toUser(user, req->msg, &sent) == -1 ? -1 : 0;
     }
 
-    free(prm);
+    //invio la lista insieme ai messaggi non ancora consegnati
+    int msgsdelivered = 0, filesdelivered = 0;
+    if (send_undelivered(user, req->msg, &msgsdelivered, &filesdelivered) == -1) return -1;
+
+    //aggiorno le statistiche
+    int checklock = lock_stats();
+    err_check_return(checklock != 0, checklock, "lock_stats", -1);
+    chattyStats.ndelivered        = chattyStats.ndelivered + msgsdelivered;
+    chattyStats.nnotdelivered     = chattyStats.nnotdelivered - msgsdelivered;
+    chattyStats.nfiledelivered    = chattyStats.nfiledelivered + filesdelivered;
+    chattyStats.nfilenotdelivered = chattyStats.nfilenotdelivered - filesdelivered;
+    checklock = unlock_stats();
+    err_check_return(checklock != 0, checklock, "unlock_stats", -1);
+
     return 0;
 }
 
@@ -269,28 +446,20 @@ static int usrlist_fun(request_t *req, user_t *user) {
  */
 static int register_fun(request_t *req) {
     errno = 0;
-    //controllo che non esista un gruppo con tale nome
-    group_t *gr = search_data_ht(hash_gr, (void*)req->msg->hdr.sender);
-    if (gr != NULL) {
-        //invio il messaggio di errore al client
-        return send_error(req, NULL, OP_NICK_ALREADY);
-    }
-    //se errore
-    else if (gr == NULL && errno != 0) return -1;
-
     //creo l'utente
     user_t *user = create_user(req->msg->hdr.sender, req->fd);
     err_return_msg(user,NULL,-1,"Errore: creazione utente\n");
 
-    //provo ad aggiugerlo nella tabella hash
-    int check = add_data_ht(hash_us, (void*)user, (void*)user->nickname);
+    //provo ad aggiugerlo nella tabella hash (se il nome non è già di un utente o
+    //di un gruppo, controllo ed inserimento sono atomici)
+    int check = names_add_user(user);
 
     //se errore
     if (check == -1 && errno != 0) {
         clean_user(user);
         return -1;
     }
-    //se esiste già un utente con tale nome
+    //se esiste già un utente o un gruppo con tale nome
     else if (check == 0 && errno == 0) {
         clean_user(user);
         //invio il messaggio di errore al client
@@ -298,8 +467,11 @@ static int register_fun(request_t *req) {
     }
     //se OK
     else {
+        //da qui l'utente è nella tabella hash
+        if (pin_user(user) == -1) return -1;
+
         //aggiungo l'utente nella lista di quelli online
-        if (add_data(us_on, (void*)user, (void*)&user->fd) == -1) return -1;
+        if (add_data(us_on, (void*)user, (void*)&req->fd) == -1) return -1;
 
         //aggiorno le statistiche
         int checklock = lock_stats();
@@ -309,8 +481,12 @@ static int register_fun(request_t *req) {
         checklock = unlock_stats();
         err_check_return(checklock != 0, checklock, "unlock_stats", -1);
 
+        //rendo persistente la registrazione prima di rispondere
+        if (persist_log_op(P_REGISTER, user->nickname, NULL) == -1) return -1;
+        if (persist_commit() == -1) return -1;
+
         //invio all'utente l'ack OK + la lista degli utenti online
-        return usrlist_fun(req, user);
+        return usrlist_fun(req, user, 0);
     }
 }
 
@@ -326,7 +502,7 @@ static int register_fun(request_t *req) {
  */
 static int connect_fun(request_t *req) {
     errno = 0;
-    user_t *user = search_data_ht(hash_us, (void*)req->msg->hdr.sender);
+    user_t *user = users_ht_search(hash_us, req->msg->hdr.sender);
 
     //se errore 
     if (user == NULL && errno != 0) return -1;
@@ -337,6 +513,8 @@ static int connect_fun(request_t *req) {
     }
     //se OK
     else {
+        if (pin_user(user) == -1) return -1;
+
         //setto online l'utente
         int check = set_online(user, req->fd);
 
@@ -351,8 +529,13 @@ static int connect_fun(request_t *req) {
             checklock = unlock_stats();
             err_check_return(checklock != 0, checklock, "unlock_stats", -1);
 
+            //con l'opzione CONNECT_PUSH invio subito anche i messaggi non consegnati
+            char *opt = req->msg->data.buf;
+            unsigned int len = req->msg->data.hdr.len;
+            int push = (opt != NULL && len == sizeof(CONNECT_PUSH) && strcmp(opt, CONNECT_PUSH) == 0);
+
             //invio all'utente l'ack OK + la list degli utenti online
-            return usrlist_fun(req, user);
+            return usrlist_fun(req, user, push);
         }
         //se già online o disattivo
         else if (check == 0) {
@@ -365,6 +548,44 @@ static int connect_fun(request_t *req) {
 }
 
 
+/**
+ * @function find_receiver
+ * @brief Cerca il destinatario di un messaggio con una sola ricerca nel registro dei
+ *        nomi: un utente oppure un gruppo a cui è iscritto il mittente
+ * 
+ * @param us_sender  utente che invia il messaggio
+ * @param name       nome del destinatario
+ * @param us         vi viene scritto l'utente destinatario (se è un utente)
+ * @param gr         vi viene scritto il gruppo destinatario (se è un gruppo)
+ * 
+ * @return 1 se il destinatario è stato trovato, 0 se non esiste o è un gruppo a cui
+ *         il mittente non è iscritto, -1 ed errno settato in caso di errore
+ * 
+ * @note: il destinatario trovato viene tenuto con un riferimento fino alla fine
+ *        della richiesta
+ */
+static int find_receiver(user_t *us_sender, char *name, user_t **us, group_t **gr) {
+    name_kind_t kind = NAME_NONE;
+    errno = 0;
+    void *found = names_search(name, &kind);
+    if (found == NULL) return (errno != 0) ? -1 : 0;
+
+    if (kind == NAME_USER) {
+        *us = (user_t*)found;
+        return (pin_user(*us) == -1) ? -1 : 1;
+    }
+
+    //il gruppo è un destinatario solo se il mittente vi è iscritto (l'iscrizione
+    //deve essere a questo gruppo, non ad uno cancellato con lo stesso nome)
+    group_t *sub = check_subscription(us_sender, name);
+    if (sub == NULL) return (errno != 0) ? -1 : 0;
+    if (sub != (group_t*)found) return 0;
+
+    *gr = sub;
+    return (pin_group(sub) == -1) ? -1 : 1;
+}
+
+
 /**
  * @function posttxt_fun
  * @brief Si occupa di inviare un messaggio testuale da un utente ad un altro oppure 
@@ -398,18 +619,11 @@ static int posttxt_fun(request_t *req, user_t *us_sender) {
     }
     //altrimenti cerco tra gli utenti
     else {
-        us_receiver = search_data_ht(hash_us, (void*)req->msg->data.hdr.receiver);
+        check = find_receiver(us_sender, req->msg->data.hdr.receiver, &us_receiver, &gr_receiver);
         //se errore
-        if (us_receiver == NULL && errno != 0) return -1;
-        //se non esiste nessun utente con tale nome
-        if (us_receiver == NULL && errno == 0) {
-            //controllo se il destinatario è in realtà un gruppo a cui è iscritto l'utente
-            gr_receiver = check_subscription(us_sender, req->msg->data.hdr.receiver);
-            //se non è iscritto a tale gruppo mando il messaggio di errore
-            if (gr_receiver == NULL && errno == 0) return send_error(req, us_sender, OP_NICK_UNKNOWN);
-            //se errore
-            if (gr_receiver == NULL && errno != 0) return -1;
-        }
+        if (check == -1) return -1;
+        //se non esiste nè un utente nè un gruppo dell'utente con tale nome
+        if (check == 0) return send_error(req, us_sender, OP_NICK_UNKNOWN);
     }
 
 
@@ -429,6 +643,8 @@ static int posttxt_fun(request_t *req, user_t *us_sender) {
         else if (check == 0) {
             if (same_user == 1) return 0;
         }
+        //se la history del destinatario è piena
+        else if (check == 2) return send_error(req, us_sender, OP_MSG_NOSPACE);
 
         //aggiorno le statistiche
         int checklock = lock_stats();
@@ -452,31 +668,37 @@ static int posttxt_fun(request_t *req, user_t *us_sender) {
         if (check == -1){
             fprintf(stderr, "Errore: postmasg_all_group\n");
             free_msg(msg);
-            free(prm);
+            arena_free(prm);
             return -1;
         }
         //se il gruppo è in fase di cancellazione lo considero inesistente
         else if (check == 0) {
             free_msg(msg);
-            free(prm);
+            arena_free(prm);
             return send_error(req, us_sender, OP_NICK_UNKNOWN);
         }
 
         //aggiorno le statistiche
         int checklock = lock_stats();
-        if (checklock != 0) {free_msg(msg); free(prm);} 
+        if (checklock != 0) {free_msg(msg); arena_free(prm);} 
         err_check_return(checklock != 0, checklock, "lock_stats", -1);
         chattyStats.ndelivered = chattyStats.ndelivered + prm->delivered;
         chattyStats.nnotdelivered = chattyStats.nnotdelivered + prm->notdelivered;
         checklock = unlock_stats();
-        if (checklock != 0) {free_msg(msg); free(prm);} 
+        if (checklock != 0) {free_msg(msg); arena_free(prm);} 
         err_check_return(checklock != 0, checklock, "unlock_stats", -1);
 
+        //nessun membro aveva spazio nella history
+        int nospace = (prm->delivered + prm->notdelivered == 0 && prm->rejected > 0);
         free_msg(msg);
-        free(prm);
+        arena_free(prm);
+        if (nospace) return send_error(req, us_sender, OP_MSG_NOSPACE);
     }
     
 
+    //i messaggi inseriti nelle history devono essere su disco prima di rispondere
+    if (persist_commit() == -1) return -1;
+
     //invio il messaggio di buon esito all'utente sender
     setHeader(&req->msg->hdr, OP_OK, "");
     if (sendHdr_toUser(us_sender, &req->msg->hdr) == -1) return -1;
@@ -485,6 +707,190 @@ static int posttxt_fun(request_t *req, user_t *us_sender) {
 }
 
 
+/**
+ * @function posttxt_ttl_fun
+ * @brief Come posttxt_fun ma il messaggio scade dopo il ttl contenuto nella
+ *        richiesta (dati "ttl:testo")
+ * 
+ * @param req        richiesta dalla quale ricavare le informazioni per eseguire la funzione
+ * @param us_sender  utente che invia il messaggio testuale
+ * 
+ * @return -1 se occorre qualche errore e si deve terminare il server chatty,
+ *          0 altrimenti
+ */
+static int posttxt_ttl_fun(request_t *req, user_t *us_sender) {
+    char *buf = req->msg->data.buf, *end = NULL;
+    unsigned int len = req->msg->data.hdr.len;
+    if (buf == NULL || len == 0 || buf[len-1] != '\0') return send_error(req, us_sender, OP_FAIL);
+
+    //leggo il ttl
+    errno = 0;
+    unsigned long ttl = strtoul(buf, &end, 10);
+    if (errno != 0 || end == buf || *end != ':' || ttl == 0 || ttl > UINT_MAX) {
+        errno = 0;
+        return send_error(req, us_sender, OP_FAIL);
+    }
+
+    //tolgo il ttl dai dati e la richiesta diventa una POSTTXT_OP
+    unsigned int skip = (end + 1) - buf;
+    memmove(buf, end + 1, len - skip);
+    req->msg->data.hdr.len = len - skip;
+    req->msg->hdr.op = POSTTXT_OP;
+
+    ttl_set_post((unsigned int)ttl);
+    int check = posttxt_fun(req, us_sender);
+    ttl_set_post(0);
+
+    return check;
+}
+
+
+/**
+ * @function cmp_rcpt
+ * @brief Confronta due destinatari per utente e, a parità, per posizione nella lista
+ */
+static int cmp_rcpt(const void *a, const void *b) {
+    const rcpt_t *x = a, *y = b;
+    if (x->us != y->us) return ((uintptr_t)x->us < (uintptr_t)y->us) ? -1 : 1;
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+
+/**
+ * @function posttxtmulti_fun
+ * @brief Si occupa di inviare un messaggio testuale ad una lista di utenti (dati
+ *        "n:" seguito da n nomi da MAX_NAME_LENGTH+1 byte e dal testo): i destinatari
+ *        vengono cercati in una sola passata, il testo viene copiato solo nei messaggi
+ *        dei destinatari e la risposta contiene un esito (op_t, un byte) per utente.
+ *        Un nome ripetuto riceve il testo una volta sola ed ha l'esito della prima
+ *        occorrenza
+ * 
+ * @param req        richiesta dalla quale ricavare le informazioni per eseguire la funzione
+ * @param us_sender  utente che invia il messaggio testuale
+ * 
+ * @return -1 se occorre qualche errore e si deve terminare il server chatty,
+ *          0 altrimenti
+ */
+static int posttxtmulti_fun(request_t *req, user_t *us_sender) {
+    char *buf = req->msg->data.buf, *end = NULL;
+    unsigned int len = req->msg->data.hdr.len;
+    if (buf == NULL || len == 0 || buf[len-1] != '\0') return send_error(req, us_sender, OP_FAIL);
+
+    //leggo il numero di destinatari
+    errno = 0;
+    unsigned long n = strtoul(buf, &end, 10);
+    if (errno != 0 || end == buf || *end != ':' || n == 0 || n > len / (MAX_NAME_LENGTH+1)) {
+        errno = 0;
+        return send_error(req, us_sender, OP_FAIL);
+    }
+
+    //dopo i nomi c'è il testo (almeno il terminatore)
+    char *names = end + 1;
+    unsigned int head = (names - buf) + n * (MAX_NAME_LENGTH+1);
+    if (head >= len) return send_error(req, us_sender, OP_FAIL);
+    char *text = buf + head;
+    unsigned int textlen = len - head;
+
+    //se la size del messaggio è troppo grande
+    if (textlen > conf_server.max_msg_size) return send_error(req, us_sender, OP_MSG_TOOLONG);
+
+    //esiti per destinatario e destinatari (nell'arena della richiesta)
+    unsigned char *res = arena_alloc(n);
+    err_return_msg(res,NULL,-1,"Errore: arena_alloc\n");
+    rcpt_t *rcpt = arena_alloc(n * sizeof(rcpt_t));
+    err_return_msg_clean(rcpt,NULL,-1,"Errore: arena_alloc\n",arena_free(res));
+    rcpt_t *byus = arena_alloc(n * sizeof(rcpt_t));
+    err_return_msg_clean(byus,NULL,-1,"Errore: arena_alloc\n",arena_free(rcpt); arena_free(res));
+
+    //cerco tutti i destinatari
+    int check = 0;
+    for (unsigned long i = 0; check != -1 && i < n; i++) {
+        char *name = names + i * (MAX_NAME_LENGTH+1);
+        name[MAX_NAME_LENGTH] = '\0';
+        //i destinatari sono solo utenti (i nomi sconosciuti li scarta il filtro)
+        name_kind_t kind = NAME_NONE;
+        void *found = names_search(name, &kind);
+        if (found == NULL && errno != 0) check = -1;
+        rcpt[i].us    = (kind == NAME_USER) ? (user_t*)found : NULL;
+        rcpt[i].first = i;
+        if (check != -1 && pin_user(rcpt[i].us) == -1) check = -1;
+        byus[i] = rcpt[i];
+    }
+
+    //i nomi ripetuti puntano alla prima occorrenza dello stesso utente
+    qsort(byus, n, sizeof(rcpt_t), cmp_rcpt);
+    for (unsigned long i = 1; i < n; i++) {
+        if (byus[i].us == NULL || byus[i].us != byus[i-1].us) continue;
+        rcpt[byus[i].first].first = rcpt[byus[i-1].first].first;
+    }
+    arena_free(byus);
+
+    //messaggio con il solo testo, da cui si copiano quelli dei destinatari
+    message_t txt;
+    memset(&txt, 0, sizeof(message_t));
+    setHeader(&txt.hdr, TXT_MESSAGE, req->msg->hdr.sender);
+    setData(&txt.data, "", text, textlen);
+
+    //invio il messaggio ai destinatari
+    int delivered = 0, notdelivered = 0;
+    for (unsigned long i = 0; check != -1 && i < n; i++) {
+        if (rcpt[i].us == NULL) {
+            res[i] = OP_NICK_UNKNOWN;
+            continue;
+        }
+        //nome ripetuto: ha già ricevuto il testo
+        if (rcpt[i].first != i) {
+            res[i] = res[rcpt[i].first];
+            continue;
+        }
+
+        message_t *msg = duplicate_msg(&txt, TXT_MESSAGE);
+        if (msg == NULL) {
+            check = -1;
+            break;
+        }
+
+        int sent = 0;
+        check = sendMsg_toUser(rcpt[i].us, msg, &sent);
+        if (check == -1) break;
+
+        res[i] = (check == 2) ? OP_MSG_NOSPACE : OP_OK;
+        if (sent == 1) delivered++;
+        else if (check != 2) notdelivered++;
+    }
+    arena_free(rcpt);
+
+    //in caso di errore
+    if (check == -1) {
+        arena_free(res);
+        return -1;
+    }
+
+    //aggiorno le statistiche una volta sola
+    int checklock = lock_stats();
+    if (checklock != 0) arena_free(res);
+    err_check_return(checklock != 0, checklock, "lock_stats", -1);
+    chattyStats.ndelivered    = chattyStats.ndelivered + delivered;
+    chattyStats.nnotdelivered = chattyStats.nnotdelivered + notdelivered;
+    checklock = unlock_stats();
+    if (checklock != 0) arena_free(res);
+    err_check_return(checklock != 0, checklock, "unlock_stats", -1);
+
+    //i messaggi inseriti nelle history devono essere su disco prima di rispondere
+    if (persist_commit() == -1) {
+        arena_free(res);
+        return -1;
+    }
+
+    //invio gli esiti all'utente sender
+    slab_free(req->msg->data.buf);
+    setHeader(&req->msg->hdr, OP_OK, "");
+    setData(&req->msg->data, "", (char*)res, n);
+    int sent = 0;
+    return sendMsg_toUser(us_sender, req->msg, &sent) == -1 ? -1 : 0;
+}
+
+
 /**
  * @function posttxtall_fun
  * @brief Si occupa di inviare un messaggio testuale a tutti gli utenti registrati
@@ -509,26 +915,45 @@ static int posttxtall_fun(request_t *req, user_t *us_sender) {
     param_postmsg_all_t *prm = init_param_postmsg_all(msg);
     err_return_msg_clean(prm,NULL,-1,"Errore: init_param_postmsg_all\n",free_msg(msg));
 
-    //invio il messaggio a tutta la tabella hash degli utenti
-    if (apply_fun_param_ht(hash_us, postmsg_all, (void*)prm) == -1){
+    //prendo gli utenti registrati con un riferimento: durante l'invio il worker
+    //esce dalla sezione epoch e gli utenti deregistrati nel frattempo non devono
+    //essere liberati
+    ht_snapshot_t *snap = get_snapshot_ht(hash_us);
+    err_return_msg_clean(snap,NULL,-1,"Errore: get_snapshot_ht\n",free_msg(msg); arena_free(prm));
+    for (int i = 0; i < snap->len; i++) get_user((user_t*)snap->elements[i]);
+
+    //invio il messaggio a tutti gli utenti
+    int check = 0;
+    for (int i = 0; i < snap->len; i++) {
+        if (check != -1 && postmsg_all(snap->elements[i], (void*)prm) == -1) check = -1;
+        clean_user(snap->elements[i]);
+    }
+    release_snapshot_ht(hash_us, snap);
+    if (check == -1){
         fprintf(stderr, "Errore: postmsg_all\n");
         free_msg(msg);
-        free(prm);
+        arena_free(prm);
         return -1;
     }
 
     //aggiorno le statistiche
     int checklock = lock_stats();
-    if (checklock != 0) {free_msg(msg); free(prm);} 
+    if (checklock != 0) {free_msg(msg); arena_free(prm);} 
     err_check_return(checklock != 0, checklock, "lock_stats", -1);
     chattyStats.ndelivered = chattyStats.ndelivered + prm->delivered;
     chattyStats.nnotdelivered = chattyStats.nnotdelivered + prm->notdelivered;
     checklock = unlock_stats();
-    if (checklock != 0) {free_msg(msg); free(prm);} 
+    if (checklock != 0) {free_msg(msg); arena_free(prm);} 
     err_check_return(checklock != 0, checklock, "unlock_stats", -1);
 
+    //nessun utente aveva spazio nella history
+    int nospace = (prm->delivered + prm->notdelivered == 0 && prm->rejected > 0);
     free_msg(msg);
-    free(prm);
+    arena_free(prm);
+    if (nospace) return send_error(req, us_sender, OP_MSG_NOSPACE);
+
+    //i messaggi inseriti nelle history devono essere su disco prima di rispondere
+    if (persist_commit() == -1) return -1;
 
     //invio il messaggio di buon esito all'utente sender
     setHeader(&req->msg->hdr, OP_OK, "");
@@ -570,11 +995,11 @@ static int postfile_fun(request_t *req, user_t *us_sender) {
     }
     //se errore
     else if (errno != 0) {
-        if (name_file != NULL) free(name_file);
+        arena_free(name_file);
         return -1;
     }
     
-    if (req->msg->data.buf != NULL) free(req->msg->data.buf);
+    slab_free(req->msg->data.buf);
     req->msg->data.buf = name_file;
     req->msg->data.hdr.len = strlen(name_file) + 1;
 
@@ -590,18 +1015,11 @@ static int postfile_fun(request_t *req, user_t *us_sender) {
     }
     //altrimenti cerco receiver
     else {
-        us_receiver = search_data_ht(hash_us, (void*)req->msg->data.hdr.receiver);
+        check = find_receiver(us_sender, req->msg->data.hdr.receiver, &us_receiver, &gr_receiver);
         //se errore
-        if (us_receiver == NULL && errno != 0) return -1;
-        //se non esiste nessun utente con tale nome
-        if (us_receiver == NULL && errno == 0) {
-            //controllo se il destinatario è in realtà un gruppo a cui è iscritto l'utente
-            gr_receiver = check_subscription(us_sender, req->msg->data.hdr.receiver);
-            //se non è iscritto a tale gruppo mando il messaggio di errore
-            if (gr_receiver == NULL && errno == 0) return send_error(req, us_sender, OP_NICK_UNKNOWN);
-            //se errore 
-            if (gr_receiver == NULL && errno != 0) return -1;
-        }
+        if (check == -1) return -1;
+        //se non esiste nè un utente nè un gruppo dell'utente con tale nome
+        if (check == 0) return send_error(req, us_sender, OP_NICK_UNKNOWN);
     }
 
 
@@ -623,6 +1041,8 @@ static int postfile_fun(request_t *req, user_t *us_sender) {
         else if (check == 0) {
             if (same_user == 1) return 0;
         }
+        //se la history del destinatario è piena
+        else if (check == 2) return send_error(req, us_sender, OP_MSG_NOSPACE);
 
         //aggiorno le statistiche
         int checklock = lock_stats();
@@ -646,32 +1066,38 @@ static int postfile_fun(request_t *req, user_t *us_sender) {
         if (check == -1){
             fprintf(stderr, "Errore: postmasg_all_group\n");
             free_msg(msg);
-            free(prm);
+            arena_free(prm);
             return -1;
         }
         //se il gruppo è in fase di cancellazione lo considero inesistente
         else if (check == 0) {
             free_msg(msg);
-            free(prm);
+            arena_free(prm);
             return send_error(req, us_sender, OP_NICK_UNKNOWN);
         }
 
         //aggiorno le statistiche
         int checklock = lock_stats();
-        if (checklock != 0) {free_msg(msg); free(prm);} 
+        if (checklock != 0) {free_msg(msg); arena_free(prm);} 
         err_check_return(checklock != 0, checklock, "lock_stats", -1);
         chattyStats.nfiledelivered = chattyStats.nfiledelivered + prm->delivered;
         chattyStats.nfilenotdelivered = chattyStats.nfilenotdelivered + prm->notdelivered;
         checklock = unlock_stats();
-        if (checklock != 0) {free_msg(msg); free(prm);} 
+        if (checklock != 0) {free_msg(msg); arena_free(prm);} 
         err_check_return(checklock != 0, checklock, "unlock_stats", -1);
 
+        //nessun membro aveva spazio nella history
+        int nospace = (prm->delivered + prm->notdelivered == 0 && prm->rejected > 0);
         free_msg(msg);
-        free(prm);
+        arena_free(prm);
+        if (nospace) return send_error(req, us_sender, OP_MSG_NOSPACE);
 
     }
 
 
+    //i messaggi inseriti nelle history devono essere su disco prima di rispondere
+    if (persist_commit() == -1) return -1;
+
     //invio il messaggio di buon esito all'utente sender
     setHeader(&req->msg->hdr, OP_OK, "");
     if (sendHdr_toUser(us_sender, &req->msg->hdr) == -1) return -1;
@@ -694,6 +1120,12 @@ static int getfile_fun(request_t *req, user_t *user) {
     //variabili di appoggio
     int check = 1, delivered = 0;
     char *mappedfile = NULL;
+
+    //i file salvati non hanno path né iniziano con '.' (vedi get_filename)
+    char *name = req->msg->data.buf;
+    if (name == NULL || name[0] == '.' || strchr(name, '/') != NULL) {
+        return send_error(req, user, OP_NO_SUCH_FILE);
+    }
     
     //mappo il file da inviare in memoria
     int size_file = get_mappedfile(&mappedfile, conf_server.dir_name, req->msg->data.buf);
@@ -707,7 +1139,7 @@ static int getfile_fun(request_t *req, user_t *user) {
 
     //se il file esiste preparo il messaggio da inviare all'utente
     setHeader(&req->msg->hdr, OP_OK, "");
-    if (req->msg->data.buf != NULL) free(req->msg->data.buf);
+    slab_free(req->msg->data.buf);
     setData(&req->msg->data, "", mappedfile, size_file);
 
     //invio il messaggio
@@ -727,7 +1159,8 @@ static int getfile_fun(request_t *req, user_t *user) {
 
 /**
  * @function getprevmsgs_fun
- * @brief Si occupa di inviare all'utente i messaggi nella sua history
+ * @brief Si occupa di inviare all'utente i messaggi nella sua history (tutti, oppure
+ *        per GETPREVMSGS_SINCE_OP solo quelli successivi al cursore ricevuto)
  * 
  * @param req   richiesta dalla quale ricavare le informazioni per eseguire la funzione
  * @param user  utente che vuole scaricare il file
@@ -738,9 +1171,27 @@ static int getfile_fun(request_t *req, user_t *user) {
 static int getprevmsgs_fun(request_t *req, user_t *user) {
     //variabili di appoggio
     int msgsdelivered = 0, filesdelivered = 0;
-    
+    prevmsgs_req_t cursor, *cur = NULL;
+
+    if (req->msg->hdr.op == GETPREVMSGS_SINCE_OP) {
+        //la richiesta deve contenere il cursore ("since:page")
+        char *buf = req->msg->data.buf, *end = NULL;
+        unsigned int len = req->msg->data.hdr.len;
+        if (buf == NULL || len == 0 || buf[len-1] != '\0') return send_error(req, user, OP_FAIL);
+
+        errno = 0;
+        cursor.since = strtoul(buf, &end, 10);
+        cursor.page  = 0;
+        if (errno == 0 && end != buf && *end == ':') cursor.page = strtoul(end + 1, &end, 10);
+        if (errno != 0 || end == buf || *end != '\0') {
+            errno = 0;
+            return send_error(req, user, OP_FAIL);
+        }
+        cur = &cursor;
+    }
+
     //invio la history
-    if (send_history(user, &msgsdelivered, &filesdelivered) == -1) return -1;
+    if (send_history(user, cur, &msgsdelivered, &filesdelivered) == -1) return -1;
 
     //aggiorno le statistiche
     int checklock = lock_stats();
@@ -774,33 +1225,36 @@ static int cancgroup_fun(request_t *req, user_t *user, group_t *gr) {
     group_t *group = gr;
     if (group == NULL) {
         //cerco il gruppo nella lista di quelli a cui è iscritto l'utente
-        group_t *group = check_subscription(user, (void*)req->msg->data.hdr.receiver);
+        group = check_subscription(user, (void*)req->msg->data.hdr.receiver);
         //se l'utente non è iscritto a tale gruppo
-        if (group == NULL && req != NULL && errno == 0) {
+        if (group == NULL && errno == 0) {
             //invio il messaggio di errore all' utente
             return send_error(req, user, OP_NICK_UNKNOWN);
         }
         //se errore
         if (group == NULL && errno != 0) return -1;
+        if (pin_group(group) == -1) return -1;
     }
 
-    //'disabilito' il gruppo
-    int check = disable_group(group, user->nickname);
+    //metto il gruppo in 'cancellazione': da qui non accetta più messaggi né iscrizioni
+    int check = mark_group(group, user->nickname);
 
     //se errore
     if (check == -1) return -1;
-    //se l'utente non è il creatore
+    //se l'utente non è il creatore o se il gruppo è già in fase di cancellazione
     else if (check == 0 && req != NULL) return send_error(req, user, OP_NO_CREATOR);
+    else if (check == 0) return 0;
 
-    //elimino il gruppo dalla tabella hash dei gruppi
-    check = remove_data_ht(hash_gr, (void*)group->groupname);
+    //elimino il gruppo dalla tabella hash dei gruppi (il nome torna libero), verrà
+    //rimosso dai gruppi dei membri e liberato dal thread di reclaim.c
+    group_t *detached = names_detach_group(group->groupname);
 
-    //se non esiste nessun gruppo con tale nome nella tabella hash
-    //(controllo solo precauzionale)
-    if (check != 1) {
+    //se non esiste questo gruppo nella tabella hash (controllo solo precauzionale)
+    if (detached != group) {
         fprintf(stderr, "Errore: problema nella cancellazione gruppo\n");
         return -1;
     }
+    if (reclaim_group(group) == -1) return -1;
     
     //aggiorno le statistiche
     int checklock = lock_stats();
@@ -811,9 +1265,17 @@ static int cancgroup_fun(request_t *req, user_t *user, group_t *gr) {
 
     //se era un richiesta diretta devo comunicare l'esito all'utente
     if (req != NULL) {
-        //invio il messaggio di ok al client
+        //rendo persistente la cancellazione (quelle indirette vengono rieseguite
+        //insieme all'operazione che le ha causate)
+        if (persist_log_op(P_CANCGROUP, req->msg->data.hdr.receiver, user->nickname) == -1) return -1;
+        if (persist_commit() == -1) return -1;
+
+        //invio il messaggio di ok al client (fuori dalla sezione epoch)
         setHeader(&req->msg->hdr, OP_OK, "");
-        if (sendHdr_toClient(req->fd, &req->msg->hdr) == -1) return -1;
+        int paused = epoch_pause();
+        check = sendHdr_toClient(req->fd, &req->msg->hdr);
+        epoch_resume(paused);
+        if (check == -1) return -1;
     }
 
     return 0;
@@ -822,7 +1284,10 @@ static int cancgroup_fun(request_t *req, user_t *user, group_t *gr) {
 
 /**
  * @function unregister_fun
- * @brief Si occupa della deregistrazione di un utente
+ * @brief Si occupa della deregistrazione di un utente: l'utente ed i gruppi di cui
+ *        era il creatore vengono disattivati e tolti dalle tabelle hash prima della
+ *        risposta, la rimozione dai gruppi e dai membri avviene in background
+ *        (vedi reclaim.h)
  * 
  * @param req   richiesta dalla quale ricavare le informazioni per eseguire la funzione
  * @param user  utente che vuole deregistrarsi
@@ -843,108 +1308,237 @@ static int unregister_fun(request_t *req, user_t *user) {
     //rimuovo l'utente dalla lista online
     user_t *p = remove_data(us_on, (void*)&req->fd);
 
-    //disattivo l'utente (e lo rimuovo da tutti i gruppi a cui è iscritto)
-    check = disable_user(user);
+    //disattivo l'utente
+    check = deactivate_user(user);
     if (check != 1) return check;
 
-    //cancello gli eventuali gruppi di cui l'utente era creatore
-    //(gli unici rimasti nella sua lista)
-    group_t *group_to_canc = (group_t*)pop_data(user->groups);
-    if (group_to_canc == NULL && errno != 0) return -1;
-    while(group_to_canc != NULL){
-        if (cancgroup_fun(NULL, user, group_to_canc) == -1) {
+    //metto in 'cancellazione' i gruppi di cui l'utente era creatore e li elimino
+    //dalla tabella hash dei gruppi
+    unsigned int n = 0, ncanc = 0;
+    errno = 0;
+    group_t **owned = (group_t**)owned_groups(user, &n);
+    if (owned == NULL && errno != 0) return -1;
+    for (unsigned int i = 0; i < n; i++) {
+        check = mark_group(owned[i], user->nickname);
+        //già in cancellazione (se ne occupa chi l'ha cancellato)
+        if (check == 0) continue;
+        if (check == -1 || names_detach_group(owned[i]->groupname) != owned[i]) {
             fprintf(stderr, "Errore: problema nella deregistrazione\n");
+            free(owned);
             return -1;
         }
-        group_to_canc = (group_t*)pop_data(user->groups);
-        if (group_to_canc == NULL && errno != 0) return -1;
+        owned[ncanc++] = owned[i];
     }
 
     //rimuovo l'utente dalla tabella hash degli utenti registrati
-    check = remove_data_ht(hash_us, (void*)req->msg->hdr.sender);
+    user_t *detached = names_detach_user(req->msg->hdr.sender);
 
-    //se non esiste nessun utente con tale nome nella tabella hash o nella lista degli
+    //se non esiste questo utente nella tabella hash o nella lista degli
     //utenti online (controllo solo precauzionale)
-    if (check != 1 || p == NULL) {
+    if (detached != user || p == NULL) {
         fprintf(stderr, "Errore: problema nella deregistrazione\n");
+        free(owned);
         return -1;
     }
-    //se OK
-    else {
-        //aggiorno le statistiche
-        int checklock = lock_stats();
-        err_check_return(checklock != 0, checklock, "lock_stats", -1);
-        chattyStats.nonline--;
-        chattyStats.nusers--;
-        checklock = unlock_stats();
-        err_check_return(checklock != 0, checklock, "unlock_stats", -1);
 
-        //invio il messaggio di ok al client
-        setHeader(&req->msg->hdr, OP_OK, "");
-        if (sendHdr_toClient(req->fd, &req->msg->hdr) == -1) return -1;
+    //la rimozione dai gruppi e la free avvengono nel thread di reclaim.c
+    check = reclaim_user(user, owned, ncanc);
+    free(owned);
+    if (check == -1) return -1;
 
-        return 0;
-    }
+    //aggiorno le statistiche
+    int checklock = lock_stats();
+    err_check_return(checklock != 0, checklock, "lock_stats", -1);
+    chattyStats.nonline--;
+    chattyStats.nusers--;
+    chattyStats.ngroups -= ncanc;
+    checklock = unlock_stats();
+    err_check_return(checklock != 0, checklock, "unlock_stats", -1);
+
+    //rendo persistente la deregistrazione
+    if (persist_log_op(P_UNREGISTER, req->msg->hdr.sender, NULL) == -1) return -1;
+    if (persist_commit() == -1) return -1;
+
+    //invio il messaggio di ok al client (fuori dalla sezione epoch)
+    setHeader(&req->msg->hdr, OP_OK, "");
+    int paused = epoch_pause();
+    check = sendHdr_toClient(req->fd, &req->msg->hdr);
+    epoch_resume(paused);
+    if (check == -1) return -1;
+
+    return 0;
 }
 
 
 /**
- * @function creategroup_fun
- * @brief Si occupa della creazione di un gruppo
+ * @function make_group
+ * @brief Crea il gruppo richiesto, lo inserisce nella tabella hash e tra i gruppi
+ *        del creatore (la creazione viene scritta nel log ma non confermata)
  * 
  * @param req   richiesta dalla quale ricavare le informazioni per eseguire la funzione
  * @param user  utente che vuole creare un gruppo
+ * @param out   vi viene scritto il gruppo creato
  * 
- * @return -1 se occorre qualche errore e si deve terminare il server chatty,
- *          0 altrimenti
+ * @return 1 se il gruppo è stato creato, 0 se è stato inviato un errore all'utente,
+ *         -1 se occorre qualche errore e si deve terminare il server chatty
  */
-static int creategroup_fun(request_t *req, user_t *user) {
+static int make_group(request_t *req, user_t *user, group_t **out) {
     errno = 0;
-    //controllo che non esista già un utente con quel nome 
-    user_t *us = search_data_ht(hash_us, (void*)req->msg->data.hdr.receiver);
-    if (us != NULL) {
-        //invio il messaggio di errore al client
-        return send_error(req, user, OP_NICK_ALREADY);
-    }
-    //se errore
-    else if (us == NULL && errno != 0) return -1;
-
     //creo il gruppo
     group_t *group = create_group(req->msg->data.hdr.receiver, user);
     err_return_msg(group,NULL,-1,"Errore: create_group\n");
 
-    //provo ad aggiugerlo nella tabella hash
-    int check = add_data_ht(hash_gr, (void*)group, (void*)group->groupname);
+    //provo ad aggiugerlo nella tabella hash (se il nome non è già di un utente o
+    //di un gruppo, controllo ed inserimento sono atomici)
+    int check = names_add_group(group);
 
     //se errore
     if (check == -1) {
         clean_group(group);
         return -1;
     }
-    //se esiste già un gruppo con tale nome
+    //se esiste già un utente o un gruppo con tale nome
     else if (check == 0) {
         clean_group(group);
         //invio il messaggio di errore all'utente
         return send_error(req, user, OP_NICK_ALREADY);
     }
-    //se OK
+
+    //inserisco il gruppo nella lista dei gruppi d'iscrizione dell'utente
+    if(subscribe(user, group) == -1) return -1;
+
+    //aggiorno le statistiche
+    int checklock = lock_stats();
+    err_check_return(checklock != 0, checklock, "lock_stats", -1);
+    chattyStats.ngroups++;
+    checklock = unlock_stats();
+    err_check_return(checklock != 0, checklock, "unlock_stats", -1);
+
+    //rendo persistente la creazione del gruppo
+    if (persist_log_op(P_CREATEGROUP, group->groupname, user->nickname) == -1) return -1;
+
+    *out = group;
+    return 1;
+}
+
+
+/**
+ * @function creategroup_fun
+ * @brief Si occupa della creazione di un gruppo
+ * 
+ * @param req   richiesta dalla quale ricavare le informazioni per eseguire la funzione
+ * @param user  utente che vuole creare un gruppo
+ * 
+ * @return -1 se occorre qualche errore e si deve terminare il server chatty,
+ *          0 altrimenti
+ */
+static int creategroup_fun(request_t *req, user_t *user) {
+    group_t *group = NULL;
+    int check = make_group(req, user, &group);
+    if (check != 1) return check;
+
+    if (persist_commit() == -1) return -1;
+
+    //invio il messaggio di buon esito all'utente
+    setHeader(&req->msg->hdr, OP_OK, "");
+    if (sendHdr_toUser(user, &req->msg->hdr) == -1) return -1;
+
+    return 0;
+}
+
+
+/**
+ * @function groupmembers_fun
+ * @brief Si occupa delle operazioni su una lista di membri di un gruppo (GROUPADD_OP,
+ *        GROUPDEL_OP e CREATEGROUPWITH_OP): la lock del gruppo viene presa una volta
+ *        sola e la risposta contiene un esito (op_t, un byte) per ogni utente
+ * 
+ * @param req   richiesta dalla quale ricavare le informazioni per eseguire la funzione
+ * @param user  utente che ha fatto la richiesta (il creatore del gruppo)
+ * @param op    operazione richiesta
+ * 
+ * @return -1 se occorre qualche errore e si deve terminare il server chatty,
+ *          0 altrimenti
+ */
+static int groupmembers_fun(request_t *req, user_t *user, op_t op) {
+    errno = 0;
+    //la lista è fatta di nomi da MAX_NAME_LENGTH+1 byte
+    unsigned int len = req->msg->data.hdr.len;
+    unsigned int n   = len / (MAX_NAME_LENGTH+1);
+    char *names      = req->msg->data.buf;
+    if (n == 0 || len % (MAX_NAME_LENGTH+1) != 0 || names == NULL) {
+        return send_error(req, user, OP_FAIL);
+    }
+    for (unsigned int i = 0; i < n; i++) names[i * (MAX_NAME_LENGTH+1) + MAX_NAME_LENGTH] = '\0';
+
+    group_t *group = NULL;
+    int check = 0;
+    if (op == CREATEGROUPWITH_OP) {
+        check = make_group(req, user, &group);
+        if (check != 1) return check;
+    }
     else {
-        //inserisco il gruppo nella lista dei gruppi d'iscrizione dell'utente
-        if(subscribe(user, group) == -1) return -1;
+        //cerco il gruppo
+        group = groups_ht_search(hash_gr, req->msg->data.hdr.receiver);
+        //se non esiste
+        if (group == NULL && errno == 0) return send_error(req, user, OP_NICK_UNKNOWN);
+        //se errore
+        else if (group == NULL && errno != 0) return -1;
+        if (pin_group(group) == -1) return -1;
 
-        //aggiorno le statistiche
-        int checklock = lock_stats();
-        err_check_return(checklock != 0, checklock, "lock_stats", -1);
-        chattyStats.ngroups++;
-        checklock = unlock_stats();
-        err_check_return(checklock != 0, checklock, "unlock_stats", -1);
+        //solo il creatore può iscrivere o rimuovere altri utenti
+        if (group->creator != user->id) {
+            return send_error(req, user, OP_NO_CREATOR);
+        }
+    }
 
-        //invio il messaggio di buon esito all'utente
-        setHeader(&req->msg->hdr, OP_OK, "");
-        if (sendHdr_toUser(user, &req->msg->hdr) == -1) return -1;
+    //esiti per utente (nell'arena della richiesta)
+    unsigned char *res = arena_alloc(n);
+    err_return_msg(res,NULL,-1,"Errore: arena_alloc\n");
 
-        return 0;
+    //risolvo gli utenti attuali con quei nomi
+    user_t **users = arena_alloc(n * sizeof(user_t *));
+    err_return_msg_clean(users,NULL,-1,"Errore: arena_alloc\n",arena_free(res));
+    for (unsigned int i = 0; check != -1 && i < n; i++) {
+        errno = 0;
+        users[i] = users_ht_search(hash_us, names + i * (MAX_NAME_LENGTH+1));
+        if (users[i] == NULL && errno != 0) check = -1;
+        else if (pin_user(users[i]) == -1) check = -1;
     }
+    if (check != -1 && op == GROUPDEL_OP) check = remove_members(group, users, n, res);
+    else if (check != -1) check = add_members(group, users, n, res);
+    arena_free(users);
+
+    //se errore
+    if (check == -1) {
+        arena_free(res);
+        return -1;
+    }
+
+    //rendo persistenti le iscrizioni/rimozioni eseguite
+    persist_op_t pop = (op == GROUPDEL_OP) ? P_DELGROUP : P_ADDGROUP;
+    for (unsigned int i = 0; check == 1 && i < n; i++) {
+        if (res[i] != OP_OK) continue;
+        if (persist_log_op(pop, group->groupname, names + i * (MAX_NAME_LENGTH+1)) == -1) check = -1;
+    }
+    if (check != -1 && persist_commit() == -1) check = -1;
+    if (check == -1) {
+        arena_free(res);
+        return -1;
+    }
+
+    //se il gruppo è in fase di cancellazione lo considero come inesistente
+    if (check == 0) {
+        arena_free(res);
+        return send_error(req, user, OP_NICK_UNKNOWN);
+    }
+
+    //invio gli esiti all'utente
+    slab_free(req->msg->data.buf);
+    setHeader(&req->msg->hdr, OP_OK, "");
+    setData(&req->msg->data, "", (char*)res, n);
+    int sent = 0;
+    return sendMsg_toUser(user, req->msg, &sent) == -1 ? -1 : 0;
 }
 
 
@@ -960,18 +1554,8 @@ static int creategroup_fun(request_t *req, user_t *user) {
  */
 static int addgroup_fun(request_t *req, user_t *user) {
     errno = 0;
-    //controllo che l'utente non sia già iscritto a tale gruppo
-    group_t *group = check_subscription(user, (void*)req->msg->data.hdr.receiver);
-    //se l'utente non è iscritto a tale gruppo
-    if (group != NULL && errno == 0) {
-        //invio il messaggio di errore all' utente
-        return send_error(req, user, OP_FAIL);
-    }
-    //se errore
-    if (group == NULL && errno != 0) return -1;
-
     //cerco il gruppo
-    group = search_data_ht(hash_gr, (void*)req->msg->data.hdr.receiver);
+    group_t *group = groups_ht_search(hash_gr, req->msg->data.hdr.receiver);
     //se non esiste
     if (group == NULL && errno == 0) {
         //invio il messaggio di errore all' utente
@@ -979,6 +1563,18 @@ static int addgroup_fun(request_t *req, user_t *user) {
     }
     //se errore
     else if (group == NULL && errno != 0) return -1;
+    if (pin_group(group) == -1) return -1;
+
+    //controllo che l'utente non sia già iscritto a tale gruppo (tra i suoi gruppi
+    //può esserci ancora un gruppo omonimo cancellato, vedi reclaim.h)
+    group_t *sub = check_subscription(user, (void*)req->msg->data.hdr.receiver);
+    //se l'utente è già iscritto a tale gruppo
+    if (sub == group) {
+        //invio il messaggio di errore all' utente
+        return send_error(req, user, OP_FAIL);
+    }
+    //se errore
+    if (sub == NULL && errno != 0) return -1;
 
     //provo ad aggiugere l'utente tra i membri del gruppo
     int check = add_member(group, user);
@@ -992,6 +1588,10 @@ static int addgroup_fun(request_t *req, user_t *user) {
         //inserisco il gruppo nella lista dei gruppi d'iscrizione dell'utente
         if(subscribe(user, group) == -1) return -1;
 
+        //rendo persistente l'iscrizione
+        if (persist_log_op(P_ADDGROUP, group->groupname, user->nickname) == -1) return -1;
+        if (persist_commit() == -1) return -1;
+
         //invio il messaggio di buon esito all'utente
         setHeader(&req->msg->hdr, OP_OK, "");
         if (sendHdr_toUser(user, &req->msg->hdr) == -1) return -1;
@@ -1022,13 +1622,17 @@ static int delgroup_fun(request_t *req, user_t *user) {
     }
     //errore
     else if (group == NULL && errno != 0) return -1;
+    if (pin_group(group) == -1) return -1;
 
     //elimino l'utente tra i membri del gruppo
     int is_creator = 0;
-    user_t *us = remove_member(group, user->nickname, &is_creator);
+    user_t *us = remove_member(group, user, &is_creator);
     //se errore
     if (us == NULL && errno != 0) return -1;
 
+    //rendo persistente la disiscrizione (il nome serve anche dopo la cancellazione)
+    if (persist_log_op(P_DELGROUP, req->msg->data.hdr.receiver, user->nickname) == -1) return -1;
+
     //se l'utente rimosso è il creatore del gruppo cancello il gruppo
     if (us != NULL && is_creator == 1) {
         if (cancgroup_fun(NULL, user, group) == -1) {
@@ -1036,6 +1640,7 @@ static int delgroup_fun(request_t *req, user_t *user) {
             return -1;
         }
     }
+    if (persist_commit() == -1) return -1;
 
     //invio il messaggio di buon esito all'utente
     setHeader(&req->msg->hdr, OP_OK, "");
@@ -1072,6 +1677,15 @@ void* worker(void* arg){
     //variabili di appoggio
     int check = 0, checklock = 0;
 
+    //mi registro per poter cercare utenti e gruppi senza lock
+    if (epoch_register() == -1) quit_worker(tid_sh);
+    //riuso i nodi delle liste liberati da questo thread
+    enable_node_pool();
+    //messaggi dalla cache delle slab di questo thread, oggetti temporanei delle
+    //richieste dalla sua arena
+    slab_enable_cache();
+    if (arena_enable() == -1) quit_worker(tid_sh);
+
     while(1) {
         errno = 0;
         //prelevo dalla coda un fd pronto ad inviare una richiesta
@@ -1079,17 +1693,32 @@ void* worker(void* arg){
         //in caso di errore
         if (connfd == -1 && errno != 0) {
             ret = errno;
+            epoch_unregister();
+            clean_node_pool();
+            slab_clean_cache();
+            arena_clean();
             pthread_exit((void *) ret);
         }
         //se l'fd è -1 (ma errno non è settato) significa che il worker thread deve terminare
-        if (connfd == -1 && errno == 0) pthread_exit((void *) ret);
+        if (connfd == -1 && errno == 0) {
+            epoch_unregister();
+            clean_node_pool();
+            slab_clean_cache();
+            arena_clean();
+            pthread_exit((void *) ret);
+        }
 
-        //controllo se l'fd appartiene ad un utente già online
-        user_t *user = search_data(us_on, (void *) &connfd);
+        //controllo se l'fd appartiene ad un utente già online (la lettura della
+        //richiesta avviene fuori dalla sezione epoch, l'utente resta con un
+        //riferimento fino alla fine della richiesta)
+        epoch_enter();
+        user_t *user = users_on_search(us_on, &connfd);
         if (user == NULL && errno != 0) quit_worker(tid_sh);
+        if (pin_user(user) == -1) quit_worker(tid_sh);
+        epoch_exit();
 
         //alloco la memoria per la richiesta
-        request_t *req = malloc(sizeof(request_t));
+        request_t *req = arena_alloc(sizeof(request_t));
         if (req == NULL) quit_worker(tid_sh);
 
         //leggo la richiesta del client 
@@ -1114,6 +1743,11 @@ void* worker(void* arg){
         }
         else check = read_request(connfd, req);
 
+        //utenti e gruppi cercati durante l'esecuzione non vengono liberati fino
+        //alla fine della richiesta (fino all'uscita dalla sezione epoch o al
+        //rilascio dei riferimenti, prima di scrivere ai client)
+        epoch_enter();
+
         //controllo l'esito della lettura della richiesta 
         //se errore
         if (check == -1 && errno != ECONNRESET) {
@@ -1154,6 +1788,12 @@ void* worker(void* arg){
                     case POSTTXT_OP:
                         check = posttxt_fun(req, user);
                         break;
+                    case POSTTXT_TTL_OP:
+                        check = posttxt_ttl_fun(req, user);
+                        break;
+                    case POSTTXTMULTI_OP:
+                        check = posttxtmulti_fun(req, user);
+                        break;
                     case POSTTXTALL_OP:
                         check = posttxtall_fun(req, user);
                         break;
@@ -1164,10 +1804,11 @@ void* worker(void* arg){
                         check = getfile_fun(req, user);
                         break;
                     case GETPREVMSGS_OP:
+                    case GETPREVMSGS_SINCE_OP:
                         check = getprevmsgs_fun(req, user);
                         break;
                     case USRLIST_OP:
-                        check = usrlist_fun(req, user);
+                        check = usrlist_fun(req, user, 0);
                         break;
                     case UNREGISTER_OP:
                         check = unregister_fun(req, user);
@@ -1184,6 +1825,11 @@ void* worker(void* arg){
                     case CANCGROUP_OP:
                         check = cancgroup_fun(req, user, NULL);
                         break;
+                    case GROUPADD_OP:
+                    case GROUPDEL_OP:
+                    case CREATEGROUPWITH_OP:
+                        check = groupmembers_fun(req, user, op);
+                        break;
                     default:
                         ;
                     break;
@@ -1192,6 +1838,12 @@ void* worker(void* arg){
 
             free_request(req);
 
+            //oltre il limite globale libero le history degli utenti con più byte
+            if (check == 0 && conf_server.evict_policy == 1 && conf_server.hist_bytes != 0 &&
+                total_bytes_history() > HIST_BYTES_HIGH(conf_server.hist_bytes)) {
+                if (reclaim_users(hash_us) == -1) fprintf(stderr, "Errore: reclaim_users\n");
+            }
+
             //comunico al listener che è stata eseguita la richiesta 
             if (check == 0) {
                 if (write_pipe(pipe_fd, (int)connfd, UPDATE) == -1) quit_worker(tid_sh);
@@ -1199,5 +1851,10 @@ void* worker(void* arg){
             //se c'è stato qualche errore
             else if (check != 0) quit_worker(tid_sh);
         }
+
+        epoch_exit();
+        release_pins();
+        //gli oggetti temporanei della richiesta sono liberati tutti insieme
+        arena_reset();
     }
 }
\ No newline at end of file